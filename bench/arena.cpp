@@ -0,0 +1,166 @@
+/*
+ * arena.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the thread arena against malloc.
+ *
+ * Each thread serves "requests" that allocate short-lived memory and
+ * release it at the end:
+ * - raw: 64 blocks of 16-256 bytes, freed one by one (malloc) or by an
+ *   Arena::Scope (arena);
+ * - containers: a std::vector<int> of 256 elements and a std::map<int,int>
+ *   of 32 elements, with std::allocator or ArenaAllocator.
+ * The throughput (million allocations per second) is reported for 1 and
+ * 4 threads.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+#include "AbstractThread.hpp"
+#include "Arena.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned int REQUESTS = 200000;
+static const unsigned int BLOCKS = 64;
+static const unsigned int ELEMENTS = 256;
+static const unsigned int ENTRIES = 32;
+
+/*
+ * Allocations of a container request: the vector grows by doubling up to
+ * ELEMENTS (9 allocations) and the map allocates one node per entry
+ */
+static const unsigned int CONTAINER_ALLOCS = 9 + ENTRIES;
+
+enum Mode {
+	RAW_MALLOC,
+	RAW_ARENA,
+	STL_HEAP,
+	STL_ARENA
+};
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+template <typename Allocator, typename MapAllocator>
+static unsigned long int containers(const Allocator& a, const MapAllocator& m)
+{
+	std::vector<int, Allocator> v (a);
+	for (unsigned int i = 0; i < ELEMENTS; ++i)
+		v.push_back(i);
+	std::map<int, int, std::less<int>, MapAllocator> s (std::less<int>(), m);
+	for (unsigned int i = 0; i < ENTRIES; ++i)
+		s[(i * 7919) % ENTRIES] = i;
+	return v.size() + s.size();
+}
+
+class Worker: public AbstractThread {
+public:
+	Mode mode_;
+	unsigned long int check_;
+
+	explicit Worker(Mode mode): mode_(mode), check_(0) {}
+
+	void run() {
+		unsigned int sizes[BLOCKS];
+		for (unsigned int i = 0; i < BLOCKS; ++i)
+			sizes[i] = 16 + (i * 37) % 241;
+		char* p[BLOCKS];
+		Arena* arena = Arena::getCurrent();
+
+		for (unsigned int r = 0; r < REQUESTS; ++r) {
+			switch (mode_) {
+			case RAW_MALLOC:
+				for (unsigned int i = 0; i < BLOCKS; ++i) {
+					p[i] = reinterpret_cast<char*>(
+					    malloc(sizes[i]));
+					p[i][0] = i;
+				}
+				for (unsigned int i = 0; i < BLOCKS; ++i) {
+					check_ += p[i][0];
+					free(p[i]);
+				}
+				break;
+			case RAW_ARENA: {
+				Arena::Scope s (*arena);
+				for (unsigned int i = 0; i < BLOCKS; ++i) {
+					p[i] = reinterpret_cast<char*>(
+					    arena->allocate(sizes[i]));
+					p[i][0] = i;
+				}
+				for (unsigned int i = 0; i < BLOCKS; ++i)
+					check_ += p[i][0];
+				break;
+			}
+			case STL_HEAP:
+				check_ += containers(std::allocator<int>(),
+				    std::allocator<std::pair<const int, int> >());
+				break;
+			case STL_ARENA: {
+				Arena::Scope s (*arena);
+				check_ += containers(ArenaAllocator<int>(),
+				    ArenaAllocator<std::pair<const int, int> >());
+				break;
+			}
+			}
+		}
+	}
+};
+
+static void measure(const char* name, Mode mode, unsigned int threads)
+{
+	std::vector<Worker*> w;
+	for (unsigned int i = 0; i < threads; ++i)
+		w.push_back(new Worker(mode));
+	Time start;
+	for (unsigned int i = 0; i < threads; ++i)
+		w[i]->start();
+	unsigned long int check = 0;
+	for (unsigned int i = 0; i < threads; ++i) {
+		w[i]->waitForTermination();
+		check += w[i]->check_;
+		delete w[i];
+	}
+	double t = elapsed(start);
+	unsigned int allocs = (mode == RAW_MALLOC || mode == RAW_ARENA) ?
+	    BLOCKS : CONTAINER_ALLOCS;
+	std::printf("%-16s %u thread(s): %8.2f M alloc/s (check %lu)\n", name,
+	    threads, (double) REQUESTS * allocs * threads / t / 1e6, check);
+}
+
+int main()
+{
+	unsigned int threads[] = {1, 4};
+	for (unsigned int i = 0; i < 2; ++i) {
+		measure("raw malloc", RAW_MALLOC, threads[i]);
+		measure("raw arena", RAW_ARENA, threads[i]);
+		measure("stl std::alloc", STL_HEAP, threads[i]);
+		measure("stl arena", STL_ARENA, threads[i]);
+	}
+	return 0;
+}
@@ -0,0 +1,122 @@
+/*
+ * buffer_search.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the Buffer search/compare kernels.
+ *
+ * Each operation scans a buffer whose match (or difference) is placed on
+ * the last byte, so the whole buffer is traversed. Throughput is reported
+ * in GB/s for every implementation supported by the CPU.
+ */
+
+#include <cstdio>
+#include <cstring>
+
+#include "Buffer.hpp"
+#include "ByteSearch.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned long int SIZE = 16 * 1024 * 1024;
+static const int ROUNDS = 20;
+
+static const char* names[] = { "scalar", "sse2", "avx2" };
+
+/*
+ * Prevents the compiler from hoisting pure libc calls out of the loops
+ */
+#define BARRIER() asm volatile("" ::: "memory")
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+static void report(const char* op, const char* impl, double secs,
+    unsigned long int check)
+{
+	std::printf("%-14s %-8s %8.2f GB/s   (result %lu)\n", op, impl,
+	    (double) SIZE * ROUNDS / secs / 1e9, check);
+}
+
+int main()
+{
+	Buffer a (SIZE);
+	Buffer b (SIZE);
+	for (unsigned long int i = 0; i < SIZE; ++i)
+		a.getBuffer()[i] = 'a' + (i % 13);
+	const char needle[] = "abcdefghijklm\n";
+	std::memcpy(a.getBuffer() + SIZE - 14, needle, 14);
+	b.fill(&a, SIZE);
+	b.getBuffer()[SIZE-1] = '\r';
+
+	for (int impl = ByteSearch::SCALAR;
+	    impl <= ByteSearch::getBestImplementation(); ++impl) {
+		ByteSearch::setImplementation(
+		    static_cast<ByteSearch::Implementation>(impl));
+		unsigned long int r = 0;
+
+		Time t1;
+		for (int i = 0; i < ROUNDS; ++i)
+			r += a.find('\n');
+		report("find(byte)", names[impl], elapsed(t1), r);
+
+		r = 0;
+		Time t2;
+		for (int i = 0; i < ROUNDS; ++i)
+			r += a.findAnyOf("\r\n\t", 3);
+		report("findAnyOf(3)", names[impl], elapsed(t2), r);
+
+		r = 0;
+		Time t3;
+		for (int i = 0; i < ROUNDS; ++i)
+			r += a.find(needle, 14);
+		report("find(string)", names[impl], elapsed(t3), r);
+
+		r = 0;
+		Time t4;
+		for (int i = 0; i < ROUNDS; ++i)
+			r += a.mismatch(&b, SIZE);
+		report("mismatch", names[impl], elapsed(t4), r);
+	}
+
+	// libc references
+	unsigned long int r = 0;
+	Time t5;
+	for (int i = 0; i < ROUNDS; ++i) {
+		BARRIER();
+		r += (const char*) std::memchr(a.getBuffer(), '\n', SIZE) -
+		    a.getBuffer();
+	}
+	report("memchr", "libc", elapsed(t5), r);
+
+	r = 0;
+	Time t6;
+	for (int i = 0; i < ROUNDS; ++i) {
+		BARRIER();
+		r += std::memcmp(a.getBuffer(), b.getBuffer(), SIZE) != 0;
+	}
+	report("memcmp", "libc", elapsed(t6), r);
+
+	return 0;
+}
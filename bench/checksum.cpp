@@ -0,0 +1,104 @@
+/*
+ * checksum.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the checksum algorithms.
+ *
+ * It reports the throughput (GB/s) of each algorithm on a buffer in memory
+ * and the cost of checksumming data written to a file either in a
+ * separate pass or fused into PosixDescriptor::write().
+ */
+
+#include <cstdio>
+
+#include "Buffer.hpp"
+#include "Checksum.hpp"
+#include "FileDescriptor.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned long int SIZE = 64 * 1024 * 1024;
+static const int ROUNDS = 10;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+static void report(const char* name, double secs, uint64_t check)
+{
+	std::printf("%-24s %8.2f GB/s   (result %llx)\n", name,
+	    (double) SIZE * ROUNDS / secs / 1e9, (unsigned long long) check);
+}
+
+int main()
+{
+	Buffer b (SIZE);
+	for (unsigned long int i = 0; i < SIZE; ++i)
+		b.getBuffer()[i] = i * 31;
+
+	uint64_t r = 0;
+	Crc32c::setImplementation(Crc32c::TABLE);
+	Time t1;
+	for (int i = 0; i < ROUNDS; ++i)
+		r += Crc32c::compute(b.getBuffer(), SIZE);
+	report("crc32c (table)", elapsed(t1), r);
+
+	if (Crc32c::setImplementation(Crc32c::HARDWARE)) {
+		r = 0;
+		Time t2;
+		for (int i = 0; i < ROUNDS; ++i)
+			r += Crc32c::compute(b.getBuffer(), SIZE);
+		report("crc32c (hardware)", elapsed(t2), r);
+	}
+
+	r = 0;
+	Time t3;
+	for (int i = 0; i < ROUNDS; ++i)
+		r += XxHash64::compute(b.getBuffer(), SIZE);
+	report("xxh64", elapsed(t3), r);
+
+	// Write + separate checksum pass vs. checksum fused into write()
+	FileDescriptor fd ("/tmp/onposix-bench-checksum",
+	    O_WRONLY|O_CREAT|O_TRUNC, S_IRWXU);
+	Crc32c c;
+	Time t4;
+	for (int i = 0; i < ROUNDS; ++i) {
+		fd.lseek(0);
+		fd.write(&b, SIZE);
+		c.update(&b, 0, SIZE);
+	}
+	report("write + crc32c", elapsed(t4), c.getValue());
+
+	c.reset();
+	Time t5;
+	for (int i = 0; i < ROUNDS; ++i) {
+		fd.lseek(0);
+		fd.write(&b, SIZE, &c);
+	}
+	report("write (fused crc32c)", elapsed(t5), c.getValue());
+
+	fd.close();
+	unlink("/tmp/onposix-bench-checksum");
+	return 0;
+}
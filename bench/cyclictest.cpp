@@ -0,0 +1,143 @@
+/*
+ * cyclictest.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the wake-up latency of periodic threads (as cyclictest).
+ *
+ * A thread sleeps until absolute deadlines with clock_nanosleep() and
+ * measures how late it wakes up. The test is run by a plain thread and by a
+ * thread with a RealTimeProfile (SCHED_FIFO, locked memory, prefaulted
+ * stack), both idle and with one CPU-bound thread per CPU competing for the
+ * processor. The latencies (min, average, 99th percentile, max) are
+ * reported in microseconds.
+ *
+ * Usage: cyclictest [loops] (default 2000, with a period of 1 ms)
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "AbstractThread.hpp"
+#include "RealTimeProfile.hpp"
+
+using namespace onposix;
+
+static const long int PERIOD = 1000000;
+
+class CyclicThread: public AbstractThread {
+public:
+	std::vector<uint64_t> latencies_;
+
+	explicit CyclicThread(unsigned int loops): latencies_(loops) {}
+
+	void run() {
+		struct timespec next, now;
+		clock_gettime(CLOCK_MONOTONIC, &next);
+		for (unsigned int i = 0; i < latencies_.size(); ++i) {
+			next.tv_nsec += PERIOD;
+			if (next.tv_nsec >= 1000000000) {
+				next.tv_nsec -= 1000000000;
+				++next.tv_sec;
+			}
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next,
+			    NULL);
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			latencies_[i] = (now.tv_sec - next.tv_sec) * 1000000000LL +
+			    (now.tv_nsec - next.tv_nsec);
+		}
+	}
+};
+
+class LoadThread: public AbstractThread {
+public:
+	bool stop_;
+
+	LoadThread(): stop_(false) {}
+
+	void run() {
+		while (!__atomic_load_n(&stop_, __ATOMIC_RELAXED))
+			;
+	}
+};
+
+static void measure(const char* name, unsigned int loops, bool load,
+    const RealTimeProfile* profile)
+{
+	std::vector<LoadThread*> hogs;
+	if (load) {
+		long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		for (long int i = 0; i < cpus; ++i) {
+			hogs.push_back(new LoadThread);
+			hogs.back()->start();
+		}
+	}
+
+	CyclicThread t (loops);
+	if (profile != 0)
+		t.setRealTimeProfile(*profile);
+	bool started = t.start();
+	if (started)
+		t.waitForTermination();
+
+	for (unsigned int i = 0; i < hogs.size(); ++i) {
+		__atomic_store_n(&hogs[i]->stop_, true, __ATOMIC_RELAXED);
+		hogs[i]->waitForTermination();
+		delete hogs[i];
+	}
+
+	if (!started) {
+		std::printf("%-24s not permitted (needs CAP_SYS_NICE and "
+		    "CAP_IPC_LOCK)\n", name);
+		return;
+	}
+	std::vector<uint64_t>& l = t.latencies_;
+	uint64_t sum = 0;
+	for (unsigned int i = 0; i < l.size(); ++i)
+		sum += l[i];
+	std::sort(l.begin(), l.end());
+	std::printf("%-24s min %6.1f  avg %6.1f  p99 %8.1f  max %8.1f us\n",
+	    name, l.front() / 1e3, sum / 1e3 / l.size(),
+	    l[l.size() * 99 / 100] / 1e3, l.back() / 1e3);
+}
+
+int main(int argc, char* argv[])
+{
+	unsigned int loops = (argc > 1) ? std::atoi(argv[1]) : 2000;
+	if (loops == 0)
+		loops = 1;
+
+	RealTimeProfile rt;
+	rt.setScheduling(SCHED_FIFO, 80).setMemoryLock(true)
+	    .setStackPrefault(256 * 1024);
+
+	std::printf("%u loops, period %ld us\n", loops, PERIOD / 1000);
+	measure("plain, idle", loops, false, 0);
+	measure("plain, loaded", loops, true, 0);
+	measure("real-time, idle", loops, false, &rt);
+	measure("real-time, loaded", loops, true, &rt);
+	munlockall();
+	return 0;
+}
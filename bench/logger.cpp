@@ -0,0 +1,252 @@
+/*
+ * logger.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the Logger.
+ *
+ * It reports the average cost (ns) of a DEBUG() or DEBUGF() call printed
+ * on file, i.e. the wall time divided by the number of calls of all
+ * threads, in synchronous and asynchronous mode. The asynchronous mode
+ * uses the DROP policy, so that the writer thread does not slow down the
+ * callers.
+ * Then, it compares the text and binary file sinks, reporting the time to
+ * log and write each message of DEBUGF().
+ * Then, it reports the distribution of the latency of synchronous
+ * DEBUGF() calls, with files growing window by window and with files
+ * preallocated by the rotation, and of the writes on a LogFile, with
+ * each window mapped by the write crossing it and mapped ahead of time
+ * (as done by the writer thread in asynchronous mode).
+ * Finally, it reports the cost of the calls suppressed by rate limiting,
+ * by sampling and by the runtime level of the module.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+
+#define LOG_LEVEL_CONSOLE	LOG_NOLOG
+#define LOG_LEVEL_FILE		LOG_ALL
+#include "Logger.hpp"
+#include "AbstractThread.hpp"
+#include "LogClock.hpp"
+#include "LogFile.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const int MESSAGES = 200000;
+static const char* LOG_BASE = "/tmp/onposix-bench-logger";
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+class LoggingThread: public AbstractThread {
+public:
+	bool deferred_;
+
+	void run() {
+		if (deferred_) {
+			for (int i = 0; i < MESSAGES; ++i)
+				DEBUGF("job %d completed in %d us", i, 42);
+		} else {
+			for (int i = 0; i < MESSAGES; ++i)
+				DEBUG("job " << i << " completed in " << 42 <<
+				    " us");
+		}
+	}
+};
+
+static void measure(const char* name, int threads, bool deferred)
+{
+	LoggingThread t[16];
+	Time start;
+	for (int i = 0; i < threads; ++i) {
+		t[i].deferred_ = deferred;
+		t[i].start();
+	}
+	for (int i = 0; i < threads; ++i)
+		t[i].waitForTermination();
+	double secs = elapsed(start);
+	Time f;
+	Logger::getInstance().flush();
+	std::printf("%-24s %2d thread(s) %8.1f ns/call   (flush %.1f ms)\n",
+	    name, threads, secs / (threads * MESSAGES) * 1e9,
+	    elapsed(f) * 1e3);
+}
+
+/*
+ * Cost of a file sink: time to log and write all messages (flush
+ * included), and size of the resulting file.
+ */
+static void measureSink(const char* name, Logger::FileFormat format,
+    bool async)
+{
+	Logger::getInstance().setFile(LOG_BASE, format);
+	if (async)
+		Logger::getInstance().startAsync(Logger::BLOCK, 1024*1024);
+	LoggingThread t;
+	t.deferred_ = true;
+	Time start;
+	t.start();
+	t.waitForTermination();
+	Logger::getInstance().flush();
+	double secs = elapsed(start);
+	if (async)
+		Logger::getInstance().stopAsync();
+	std::string file = Logger::getInstance().getFileName();
+	LOG_FILE(LOG_BASE);
+	FILE* f = std::fopen(file.c_str(), "r");
+	std::fseek(f, 0, SEEK_END);
+	std::printf("%-24s %8.1f ns/message  %6.1f bytes/message\n", name,
+	    secs / MESSAGES * 1e9, (double) std::ftell(f) / MESSAGES);
+	std::fclose(f);
+	unlink(file.c_str());
+}
+
+/*
+ * Prints the distribution of the latencies (ns).
+ */
+static void printLatency(const char* name, std::vector<uint64_t>* samples)
+{
+	std::sort(samples->begin(), samples->end());
+	std::printf("%-24s p50 %6llu ns  p99 %6llu ns  p99.99 %8llu ns  "
+	    "max %8llu ns\n", name,
+	    (unsigned long long) (*samples)[MESSAGES / 2],
+	    (unsigned long long) (*samples)[MESSAGES / 100 * 99],
+	    (unsigned long long) (*samples)[MESSAGES / 10000 * 9999],
+	    (unsigned long long) (*samples)[MESSAGES - 1]);
+}
+
+/*
+ * Latency of synchronous DEBUGF() calls on a text file.
+ */
+static void measureLatency(const char* name, unsigned long int maxSize)
+{
+	Logger::getInstance().setRotation(maxSize, 0, 2);
+	LOG_FILE(LOG_BASE);
+	std::vector<uint64_t> samples (MESSAGES);
+	for (int i = 0; i < MESSAGES; ++i) {
+		uint64_t start = LogClock::now();
+		DEBUGF("job %d completed in %d us", i, 42);
+		samples[i] = LogClock::now() - start;
+	}
+	std::string file = Logger::getInstance().getFileName();
+	Logger::getInstance().closeFile();
+	unlink(file.c_str());
+	Logger::getInstance().setRotation(0);
+	printLatency(name, &samples);
+}
+
+/*
+ * Latency of the writes on a LogFile, with the windows mapped by the
+ * write crossing them or by prepare() (out of the measure).
+ */
+static void measureWindows(const char* name, bool ahead)
+{
+	std::string file = std::string(LOG_BASE) + ".windows";
+	std::vector<uint64_t> samples (MESSAGES);
+	char record[64];
+	std::memset(record, 'a', sizeof(record));
+	{
+		LogFile f (file);
+		for (int i = 0; i < MESSAGES; ++i) {
+			uint64_t start = LogClock::now();
+			f.write(record, sizeof(record));
+			samples[i] = LogClock::now() - start;
+			if (ahead)
+				f.prepare();
+		}
+	}
+	unlink(file.c_str());
+	printLatency(name, &samples);
+}
+
+/*
+ * Cost of the calls of rate-limited and sampled macros (almost all
+ * suppressed).
+ */
+static void measureLimit()
+{
+	Time start;
+	for (int i = 0; i < MESSAGES; ++i)
+		DEBUGF_RATE(10, 1, "job %d completed in %d us", i, 42);
+	std::printf("%-24s %8.1f ns/call\n", "DEBUGF_RATE(10, 1)",
+	    elapsed(start) / MESSAGES * 1e9);
+	start.resetToCurrentTime();
+	for (int i = 0; i < MESSAGES; ++i)
+		DEBUGF_SAMPLE(MESSAGES, "job %d completed in %d us", i, 42);
+	std::printf("%-24s %8.1f ns/call\n", "DEBUGF_SAMPLE(200000)",
+	    elapsed(start) / MESSAGES * 1e9);
+
+	LogModule::setLevel("logger.cpp", LOG_WARNINGS);
+	start.resetToCurrentTime();
+	for (int i = 0; i < MESSAGES; ++i)
+		DEBUG("job " << i << " completed in " << 42 << " us");
+	std::printf("%-24s %8.1f ns/call\n", "DEBUG (module disabled)",
+	    elapsed(start) / MESSAGES * 1e9);
+	start.resetToCurrentTime();
+	for (int i = 0; i < MESSAGES; ++i)
+		DEBUGF("job %d completed in %d us", i, 42);
+	std::printf("%-24s %8.1f ns/call\n", "DEBUGF (module disabled)",
+	    elapsed(start) / MESSAGES * 1e9);
+	LogModule::resetLevels();
+}
+
+int main()
+{
+	LOG_FILE(LOG_BASE);
+	for (int n = 1; n <= 4; n *= 4) {
+		measure("sync DEBUG", n, false);
+		measure("sync DEBUGF", n, true);
+	}
+
+	Logger::getInstance().startAsync(Logger::DROP, 1024*1024);
+	for (int n = 1; n <= 4; n *= 4) {
+		measure("async DEBUG", n, false);
+		measure("async DEBUGF", n, true);
+	}
+	Logger::getInstance().stopAsync();
+	std::printf("%lu messages dropped\n\n",
+	    Logger::getInstance().getDroppedMessages());
+
+	measureSink("sync text", Logger::TEXT, false);
+	measureSink("sync binary", Logger::BINARY, false);
+	measureSink("async text", Logger::TEXT, true);
+	measureSink("async binary", Logger::BINARY, true);
+	unlink(Logger::getInstance().getFileName().c_str());
+	std::printf("\n");
+
+	measureLatency("growing file", 0);
+	measureLatency("preallocated 64 MB", 64*1024*1024);
+	measureWindows("LogFile, mapped on write", false);
+	measureWindows("LogFile, mapped ahead", true);
+	std::printf("\n");
+
+	LOG_FILE(LOG_BASE);
+	measureLimit();
+	unlink(Logger::getInstance().getFileName().c_str());
+	return 0;
+}
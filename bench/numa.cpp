@@ -0,0 +1,103 @@
+/*
+ * numa.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of NUMA placement.
+ *
+ * For each pair of nodes, a worker pinned to the first node reads and
+ * writes a Buffer allocated on the second one, reporting the bandwidth
+ * (GB/s). Pairs with the same node measure local accesses; the others
+ * remote accesses. On machines with a single node, only the local
+ * bandwidth is reported.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "Numa.hpp"
+#include "ThreadPool.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned long int SIZE = 256 * 1024 * 1024;
+static const int ROUNDS = 4;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+struct Measure {
+	Buffer* buffer;
+	double readGBs;
+	double writeGBs;
+	int node;
+
+	static void run(void* arg) {
+		Measure* m = reinterpret_cast<Measure*>(arg);
+		char* data = m->buffer->getBuffer();
+
+		// First touch, then write and read bandwidth
+		memset(data, 1, SIZE);
+		m->node = Numa::getNodeOfAddress(data + SIZE / 2);
+		Time start;
+		for (int i = 0; i < ROUNDS; ++i)
+			memset(data, i, SIZE);
+		m->writeGBs = SIZE * ROUNDS / elapsed(start) / 1e9;
+
+		const uint64_t* p = reinterpret_cast<const uint64_t*>(data);
+		uint64_t sum = 0;
+		start.resetToCurrentTime();
+		for (int i = 0; i < ROUNDS; ++i)
+			for (unsigned long int j = 0; j < SIZE / 8; ++j)
+				sum += p[j];
+		m->readGBs = SIZE * ROUNDS / elapsed(start) / 1e9;
+		if (sum == 42)
+			std::printf("(unlikely)\n");
+	}
+};
+
+int main()
+{
+	std::vector<int> nodes = Numa::getNodes();
+	std::printf("NUMA %s, %lu node(s)\n",
+	    Numa::isAvailable() ? "available" : "not available",
+	    (unsigned long int) nodes.size());
+
+	for (unsigned int c = 0; c < nodes.size(); ++c) {
+		ThreadPool pool (1, nodes[c]);
+		for (unsigned int m = 0; m < nodes.size(); ++m) {
+			Buffer b (SIZE, nodes[m]);
+			Measure r = {&b, 0, 0, -1};
+			pool.submit(Measure::run, &r).wait();
+			std::printf("CPU node %d, memory node %d (%s, pages on "
+			    "%d): read %6.2f GB/s  write %6.2f GB/s\n",
+			    nodes[c], nodes[m], (c == m) ? "local" : "remote",
+			    r.node, r.readGBs, r.writeGBs);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,224 @@
+/*
+ * parallel.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the parallel algorithms.
+ *
+ * It reports the throughput (MB/s) of three scans of a Buffer (checksum
+ * of each 64 KB block, count of the lines, byte-wise transform) run
+ * serially, split across one SimpleThread per CPU created at each call,
+ * and through parallelFor(), parallelReduce() and parallelTransform() on
+ * the default ThreadPool. Small buffers show the cost of creating the
+ * threads at each call.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "ByteSearch.hpp"
+#include "Checksum.hpp"
+#include "Parallel.hpp"
+#include "SimpleThread.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned long int BLOCK = 64 * 1024;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+struct BlockChecksum {
+	const char* data;
+	uint32_t* crc;
+
+	void operator()(unsigned long int begin, unsigned long int end) const {
+		for (unsigned long int i = begin; i < end; ++i)
+			crc[i] = Crc32c::compute(data + i * BLOCK, BLOCK);
+	}
+};
+
+struct CountLines {
+	const char* data;
+
+	unsigned long int operator()(unsigned long int begin,
+	    unsigned long int end) const {
+		unsigned long int n = 0;
+		while (begin < end) {
+			begin += ByteSearch::findByte(data + begin, end - begin,
+			    '\n');
+			if (begin < end) {
+				++n;
+				++begin;
+			}
+		}
+		return n;
+	}
+};
+
+struct Add {
+	unsigned long int operator()(unsigned long int a,
+	    unsigned long int b) const {
+		return a + b;
+	}
+};
+
+struct Rotate {
+	char operator()(char c) const {
+		return c ^ 0x20;
+	}
+};
+
+/*
+ * Scan split by hand across threads created at each call
+ */
+template<typename F>
+struct Chunk {
+	const F* body;
+	unsigned long int begin;
+	unsigned long int end;
+	unsigned long int result;
+
+	static void run(void* arg) {
+		Chunk* c = reinterpret_cast<Chunk*>(arg);
+		c->result = (*c->body)(c->begin, c->end);
+	}
+};
+
+template<typename F>
+static unsigned long int splitByHand(unsigned long int size, const F& body,
+    unsigned int threads)
+{
+	std::vector<Chunk<F> > chunks (threads);
+	std::vector<SimpleThread*> t (threads);
+	for (unsigned int i = 0; i < threads; ++i) {
+		chunks[i].body = &body;
+		chunks[i].begin = size * i / threads;
+		chunks[i].end = size * (i + 1) / threads;
+		t[i] = new SimpleThread(Chunk<F>::run, &chunks[i]);
+		t[i]->start();
+	}
+	unsigned long int result = 0;
+	for (unsigned int i = 0; i < threads; ++i) {
+		t[i]->waitForTermination();
+		delete t[i];
+		result += chunks[i].result;
+	}
+	return result;
+}
+
+/*
+ * Adaptors giving the same signature to the three scans
+ */
+struct ChecksumScan {
+	BlockChecksum b;
+	unsigned long int operator()(unsigned long int begin,
+	    unsigned long int end) const {
+		b(begin, end);
+		return 0;
+	}
+};
+
+struct TransformScan {
+	const char* in;
+	char* out;
+	unsigned long int operator()(unsigned long int begin,
+	    unsigned long int end) const {
+		std::transform(in + begin, in + end, out + begin, Rotate());
+		return 0;
+	}
+};
+
+static void report(const char* name, unsigned long int size, int calls,
+    const Time& start)
+{
+	std::printf("  %-20s %9.1f MB/s\n", name,
+	    (double) size * calls / elapsed(start) / (1024 * 1024));
+}
+
+static void measure(unsigned long int size)
+{
+	unsigned int threads = ThreadPool::getDefault().getThreads();
+	int calls = (256 * 1024 * 1024) / size;
+	Buffer in (size);
+	Buffer out (size);
+	for (unsigned long int i = 0; i < size; ++i)
+		in.getBuffer()[i] = (i % 80 == 79) ? '\n' : 'a' + i % 26;
+	std::vector<uint32_t> crc (size / BLOCK);
+	unsigned long int blocks = size / BLOCK;
+
+	std::printf("%lu KB buffer, %u CPU(s)\n", size / 1024, threads);
+
+	ChecksumScan cs = {{in.getBuffer(), &crc[0]}};
+	Time start;
+	for (int i = 0; i < calls; ++i)
+		cs(0, blocks);
+	report("checksum serial", size, calls, start);
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		splitByHand(blocks, cs, threads);
+	report("checksum by hand", size, calls, start);
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		parallelFor(0, blocks, 1, cs.b);
+	report("parallelFor", size, calls, start);
+
+	CountLines cl = {in.getBuffer()};
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		cl(0, size);
+	report("lines serial", size, calls, start);
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		splitByHand(size, cl, threads);
+	report("lines by hand", size, calls, start);
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		parallelReduce(0, size, BLOCK, 0UL, cl, Add());
+	report("parallelReduce", size, calls, start);
+
+	TransformScan ts = {in.getBuffer(), out.getBuffer()};
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		ts(0, size);
+	report("transform serial", size, calls, start);
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		splitByHand(size, ts, threads);
+	report("transform by hand", size, calls, start);
+	start.resetToCurrentTime();
+	for (int i = 0; i < calls; ++i)
+		parallelTransform(in.getBuffer(), in.getBuffer() + size,
+		    out.getBuffer(), BLOCK, Rotate());
+	report("parallelTransform", size, calls, start);
+}
+
+int main()
+{
+	measure(256 * 1024);
+	measure(64 * 1024 * 1024);
+	return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * priority_queue.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of PosixPrioritySharedQueue with 64 priorities.
+ *
+ * A single thread pushes elements of random priorities and pops them,
+ * keeping a given number of elements queued, with an integral priority
+ * (ring buffers and bitmap) and with a class wrapping it (map of queues).
+ * The cost of a push/pop pair is reported, in nanoseconds.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "PosixPrioritySharedQueue.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned int LEVELS = 64;
+static const unsigned int OPERATIONS = 2000000;
+
+/**
+ * \brief Non-integral priority, to select the map of queues
+ */
+struct Level {
+	int value_;
+	Level(int value): value_(value) {}
+	bool operator<(const Level& other) const {
+		return value_ < other.value_;
+	}
+};
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+template <typename Priority>
+static double measure(unsigned int queued)
+{
+	PosixPrioritySharedQueue<unsigned int, Priority> q;
+	for (unsigned int i = 0; i < LEVELS; ++i)
+		q.addQueue(Priority(i));
+	srand(1);
+	for (unsigned int i = 0; i < queued; ++i)
+		q.push(i, Priority(rand() % LEVELS));
+
+	unsigned long int sum = 0;
+	Time start;
+	for (unsigned int i = 0; i < OPERATIONS; ++i) {
+		q.push(i, Priority(rand() % LEVELS));
+		sum += q.pop();
+	}
+	double t = elapsed(start);
+	if (sum == 0)
+		std::printf("(wrong sum)\n");
+	return t / OPERATIONS * 1e9;
+}
+
+int main()
+{
+	unsigned int queued[] = {0, 16, 1024};
+	for (unsigned int i = 0; i < sizeof(queued) / sizeof(queued[0]); ++i)
+		std::printf("%4u elements queued: integral %6.1f ns, "
+		    "map %6.1f ns per push+pop\n", queued[i],
+		    measure<int>(queued[i]), measure<Level>(queued[i]));
+	return 0;
+}
@@ -0,0 +1,170 @@
+/*
+ * queue.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the shared queues under contention.
+ *
+ * Producers push integers that consumers pop, through PosixSharedQueue
+ * (one element or batches of 64 elements per operation) and
+ * BoundedSharedQueue, with several numbers of producers and consumers.
+ * The throughput (million elements per second) is reported.
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "AbstractThread.hpp"
+#include "BoundedSharedQueue.hpp"
+#include "PosixSharedQueue.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned int ELEMENTS = 1000000;
+static const unsigned int BATCH = 64;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+template <typename Queue>
+class Producer: public AbstractThread {
+	Queue* queue_;
+	unsigned int count_;
+public:
+	Producer(Queue* q, unsigned int count): queue_(q), count_(count) {}
+
+	void run() {
+		for (unsigned int i = 1; i <= count_; ++i)
+			queue_->push(i);
+	}
+};
+
+template <typename Queue>
+class Consumer: public AbstractThread {
+	Queue* queue_;
+	unsigned int count_;
+public:
+	unsigned long int sum_;
+
+	Consumer(Queue* q, unsigned int count): queue_(q), count_(count),
+	    sum_(0) {}
+
+	void run() {
+		for (unsigned int i = 0; i < count_; ++i)
+			sum_ += queue_->pop();
+	}
+};
+
+class BatchProducer: public AbstractThread {
+	PosixSharedQueue<unsigned int>* queue_;
+	unsigned int count_;
+public:
+	BatchProducer(PosixSharedQueue<unsigned int>* q, unsigned int count):
+	    queue_(q), count_(count) {}
+
+	void run() {
+		unsigned int batch[BATCH];
+		for (unsigned int i = 1; i <= count_; i += BATCH) {
+			unsigned int n = 0;
+			for (; n < BATCH && i + n <= count_; ++n)
+				batch[n] = i + n;
+			queue_->pushBatch(batch, batch + n);
+		}
+	}
+};
+
+class BatchConsumer: public AbstractThread {
+	PosixSharedQueue<unsigned int>* queue_;
+	unsigned int count_;
+public:
+	unsigned long int sum_;
+
+	BatchConsumer(PosixSharedQueue<unsigned int>* q, unsigned int count):
+	    queue_(q), count_(count), sum_(0) {}
+
+	void run() {
+		unsigned int batch[BATCH];
+		for (unsigned int i = 0; i < count_;) {
+			unsigned int max = count_ - i < BATCH ? count_ - i : BATCH;
+			size_t n = queue_->popBatch(batch, max);
+			for (size_t j = 0; j < n; ++j)
+				sum_ += batch[j];
+			i += n;
+		}
+	}
+};
+
+template <typename Queue, typename P, typename C>
+static double measure(Queue* q, unsigned int producers,
+    unsigned int consumers)
+{
+	std::vector<AbstractThread*> threads;
+	std::vector<C*> c;
+	for (unsigned int i = 0; i < consumers; ++i) {
+		c.push_back(new C(q, ELEMENTS / consumers));
+		threads.push_back(c.back());
+	}
+	for (unsigned int i = 0; i < producers; ++i)
+		threads.push_back(new P(q, ELEMENTS / producers));
+
+	Time start;
+	for (unsigned int i = 0; i < threads.size(); ++i)
+		threads[i]->start();
+	unsigned long int sum = 0;
+	for (unsigned int i = 0; i < threads.size(); ++i)
+		threads[i]->waitForTermination();
+	double t = elapsed(start);
+	for (unsigned int i = 0; i < c.size(); ++i)
+		sum += c[i]->sum_;
+	for (unsigned int i = 0; i < threads.size(); ++i)
+		delete threads[i];
+
+	unsigned long int per = ELEMENTS / producers;
+	if (sum != producers * per * (per + 1) / 2)
+		std::printf("(wrong sum)\n");
+	return ELEMENTS / t / 1e6;
+}
+
+int main()
+{
+	unsigned int configs[][2] = {{1, 1}, {4, 4}, {16, 1}, {16, 16}};
+	for (unsigned int i = 0; i < sizeof(configs) / sizeof(configs[0]);
+	    ++i) {
+		unsigned int p = configs[i][0], c = configs[i][1];
+		typedef PosixSharedQueue<unsigned int> Locked;
+		typedef BoundedSharedQueue<unsigned int> Bounded;
+		Locked locked;
+		Bounded bounded (1024);
+		double l = measure<Locked, Producer<Locked>,
+		    Consumer<Locked> >(&locked, p, c);
+		double lb = measure<Locked, BatchProducer,
+		    BatchConsumer>(&locked, p, c);
+		double b = measure<Bounded, Producer<Bounded>,
+		    Consumer<Bounded> >(&bounded, p, c);
+		std::printf("%2u producers, %2u consumers: PosixSharedQueue "
+		    "%6.2f M/s  (batch %6.2f M/s)  BoundedSharedQueue "
+		    "%6.2f M/s\n", p, c, l, lb, b);
+	}
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * queue_move.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the copies of large elements in the shared queues.
+ *
+ * A single thread builds elements owning a buffer of several sizes, pushes
+ * them in PosixSharedQueue and PosixPrioritySharedQueue and pops them,
+ * inserting them by copy (push(const T&)), by move (push(T&&)) or by
+ * construction in place (emplace()). The cost of a push/pop pair is
+ * reported, in nanoseconds. Before C++11 only the copies are measured.
+ */
+
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+#include "PosixPrioritySharedQueue.hpp"
+#include "PosixSharedQueue.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const unsigned int OPERATIONS = 200000;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+/**
+ * \brief Large element, owning its payload
+ */
+struct Message {
+	std::vector<char> payload_;
+
+	Message() {}
+	explicit Message(size_t size): payload_(size, 1) {}
+};
+
+enum Mode { COPY, MOVE, EMPLACE };
+
+static void push(PosixSharedQueue<Message>* q, size_t size, Mode mode)
+{
+#ifdef ONPOSIX_MOVE_SEMANTICS
+	if (mode == EMPLACE) {
+		q->emplace(size);
+		return;
+	}
+	Message m (size);
+	if (mode == COPY)
+		q->push(m);
+	else
+		q->push(std::move(m));
+#else
+	(void) mode;
+	q->push(Message(size));
+#endif
+}
+
+static void push(PosixPrioritySharedQueue<Message>* q, size_t size,
+    Mode mode)
+{
+#ifdef ONPOSIX_MOVE_SEMANTICS
+	if (mode == EMPLACE) {
+		q->emplace(0, size);
+		return;
+	}
+	Message m (size);
+	if (mode == COPY)
+		q->push(m, 0);
+	else
+		q->push(std::move(m), 0);
+#else
+	(void) mode;
+	q->push(Message(size), 0);
+#endif
+}
+
+template <typename Queue>
+static double measure(Queue* q, size_t size, Mode mode)
+{
+	unsigned long int sum = 0;
+	Time start;
+	for (unsigned int i = 0; i < OPERATIONS; ++i) {
+		push(q, size, mode);
+		sum += q->pop().payload_.size();
+	}
+	double t = elapsed(start);
+	if (sum != OPERATIONS * size)
+		std::printf("(wrong sum)\n");
+	return t / OPERATIONS * 1e9;
+}
+
+int main()
+{
+	size_t sizes[] = {64, 4096, 65536};
+	PosixSharedQueue<Message> fifo;
+	PosixPrioritySharedQueue<Message> prio;
+	prio.addQueue(0);
+	for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+#ifdef ONPOSIX_MOVE_SEMANTICS
+		std::printf("%6zu bytes: PosixSharedQueue copy %8.1f ns, "
+		    "move %8.1f ns, emplace %8.1f ns\n", sizes[i],
+		    measure(&fifo, sizes[i], COPY),
+		    measure(&fifo, sizes[i], MOVE),
+		    measure(&fifo, sizes[i], EMPLACE));
+		std::printf("%6zu bytes: PosixPrioritySharedQueue copy %8.1f ns, "
+		    "move %8.1f ns, emplace %8.1f ns\n", sizes[i],
+		    measure(&prio, sizes[i], COPY),
+		    measure(&prio, sizes[i], MOVE),
+		    measure(&prio, sizes[i], EMPLACE));
+#else
+		std::printf("%6zu bytes: PosixSharedQueue copy %8.1f ns\n",
+		    sizes[i], measure(&fifo, sizes[i], COPY));
+		std::printf("%6zu bytes: PosixPrioritySharedQueue copy %8.1f ns\n",
+		    sizes[i], measure(&prio, sizes[i], COPY));
+#endif
+	}
+	return 0;
+}
@@ -0,0 +1,172 @@
+/*
+ * thread_pool.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the ThreadPool.
+ *
+ * It compares the work-stealing ThreadPool with a pool whose workers share
+ * a single PosixSharedQueue, at 1, 4, 16 and 64 threads, reporting the
+ * throughput (tasks per second) in two cases:
+ * <ul>
+ * <li> flat: the main thread submits many small tasks;
+ * <li> spawn: each task submits two subtasks, down to a given depth (i.e.,
+ *	the tasks are created by the workers).
+ * </ul>
+ */
+
+#include <cstdio>
+#include <sched.h>
+#include <stdint.h>
+#include <vector>
+
+#include "PosixSharedQueue.hpp"
+#include "SimpleThread.hpp"
+#include "ThreadPool.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const int FLAT_TASKS = 200000;
+static const int SPAWN_DEPTH = 17;
+static const int WORK = 100;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+/*
+ * Pool of workers sharing a single queue
+ */
+class CentralPool {
+	struct Job {
+		void (*function)(void* arg);
+		void* arg;
+	};
+
+	PosixSharedQueue<Job> queue_;
+	std::vector<SimpleThread*> threads_;
+
+	static void loop(void* p) {
+		CentralPool* pool = reinterpret_cast<CentralPool*>(p);
+		for (;;) {
+			Job j = pool->queue_.pop();
+			if (j.function == 0)
+				return;
+			j.function(j.arg);
+		}
+	}
+
+public:
+	explicit CentralPool(unsigned int threads) {
+		for (unsigned int i = 0; i < threads; ++i) {
+			threads_.push_back(new SimpleThread(loop, this));
+			threads_[i]->start();
+		}
+	}
+
+	~CentralPool() {
+		for (unsigned int i = 0; i < threads_.size(); ++i)
+			submit(0, 0);
+		for (unsigned int i = 0; i < threads_.size(); ++i) {
+			threads_[i]->waitForTermination();
+			delete threads_[i];
+		}
+	}
+
+	void submit(void (*function)(void* arg), void* arg) {
+		Job j = {function, arg};
+		queue_.push(j);
+	}
+};
+
+static int completed;
+
+static void work()
+{
+	volatile int x = 0;
+	for (int i = 0; i < WORK; ++i)
+		x = x + i;
+	__atomic_add_fetch(&completed, 1, __ATOMIC_RELAXED);
+}
+
+static void waitCompleted(int tasks)
+{
+	while (__atomic_load_n(&completed, __ATOMIC_ACQUIRE) < tasks)
+		sched_yield();
+}
+
+static void flatTask(void*)
+{
+	work();
+}
+
+template<typename Pool>
+struct Spawner {
+	static Pool* pool;
+
+	static void task(void* arg) {
+		intptr_t depth = reinterpret_cast<intptr_t>(arg);
+		if (depth > 0) {
+			pool->submit(task, reinterpret_cast<void*>(depth - 1));
+			pool->submit(task, reinterpret_cast<void*>(depth - 1));
+		}
+		work();
+	}
+};
+
+template<typename Pool>
+Pool* Spawner<Pool>::pool = 0;
+
+template<typename Pool>
+static void measure(const char* name, unsigned int threads)
+{
+	Pool pool (threads);
+	Spawner<Pool>::pool = &pool;
+
+	completed = 0;
+	Time start;
+	for (int i = 0; i < FLAT_TASKS; ++i)
+		pool.submit(flatTask, 0);
+	waitCompleted(FLAT_TASKS);
+	double flat = FLAT_TASKS / elapsed(start);
+
+	const int tasks = (1 << (SPAWN_DEPTH + 1)) - 1;
+	completed = 0;
+	start.resetToCurrentTime();
+	pool.submit(Spawner<Pool>::task,
+	    reinterpret_cast<void*>(SPAWN_DEPTH));
+	waitCompleted(tasks);
+	double spawn = tasks / elapsed(start);
+
+	std::printf("%-16s %2u thread(s)  flat %6.2f Mtask/s  "
+	    "spawn %6.2f Mtask/s\n", name, threads, flat / 1e6, spawn / 1e6);
+}
+
+int main()
+{
+	for (unsigned int n = 1; n <= 64; n *= 4) {
+		measure<CentralPool>("central queue", n);
+		measure<ThreadPool>("work stealing", n);
+	}
+	return 0;
+}
@@ -0,0 +1,109 @@
+/*
+ * thread_start.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the cost of running a short handler on a thread.
+ *
+ * For raw pthread_create()/pthread_join(), SimpleThread and PooledThread
+ * it reports the latency from the call starting the thread to the first
+ * instruction of the handler (median, 99th percentile) and the time of a
+ * whole start/wait cycle, in microseconds.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#include "PooledThread.hpp"
+#include "SimpleThread.hpp"
+
+using namespace onposix;
+
+static const unsigned int RUNS = 5000;
+
+static uint64_t now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void handler(void* arg)
+{
+	*reinterpret_cast<uint64_t*>(arg) = now();
+}
+
+static void* rawHandler(void* arg)
+{
+	handler(arg);
+	return 0;
+}
+
+static void report(const char* name, std::vector<uint64_t>* latencies,
+    uint64_t total)
+{
+	std::sort(latencies->begin(), latencies->end());
+	std::printf("%-16s start-to-run p50 %7.2f  p99 %7.2f us, "
+	    "start+wait %7.2f us\n", name,
+	    (*latencies)[latencies->size() / 2] / 1e3,
+	    (*latencies)[latencies->size() * 99 / 100] / 1e3,
+	    (double) total / RUNS / 1e3);
+}
+
+int main()
+{
+	std::vector<uint64_t> l (RUNS);
+	uint64_t ran, start, begin;
+
+	begin = now();
+	for (unsigned int i = 0; i < RUNS; ++i) {
+		pthread_t t;
+		start = now();
+		pthread_create(&t, NULL, rawHandler, &ran);
+		pthread_join(t, NULL);
+		l[i] = ran - start;
+	}
+	report("pthread_create", &l, now() - begin);
+
+	SimpleThread s (handler, &ran);
+	begin = now();
+	for (unsigned int i = 0; i < RUNS; ++i) {
+		start = now();
+		s.start();
+		s.waitForTermination();
+		l[i] = ran - start;
+	}
+	report("SimpleThread", &l, now() - begin);
+
+	PooledThread::reserve(1);
+	PooledThread p (handler, &ran);
+	begin = now();
+	for (unsigned int i = 0; i < RUNS; ++i) {
+		start = now();
+		p.start();
+		p.waitForTermination();
+		l[i] = ran - start;
+	}
+	report("PooledThread", &l, now() - begin);
+	return 0;
+}
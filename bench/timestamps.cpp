@@ -0,0 +1,95 @@
+/*
+ * timestamps.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Benchmark of the sources of timestamps.
+ *
+ * It reports the average cost (ns) of reading the time through the
+ * system calls used in the past by the Logger, and through LogClock::now()
+ * for each available source, together with the smallest non-zero step
+ * observed between consecutive reads (i.e., the effective resolution).
+ */
+
+#include <cstdio>
+#include <sys/time.h>
+
+#include "LogClock.hpp"
+#include "Time.hpp"
+
+using namespace onposix;
+
+static const int READS = 5000000;
+
+static double elapsed(const Time& start)
+{
+	Time end;
+	return (end.getSeconds() - start.getSeconds()) +
+	    (end.getNSeconds() - start.getNSeconds()) / 1e9;
+}
+
+static uint64_t readGettimeofday()
+{
+	struct timeval t;
+	gettimeofday(&t, 0);
+	return t.tv_sec * 1000000000ULL + t.tv_usec * 1000ULL;
+}
+
+template <clockid_t id>
+static uint64_t readClock()
+{
+	struct timespec t;
+	clock_gettime(id, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void measure(const char* name, uint64_t (*read)())
+{
+	uint64_t previous = read();
+	uint64_t step = 0;
+	Time start;
+	for (int i = 0; i < READS; ++i) {
+		uint64_t t = read();
+		if (t != previous && (step == 0 || t - previous < step))
+			step = t - previous;
+		previous = t;
+	}
+	double secs = elapsed(start);
+	std::printf("%-32s %6.1f ns/read   step %10llu ns\n", name,
+	    secs / READS * 1e9, (unsigned long long) step);
+}
+
+int main()
+{
+	measure("gettimeofday()", readGettimeofday);
+	measure("clock_gettime(REALTIME)", readClock<CLOCK_REALTIME>);
+	measure("clock_gettime(MONOTONIC)", readClock<CLOCK_MONOTONIC>);
+	measure("clock_gettime(MONOTONIC_COARSE)",
+	    readClock<CLOCK_MONOTONIC_COARSE>);
+
+	LogClock::setSource(LogClock::MONOTONIC);
+	measure("LogClock::now() MONOTONIC", LogClock::now);
+	LogClock::setSource(LogClock::MONOTONIC_COARSE);
+	measure("LogClock::now() MONOTONIC_COARSE", LogClock::now);
+	if (LogClock::setSource(LogClock::TSC))
+		measure("LogClock::now() TSC", LogClock::now);
+	else
+		std::printf("LogClock::now() TSC: not available\n");
+	return 0;
+}
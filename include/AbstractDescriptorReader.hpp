@@ -112,6 +112,15 @@ public:
 	 */
 	virtual void dataAvailable(PosixDescriptor& descriptor)=0;
 
+	/**
+	 * \brief Method called when the descriptor becomes ready for write
+	 * operations
+	 *
+	 * It is called only for the descriptors monitored through
+	 * monitorWritable(). The default implementation does nothing.
+	 */
+	virtual void writeAvailable(PosixDescriptor& /*descriptor*/) {}
+
 	/**
 	 * \brief Method to start monitoring a descriptor.
 	 *
@@ -134,6 +143,28 @@ public:
 	inline bool stopMonitorDescriptor(PosixDescriptor& descriptor){
 		return dm_->stopMonitoringDescriptor(descriptor);
 	}
+
+	/**
+	 * \brief Method to start monitoring a descriptor for write
+	 * operations.
+	 *
+	 * @param Descriptor that must be monitored
+	 * @return true in case of success, false otherwise
+	 */
+	inline bool monitorWritable(PosixDescriptor& descriptor){
+		return dm_->startMonitoringWritable(*this, descriptor);
+	}
+
+	/**
+	 * \brief Method to stop monitoring a descriptor for write
+	 * operations.
+	 *
+	 * @param Descriptor that must be monitored
+	 * @return true in case of success, false otherwise
+	 */
+	inline bool stopMonitorWritable(PosixDescriptor& descriptor){
+		return dm_->stopMonitoringWritable(descriptor);
+	}
 };
 
 
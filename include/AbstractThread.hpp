@@ -27,13 +27,34 @@
 #include <pthread.h>
 #include <features.h>
 
+#include <string>
+#include <stdint.h>
+#include <sys/types.h>
 #include <vector>
 
+#include "Arena.hpp"
+#include "RealTimeProfile.hpp"
+
 // Uncomment to enable Linux-specific methods:
 #define ONPOSIX_LINUX_SPECIFIC
 
 namespace onposix {
 
+/**
+ * \brief Statistics of a thread, as returned by AbstractThread::getStats()
+ *
+ * For a terminated thread they are the values at termination.
+ */
+struct ThreadStats {
+	std::string name;	///< Name of the thread (may be empty)
+	pid_t tid;		///< Kernel thread id
+	bool running;		///< If run() has not returned yet
+	uint64_t cpuTime;	///< CPU time consumed (ns)
+	uint64_t wallTime;	///< Time elapsed since the start (ns)
+	unsigned long int voluntarySwitches;	///< Blocking context switches
+	unsigned long int involuntarySwitches;	///< Preemptions
+};
+
 /**
  * \brief Abstract for thread implementation.
  *
@@ -99,12 +120,59 @@ namespace onposix {
 class AbstractThread {
 
 	static void* Execute(void* param);
+	static void Terminated(void* param);
 
 	/**
 	 * \brief If the thread is running
 	 */
 	bool isStarted_;
 
+	/**
+	 * \brief Name of the thread
+	 */
+	std::string name_;
+
+	/**
+	 * \brief Kernel thread id (0 until the thread runs)
+	 */
+	pid_t tid_;
+
+	/**
+	 * \brief Handle of the thread, set when it is registered
+	 */
+	pthread_t self_;
+
+	/**
+	 * \brief Statistics at termination, and start time (ns)
+	 */
+	ThreadStats final_;
+	uint64_t startTime_;
+
+	/**
+	 * \brief Links of the registry of the running threads
+	 */
+	AbstractThread* prev_;
+	AbstractThread* next_;
+	bool registered_;
+
+	static pthread_mutex_t threadsLock_;
+	static AbstractThread* threads_;
+
+	/**
+	 * \brief Real-time setup applied by start()
+	 */
+	RealTimeProfile profile_;
+
+	/**
+	 * \brief Arena of the thread, released when the thread is restarted
+	 * or destroyed
+	 */
+	Arena arena_;
+
+	void registerThread();
+	void unregister();
+	void fillStats(ThreadStats* s) const;
+
 	AbstractThread(const AbstractThread&);
 	AbstractThread& operator=(const AbstractThread&);
 
@@ -142,6 +210,36 @@ public:
 	bool setSchedParam(int policy, int priority);
 	bool getSchedParam(int* policy, int* priority);
 
+	void setName(const std::string& name);
+
+	/**
+	 * \brief Method to set the real-time setup of the thread
+	 *
+	 * It must be called before start().
+	 */
+	inline void setRealTimeProfile(const RealTimeProfile& profile) {
+		profile_ = profile;
+	}
+
+	/**
+	 * \brief Method to get the name of the thread
+	 */
+	inline const std::string& getName() const {
+		return name_;
+	}
+
+	/**
+	 * \brief Method to get the arena of the thread
+	 *
+	 * From the thread itself it is also returned by Arena::getCurrent().
+	 */
+	inline Arena& getArena() {
+		return arena_;
+	}
+
+	bool getStats(ThreadStats* s) const;
+	static void getThreads(std::vector<ThreadStats>* threads);
+
 #if defined(ONPOSIX_LINUX_SPECIFIC) && defined(__GLIBC__) && \
     ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ > 3)))
 	// Functions to get/set affinity are available only from glibc 2.4
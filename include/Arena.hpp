@@ -0,0 +1,277 @@
+/*
+ * Arena.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef ARENA_HPP_
+#define ARENA_HPP_
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+namespace onposix {
+
+/**
+ * \brief Bump allocator for short-lived objects of a single thread.
+ *
+ * Memory is carved out of blocks (64KB by default) by moving a pointer,
+ * so an allocation costs a few instructions and never takes a lock.
+ * Single objects are not freed: the memory allocated after a mark is
+ * released at once by rewind() (or by the destruction of a Scope), and
+ * all the memory by reset(). Blocks are kept for reuse until the arena
+ * is destroyed.
+ * Requests larger than a quarter of a block are served by the heap and
+ * freed by deallocate() or when rewinding past them.
+ *
+ * Each AbstractThread owns an arena, reachable from its code through
+ * getCurrent(). The arena is not thread-safe.
+ *
+ * Example of usage (inside the run() method of a thread):
+ * \code
+ * for (;;) {
+ * 	Arena::Scope s (*Arena::getCurrent());
+ * 	Request* r = new (Arena::getCurrent()->allocate(sizeof(Request)))
+ * 		Request();
+ * 	std::vector<int, ArenaAllocator<int> > v;
+ * 	// ... memory released at the end of the iteration
+ * }
+ * \endcode
+ */
+class Arena {
+
+	/**
+	 * \brief Header of the blocks taken from the heap
+	 */
+	struct Large {
+		Large* prev;
+		Large* next;
+		void* raw;
+		unsigned long int size;
+		unsigned long int sequence;
+	};
+
+	unsigned long int blockSize_;
+	std::vector<char*> blocks_;
+	unsigned int block_;
+	char* top_;
+	char* end_;
+	Large* large_;
+	unsigned long int sequence_;
+	unsigned long int used_;
+	unsigned long int largeUsed_;
+
+	static __thread Arena* current_;
+
+	void* allocateLarge(unsigned long int size, unsigned long int align);
+	void nextBlock();
+
+	Arena(const Arena&);
+	Arena& operator=(const Arena&);
+
+	friend class AbstractThread;
+
+public:
+	/**
+	 * \brief Position in the arena, returned by getMark()
+	 *
+	 * block is the number of blocks in use; sequence the number of
+	 * heap blocks allocated so far.
+	 */
+	struct Mark {
+		unsigned int block;
+		char* top;
+		unsigned long int sequence;
+		unsigned long int used;
+	};
+
+	/**
+	 * \brief Reset point released when going out of scope
+	 */
+	class Scope {
+		Arena& arena_;
+		Mark mark_;
+
+		Scope(const Scope&);
+		Scope& operator=(const Scope&);
+	public:
+		explicit Scope(Arena& arena): arena_(arena),
+		    mark_(arena.getMark()) {}
+		~Scope() {
+			arena_.rewind(mark_);
+		}
+	};
+
+	explicit Arena(unsigned long int blockSize = 64 * 1024);
+	~Arena();
+
+	/**
+	 * \brief Method to allocate memory
+	 *
+	 * @param size Size of the memory
+	 * @param align Alignment (a power of 2)
+	 * @exception std::bad_alloc if the memory is exhausted
+	 */
+	inline void* allocate(unsigned long int size,
+	    unsigned long int align = 16) {
+		if (size > (blockSize_ / 4))
+			return allocateLarge(size, align);
+		char* p = reinterpret_cast<char*>(
+		    (reinterpret_cast<unsigned long int>(top_) + align - 1) &
+		    ~(align - 1));
+		if (p + size > end_) {
+			nextBlock();
+			p = reinterpret_cast<char*>(
+			    (reinterpret_cast<unsigned long int>(top_) +
+			    align - 1) & ~(align - 1));
+		}
+		top_ = p + size;
+		used_ += size;
+		return p;
+	}
+
+	void deallocate(void* p, unsigned long int size);
+
+	/**
+	 * \brief Method to get the current position, to be given to rewind()
+	 */
+	inline Mark getMark() const {
+		Mark m = {block_, top_, sequence_, used_};
+		return m;
+	}
+
+	void rewind(const Mark& mark);
+	void reset();
+
+	/**
+	 * \brief Method to get the bytes allocated and not yet released
+	 */
+	inline unsigned long int getUsed() const {
+		return used_ + largeUsed_;
+	}
+
+	/**
+	 * \brief Method to get the bytes of the blocks owned by the arena
+	 */
+	inline unsigned long int getReserved() const {
+		return blocks_.size() * blockSize_;
+	}
+
+	/**
+	 * \brief Method to get the arena of the calling thread
+	 *
+	 * @return The arena of the AbstractThread running the caller, or 0
+	 * for the other threads (e.g., main())
+	 */
+	static inline Arena* getCurrent() {
+		return current_;
+	}
+};
+
+/**
+ * \brief STL allocator using an Arena.
+ *
+ * By default it uses the arena of the calling thread; without one (i.e.,
+ * outside an AbstractThread) it uses the heap.
+ * A container using it must not outlive the scope of its memory.
+ *
+ * Example of usage:
+ * \code
+ * std::map<int, int, std::less<int>,
+ * 	ArenaAllocator<std::pair<const int, int> > > m;
+ * \endcode
+ */
+template <typename T>
+class ArenaAllocator {
+	template <typename U> friend class ArenaAllocator;
+
+	Arena* arena_;
+
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+
+	template <typename U> struct rebind {
+		typedef ArenaAllocator<U> other;
+	};
+
+	ArenaAllocator(): arena_(Arena::getCurrent()) {}
+	explicit ArenaAllocator(Arena* arena): arena_(arena) {}
+	template <typename U> ArenaAllocator(const ArenaAllocator<U>& o):
+	    arena_(o.arena_) {}
+
+	inline T* allocate(size_type n, const void* = 0) {
+		if (arena_ == 0)
+			return reinterpret_cast<T*>(::operator new(n * sizeof(T)));
+		return reinterpret_cast<T*>(arena_->allocate(n * sizeof(T),
+		    __alignof__(T)));
+	}
+
+	inline void deallocate(T* p, size_type n) {
+		if (arena_ == 0)
+			::operator delete(p);
+		else
+			arena_->deallocate(p, n * sizeof(T));
+	}
+
+	inline size_type max_size() const {
+		return size_type(-1) / sizeof(T);
+	}
+
+	inline T* address(T& r) const {
+		return &r;
+	}
+
+	inline const T* address(const T& r) const {
+		return &r;
+	}
+
+	inline void construct(T* p, const T& v) {
+		new (p) T(v);
+	}
+
+	inline void destroy(T* p) {
+		p->~T();
+	}
+
+	template <typename U>
+	inline bool operator==(const ArenaAllocator<U>& o) const {
+		return arena_ == o.arena_;
+	}
+
+	template <typename U>
+	inline bool operator!=(const ArenaAllocator<U>& o) const {
+		return arena_ != o.arena_;
+	}
+
+	/**
+	 * \brief Method to get the arena (0 for the heap)
+	 */
+	inline Arena* getArena() const {
+		return arena_;
+	}
+};
+
+} /* onposix */
+
+#endif /* ARENA_HPP_ */
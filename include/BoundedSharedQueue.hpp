@@ -0,0 +1,390 @@
+/*
+ * BoundedSharedQueue.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef BOUNDEDSHAREDQUEUE_HPP_
+#define BOUNDEDSHAREDQUEUE_HPP_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdexcept>
+#include <errno.h>
+#include <string.h>
+#include "PosixMutex.hpp"
+#include "Assert.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Bounded lock-free FIFO queue for many producers and consumers.
+ *
+ * The elements are stored in a ring of cells, each with a sequence number
+ * telling whether it is free for the producer or full for the consumer of
+ * a given round; producers and consumers claim positions with a
+ * compare-and-swap on their own (cache-line padded) index, so they never
+ * take a lock nor contend with each other while the queue is neither
+ * empty nor full.
+ *
+ * try_push() and try_pop() never block. push() and pop() retry for a few
+ * rounds and then sleep on a condition variable until the queue changes;
+ * the lock is taken by the other side only when somebody is sleeping.
+ *
+ * The template parameter is the type of the elements, which must be
+ * default-constructible and assignable. If the assignment throws, the
+ * exception is propagated and the queue stays usable: the element is not
+ * inserted (push) or is lost (pop). The class is non copyable.
+ */
+template<typename T>
+class BoundedSharedQueue {
+
+	/**
+	 * \brief Rounds of retry before a blocking operation sleeps
+	 */
+	static const int SPIN_ROUNDS = 16;
+
+	struct Cell {
+		unsigned long int sequence;
+
+		/**
+		 * \brief False if the assignment of data has thrown, so that
+		 * the consumers skip the cell
+		 */
+		bool valid;
+		T data;
+	};
+
+	Cell* cells_;
+	unsigned long int mask_;
+
+	/**
+	 * \brief Padding between the read-only fields and head_, to avoid
+	 * false sharing.
+	 *
+	 * Padding is used instead of an alignment attribute because new
+	 * does not honour extended alignments before C++17.
+	 */
+	char headPad_[64];
+
+	/**
+	 * \brief Next position to be written (by the producers)
+	 */
+	unsigned long int head_;
+	char tailPad_[64 - sizeof(unsigned long int)];
+
+	/**
+	 * \brief Next position to be read (by the consumers)
+	 */
+	unsigned long int tail_;
+	char sleepingPad_[64 - sizeof(unsigned long int)];
+
+	/**
+	 * \brief Threads sleeping in pop() and in push()
+	 */
+	int sleepingPop_;
+	int sleepingPush_;
+	pthread_mutex_t mutex_;
+	pthread_cond_t notEmpty_;
+	pthread_cond_t notFull_;
+
+	bool doPush(const T& data);
+	bool doPop(T* data);
+	void wake(int* sleeping, pthread_cond_t* cond);
+
+	BoundedSharedQueue(const BoundedSharedQueue&);
+	BoundedSharedQueue& operator=(const BoundedSharedQueue&);
+
+public:
+	explicit BoundedSharedQueue(unsigned long int capacity = 1024,
+	    bool priorityInheritance = false);
+	~BoundedSharedQueue();
+
+	bool try_push(const T& data);
+	bool try_pop(T* data);
+	void push(const T& data);
+	T pop();
+
+	/**
+	 * \brief Maximum number of elements
+	 */
+	inline unsigned long int capacity() const {
+		return mask_ + 1;
+	}
+
+	size_t size() const;
+};
+
+/**
+ * \brief Constructor. Initialize the queue.
+ *
+ * @param capacity Maximum number of elements, rounded up to a power of 2
+ * @param priorityInheritance If the mutex of the queue uses priority
+ * inheritance (PTHREAD_PRIO_INHERIT)
+ * @exception runtime_error if the initialization fails.
+ */
+template<typename T>
+BoundedSharedQueue<T>::BoundedSharedQueue(unsigned long int capacity,
+    bool priorityInheritance):
+    head_(0), tail_(0), sleepingPop_(0), sleepingPush_(0)
+{
+	unsigned long int size = 2;
+	while (size < capacity)
+		size *= 2;
+	mask_ = size - 1;
+	cells_ = new Cell[size];
+	for (unsigned long int i = 0; i < size; ++i) {
+		cells_[i].sequence = i;
+		cells_[i].valid = false;
+	}
+
+	int ret = PosixMutex::initialize(&mutex_, priorityInheritance);
+	if (ret != 0) {
+		delete[] cells_;
+		throw std::runtime_error(std::string("Mutex initialization: ") +
+								 strerror(ret));
+	}
+	if ((pthread_cond_init(&notEmpty_, NULL) != 0) ||
+	    (pthread_cond_init(&notFull_, NULL) != 0)) {
+		delete[] cells_;
+		throw std::runtime_error(std::string("Condition variable initialization: ") +
+								 strerror(errno));
+	}
+}
+
+/**
+ * \brief Destructor. Clean up the resources.
+ */
+template<typename T>
+BoundedSharedQueue<T>::~BoundedSharedQueue()
+{
+	VERIFY_ASSERTION(!pthread_mutex_destroy(&mutex_));
+	VERIFY_ASSERTION(!pthread_cond_destroy(&notEmpty_));
+	VERIFY_ASSERTION(!pthread_cond_destroy(&notFull_));
+	delete[] cells_;
+}
+
+/**
+ * \brief Method to insert an element, without waking up consumers
+ *
+ * @return false if the queue is full
+ */
+template<typename T>
+bool BoundedSharedQueue<T>::doPush(const T& data)
+{
+	unsigned long int pos = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+	Cell* c;
+	for (;;) {
+		c = &cells_[pos & mask_];
+		unsigned long int seq = __atomic_load_n(&c->sequence,
+		    __ATOMIC_ACQUIRE);
+		long int diff = (long int) seq - (long int) pos;
+		if (diff == 0) {
+			// Free cell of this round: claim it
+			if (__atomic_compare_exchange_n(&head_, &pos, pos + 1,
+			    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (diff < 0) {
+			// Cell still full from the previous round
+			return false;
+		} else {
+			pos = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+		}
+	}
+	try {
+		c->data = data;
+		c->valid = true;
+	} catch (...) {
+		// Publish the cell anyway, or the consumers would stop at it
+		c->valid = false;
+		__atomic_store_n(&c->sequence, pos + 1, __ATOMIC_RELEASE);
+		throw;
+	}
+	__atomic_store_n(&c->sequence, pos + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * \brief Method to extract an element, without waking up producers
+ *
+ * @return false if the queue is empty
+ */
+template<typename T>
+bool BoundedSharedQueue<T>::doPop(T* data)
+{
+	unsigned long int pos = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+	Cell* c;
+	for (;;) {
+		c = &cells_[pos & mask_];
+		unsigned long int seq = __atomic_load_n(&c->sequence,
+		    __ATOMIC_ACQUIRE);
+		long int diff = (long int) seq - (long int) (pos + 1);
+		if (diff == 0) {
+			// Full cell of this round: claim it
+			if (__atomic_compare_exchange_n(&tail_, &pos, pos + 1,
+			    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				if (c->valid)
+					break;
+				// Left by a failed push: free it and go on
+				__atomic_store_n(&c->sequence, pos + mask_ + 1,
+				    __ATOMIC_RELEASE);
+				++pos;
+			}
+		} else if (diff < 0) {
+			// Cell not yet written
+			return false;
+		} else {
+			pos = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+		}
+	}
+	try {
+		*data = c->data;
+	} catch (...) {
+		__atomic_store_n(&c->sequence, pos + mask_ + 1,
+		    __ATOMIC_RELEASE);
+		throw;
+	}
+	// Free the cell for the next round
+	__atomic_store_n(&c->sequence, pos + mask_ + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * \brief Method to wake up a thread sleeping on a condition, if any
+ *
+ * The fence orders the update of the queue with the check of the
+ * sleepers, which in turn increment the counter before checking the
+ * queue for the last time.
+ */
+template<typename T>
+void BoundedSharedQueue<T>::wake(int* sleeping, pthread_cond_t* cond)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(sleeping, __ATOMIC_RELAXED) > 0) {
+		PthreadMutexLocker lock(mutex_);
+		pthread_cond_signal(cond);
+	}
+}
+
+/**
+ * \brief Inserts an element in the queue, if not full
+ *
+ * @param data	The element to be added in the queue.
+ * @return false if the queue is full
+ */
+template<typename T>
+bool BoundedSharedQueue<T>::try_push(const T& data)
+{
+	if (!doPush(data))
+		return false;
+	wake(&sleepingPop_, &notEmpty_);
+	return true;
+}
+
+/**
+ * \brief Extracts an element from the queue, if not empty
+ *
+ * @param data	Where the element is stored.
+ * @return false if the queue is empty
+ */
+template<typename T>
+bool BoundedSharedQueue<T>::try_pop(T* data)
+{
+	if (!doPop(data))
+		return false;
+	wake(&sleepingPush_, &notFull_);
+	return true;
+}
+
+/**
+ * \brief Inserts an element in the queue
+ *
+ * Blocks the calling thread if the queue is full.
+ * @param data	The element to be added in the queue.
+ */
+template<typename T>
+void BoundedSharedQueue<T>::push(const T& data)
+{
+	for (int i = 0; i < SPIN_ROUNDS; ++i) {
+		if (try_push(data))
+			return;
+		sched_yield();
+	}
+	{
+		PthreadMutexLocker lock(mutex_);
+		__atomic_add_fetch(&sleepingPush_, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		try {
+			while (!doPush(data))
+				pthread_cond_wait(&notFull_, &mutex_);
+		} catch (...) {
+			__atomic_sub_fetch(&sleepingPush_, 1, __ATOMIC_RELAXED);
+			throw;
+		}
+		__atomic_sub_fetch(&sleepingPush_, 1, __ATOMIC_RELAXED);
+	}
+	wake(&sleepingPop_, &notEmpty_);
+}
+
+/**
+ * \brief Extracts an element from the queue.
+ *
+ * Blocks the calling thread if the queue is empty.
+ * @return The first element in the queue.
+ */
+template<typename T>
+T BoundedSharedQueue<T>::pop()
+{
+	T data;
+	for (int i = 0; i < SPIN_ROUNDS; ++i) {
+		if (try_pop(&data))
+			return data;
+		sched_yield();
+	}
+	{
+		PthreadMutexLocker lock(mutex_);
+		__atomic_add_fetch(&sleepingPop_, 1, __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		try {
+			while (!doPop(&data))
+				pthread_cond_wait(&notEmpty_, &mutex_);
+		} catch (...) {
+			__atomic_sub_fetch(&sleepingPop_, 1, __ATOMIC_RELAXED);
+			throw;
+		}
+		__atomic_sub_fetch(&sleepingPop_, 1, __ATOMIC_RELAXED);
+	}
+	wake(&sleepingPush_, &notFull_);
+	return data;
+}
+
+/** \brief The current size of the queue.
+ *
+ * The value is approximate while other threads use the queue.
+ * @return The queue size.
+ */
+template<typename T>
+size_t BoundedSharedQueue<T>::size() const
+{
+	unsigned long int tail = __atomic_load_n(&tail_, __ATOMIC_RELAXED);
+	unsigned long int head = __atomic_load_n(&head_, __ATOMIC_RELAXED);
+	return (head > tail) ? head - tail : 0;
+}
+
+} /* onposix */
+
+#endif /* BOUNDEDSHAREDQUEUE_HPP_ */
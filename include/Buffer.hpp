@@ -31,6 +31,8 @@ namespace onposix {
  * This is a simple buffer, internally allocated as a char buffer with new
  * and delete.
  * With respect to hand-made buffers, it adds the check on boundaries.
+ * Derived classes can make the buffer point to memory allocated elsewhere
+ * (see MappedRegion).
  */
 class Buffer {
 	/**
@@ -43,17 +45,48 @@ class Buffer {
 	 */
 	char* data_;
 
+	/**
+	 * \brief If the memory has been allocated by this class.
+	 *
+	 * It is false when the buffer wraps memory owned by a derived
+	 * class (e.g., MappedRegion).
+	 */
+	bool owner_;
+
+	/**
+	 * \brief NUMA node the memory has been allocated on (-1 for heap
+	 * memory).
+	 */
+	int node_;
+
 	// Disable default copy constructor
 	Buffer(const Buffer&);
 
+protected:
+	Buffer();
+	void wrap(char* data, unsigned long int size);
+
 public:
+	/**
+	 * \brief Value returned by search methods when nothing is found
+	 */
+	static const unsigned long int npos = ~0UL;
+
 	explicit Buffer(unsigned long int size);
+	Buffer(unsigned long int size, int node);
 	virtual ~Buffer();
 	char& operator[](unsigned long int p);
 	unsigned long int fill(const char* src, unsigned long int size);
 	unsigned long int fill(Buffer* b, unsigned long int size);
 	bool compare(Buffer* b, unsigned long int size);
 	bool compare(const char* s, unsigned long int size);
+	unsigned long int find(char c, unsigned long int from = 0);
+	unsigned long int find(const char* s, unsigned long int size,
+	    unsigned long int from = 0);
+	unsigned long int findAnyOf(const char* set, unsigned long int setSize,
+	    unsigned long int from = 0);
+	unsigned long int mismatch(Buffer* b, unsigned long int size);
+	unsigned long int mismatch(const char* s, unsigned long int size);
 
 	/**
 	 * \brief Method to get a pointer to the buffer.
@@ -73,6 +106,15 @@ public:
 		return size_;
 	}
 
+	/**
+	 * \brief Method to get the NUMA node of the buffer
+	 *
+	 * @return The node given to the constructor, or -1
+	 */
+	inline int getNode() const {
+		return node_;
+	}
+
 	inline unsigned long int fill(char* src, unsigned long int size) {
 		return fill (reinterpret_cast<const char*> (src), size);
 	}
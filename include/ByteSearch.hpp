@@ -0,0 +1,76 @@
+/*
+ * ByteSearch.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef BYTESEARCH_HPP_
+#define BYTESEARCH_HPP_
+
+namespace onposix {
+
+/**
+ * \brief Search and compare kernels on raw memory.
+ *
+ * This class collects the byte-level kernels used by Buffer to search
+ * and compare its content. Each kernel is available in a scalar version
+ * and, on x86, in SSE2 and AVX2 versions. The best version supported by
+ * the CPU is selected at runtime the first time a kernel is invoked.
+ *
+ * All kernels return the position of the first match (or of the first
+ * difference, for mismatch()), or the size of the searched area if
+ * nothing has been found.
+ *
+ * Example of usage:
+ * \code
+ * const char* s = "GET / HTTP/1.0\r\n";
+ * unsigned long int eol = ByteSearch::findByte(s, 16, '\n');
+ * \endcode
+ */
+class ByteSearch {
+public:
+	/**
+	 * \brief Available implementations of the kernels
+	 */
+	enum Implementation {
+		SCALAR	= 0, ///< Plain byte-by-byte loops
+		SSE2	= 1, ///< 16 bytes per iteration
+		AVX2	= 2  ///< 32 bytes per iteration
+	};
+
+	static Implementation getBestImplementation();
+	static Implementation getImplementation();
+	static bool setImplementation(Implementation impl);
+
+	static unsigned long int findByte(const char* data,
+	    unsigned long int size, char c);
+	static unsigned long int findAnyOf(const char* data,
+	    unsigned long int size, const char* set,
+	    unsigned long int setSize);
+	static unsigned long int findSubstring(const char* data,
+	    unsigned long int size, const char* needle,
+	    unsigned long int needleSize);
+	static unsigned long int mismatch(const char* a, const char* b,
+	    unsigned long int size);
+
+private:
+	ByteSearch();
+};
+
+} /* onposix */
+
+#endif /* BYTESEARCH_HPP_ */
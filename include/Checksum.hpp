@@ -0,0 +1,164 @@
+/*
+ * Checksum.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef CHECKSUM_HPP_
+#define CHECKSUM_HPP_
+
+#include <stdint.h>
+
+#include "Buffer.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Abstract incremental checksum.
+ *
+ * Data is added through update() in as many pieces as needed; the
+ * result is available at any time through getValue().
+ * An instance can be given to PosixDescriptor::read() and
+ * PosixDescriptor::write() to compute the checksum of the transferred
+ * data while it is still in cache, without a separate pass.
+ *
+ * Example of usage:
+ * \code
+ * Crc32c crc;
+ * des.write(&b, b.getSize(), &crc);
+ * uint64_t value = crc.getValue();
+ * \endcode
+ */
+class Checksum {
+public:
+	virtual ~Checksum(){}
+
+	/**
+	 * \brief Method to add data to the checksum
+	 *
+	 * @param data Pointer to the data
+	 * @param size Number of bytes
+	 */
+	virtual void update(const void* data, unsigned long int size) = 0;
+
+	/**
+	 * \brief Method to restart the computation from scratch
+	 */
+	virtual void reset() = 0;
+
+	/**
+	 * \brief Method to get the checksum of the data added so far
+	 *
+	 * @return Value of the checksum
+	 */
+	virtual uint64_t getValue() const = 0;
+
+	void update(Buffer* b, unsigned long int offset,
+	    unsigned long int size);
+};
+
+/**
+ * \brief CRC-32C (Castagnoli) checksum.
+ *
+ * The computation uses the crc32 instruction of SSE4.2 (x86) or of the
+ * ARMv8 CRC extension, when available; otherwise it falls back to a
+ * table-driven (slicing-by-8) implementation.
+ *
+ * Example of usage:
+ * \code
+ * uint32_t c = Crc32c::compute(b.getBuffer(), b.getSize());
+ * \endcode
+ */
+class Crc32c: public Checksum {
+	uint32_t state_;
+
+public:
+	/**
+	 * \brief Available implementations
+	 */
+	enum Implementation {
+		TABLE		= 0, ///< Slicing-by-8 lookup tables
+		HARDWARE	= 1  ///< SSE4.2 or ARMv8 crc32c instructions
+	};
+
+	/**
+	 * \brief Constructor.
+	 */
+	Crc32c(): state_(0xFFFFFFFF) {}
+
+	virtual void update(const void* data, unsigned long int size);
+	using Checksum::update;
+
+	/**
+	 * \brief Method to restart the computation from scratch
+	 */
+	virtual void reset() {
+		state_ = 0xFFFFFFFF;
+	}
+
+	/**
+	 * \brief Method to get the CRC of the data added so far
+	 *
+	 * @return Value of the CRC (32 bits)
+	 */
+	virtual uint64_t getValue() const {
+		return ~state_;
+	}
+
+	static uint32_t compute(const void* data, unsigned long int size);
+	static Implementation getBestImplementation();
+	static Implementation getImplementation();
+	static bool setImplementation(Implementation impl);
+};
+
+/**
+ * \brief 64-bit xxHash (XXH64).
+ *
+ * Fast non-cryptographic hash, suitable to detect corruption of data at
+ * memory speed. The value is compatible with the reference XXH64
+ * implementation.
+ *
+ * Example of usage:
+ * \code
+ * uint64_t h = XxHash64::compute(b.getBuffer(), b.getSize());
+ * \endcode
+ */
+class XxHash64: public Checksum {
+	uint64_t seed_;
+	uint64_t v1_, v2_, v3_, v4_;
+	uint64_t totalLength_;
+
+	/**
+	 * \brief Data not yet processed (less than a 32-byte stripe)
+	 */
+	unsigned char pending_[32];
+	unsigned int pendingSize_;
+
+public:
+	explicit XxHash64(uint64_t seed = 0);
+	virtual void update(const void* data, unsigned long int size);
+	using Checksum::update;
+	virtual void reset();
+	virtual uint64_t getValue() const;
+
+	static uint64_t compute(const void* data, unsigned long int size,
+	    uint64_t seed = 0);
+};
+
+} /* onposix */
+
+#endif /* CHECKSUM_HPP_ */
@@ -0,0 +1,133 @@
+/*
+ * CpuTopology.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef CPUTOPOLOGY_HPP_
+#define CPUTOPOLOGY_HPP_
+
+#include <string>
+#include <vector>
+
+namespace onposix {
+
+/**
+ * \brief Topology of the online CPUs, read from sysfs.
+ *
+ * It knows which CPUs are SMT siblings of the same physical core, which
+ * ones share the last level cache (LLC) and which NUMA node they belong
+ * to. The placement helpers return one affinity mask per thread, in the
+ * format accepted by AbstractThread::setAffinity(),
+ * Process::setAffinity() and ThreadPool::setAffinity().
+ * If sysfs is not available, all online CPUs are considered separate
+ * cores of a single node and LLC.
+ *
+ * Example of usage:
+ * \code
+ * CpuTopology topology;
+ * ThreadPool pool (topology.getCores());
+ * std::vector<std::vector<bool> > masks =
+ * 	topology.onePerCore(pool.getThreads());
+ * for (unsigned int i = 0; i < masks.size(); ++i)
+ * 	pool.setAffinity(i, masks[i]);
+ * \endcode
+ */
+class CpuTopology {
+public:
+	/**
+	 * \brief Position of an online CPU in the topology
+	 *
+	 * Cores, LLCs and packages are numbered from 0 in order of their
+	 * first CPU.
+	 */
+	struct Cpu {
+		int id;		///< CPU number, as used by affinity masks
+		int core;	///< Physical core
+		int thread;	///< Index among the SMT siblings of the core
+		int llc;	///< Group of CPUs sharing the last level cache
+		int package;	///< Physical package (socket)
+		int node;	///< NUMA node
+	};
+
+	explicit CpuTopology(const std::string& root = "/sys/devices/system");
+
+	/**
+	 * \brief Method to get the online CPUs, sorted by number
+	 */
+	inline const std::vector<Cpu>& getCpus() const {
+		return cpus_;
+	}
+
+	/**
+	 * \brief Method to get the number of physical cores
+	 */
+	inline unsigned int getCores() const {
+		return cores_;
+	}
+
+	/**
+	 * \brief Method to get the number of groups sharing the LLC
+	 */
+	inline unsigned int getLlcs() const {
+		return llcs_;
+	}
+
+	/**
+	 * \brief Method to get the number of physical packages
+	 */
+	inline unsigned int getPackages() const {
+		return packages_;
+	}
+
+	/**
+	 * \brief Method to get the NUMA nodes having online CPUs
+	 */
+	inline const std::vector<int>& getNodes() const {
+		return nodes_;
+	}
+
+	std::vector<bool> getCoreMask(int core) const;
+	std::vector<bool> getLlcMask(int llc) const;
+	std::vector<bool> getNodeMask(int node) const;
+
+	std::vector<std::vector<bool> > onePerCore(unsigned int threads) const;
+	std::vector<std::vector<bool> > compact(unsigned int threads,
+	    int node = -1) const;
+	std::vector<std::vector<bool> > spread(unsigned int threads) const;
+
+	static std::vector<int> parseCpuList(const std::string& list);
+
+private:
+	std::vector<Cpu> cpus_;
+	std::vector<int> nodes_;
+	unsigned int cores_;
+	unsigned int llcs_;
+	unsigned int packages_;
+
+	/**
+	 * \brief Size of the masks (i.e., highest CPU number + 1)
+	 */
+	unsigned int maskSize_;
+
+	std::vector<bool> getMask(int Cpu::* field, int value) const;
+	std::vector<bool> getCpuMask(int cpu) const;
+};
+
+} /* onposix */
+
+#endif /* CPUTOPOLOGY_HPP_ */
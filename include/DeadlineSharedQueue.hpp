@@ -0,0 +1,552 @@
+/*
+ * DeadlineSharedQueue.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef DEADLINESHAREDQUEUE_HPP_
+#define DEADLINESHAREDQUEUE_HPP_
+
+#include <new>
+#include <pthread.h>
+#include <stdexcept>
+#include <stdint.h>
+#include <stdlib.h>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include "PosixMutex.hpp"
+#include "Time.hpp"
+#include "Assert.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Thread-safe earliest-deadline-first queue class.
+ *
+ * Each element has a deadline (an onposix::Time on the CLOCK_MONOTONIC
+ * clock) and the element with the earliest deadline is extracted first;
+ * elements with the same deadline are extracted in FIFO order.
+ *
+ * Plain priorities can be used as well through pushPriority(), with
+ * aging: an element of priority p gets the deadline "now + p * step", so
+ * that a low priority element waiting since long is eventually extracted
+ * before the high priority elements arriving later, and never starves
+ * (unlike in PosixPrioritySharedQueue). The step is set by setAging().
+ *
+ * The order is kept by a 4-ary heap of 16-byte nodes (deadline, sequence
+ * number and position of the element), shallower than a binary one. The
+ * nodes are stored in memory aligned to a cache line, with the root at
+ * the fourth node: then, the four children of any node fill exactly one
+ * cache line. The elements themselves do not move while the heap is
+ * updated.
+ *
+ * Besides the extraction of one element (blocking, non-blocking or with a
+ * timeout), popDue() extracts at once all the elements whose deadline has
+ * expired. After close() the consumers do not wait anymore.
+ *
+ * The template parameter is the type of the elements, which must be
+ * default-constructible and assignable. The class is non copyable.
+ */
+template<typename T>
+class DeadlineSharedQueue {
+
+	/**
+	 * \brief Number of children of each node of the heap
+	 */
+	static const size_t ARITY = 4;
+
+	/**
+	 * \brief Size of a cache line, filled by the children of a node
+	 */
+	static const size_t CACHE_LINE = 64;
+
+	/**
+	 * \brief Position of the root in the storage of the heap, so that
+	 * the children of each node start on a cache line boundary
+	 */
+	static const size_t ROOT = ARITY - 1;
+
+	struct Node {
+		/**
+		 * \brief Deadline, in nanoseconds
+		 */
+		int64_t deadline;
+
+		/**
+		 * \brief Insertion order, to keep FIFO order on equal deadlines
+		 */
+		uint32_t sequence;
+
+		/**
+		 * \brief Index of the element in elements_
+		 */
+		uint32_t slot;
+	};
+
+	// The children of a node must fill a cache line
+	typedef char NodeSizeCheck[(sizeof(Node) * ARITY == CACHE_LINE) ?
+	    1 : -1];
+
+	/**
+	 * \brief Storage of the heap, aligned to a cache line (0 if none)
+	 */
+	Node* storage_;
+
+	/**
+	 * \brief Root of the heap (i.e., storage_ + ROOT)
+	 */
+	Node* heap_;
+
+	size_t size_;
+	size_t capacity_;
+	std::vector<T> elements_;
+	std::vector<uint32_t> freeSlots_;
+	uint32_t sequence_;
+	int64_t agingStep_;
+	pthread_cond_t empty_;
+	mutable pthread_mutex_t mutex_;
+	bool closed_;
+
+	static int64_t nanoseconds(const Time& t) {
+		return (int64_t) t.getSeconds() * 1000000000LL + t.getNSeconds();
+	}
+
+	static bool before(const Node& a, const Node& b) {
+		if (a.deadline != b.deadline)
+			return a.deadline < b.deadline;
+		// Correct across the wrap-around of the sequence numbers
+		return (int32_t) (a.sequence - b.sequence) < 0;
+	}
+
+	void grow();
+	void insert(const T& data, int64_t deadline);
+	T extract();
+	bool wait(const Time* deadline);
+
+	DeadlineSharedQueue(const DeadlineSharedQueue&);
+	DeadlineSharedQueue& operator=(const DeadlineSharedQueue&);
+
+public:
+	explicit DeadlineSharedQueue(bool priorityInheritance = false);
+	~DeadlineSharedQueue();
+
+	void push(const T& data, const Time& deadline);
+
+	void pushPriority(const T& data, unsigned int priority);
+
+	void setAging(time_t sec, long nsec);
+
+	T pop();
+
+	bool try_pop(T* data);
+
+	bool pop_until(T* data, const Time& deadline);
+
+	template<typename OutputIterator>
+	size_t popDue(OutputIterator out, const Time& now = Time());
+
+	bool nextDeadline(Time* deadline) const;
+
+	void close();
+
+	bool isClosed() const;
+
+	void clear();
+
+	size_t size() const;
+};
+
+/**
+ * \brief Constructor. Initialize the queue.
+ *
+ * The aging step is 1 millisecond.
+ * @param priorityInheritance If the mutex of the queue uses priority
+ * inheritance (PTHREAD_PRIO_INHERIT)
+ * @exception runtime_error if the initialization fails.
+ */
+template<typename T>
+DeadlineSharedQueue<T>::DeadlineSharedQueue(bool priorityInheritance):
+	storage_(0),
+	heap_(0),
+	size_(0),
+	capacity_(0),
+	sequence_(0),
+	agingStep_(1000000),
+	closed_(false)
+{
+	int ret = PosixMutex::initialize(&mutex_, priorityInheritance);
+	if (ret != 0)
+		throw std::runtime_error(std::string("Mutex initialization: ") +
+								 strerror(ret));
+	// Timeouts are measured on the monotonic clock, as onposix::Time
+	pthread_condattr_t attr;
+	if ((pthread_condattr_init(&attr) != 0) ||
+	    (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) ||
+	    (pthread_cond_init(&empty_, &attr) != 0))
+		throw std::runtime_error(std::string("Condition variable initialization: ") +
+								 strerror(errno));
+	pthread_condattr_destroy(&attr);
+}
+
+/**
+ * \brief Destructor. Clean up the resources.
+ */
+template<typename T>
+DeadlineSharedQueue<T>::~DeadlineSharedQueue()
+{
+	free(storage_);
+	VERIFY_ASSERTION(!pthread_mutex_destroy(&mutex_));
+	VERIFY_ASSERTION(!pthread_cond_destroy(&empty_));
+}
+
+/**
+ * \brief Method to double the capacity of the heap
+ *
+ * It must be called with the mutex held.
+ * @exception bad_alloc if the memory is exhausted
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::grow()
+{
+	size_t capacity = (capacity_ == 0) ? 4 * ARITY : 2 * capacity_;
+	void* p;
+	if (posix_memalign(&p, CACHE_LINE, (ROOT + capacity) * sizeof(Node))
+	    != 0)
+		throw std::bad_alloc();
+	Node* storage = reinterpret_cast<Node*>(p);
+	if (size_ > 0)
+		memcpy(storage + ROOT, heap_, size_ * sizeof(Node));
+	free(storage_);
+	storage_ = storage;
+	heap_ = storage + ROOT;
+	capacity_ = capacity;
+}
+
+/**
+ * \brief Method to add an element to the heap
+ *
+ * It must be called with the mutex held.
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::insert(const T& data, int64_t deadline)
+{
+	if (size_ == capacity_)
+		grow();
+	Node n;
+	n.deadline = deadline;
+	n.sequence = sequence_++;
+	if (freeSlots_.empty()) {
+		n.slot = elements_.size();
+		elements_.push_back(data);
+	} else {
+		n.slot = freeSlots_.back();
+		freeSlots_.pop_back();
+		elements_[n.slot] = data;
+	}
+
+	// Sift up
+	size_t i = size_++;
+	while (i > 0) {
+		size_t parent = (i - 1) / ARITY;
+		if (!before(n, heap_[parent]))
+			break;
+		heap_[i] = heap_[parent];
+		i = parent;
+	}
+	heap_[i] = n;
+}
+
+/**
+ * \brief Method to remove the element with the earliest deadline
+ *
+ * It must be called with the mutex held and the queue not empty.
+ */
+template<typename T>
+T DeadlineSharedQueue<T>::extract()
+{
+	uint32_t slot = heap_[0].slot;
+	T data = elements_[slot];
+	// Release the resources of the element
+	elements_[slot] = T();
+	freeSlots_.push_back(slot);
+
+	// Sift down the last node from the root
+	Node n = heap_[--size_];
+	size_t size = size_;
+	if (size > 0) {
+		size_t i = 0;
+		for (;;) {
+			size_t first = i * ARITY + 1;
+			if (first >= size)
+				break;
+			size_t last = (first + ARITY < size) ?
+			    first + ARITY : size;
+			size_t best = first;
+			for (size_t c = first + 1; c < last; ++c)
+				if (before(heap_[c], heap_[best]))
+					best = c;
+			if (!before(heap_[best], n))
+				break;
+			heap_[i] = heap_[best];
+			i = best;
+		}
+		heap_[i] = n;
+	}
+	return data;
+}
+
+/**
+ * \brief Method to wait until the queue is not empty
+ *
+ * It must be called with the mutex held.
+ * @param deadline	Absolute time (CLOCK_MONOTONIC) of the timeout, or NULL
+ * to wait with no timeout.
+ * @return false if the queue is still empty because it has been closed or
+ * the deadline has expired
+ * @exception runtime_error if the wait fails.
+ */
+template<typename T>
+bool DeadlineSharedQueue<T>::wait(const Time* deadline)
+{
+	while (size_ == 0) {
+		if (closed_)
+			return false;
+		int ret;
+		if (deadline == NULL)
+			ret = pthread_cond_wait(&empty_, &mutex_);
+		else {
+			timespec ts;
+			ts.tv_sec = deadline->getSeconds();
+			ts.tv_nsec = deadline->getNSeconds();
+			ret = pthread_cond_timedwait(&empty_, &mutex_, &ts);
+		}
+		if (ret == ETIMEDOUT)
+			return (size_ > 0);
+		if (ret != 0)
+			throw std::runtime_error(std::string("Condition variable wait: ") +
+									 strerror(ret));
+	}
+	return true;
+}
+
+/**
+ * \brief Inserts an element in the queue
+ *
+ * @param data	The element to be added in the queue.
+ * @param deadline	Deadline of the element, on the CLOCK_MONOTONIC clock
+ * (i.e., the default of onposix::Time).
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::push(const T& data, const Time& deadline)
+{
+	{
+		PthreadMutexLocker lock(mutex_);
+		insert(data, nanoseconds(deadline));
+	}
+	pthread_cond_signal(&empty_);
+}
+
+/**
+ * \brief Inserts an element with a plain priority in the queue
+ *
+ * The deadline of the element is the current time plus priority times the
+ * aging step (see setAging()).
+ * @param data	The element to be added in the queue.
+ * @param priority	Priority of the element (0 is the highest).
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::pushPriority(const T& data,
+				unsigned int priority)
+{
+	Time now;
+	{
+		PthreadMutexLocker lock(mutex_);
+		insert(data, nanoseconds(now) + priority * agingStep_);
+	}
+	pthread_cond_signal(&empty_);
+}
+
+/**
+ * \brief Sets the aging step of pushPriority()
+ *
+ * It is the time after which an element is extracted before the elements
+ * of the next higher priority (i.e., the lower number).
+ * @param sec	Seconds of the step.
+ * @param nsec	Nanoseconds of the step.
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::setAging(time_t sec, long nsec)
+{
+	PthreadMutexLocker lock(mutex_);
+	agingStep_ = (int64_t) sec * 1000000000LL + nsec;
+}
+
+/**
+ * \brief Extracts an element from the queue.
+ *
+ * Blocks the calling thread if the queue is empty.
+ * @return The element with the earliest deadline.
+ * @exception runtime_error if the queue is empty and closed.
+ */
+template<typename T>
+T DeadlineSharedQueue<T>::pop()
+{
+	PthreadMutexLocker lock(mutex_);
+	if (!wait(NULL))
+		throw std::runtime_error("Queue closed");
+	return extract();
+}
+
+/**
+ * \brief Extracts an element from the queue, if not empty
+ *
+ * @param data	Where the element with the earliest deadline is stored.
+ * @return false if the queue is empty
+ */
+template<typename T>
+bool DeadlineSharedQueue<T>::try_pop(T* data)
+{
+	PthreadMutexLocker lock(mutex_);
+	if (size_ == 0)
+		return false;
+	*data = extract();
+	return true;
+}
+
+/**
+ * \brief Extracts an element from the queue, waiting until a deadline
+ *
+ * Blocks the calling thread while the queue is empty, until the deadline
+ * or until the queue is closed.
+ * @param data	Where the element with the earliest deadline is stored.
+ * @param deadline	Absolute time of the timeout, on the CLOCK_MONOTONIC
+ * clock.
+ * @return false if no element has been extracted
+ * @exception runtime_error if the wait fails.
+ */
+template<typename T>
+bool DeadlineSharedQueue<T>::pop_until(T* data, const Time& deadline)
+{
+	PthreadMutexLocker lock(mutex_);
+	if (!wait(&deadline))
+		return false;
+	*data = extract();
+	return true;
+}
+
+/**
+ * \brief Extracts all the elements whose deadline has expired
+ *
+ * The elements are extracted under a single lock acquisition, without
+ * blocking.
+ * @param out	Iterator where the elements are stored, in deadline order.
+ * @param now	Current time (by default, the time of the call).
+ * @return The number of elements extracted.
+ */
+template<typename T>
+template<typename OutputIterator>
+size_t DeadlineSharedQueue<T>::popDue(OutputIterator out, const Time& now)
+{
+	int64_t limit = nanoseconds(now);
+	size_t n = 0;
+	PthreadMutexLocker lock(mutex_);
+	while (size_ > 0 && heap_[0].deadline <= limit) {
+		*out = extract();
+		++out;
+		++n;
+	}
+	return n;
+}
+
+/**
+ * \brief Gets the earliest deadline in the queue
+ *
+ * It is useful to sleep until the next element is due.
+ * @param deadline	Where the deadline is stored.
+ * @return false if the queue is empty
+ */
+template<typename T>
+bool DeadlineSharedQueue<T>::nextDeadline(Time* deadline) const
+{
+	PthreadMutexLocker lock(mutex_);
+	if (size_ == 0)
+		return false;
+	deadline->set(heap_[0].deadline / 1000000000LL,
+	    heap_[0].deadline % 1000000000LL);
+	return true;
+}
+
+/**
+ * \brief Closes the queue, waking up all the waiting threads.
+ *
+ * From now on the consumers do not wait for new elements anymore: the
+ * elements left can still be extracted, then pop() throws and the other
+ * methods return false.
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::close()
+{
+	{
+		PthreadMutexLocker lock(mutex_);
+		closed_ = true;
+	}
+	pthread_cond_broadcast(&empty_);
+}
+
+/**
+ * \brief Tells whether close() has been called
+ */
+template<typename T>
+bool DeadlineSharedQueue<T>::isClosed() const
+{
+	PthreadMutexLocker lock(mutex_);
+	return closed_;
+}
+
+/**
+ * \brief Empties the queue.
+ */
+template<typename T>
+void DeadlineSharedQueue<T>::clear()
+{
+	PthreadMutexLocker lock(mutex_);
+	std::vector<T> elements;
+	std::vector<uint32_t> freeSlots;
+	free(storage_);
+	storage_ = 0;
+	heap_ = 0;
+	size_ = 0;
+	capacity_ = 0;
+	elements_.swap(elements);
+	freeSlots_.swap(freeSlots);
+}
+
+/** \brief The current size of the queue.
+ *
+ * @return The queue size.
+ */
+template<typename T>
+size_t DeadlineSharedQueue<T>::size() const
+{
+	PthreadMutexLocker lock(mutex_);
+	return size_;
+}
+
+} /* onposix */
+
+#endif /* DEADLINESHAREDQUEUE_HPP_ */
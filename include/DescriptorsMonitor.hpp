@@ -21,11 +21,11 @@
 #ifndef DESCRIPTORSMONITOR_HPP_
 #define DESCRIPTORSMONITOR_HPP_
 
+#include <map>
 #include <sys/select.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
-#include <vector>
 
 #include "PosixDescriptor.hpp"
 
@@ -39,17 +39,22 @@ class AbstractDescriptorReader;
  * This class implements the "Observer" design pattern, and allows classes
  * inherited from AbstractDescriptorReader to be notified when a descriptor
  * they monitor becomes ready for read operations.
- * The class is a wrapper for the select() POSIX system call, so the
- * descriptor may refer to both a file or a socket.
+ * The class is a wrapper for the epoll() Linux system calls (or, if
+ * ONPOSIX_LINUX_SPECIFIC is not defined, for the select() POSIX system
+ * call), so the descriptor may refer to both a file or a socket.
  * When the descriptor becomes ready, this class notifies the reader
  * class by calling AbstractDescriptorReader::dataAvailable(int descriptor).
+ * Descriptors can also be monitored for write operations, through
+ * startMonitoringWritable(): then, the reader class is notified by calling
+ * AbstractDescriptorReader::writeAvailable().
  * Notes:
  * <ul>
- * <li> This monitor works only for read operations (i.e., it does
- * not monitor write operations or system exceptions) even if it can
- * be easily extended to support also write operations.
- * <li> One descriptor can be monitored by at most one receiver.
+ * <li> This monitor does not monitor system exceptions.
+ * <li> One descriptor can be monitored by at most one receiver for read
+ * operations and by at most one receiver for write operations.
  * <li> A receiver can monitor more than one descriptor.
+ * <li> With select(), descriptors greater than or equal to FD_SETSIZE
+ * (usually 1024) cannot be monitored; epoll() has no such limit.
  * </ul>
  * It is not implemented as a Singleton because it must be possible to have
  * more than one monitor with different sets of descriptors.
@@ -60,42 +65,90 @@ class AbstractDescriptorReader;
  */
 
 class DescriptorsMonitor {
-	/**
-	 * \brief Current set of monitored descriptors.
-	 *
-	 * This set is given as argument to the select() syscall.
-	 */
-	fd_set descriptorSet_;
-
-	/**
-	 * \brief Highest-value descriptor in descriptorSet_.
-	 *
-	 * The select() syscall needs this value + 1.
-	 */
-	int highestDescriptor_;
 
 	/**
-	 * \brief Association between a reader and a monitored descriptor.
+	 * \brief Readers of a monitored descriptor.
 	 */
 	struct monitoredDescriptor {
 		/**
 		 * \brief Pointer to the observer class.
 		 *
 		 * This points to the class that wants to be notified when
-		 * the descriptor ise ready for read operations.
+		 * the descriptor is ready for read operations (0 if none).
 		 */
 		AbstractDescriptorReader* reader_;
 
 		/**
-		 * \brief Monitored descriptor.
+		 * \brief Descriptor given by reader_.
 		 */
 		PosixDescriptor* descriptor_;
+
+		/**
+		 * \brief Class notified when the descriptor is ready for
+		 * write operations (0 if none).
+		 */
+		AbstractDescriptorReader* writer_;
+
+		/**
+		 * \brief Descriptor given by writer_.
+		 */
+		PosixDescriptor* writeDescriptor_;
+
+#ifdef ONPOSIX_LINUX_SPECIFIC
+		/**
+		 * \brief If the descriptor cannot be added to epoll (e.g.,
+		 * a regular file) and is therefore always ready, as with
+		 * select().
+		 */
+		bool alwaysReady_;
+#endif
 	};
 
 	/**
-	 * \brief Associations between readers and monitored descriptors
+	 * \brief Monitored descriptors, by number
+	 */
+	std::map<int, monitoredDescriptor> descriptors_;
+
+#ifdef ONPOSIX_LINUX_SPECIFIC
+	/**
+	 * \brief Descriptor of the epoll instance
+	 */
+	int epoll_;
+
+	/**
+	 * \brief Number of monitored descriptors that are always ready
+	 */
+	int alwaysReady_;
+
+	bool update(int fd, monitoredDescriptor& m, int op);
+#else
+	/**
+	 * \brief Current set of monitored descriptors.
+	 *
+	 * This set is given as argument to the select() syscall.
 	 */
-	std::vector<monitoredDescriptor*> descriptors_;
+	fd_set descriptorSet_;
+
+	/**
+	 * \brief Current set of descriptors monitored for write operations.
+	 */
+	fd_set writeSet_;
+
+	/**
+	 * \brief Highest-value descriptor in descriptorSet_ and writeSet_.
+	 *
+	 * The select() syscall needs this value + 1.
+	 */
+	int highestDescriptor_;
+#endif
+
+	bool startMonitoring(AbstractDescriptorReader& reader,
+	    PosixDescriptor& descriptor, bool write);
+	bool stopMonitoring(PosixDescriptor& descriptor, bool write);
+	void notify(int fd, bool readable, bool writable);
+
+	DescriptorsMonitor(const DescriptorsMonitor&);
+	DescriptorsMonitor& operator=(const DescriptorsMonitor&);
 
 public:
 	DescriptorsMonitor();
@@ -103,6 +156,9 @@ public:
 	bool startMonitoringDescriptor(AbstractDescriptorReader& reader,
 	    PosixDescriptor& descriptor);
 	bool stopMonitoringDescriptor(PosixDescriptor& descriptor);
+	bool startMonitoringWritable(AbstractDescriptorReader& reader,
+	    PosixDescriptor& descriptor);
+	bool stopMonitoringWritable(PosixDescriptor& descriptor);
 	bool wait();
 };
 
@@ -0,0 +1,153 @@
+/*
+ * Fiber.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef FIBER_HPP_
+#define FIBER_HPP_
+
+#include <deque>
+#include <map>
+#include <ucontext.h>
+#include <vector>
+
+#include "AbstractDescriptorReader.hpp"
+#include "DescriptorsMonitor.hpp"
+#include "PosixDescriptor.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Scheduler of user-space fibers on the calling thread.
+ *
+ * Fibers are functions with their own (small) stack, switched with
+ * swapcontext() instead of the kernel. They run one at a time, on the
+ * thread calling run(), until they yield or wait for a descriptor: code
+ * keeps the blocking style while many sessions share a few threads.
+ *
+ * A fiber calling PosixDescriptor::read() on a non-blocking descriptor
+ * with no data is parked, and resumed when the DescriptorsMonitor reports
+ * the descriptor as readable; likewise, a write() which would block is
+ * parked until the descriptor is writable.
+ * Other readers can use the same monitor, which is waited by run() when
+ * all fibers are parked.
+ *
+ * Stacks are mapped with a guard page and kept for the next fibers, so
+ * spawning a fiber does not enter the kernel after the first ones.
+ * The scheduler is not thread-safe: fibers must be spawned before run()
+ * or by the fibers themselves.
+ *
+ * Example of usage:
+ * \code
+ * void session(void* arg)
+ * {
+ * 	PosixDescriptor* d = reinterpret_cast<PosixDescriptor*>(arg);
+ * 	char request[64];
+ * 	while (d->read(request, sizeof(request)) > 0)
+ * 		// ...
+ * }
+ *
+ * DescriptorsMonitor dm;
+ * FiberScheduler s (dm);
+ * s.spawn(session, &d1);
+ * s.spawn(session, &d2);
+ * s.run();
+ * \endcode
+ */
+class FiberScheduler: public AbstractDescriptorReader {
+
+	/**
+	 * \brief Fiber, with its context and stack
+	 */
+	struct Fiber {
+		ucontext_t context_;
+		void (*function_)(void*);
+		void* arg_;
+		char* stack_;
+		bool finished_;
+	};
+
+	DescriptorsMonitor* monitor_;
+	unsigned long int stackSize_;
+	unsigned long int pageSize_;
+
+	/**
+	 * \brief Context of run(), resumed when a fiber suspends
+	 */
+	ucontext_t context_;
+
+	Fiber* running_;
+	unsigned int fibers_;
+	std::deque<Fiber*> ready_;
+	std::map<PosixDescriptor*, Fiber*> parked_;
+	std::map<PosixDescriptor*, Fiber*> writers_;
+
+	/**
+	 * \brief Every fiber allocated, and the terminated ones to be reused
+	 */
+	std::vector<Fiber*> all_;
+	std::vector<Fiber*> free_;
+
+	static __thread FiberScheduler* current_;
+
+	static void Trampoline();
+	void suspend();
+
+	FiberScheduler(const FiberScheduler&);
+	FiberScheduler& operator=(const FiberScheduler&);
+
+public:
+	explicit FiberScheduler(DescriptorsMonitor& dm,
+	    unsigned long int stackSize = 64 * 1024);
+	virtual ~FiberScheduler();
+
+	void spawn(void (*function)(void*), void* arg);
+	void run();
+
+	void dataAvailable(PosixDescriptor& descriptor);
+	void writeAvailable(PosixDescriptor& descriptor);
+
+	/**
+	 * \brief Method to get the number of fibers not yet terminated
+	 */
+	inline unsigned int getFibers() const {
+		return fibers_;
+	}
+
+	/**
+	 * \brief Method to get the number of stacks allocated
+	 */
+	inline unsigned int getStacks() const {
+		return all_.size();
+	}
+
+	/**
+	 * \brief Method to know if the caller is a fiber
+	 */
+	static inline bool isFiber() {
+		return (current_ != 0) && (current_->running_ != 0);
+	}
+
+	static void yield();
+	static void waitReadable(PosixDescriptor& descriptor);
+	static void waitWritable(PosixDescriptor& descriptor);
+};
+
+} /* onposix */
+
+#endif /* FIBER_HPP_ */
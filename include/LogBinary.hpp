@@ -0,0 +1,168 @@
+/*
+ * LogBinary.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGBINARY_HPP_
+#define LOGBINARY_HPP_
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <stdint.h>
+
+#include "LogFile.hpp"
+#include "LogFormat.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Header of binary log files.
+ *
+ * The header is followed by a sequence of records, each starting with a
+ * LogBinaryRecord and padded to a multiple of 8 bytes. A record of size 0
+ * marks the end of the data (e.g., in the file of a crashed process).
+ */
+struct LogBinaryHeader {
+	char magic[8];		///< "ONPXLOG1"
+	uint32_t version;	///< Version of the format
+	uint32_t reserved;
+	uint64_t initialTime;	///< Start of the program (LogClock ns)
+	uint64_t wallTime;	///< Wall-clock time (ns since Epoch)...
+	uint64_t monotonic;	///< ...at this LogClock time (ns)
+};
+
+/**
+ * \brief Types of records
+ */
+enum LogBinaryType {
+	LOG_BINARY_SITE		= 1, ///< Definition of a call site
+	LOG_BINARY_MESSAGE	= 2  ///< Message logged by a call site
+};
+
+/**
+ * \brief Common header of the records
+ */
+struct LogBinaryRecord {
+	uint32_t size;		///< Size of the record (padding included)
+	uint32_t type;		///< LOG_BINARY_SITE or LOG_BINARY_MESSAGE
+};
+
+/**
+ * \brief Definition of a call site, written before its first message.
+ *
+ * It is followed by the name of the source file and by the format, both
+ * NUL-terminated.
+ */
+struct LogBinarySite {
+	LogBinaryRecord record;
+	uint32_t id;		///< Identifier used by the messages
+	int32_t line;		///< Source line
+	int32_t level;		///< Log level (0 if unknown)
+	uint32_t fileLength;	///< Length of the file name (NUL included)
+	uint32_t formatLength;	///< Length of the format (NUL included)
+	uint32_t reserved;
+};
+
+/**
+ * \brief Message; it is followed by the arguments encoded through
+ * logArgsEncode()
+ */
+struct LogBinaryMessage {
+	LogBinaryRecord record;
+	uint64_t timestamp;	///< Time (LogClock ns)
+	uint32_t site;		///< Identifier of the call site
+	uint32_t thread;	///< Id of the thread (as returned by gettid())
+};
+
+/**
+ * \brief Writer of binary log files.
+ *
+ * Messages are written without formatting them: the arguments are
+ * copied as encoded by the DEBUGF() & co. macros, while messages already
+ * built as text (e.g., by DEBUG()) are stored as a single string argument.
+ * The file can be converted to text through decodeLogFile() (e.g., by
+ * the logdecode tool).
+ */
+class LogBinaryWriter {
+
+	/**
+	 * \brief File written through a memory-mapped window
+	 */
+	LogFile file_;
+
+	/**
+	 * \brief Identifiers of the call sites of DEBUGF() & co.
+	 */
+	std::map<const LogSite*, uint32_t> sites_;
+
+	/**
+	 * \brief Identifiers of the call sites of DEBUG() & co.
+	 */
+	std::map<std::pair<std::string, int>, uint32_t> textSites_;
+
+	/**
+	 * \brief Next free identifier
+	 */
+	uint32_t nextSite_;
+
+	uint32_t writeSite(const char* file, int line, int level,
+	    const char* format);
+	char* reserveMessage(uint64_t timestamp, uint32_t thread,
+	    uint32_t site, unsigned long int size);
+
+	LogBinaryWriter(const LogBinaryWriter&);
+	LogBinaryWriter& operator=(const LogBinaryWriter&);
+
+public:
+	LogBinaryWriter(const std::string& name, uint64_t initialTime,
+	    unsigned long int preallocate = 0);
+
+	void writeMessage(uint64_t timestamp, uint32_t thread,
+	    const LogSite* site, const char* args, unsigned long int size);
+	void writeText(uint64_t timestamp, uint32_t thread, const char* file,
+	    int line, const char* text, unsigned long int length);
+
+	/**
+	 * \brief Method to map the next window of the file ahead of time
+	 * (see LogFile::prepare())
+	 */
+	inline void prepare() {
+		file_.prepare();
+	}
+
+	/**
+	 * \brief Method to get the name of the file
+	 */
+	inline const std::string& getName() const {
+		return file_.getName();
+	}
+
+	/**
+	 * \brief Method to get the length of the file
+	 */
+	inline unsigned long int getLength() const {
+		return file_.getLength();
+	}
+};
+
+bool decodeLogFile(const std::string& name, std::ostream& out);
+
+} /* onposix */
+
+#endif /* LOGBINARY_HPP_ */
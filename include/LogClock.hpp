@@ -0,0 +1,132 @@
+/*
+ * LogClock.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGCLOCK_HPP_
+#define LOGCLOCK_HPP_
+
+#include <string>
+#include <stdint.h>
+#include <time.h>
+
+namespace onposix {
+
+/**
+ * \brief Cheap source of timestamps for the Logger.
+ *
+ * All sources return nanoseconds on the CLOCK_MONOTONIC timeline, so the
+ * source can be changed at any time:
+ * <ul>
+ * <li> TSC: the time-stamp counter of x86 CPUs, converted through a
+ *	calibration against CLOCK_MONOTONIC. Available only if the counter
+ *	is invariant (i.e., constant rate, not stopped in idle states).
+ * <li> MONOTONIC: clock_gettime(CLOCK_MONOTONIC), served by the vDSO.
+ * <li> MONOTONIC_COARSE: clock_gettime(CLOCK_MONOTONIC_COARSE); the
+ *	cheapest, but with the resolution of the timer tick (1-4 ms).
+ * </ul>
+ *
+ * Example of usage:
+ * \code
+ * LogClock::setSource(LogClock::MONOTONIC_COARSE);
+ * uint64_t t = LogClock::now();
+ * \endcode
+ */
+class LogClock {
+public:
+	/**
+	 * \brief Available sources
+	 */
+	enum Source {
+		MONOTONIC		= 0, ///< clock_gettime() (vDSO)
+		MONOTONIC_COARSE	= 1, ///< Coarse clock_gettime()
+		TSC			= 2  ///< Calibrated rdtsc
+	};
+
+	/**
+	 * \brief Method to get the current time
+	 *
+	 * @return Nanoseconds on the CLOCK_MONOTONIC timeline
+	 */
+	static inline uint64_t now() {
+		Source source = __atomic_load_n(&source_, __ATOMIC_ACQUIRE);
+#if defined(__x86_64__) || defined(__i386__)
+		if (source == TSC)
+			return tscBase_ +
+			    toNanoseconds(__builtin_ia32_rdtsc() - tscStart_);
+#endif
+		struct timespec t;
+		clock_gettime((source == MONOTONIC_COARSE) ?
+		    CLOCK_MONOTONIC_COARSE : CLOCK_MONOTONIC, &t);
+		return t.tv_sec * 1000000000ULL + t.tv_nsec;
+	}
+
+	static uint64_t getWallClock(uint64_t* monotonic);
+	static Source getBestSource();
+	static Source getSource();
+	static bool setSource(Source source);
+
+private:
+	/**
+	 * \brief Current source
+	 */
+	static Source source_;
+
+	/**
+	 * \brief TSC value at the calibration
+	 */
+	static uint64_t tscStart_;
+
+	/**
+	 * \brief Monotonic time (ns) corresponding to tscStart_
+	 */
+	static uint64_t tscBase_;
+
+	/**
+	 * \brief Nanoseconds per TSC tick, as a 32.32 fixed-point number
+	 */
+	static uint64_t tscMult_;
+
+	static void calibrate();
+
+	/**
+	 * \brief Method to convert TSC ticks to nanoseconds
+	 *
+	 * Without 128-bit integers (e.g., 32-bit x86) the product is split
+	 * into 32-bit halves.
+	 */
+	static inline uint64_t toNanoseconds(uint64_t ticks) {
+#ifdef __SIZEOF_INT128__
+		return static_cast<uint64_t>((static_cast<unsigned __int128>
+		    (ticks) * tscMult_) >> 32);
+#else
+		uint64_t tl = ticks & 0xffffffffULL, th = ticks >> 32;
+		uint64_t ml = tscMult_ & 0xffffffffULL, mh = tscMult_ >> 32;
+		return ((th * mh) << 32) + th * ml + tl * mh +
+		    ((tl * ml) >> 32);
+#endif
+	}
+};
+
+void formatLogTime(std::string* out, uint64_t timestamp,
+    uint64_t initialTime);
+void formatWallClock(std::string* out, uint64_t wallTime);
+
+} /* onposix */
+
+#endif /* LOGCLOCK_HPP_ */
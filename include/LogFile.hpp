@@ -0,0 +1,181 @@
+/*
+ * LogFile.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGFILE_HPP_
+#define LOGFILE_HPP_
+
+#include <cstring>
+#include <string>
+
+namespace onposix {
+
+/**
+ * \brief Append-only file written through a memory-mapped window.
+ *
+ * Data is copied in a window of the file mapped in memory; when the
+ * window is full, the next one is mapped. Therefore, appending data is
+ * just a memcpy(), and written data survives a crash of the process.
+ * Mapping a window (and populating its pages) takes time: a thread other
+ * than the writer (e.g., the writer thread of the asynchronous Logger)
+ * can call prepare() to map the next window ahead of time (and unmap the
+ * previous one), so that the write crossing the window just switches to
+ * it. Otherwise, that write maps the window itself.
+ * The space of the file can be preallocated (through fallocate(), where
+ * supported), so that writes do not stall on the allocation of blocks.
+ * The file is truncated to the written length when the object is
+ * destroyed; after a crash, its tail is just zero-filled.
+ *
+ * Unlike FileDescriptor and MappedRegion, this class never logs (it is
+ * used by the Logger itself); errors are reported through exceptions.
+ *
+ * Example of usage:
+ * \code
+ * LogFile f ("/tmp/mylog.bin", false, 16*1024*1024);
+ * f.write(data, size);
+ * \endcode
+ */
+class LogFile {
+
+	/**
+	 * \brief Name of the file
+	 */
+	std::string name_;
+
+	/**
+	 * \brief File descriptor
+	 */
+	int fd_;
+
+	/**
+	 * \brief Current mapped window (0 if none)
+	 */
+	char* window_;
+
+	/**
+	 * \brief Offset of the window inside the file
+	 */
+	unsigned long int windowOffset_;
+
+	/**
+	 * \brief Length of the current window
+	 */
+	unsigned long int windowLength_;
+
+	/**
+	 * \brief Next window, mapped by prepare() (0 if none)
+	 */
+	char* next_;
+
+	/**
+	 * \brief Offset of the next window inside the file
+	 */
+	unsigned long int nextOffset_;
+
+	/**
+	 * \brief Length of the next window
+	 */
+	unsigned long int nextLength_;
+
+	/**
+	 * \brief Previous window, left to prepare() to unmap (0 if none)
+	 */
+	char* retired_;
+
+	/**
+	 * \brief Length of the previous window
+	 */
+	unsigned long int retiredLength_;
+
+	/**
+	 * \brief Default length of a window
+	 */
+	unsigned long int windowSize_;
+
+	/**
+	 * \brief Amount of data written so far
+	 */
+	unsigned long int length_;
+
+	/**
+	 * \brief Size of the file (i.e., space available for the data)
+	 */
+	unsigned long int allocated_;
+
+	void allocate(unsigned long int size);
+	char* map(unsigned long int offset, unsigned long int length);
+	void remap(unsigned long int size);
+
+	LogFile(const LogFile&);
+	LogFile& operator=(const LogFile&);
+
+public:
+	explicit LogFile(const std::string& name, bool append = false,
+	    unsigned long int preallocate = 0,
+	    unsigned long int windowSize = 1024*1024);
+	~LogFile();
+
+	void prepare();
+
+	/**
+	 * \brief Method to append data through a pointer
+	 *
+	 * @param size Amount of data to be appended
+	 * @return Pointer where the data must be written
+	 * @exception runtime_error if the file cannot be extended or mapped
+	 */
+	inline char* reserve(unsigned long int size) {
+		if (window_ == 0 ||
+		    length_ + size > windowOffset_ + windowLength_)
+			remap(size);
+		char* p = window_ + (length_ - windowOffset_);
+		length_ += size;
+		return p;
+	}
+
+	/**
+	 * \brief Method to append data
+	 *
+	 * @param data Pointer to the data
+	 * @param size Amount of data
+	 * @exception runtime_error if the file cannot be extended or mapped
+	 */
+	inline void write(const void* data, unsigned long int size) {
+		memcpy(reserve(size), data, size);
+	}
+
+	/**
+	 * \brief Method to get the length of the file (i.e., the amount of
+	 * data written so far)
+	 */
+	inline unsigned long int getLength() const {
+		return length_;
+	}
+
+	/**
+	 * \brief Method to get the name of the file
+	 */
+	inline const std::string& getName() const {
+		return name_;
+	}
+};
+
+} /* onposix */
+
+#endif /* LOGFILE_HPP_ */
@@ -0,0 +1,165 @@
+/*
+ * LogFormat.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGFORMAT_HPP_
+#define LOGFORMAT_HPP_
+
+#include <cstring>
+#include <string>
+#include <stdint.h>
+
+namespace onposix {
+
+/**
+ * \brief Static descriptor of a call site of the DEBUGF(), WARNINGF() and
+ * ERRORF() macros.
+ *
+ * It is built at compile time, once per call site; at runtime only the
+ * values of the arguments are copied, and the message is formatted later
+ * (e.g., by the writer thread of the Logger) through formatLogMessage().
+ */
+struct LogSite {
+	const char* file;	///< Source file (__FILE__)
+	int line;		///< Source line (__LINE__)
+	int level;		///< Log level (LOG_ERRORS, LOG_WARNINGS, LOG_ALL)
+	unsigned int sinks;	///< Mask of Logger::Sink enabled at compile time
+	const char* format;	///< printf-like format, level prefix included
+};
+
+/**
+ * \brief Tags of the encoded arguments
+ */
+enum LogArgType {
+	LOG_ARG_INT	= 1, ///< Signed integer (stored as int64_t)
+	LOG_ARG_UINT	= 2, ///< Unsigned integer (stored as uint64_t)
+	LOG_ARG_DOUBLE	= 3, ///< Floating point (stored as double)
+	LOG_ARG_STRING	= 4, ///< C string (stored as uint32_t length + bytes)
+	LOG_ARG_POINTER	= 5  ///< Pointer (stored as uint64_t)
+};
+
+/**
+ * \brief Functions to get the size of an encoded argument and to encode
+ * it (tag followed by the raw value).
+ *
+ * Only the types accepted by printf() are supported (e.g., use c_str()
+ * for std::string).
+ */
+#define LOG_SCALAR_ARG__(type, tag, storage) \
+	inline unsigned long int logArgSize(type) { \
+		return 1 + sizeof(storage); \
+	} \
+	inline char* logArgEncode(char* p, type v) { \
+		storage s = v; \
+		*p = tag; \
+		memcpy(p + 1, &s, sizeof(s)); \
+		return p + 1 + sizeof(s); \
+	}
+
+LOG_SCALAR_ARG__(char, LOG_ARG_INT, int64_t)
+LOG_SCALAR_ARG__(signed char, LOG_ARG_INT, int64_t)
+LOG_SCALAR_ARG__(short, LOG_ARG_INT, int64_t)
+LOG_SCALAR_ARG__(int, LOG_ARG_INT, int64_t)
+LOG_SCALAR_ARG__(long, LOG_ARG_INT, int64_t)
+LOG_SCALAR_ARG__(long long, LOG_ARG_INT, int64_t)
+LOG_SCALAR_ARG__(bool, LOG_ARG_UINT, uint64_t)
+LOG_SCALAR_ARG__(unsigned char, LOG_ARG_UINT, uint64_t)
+LOG_SCALAR_ARG__(unsigned short, LOG_ARG_UINT, uint64_t)
+LOG_SCALAR_ARG__(unsigned int, LOG_ARG_UINT, uint64_t)
+LOG_SCALAR_ARG__(unsigned long, LOG_ARG_UINT, uint64_t)
+LOG_SCALAR_ARG__(unsigned long long, LOG_ARG_UINT, uint64_t)
+LOG_SCALAR_ARG__(float, LOG_ARG_DOUBLE, double)
+LOG_SCALAR_ARG__(double, LOG_ARG_DOUBLE, double)
+LOG_SCALAR_ARG__(long double, LOG_ARG_DOUBLE, double)
+
+#undef LOG_SCALAR_ARG__
+
+inline unsigned long int logArgSize(const char* s) {
+	return 1 + sizeof(uint32_t) + (s ? strlen(s) : 0) + 1;
+}
+
+inline char* logArgEncode(char* p, const char* s) {
+	uint32_t length = s ? strlen(s) : 0;
+	*p = LOG_ARG_STRING;
+	memcpy(p + 1, &length, sizeof(length));
+	memcpy(p + 1 + sizeof(length), s ? s : "", length + 1);
+	return p + 1 + sizeof(length) + length + 1;
+}
+
+inline unsigned long int logArgSize(char* s) {
+	return logArgSize(const_cast<const char*>(s));
+}
+
+inline char* logArgEncode(char* p, char* s) {
+	return logArgEncode(p, const_cast<const char*>(s));
+}
+
+template <typename T>
+inline unsigned long int logArgSize(const T*) {
+	return 1 + sizeof(uint64_t);
+}
+
+template <typename T>
+inline char* logArgEncode(char* p, const T* v) {
+	uint64_t s = reinterpret_cast<uintptr_t>(v);
+	*p = LOG_ARG_POINTER;
+	memcpy(p + 1, &s, sizeof(s));
+	return p + 1 + sizeof(s);
+}
+
+#if __cplusplus >= 201103L
+/**
+ * \brief Function to get the size of a list of encoded arguments
+ */
+inline unsigned long int logArgsSize() {
+	return 0;
+}
+
+template <typename T, typename... Args>
+inline unsigned long int logArgsSize(const T& first, const Args&... rest) {
+	return logArgSize(first) + logArgsSize(rest...);
+}
+
+/**
+ * \brief Function to encode a list of arguments
+ *
+ * @param p Destination, of at least logArgsSize(args...) bytes
+ */
+inline void logArgsEncode(char*) {}
+
+template <typename T, typename... Args>
+inline void logArgsEncode(char* p, const T& first, const Args&... rest) {
+	logArgsEncode(logArgEncode(p, first), rest...);
+}
+#endif /* C++11 */
+
+/**
+ * \brief Function never called, used to let the compiler check the
+ * format against the arguments
+ */
+inline void logCheckFormat(const char*, ...)
+    __attribute__((format(printf, 1, 2)));
+inline void logCheckFormat(const char*, ...) {}
+
+void formatLogMessage(std::string* out, const char* format,
+    const char* args, unsigned long int size);
+
+} /* onposix */
+
+#endif /* LOGFORMAT_HPP_ */
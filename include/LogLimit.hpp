@@ -0,0 +1,122 @@
+/*
+ * LogLimit.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGLIMIT_HPP_
+#define LOGLIMIT_HPP_
+
+#include <stdint.h>
+
+#include "LogClock.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Minimum interval between two reports of the messages suppressed
+ * by the same call site (ns)
+ */
+static const uint64_t LOG_REPORT_INTERVAL = 1000000000ULL;
+
+/**
+ * \brief State of a call site of the rate-limited and sampled logging
+ * macros (e.g., ERROR_RATE(), DEBUGF_SAMPLE()).
+ *
+ * It is a static variable of the call site, initialized at compile time,
+ * and it is updated through atomic operations only:
+ * <ul>
+ * <li> Rate limiting: token bucket, implemented as a generic cell rate
+ *	algorithm (i.e., a single compare-and-swap on the theoretical
+ *	arrival time of the next message).
+ * <li> Sampling: one message every N, counted through a fetch-and-add.
+ * </ul>
+ * Suppressed messages are counted, and the count is reported (at most
+ * once per LOG_REPORT_INTERVAL) together with the next message let
+ * through.
+ */
+struct LogLimit {
+	uint64_t interval;	///< Rate limiting: ns per message (0 if sampling)
+	uint64_t tolerance;	///< Rate limiting: (burst - 1) * interval
+	uint64_t sample;	///< Sampling: 1 message every sample
+	uint64_t state;		///< Theoretical arrival time, or counter
+	unsigned long int suppressed;	///< Messages not yet reported
+	uint64_t lastReport;	///< Time of the latest report
+
+	/**
+	 * \brief Method to know if a message can be logged
+	 *
+	 * @param report Number of suppressed messages to be reported now
+	 * (0 if none)
+	 * @return true if the message must be logged; false otherwise
+	 */
+	inline bool allow(unsigned long int* report) {
+		uint64_t now = 0;
+		if (interval == 0) {
+			if (__atomic_fetch_add(&state, 1, __ATOMIC_RELAXED) %
+			    sample != 0)
+				return suppress();
+		} else {
+			now = LogClock::now();
+			uint64_t tat = __atomic_load_n(&state, __ATOMIC_RELAXED);
+			uint64_t next;
+			do {
+				if (tat > now + tolerance)
+					return suppress();
+				next = ((tat > now) ? tat : now) + interval;
+			} while (!__atomic_compare_exchange_n(&state, &tat, next,
+			    true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+		}
+		*report = 0;
+		if (__atomic_load_n(&suppressed, __ATOMIC_RELAXED) != 0)
+			*report = collect(now);
+		return true;
+	}
+
+	/**
+	 * \brief Method to count a suppressed message
+	 *
+	 * @return false
+	 */
+	inline bool suppress() {
+		__atomic_add_fetch(&suppressed, 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	/**
+	 * \brief Method to take the count of suppressed messages, if it is
+	 * time to report it
+	 *
+	 * @param now Current time (0 if not known)
+	 * @return Number of messages to be reported (0 if none)
+	 */
+	inline unsigned long int collect(uint64_t now) {
+		if (now == 0)
+			now = LogClock::now();
+		uint64_t last = __atomic_load_n(&lastReport, __ATOMIC_RELAXED);
+		if (last != 0 && now - last < LOG_REPORT_INTERVAL)
+			return 0;
+		if (!__atomic_compare_exchange_n(&lastReport, &last, now, false,
+		    __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			return 0;
+		return __atomic_exchange_n(&suppressed, 0, __ATOMIC_RELAXED);
+	}
+};
+
+} /* onposix */
+
+#endif /* LOGLIMIT_HPP_ */
@@ -0,0 +1,110 @@
+/*
+ * LogModule.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGMODULE_HPP_
+#define LOGMODULE_HPP_
+
+#include <csignal>
+#include <string>
+
+namespace onposix {
+
+class LogModuleRegistrar;
+
+/**
+ * \brief Runtime log level of a module.
+ *
+ * Each source file including Logger.hpp has its own LogModule, named
+ * after the file itself or after the tag set through the LOG_MODULE macro
+ * before including Logger.hpp (e.g., "-DLOG_MODULE=\"net\"" for all files
+ * of a subsystem). Messages whose level is higher than the level of the
+ * module are discarded at the call site, through a single relaxed atomic
+ * load; the levels set at compile time (LOG_LEVEL_CONSOLE and
+ * LOG_LEVEL_FILE) are still an upper bound.
+ *
+ * Levels are changed at runtime by name, either directly or through a
+ * configuration file, possibly reloaded when the process receives a
+ * signal:
+ * \code
+ * LogModule::setLevel("*", LOG_WARNINGS);
+ * LogModule::setLevel("PosixDescriptor.cpp", LOG_ALL);
+ * LogModule::reloadOnSignal("/etc/myproject/log.conf");
+ * \endcode
+ * A name matches a module if it is equal to its name or to the name
+ * without the directories; "*" sets the level of all modules without a
+ * level of their own.
+ *
+ * It is an aggregate, initialized at compile time through a brace
+ * initializer (name, initial level, initial level, 0), so it can be used
+ * before the dynamic initialization of its source file; the fields must
+ * not be changed directly.
+ */
+struct LogModule {
+	const char* name;	///< Name of the module (source file or tag)
+	int initialLevel;	///< Level used when no level has been set
+	int level;		///< Current level
+	LogModule* next;	///< Next registered module
+
+	/**
+	 * \brief Method to know if messages of a given level are enabled
+	 */
+	inline bool isEnabled(int l) const {
+		return __atomic_load_n(&level, __ATOMIC_RELAXED) >= l;
+	}
+
+	/**
+	 * \brief Method to get the name of the module
+	 */
+	inline const char* getName() const {
+		return name;
+	}
+
+	static void setLevel(const std::string& name, int level);
+	static int getLevel(const std::string& name);
+	static void resetLevels();
+	static bool loadConfig(const std::string& fileName);
+	static bool reloadOnSignal(const std::string& fileName,
+	    int signal = SIGHUP);
+
+private:
+	void update();
+	static void updateAll();
+
+	friend class LogModuleRegistrar;
+};
+
+/**
+ * \brief Object registering a LogModule during the dynamic initialization
+ * of its source file (and unregistering it at exit)
+ */
+class LogModuleRegistrar {
+	LogModule* module_;
+
+	LogModuleRegistrar(const LogModuleRegistrar&);
+	LogModuleRegistrar& operator=(const LogModuleRegistrar&);
+
+public:
+	explicit LogModuleRegistrar(LogModule* module);
+	~LogModuleRegistrar();
+};
+
+} /* onposix */
+
+#endif /* LOGMODULE_HPP_ */
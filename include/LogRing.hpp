@@ -0,0 +1,237 @@
+/*
+ * LogRing.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef LOGRING_HPP_
+#define LOGRING_HPP_
+
+#include <stdint.h>
+
+namespace onposix {
+
+/**
+ * \brief Lock-free single-producer single-consumer ring of variable-size
+ * records.
+ *
+ * It is used by the Logger in asynchronous mode: each thread owns one ring
+ * where it appends its records without locking, while the writer thread
+ * drains all the rings.
+ * Each record is stored contiguously (a padding record is inserted when a
+ * record would wrap around the end of the ring), so it can be filled and
+ * read in place.
+ *
+ * Producer side:
+ * \code
+ * char* p = ring.reserve(size);
+ * if (p != 0) {
+ * 	// Fill p[0 .. size-1]
+ * 	ring.commit();
+ * }
+ * \endcode
+ *
+ * Consumer side:
+ * \code
+ * unsigned long int pos = ring.getReadPosition();
+ * const char* data;
+ * unsigned long int size;
+ * while (ring.read(&pos, &data, &size)) {
+ * 	// Use data[0 .. size-1]
+ * }
+ * ring.release(pos);
+ * \endcode
+ */
+class LogRing {
+
+	/**
+	 * \brief Header preceding each record in the ring
+	 */
+	struct Frame {
+		uint32_t size;		///< Size of the frame (header included)
+		uint32_t padding;	///< Non-zero for padding frames
+	};
+
+	/**
+	 * \brief Memory of the ring
+	 */
+	char* data_;
+
+	/**
+	 * \brief Size of the ring (power of 2)
+	 */
+	unsigned long int size_;
+
+	/**
+	 * \brief Size of the frame reserved but not committed yet
+	 */
+	unsigned long int reserved_;
+
+	/**
+	 * \brief Producer's copy of tail_, refreshed only when the ring
+	 * looks full
+	 */
+	unsigned long int cachedTail_;
+
+	/**
+	 * \brief Records dropped by the producer because the ring was full
+	 */
+	unsigned long int dropped_;
+
+	/**
+	 * \brief Set when the producer thread has terminated
+	 */
+	bool orphaned_;
+
+	/**
+	 * \brief Set while the producer is writing a record
+	 */
+	bool busy_;
+
+	/**
+	 * \brief Write position (written by the producer only)
+	 */
+	unsigned long int head_;
+
+	/**
+	 * \brief Padding between the fields written by the producer and
+	 * tail_, to avoid false sharing.
+	 *
+	 * Padding is used instead of an alignment attribute because new
+	 * does not honour extended alignments before C++17.
+	 */
+	char producerPad_[64];
+
+	/**
+	 * \brief Read position (written by the consumer only)
+	 */
+	unsigned long int tail_;
+
+	/**
+	 * \brief Padding keeping the cache line of tail_ for itself
+	 */
+	char consumerPad_[64 - sizeof(unsigned long int)];
+
+	LogRing(const LogRing&);
+	LogRing& operator=(const LogRing&);
+
+public:
+	explicit LogRing(unsigned long int size);
+	~LogRing();
+
+	char* reserve(unsigned long int size);
+
+	/**
+	 * \brief Method to publish the record obtained through reserve()
+	 */
+	inline void commit() {
+		__atomic_store_n(&head_, head_ + reserved_, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * \brief Method to account for a record that could not be stored
+	 */
+	inline void drop() {
+		__atomic_store_n(&dropped_, dropped_ + 1, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * \brief Method to get the number of records dropped so far
+	 */
+	inline unsigned long int getDropped() const {
+		return __atomic_load_n(&dropped_, __ATOMIC_RELAXED);
+	}
+
+	/**
+	 * \brief Method to get the size of the largest record that fits in
+	 * the ring
+	 */
+	inline unsigned long int getMaxRecordSize() const {
+		return size_/2 - sizeof(Frame);
+	}
+
+	/**
+	 * \brief Method to get the position of the oldest record not yet
+	 * released by the consumer
+	 */
+	inline unsigned long int getReadPosition() const {
+		return tail_;
+	}
+
+	bool read(unsigned long int* pos, const char** data,
+	    unsigned long int* size) const;
+
+	/**
+	 * \brief Method to free the space of the records preceding the given
+	 * position
+	 *
+	 * @param pos Position returned by the latest call to read()
+	 */
+	inline void release(unsigned long int pos) {
+		__atomic_store_n(&tail_, pos, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * \brief Method to know if all records have been released
+	 */
+	inline bool isEmpty() const {
+		return __atomic_load_n(&head_, __ATOMIC_ACQUIRE) == tail_;
+	}
+
+	/**
+	 * \brief Method called by the producer before reserve()
+	 *
+	 * The store is sequentially consistent, so that a consumer that
+	 * sees the ring idle also sees what the producer checks afterwards.
+	 */
+	inline void enter() {
+		__atomic_store_n(&busy_, true, __ATOMIC_SEQ_CST);
+	}
+
+	/**
+	 * \brief Method called by the producer once the record has been
+	 * committed (or dropped)
+	 */
+	inline void leave() {
+		__atomic_store_n(&busy_, false, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * \brief Method to know if the producer is writing a record
+	 */
+	inline bool isBusy() const {
+		return __atomic_load_n(&busy_, __ATOMIC_SEQ_CST);
+	}
+
+	/**
+	 * \brief Method to mark the ring as no longer used by its producer
+	 */
+	inline void setOrphaned() {
+		__atomic_store_n(&orphaned_, true, __ATOMIC_RELEASE);
+	}
+
+	/**
+	 * \brief Method to know if the producer has terminated
+	 */
+	inline bool isOrphaned() const {
+		return __atomic_load_n(&orphaned_, __ATOMIC_ACQUIRE);
+	}
+};
+
+} /* onposix */
+
+#endif /* LOGRING_HPP_ */
@@ -21,11 +21,19 @@
 #ifndef LOGGER_HPP_
 #define LOGGER_HPP_
 
+#include <deque>
 #include <fstream>
 #include <ostream>
 #include <string>
 #include <sstream>
+#include <vector>
 #include <sys/time.h>
+#include <pthread.h>
+
+#include "PosixMutex.hpp"
+#include "LogFormat.hpp"
+#include "LogLimit.hpp"
+#include "LogModule.hpp"
 
 /// Comment this line if you don't need multithread support
 #define LOG_MULTITHREAD
@@ -47,11 +55,6 @@
 #endif
 
 
-
-#ifdef LOG_MULTITHREAD
-#include "PosixMutex.hpp"
-#endif
-
 /**
  * \brief Macro to set the file used for logging.
  *
@@ -68,6 +71,28 @@
 
 
 
+/**
+ * \brief Sinks enabled at compile time for a given log level
+ */
+#define LOG_SINKS__(level) \
+	(((LOG_LEVEL_CONSOLE >= (level)) ? onposix::Logger::SINK_CONSOLE : 0) | \
+	((LOG_LEVEL_FILE >= (level)) ? onposix::Logger::SINK_FILE : 0))
+
+/**
+ * \brief Macro used by DEBUG(), WARNING() and ERROR() to build and print
+ * the message.
+ */
+#define LOG_PRINT__(level, prefix, msg) { \
+	if (::logger_module__.isEnabled(level)) { \
+		std::ostringstream logger_dbg_stream__; \
+		logger_dbg_stream__ << prefix; \
+		logger_dbg_stream__ << msg; \
+		onposix::Logger::getInstance().print(LOG_SINKS__(level), \
+				__FILE__, __LINE__, logger_dbg_stream__.str()); \
+	} \
+	}
+
+
 /**
  * \brief Macro to print error messages.
  *
@@ -78,34 +103,10 @@
  */
 #if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_ERRORS && LOG_LEVEL_FILE < LOG_ERRORS)
 	#define ERROR(...)
-#elif (LOG_LEVEL_CONSOLE < LOG_ERRORS)
-	#define ERROR(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[ERROR]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnFile(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
-#elif (LOG_LEVEL_FILE < LOG_ERRORS)
-	#define ERROR(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[ERROR]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnConsole(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
 #else
-	#define ERROR(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[ERROR]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnConsole(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		onposix::Logger::getInstance().printOnFile(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
+	#define ERROR(msg) LOG_PRINT__(LOG_ERRORS, "[ERROR]\t", msg)
 #endif
-	
+
 
 /**
  * \brief Macro to print warning messages.
@@ -117,36 +118,11 @@
  */
 #if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_WARNINGS && LOG_LEVEL_FILE < LOG_WARNINGS)
 	#define WARNING(...)
-#elif (LOG_LEVEL_CONSOLE < LOG_WARNINGS)
-	#define WARNING(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[WARNING]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnFile(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
-#elif (LOG_LEVEL_FILE < LOG_WARNINGS)
-	#define WARNING(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[WARNING]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnConsole(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
 #else
-	#define WARNING(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[WARNING]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnConsole(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		onposix::Logger::getInstance().printOnFile(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
+	#define WARNING(msg) LOG_PRINT__(LOG_WARNINGS, "[WARNING]\t", msg)
 #endif
 
 
-
 /**
  * \brief Macro to print debug messages.
  *
@@ -157,37 +133,191 @@
  */
 #if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_ALL && LOG_LEVEL_FILE < LOG_ALL)
 	#define DEBUG(...)
-#elif (LOG_LEVEL_CONSOLE < LOG_ALL)
-	#define DEBUG(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[DEBUG]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnFile(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
-#elif (LOG_LEVEL_FILE < LOG_ALL)
-	#define DEBUG(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[DEBUG]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnConsole(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
 #else
-	#define DEBUG(msg) { \
-		std::ostringstream logger_dbg_stream__; \
-		logger_dbg_stream__ << "[DEBUG]\t"; \
-		logger_dbg_stream__ << msg; \
-		onposix::Logger::getInstance().printOnConsole(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		onposix::Logger::getInstance().printOnFile(__FILE__, __LINE__, \
-				logger_dbg_stream__.str()); \
-		}
+	#define DEBUG(msg) LOG_PRINT__(LOG_ALL, "[DEBUG]\t", msg)
+#endif
+
+
+/**
+ * \brief Method of the Logger called by DEBUGF(), WARNINGF() and ERRORF():
+ * without variadic templates (i.e., before C++11) the message is formatted
+ * at the call site.
+ */
+#if __cplusplus >= 201103L
+#define LOG_SITE_METHOD__ log
+#else
+#define LOG_SITE_METHOD__ logNow
+#endif
+
+/**
+ * \brief Macro used by DEBUGF(), WARNINGF() and ERRORF() to log the
+ * message through its static call site descriptor.
+ */
+#define LOG_FORMAT__(level, prefix, format, ...) { \
+	static const onposix::LogSite logger_site__ = { \
+		__FILE__, __LINE__, level, LOG_SINKS__(level), \
+		prefix format \
+	}; \
+	if (0) \
+		onposix::logCheckFormat(format, ##__VA_ARGS__); \
+	if (::logger_module__.isEnabled(level)) \
+		onposix::Logger::getInstance().LOG_SITE_METHOD__( \
+		    &logger_site__, \
+		    ##__VA_ARGS__); \
+	}
+
+
+/**
+ * \brief Macros to print error, warning and debug messages with a
+ * printf-like format.
+ *
+ * Unlike ERROR(), WARNING() and DEBUG(), they do not build the message
+ * at the call site: only the values of the arguments are copied, and the
+ * message is formatted when printed (by the writer thread, in
+ * asynchronous mode). The format must be a string literal and is checked
+ * at compile time. Only the types accepted by printf() can be passed.
+ *
+ * Example of usage:
+ * \code
+ * 	DEBUGF("read %d bytes from %s", n, name.c_str());
+ * \endcode
+ */
+#if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_ERRORS && LOG_LEVEL_FILE < LOG_ERRORS)
+	#define ERRORF(...)
+#else
+	#define ERRORF(format, ...) \
+		LOG_FORMAT__(LOG_ERRORS, "[ERROR]\t", format, ##__VA_ARGS__)
+#endif
+
+#if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_WARNINGS && LOG_LEVEL_FILE < LOG_WARNINGS)
+	#define WARNINGF(...)
+#else
+	#define WARNINGF(format, ...) \
+		LOG_FORMAT__(LOG_WARNINGS, "[WARNING]\t", format, ##__VA_ARGS__)
+#endif
+
+#if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_ALL && LOG_LEVEL_FILE < LOG_ALL)
+	#define DEBUGF(...)
+#else
+	#define DEBUGF(format, ...) \
+		LOG_FORMAT__(LOG_ALL, "[DEBUG]\t", format, ##__VA_ARGS__)
+#endif
+
+
+/**
+ * \brief Initializers of the LogLimit of a call site
+ */
+#define LOG_RATE__(rate, burst) { \
+	1000000000ULL / (rate), \
+	(((burst) > 1) ? ((burst) - 1) : 0) * (1000000000ULL / (rate)), \
+	0, 0, 0, 0 \
+	}
+
+#define LOG_SAMPLE__(n) { 0, 0, (n), 0, 0, 0 }
+
+/**
+ * \brief Macro used by the rate-limited and sampled macros to execute the
+ * logging statement only if allowed by the state of the call site.
+ */
+#define LOG_LIMIT__(limit, level, prefix, statement) { \
+	static onposix::LogLimit logger_limit__ = limit; \
+	unsigned long int logger_suppressed__; \
+	if (::logger_module__.isEnabled(level) && \
+	    logger_limit__.allow(&logger_suppressed__)) { \
+		if (logger_suppressed__ != 0) \
+			onposix::Logger::getInstance().reportSuppressed( \
+			    LOG_SINKS__(level), __FILE__, __LINE__, prefix, \
+			    logger_suppressed__); \
+		statement; \
+	} \
+	}
+
+
+/**
+ * \brief Macros to limit the messages printed by a call site.
+ *
+ * The *_RATE() macros print at most rate messages per second, with bursts
+ * of at most burst messages (token bucket); the *_SAMPLE() macros print
+ * one message every n (the first one included).
+ * The state is kept in a static variable of the call site, so checking it
+ * costs a couple of atomic operations, and no lock is taken for the
+ * suppressed messages. The number of suppressed messages is reported, at
+ * most once per second, before the next message printed by the call site.
+ *
+ * Example of usage:
+ * \code
+ * 	ERROR_RATE(10, 5, "read() failed on " << fd);
+ * 	DEBUGF_SAMPLE(1000, "received packet %u", seq);
+ * \endcode
+ */
+#if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_ERRORS && LOG_LEVEL_FILE < LOG_ERRORS)
+	#define ERROR_RATE(...)
+	#define ERROR_SAMPLE(...)
+	#define ERRORF_RATE(...)
+	#define ERRORF_SAMPLE(...)
+#else
+	#define ERROR_RATE(rate, burst, msg) \
+		LOG_LIMIT__(LOG_RATE__(rate, burst), LOG_ERRORS, "[ERROR]\t", \
+		    ERROR(msg))
+	#define ERROR_SAMPLE(n, msg) \
+		LOG_LIMIT__(LOG_SAMPLE__(n), LOG_ERRORS, "[ERROR]\t", \
+		    ERROR(msg))
+	#define ERRORF_RATE(rate, burst, format, ...) \
+		LOG_LIMIT__(LOG_RATE__(rate, burst), LOG_ERRORS, "[ERROR]\t", \
+		    ERRORF(format, ##__VA_ARGS__))
+	#define ERRORF_SAMPLE(n, format, ...) \
+		LOG_LIMIT__(LOG_SAMPLE__(n), LOG_ERRORS, "[ERROR]\t", \
+		    ERRORF(format, ##__VA_ARGS__))
+#endif
+
+#if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_WARNINGS && LOG_LEVEL_FILE < LOG_WARNINGS)
+	#define WARNING_RATE(...)
+	#define WARNING_SAMPLE(...)
+	#define WARNINGF_RATE(...)
+	#define WARNINGF_SAMPLE(...)
+#else
+	#define WARNING_RATE(rate, burst, msg) \
+		LOG_LIMIT__(LOG_RATE__(rate, burst), LOG_WARNINGS, \
+		    "[WARNING]\t", WARNING(msg))
+	#define WARNING_SAMPLE(n, msg) \
+		LOG_LIMIT__(LOG_SAMPLE__(n), LOG_WARNINGS, "[WARNING]\t", \
+		    WARNING(msg))
+	#define WARNINGF_RATE(rate, burst, format, ...) \
+		LOG_LIMIT__(LOG_RATE__(rate, burst), LOG_WARNINGS, \
+		    "[WARNING]\t", WARNINGF(format, ##__VA_ARGS__))
+	#define WARNINGF_SAMPLE(n, format, ...) \
+		LOG_LIMIT__(LOG_SAMPLE__(n), LOG_WARNINGS, "[WARNING]\t", \
+		    WARNINGF(format, ##__VA_ARGS__))
+#endif
+
+#if (defined NDEBUG) || (LOG_LEVEL_CONSOLE < LOG_ALL && LOG_LEVEL_FILE < LOG_ALL)
+	#define DEBUG_RATE(...)
+	#define DEBUG_SAMPLE(...)
+	#define DEBUGF_RATE(...)
+	#define DEBUGF_SAMPLE(...)
+#else
+	#define DEBUG_RATE(rate, burst, msg) \
+		LOG_LIMIT__(LOG_RATE__(rate, burst), LOG_ALL, "[DEBUG]\t", \
+		    DEBUG(msg))
+	#define DEBUG_SAMPLE(n, msg) \
+		LOG_LIMIT__(LOG_SAMPLE__(n), LOG_ALL, "[DEBUG]\t", DEBUG(msg))
+	#define DEBUGF_RATE(rate, burst, format, ...) \
+		LOG_LIMIT__(LOG_RATE__(rate, burst), LOG_ALL, "[DEBUG]\t", \
+		    DEBUGF(format, ##__VA_ARGS__))
+	#define DEBUGF_SAMPLE(n, format, ...) \
+		LOG_LIMIT__(LOG_SAMPLE__(n), LOG_ALL, "[DEBUG]\t", \
+		    DEBUGF(format, ##__VA_ARGS__))
 #endif
 
 
 namespace onposix {
 
+class LogRing;
+class LogWriter;
+class LogBinaryWriter;
+class LogFile;
+struct LogRecord;
+
 /**
  * \brief Simple logger to log messages on file and console.
  *
@@ -206,12 +336,96 @@ namespace onposix {
  * \code
  * 	DEBUG("hello " << "world");
  * \endcode
+ *
+ * By default, messages are printed by the calling thread, under a global
+ * lock. In asynchronous mode, instead, each thread appends its messages to
+ * a private lock-free ring and a background thread formats and writes them
+ * in batches, so that logging does not serialize the threads nor wait for
+ * the disk:
+ * \code
+ * 	Logger::getInstance().startAsync(Logger::DROP);
+ * \endcode
+ *
+ * Files are written through a memory-mapped window and can be rotated by
+ * size and/or age, keeping only the most recent ones:
+ * \code
+ * 	Logger::getInstance().setRotation(64*1024*1024, 3600, 10);
+ * \endcode
  */
 class Logger
 {
 public:
+	/**
+	 * \brief Destinations of a message
+	 */
+	enum Sink {
+		SINK_CONSOLE	= 1, ///< Standard output
+		SINK_FILE	= 2  ///< File set through setFile()
+	};
+
+	/**
+	 * \brief Format of the file used for logging
+	 */
+	enum FileFormat {
+		TEXT	= 0, ///< One line of text per message
+		BINARY	= 1  ///< Compact records, decoded offline (logdecode)
+	};
+
+	/**
+	 * \brief Behavior in asynchronous mode when the ring of the
+	 * calling thread is full
+	 */
+	enum OverflowPolicy {
+		DROP	= 0, ///< Discard the message (and count it)
+		BLOCK	= 1  ///< Wait for the writer thread to make room
+	};
+
 	static Logger& getInstance();
 
+	void print(unsigned int sinks, const char* sourceFile, int codeLine,
+	    const std::string& message);
+	void reportSuppressed(unsigned int sinks, const char* sourceFile,
+	    int codeLine, const char* prefix, unsigned long int count);
+
+	/**
+	 * \brief Method used to log a message through its call site
+	 * descriptor.
+	 *
+	 * This method is called by the DEBUGF(), WARNINGF() and ERRORF()
+	 * macros. In asynchronous mode it only encodes the arguments in the
+	 * ring of the calling thread, without allocating memory.
+	 * @param site Static descriptor of the call site
+	 * @param args Arguments of the format
+	 */
+#if __cplusplus >= 201103L
+	template <typename... Args>
+	void log(const LogSite* site, const Args&... args) {
+		unsigned long int size = logArgsSize(args...);
+		if (isAsync() && !isWriter_) {
+			char* p;
+			if (reserveSite(site, size, &p)) {
+				if (p != 0) {
+					logArgsEncode(p, args...);
+					commitRecord();
+				}
+				return;
+			}
+		}
+		// Common messages are encoded on the stack
+		char buffer[256];
+		std::vector<char> large;
+		char* data = buffer;
+		if (size + 1 > sizeof(buffer)) {
+			large.resize(size + 1);
+			data = &large[0];
+		}
+		logArgsEncode(data, args...);
+		printSite(site, data, size);
+	}
+#endif
+
+	void logNow(const LogSite* site, ...);
+
 	void printOnFile(	const std::string&	sourceFile,
 				const int 		codeLine,
 				const std::string& 	message);
@@ -219,7 +433,35 @@ public:
 				const int 		codeLine,
 				const std::string& 	message);
 
-	void setFile (const std::string&	outputFile);
+	void setFile (const std::string&	outputFile,
+		      FileFormat		format = TEXT);
+	void setRotation(unsigned long int maxSize, unsigned int maxAge = 0,
+	    unsigned int maxFiles = 0);
+	void closeFile();
+
+	/**
+	 * \brief Method to get the name of the file used for logging
+	 *
+	 * @return Name of the file (empty if no file has been set)
+	 */
+	inline const std::string& getFileName() const {
+		return logFile_;
+	}
+
+	void startAsync(OverflowPolicy policy = BLOCK,
+	    unsigned long int ringSize = 64*1024);
+	void stopAsync();
+	void flush();
+	unsigned long int getDroppedMessages();
+
+	/**
+	 * \brief Method to know if the asynchronous mode is active
+	 *
+	 * @return true if it is active; false otherwise
+	 */
+	inline bool isAsync() const {
+		return __atomic_load_n(&async_, __ATOMIC_ACQUIRE);
+	}
 
 	/**
 	 * \brief Method to know if the latest message has been printed on file
@@ -260,17 +502,69 @@ private:
 	 *
 	 * Date and time are automatically appended.
 	 */
+	std::string fileBase_;
+
+	/**
+	 * \brief Name of the current file (empty if none)
+	 */
 	std::string logFile_;
 
 	/**
-	 * \brief Stream used when logging on a file
+	 * \brief Format of the file
 	 */
-	std::ofstream out_;
+	FileFormat format_;
 
 	/**
-	 * \brief Initial time (used to print relative times)
+	 * \brief File used when logging on a text file (0 otherwise)
 	 */
-	struct timeval initialTime_;
+	LogFile* text_;
+
+	/**
+	 * \brief Writer used when logging on a binary file (0 otherwise)
+	 */
+	LogBinaryWriter* binary_;
+
+	/**
+	 * \brief Initial time, as returned by LogClock::now() (used to print
+	 * relative times)
+	 */
+	uint64_t initialTime_;
+
+	/**
+	 * \brief Size of a file that triggers the rotation (0 if none); it
+	 * is also preallocated for each file
+	 */
+	unsigned long int maxFileSize_;
+
+	/**
+	 * \brief Age of a file that triggers the rotation (ns; 0 if none)
+	 */
+	uint64_t maxFileAge_;
+
+	/**
+	 * \brief Number of files kept (0 to keep all files)
+	 */
+	unsigned int maxFiles_;
+
+	/**
+	 * \brief Number of rotations since the latest setFile()
+	 */
+	unsigned int segment_;
+
+	/**
+	 * \brief Creation time of the current file (LogClock::now())
+	 */
+	uint64_t segmentStart_;
+
+	/**
+	 * \brief Length of the current file before its first message
+	 */
+	unsigned long int segmentHeader_;
+
+	/**
+	 * \brief Files created since the latest setFile(), oldest first
+	 */
+	std::deque<std::string> segments_;
 
 	/**
 	 * \brief Debug: to know if the latest message has been printed
@@ -284,6 +578,82 @@ private:
 	 */
 	bool latestMsgPrintedOnConsole_;
 
+	/**
+	 * \brief If the asynchronous mode is active
+	 */
+	bool async_;
+
+	/**
+	 * \brief Overflow policy of the asynchronous mode
+	 */
+	OverflowPolicy policy_;
+
+	/**
+	 * \brief Size of the rings created for new threads
+	 */
+	unsigned long int ringSize_;
+
+	/**
+	 * \brief Thread draining the rings in asynchronous mode
+	 */
+	LogWriter* writer_;
+
+	/**
+	 * \brief Rings of all threads that have logged in asynchronous mode
+	 */
+	std::vector<LogRing*> rings_;
+
+	/**
+	 * \brief Lock protecting rings_
+	 */
+	PosixMutex ringsLock_;
+
+	/**
+	 * \brief Lock serializing the consumers of the rings (i.e., the
+	 * writer thread and flush())
+	 */
+	PosixMutex drainLock_;
+
+	/**
+	 * \brief Dropped messages already reported in the log
+	 */
+	unsigned long int reportedDropped_;
+
+	/**
+	 * \brief Dropped messages of the rings already deleted
+	 */
+	unsigned long int orphanDropped_;
+
+	/**
+	 * \brief Set in the writer thread, which always logs synchronously
+	 */
+	static __thread bool isWriter_;
+
+	LogRing* enterRing();
+	LogRecord* reserveRecord(unsigned long int size);
+	void commitRecord();
+	bool enqueue(unsigned int sinks, const char* file, int line,
+	    const std::string& message);
+	bool reserveSite(const LogSite* site, unsigned long int size,
+	    char** args);
+	void printSite(const LogSite* site, const char* args,
+	    unsigned long int size);
+	void writeBinaryText(uint64_t timestamp, uint32_t thread,
+	    const char* file, int line, const char* text,
+	    unsigned long int length);
+	void writeBinaryMessage(uint64_t timestamp, uint32_t thread,
+	    const LogSite* site, const char* args, unsigned long int size);
+	void writeTextFile(uint64_t timestamp, const std::string& record);
+	bool prepareFile(uint64_t timestamp, unsigned long int size);
+	void openFile();
+	void releaseFile();
+	LogRing* registerThread();
+	bool drain();
+	void mapAhead();
+	unsigned long int countDropped();
+
+	friend class LogWriter;
+
 	/**
 	 * \brief Method to lock in case of multithreading
 	 */
@@ -297,4 +667,23 @@ private:
 
 } /* onposix */
 
+/**
+ * \brief Name of the module of the messages of a source file (see
+ * onposix::LogModule).
+ *
+ * By default it is the name of the source file; to group several files
+ * under a tag, define it before including this file.
+ */
+#ifndef LOG_MODULE
+#define LOG_MODULE __BASE_FILE__
+#endif
+
+/**
+ * \brief Runtime log level of the source file including this file
+ */
+static onposix::LogModule logger_module__ = {
+    LOG_MODULE, LOG_ALL, LOG_ALL, 0 };
+static onposix::LogModuleRegistrar logger_module_registrar__
+    (&logger_module__);
+
 #endif /* LOGGER_HPP_ */
@@ -0,0 +1,134 @@
+/*
+ * MappedRegion.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef MAPPEDREGION_HPP_
+#define MAPPEDREGION_HPP_
+
+#include <sys/mman.h>
+
+#include "Buffer.hpp"
+#include "FileDescriptor.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Memory-mapped view of the content of a file.
+ *
+ * This class maps (a range of) a FileDescriptor in memory through mmap().
+ * Since it is a Buffer, the content can be accessed through the usual
+ * Buffer methods (operator[], compare(), find(), etc.) and the class can
+ * be given to any method accepting a Buffer*, without copying the file
+ * content: pages are loaded on demand when first accessed.
+ *
+ * Note: writing (e.g., through fill()) a region mapped as READ_ONLY
+ * raises SIGSEGV.
+ *
+ * Example of usage:
+ * \code
+ * FileDescriptor fd ("/tmp/myindex", O_RDONLY);
+ * MappedRegion m (fd);
+ * m.advise(MappedRegion::SEQUENTIAL);
+ * unsigned long int pos = m.find('\n');
+ * \endcode
+ */
+class MappedRegion: public Buffer {
+public:
+	/**
+	 * \brief Type of access to the mapped region
+	 */
+	enum Mode {
+		READ_ONLY	= 0, ///< Pages can only be read
+		READ_WRITE	= 1  ///< Changes are carried to the file
+	};
+
+	/**
+	 * \brief Hints about the expected access pattern (see madvise())
+	 */
+	enum Advice {
+		NORMAL		= MADV_NORMAL,		///< No special treatment
+		SEQUENTIAL	= MADV_SEQUENTIAL,	///< Aggressive read-ahead
+		RANDOM		= MADV_RANDOM,		///< No read-ahead
+		WILLNEED	= MADV_WILLNEED,	///< Prefetch the pages
+		DONTNEED	= MADV_DONTNEED		///< Pages can be dropped
+	};
+
+	MappedRegion(FileDescriptor& fd, Mode mode = READ_ONLY);
+	MappedRegion(FileDescriptor& fd, unsigned long int offset,
+	    unsigned long int length, Mode mode = READ_ONLY);
+	virtual ~MappedRegion();
+
+	bool advise(Advice advice);
+	bool advise(Advice advice, unsigned long int offset,
+	    unsigned long int length);
+	bool sync(bool wait = true);
+
+	/**
+	 * \brief Method to get the offset of the region inside the file
+	 *
+	 * @return Offset of the first byte of the region
+	 */
+	inline unsigned long int getOffset() const {
+		return offset_;
+	}
+
+	/**
+	 * \brief Method to get the access mode of the region
+	 *
+	 * @return READ_ONLY or READ_WRITE
+	 */
+	inline Mode getMode() const {
+		return mode_;
+	}
+
+private:
+	/**
+	 * \brief Address returned by mmap().
+	 *
+	 * mmap() needs a page-aligned offset, so this address can precede
+	 * the first byte of the region.
+	 */
+	char* base_;
+
+	/**
+	 * \brief Length of the mapping starting at base_
+	 */
+	unsigned long int mappedLength_;
+
+	/**
+	 * \brief Offset of the region inside the file
+	 */
+	unsigned long int offset_;
+
+	/**
+	 * \brief Access mode
+	 */
+	Mode mode_;
+
+	void map(int fd, unsigned long int offset, unsigned long int length);
+	static unsigned long int getFileLength(int fd);
+
+	// Disable copy constructor and assignment
+	MappedRegion(const MappedRegion&);
+	MappedRegion& operator=(const MappedRegion&);
+};
+
+} /* onposix */
+
+#endif /* MAPPEDREGION_HPP_ */
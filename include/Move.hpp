@@ -0,0 +1,45 @@
+/*
+ * Move.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef MOVE_HPP_
+#define MOVE_HPP_
+
+/**
+ * \brief Defined when the compiler supports rvalue references (C++11)
+ *
+ * It enables the methods taking rvalue references or variadic arguments,
+ * like push(T&&) and emplace() of the shared queues.
+ */
+#if __cplusplus >= 201103L
+#define ONPOSIX_MOVE_SEMANTICS
+#endif
+
+#ifdef ONPOSIX_MOVE_SEMANTICS
+#include <utility>
+
+/**
+ * \brief Macro to move an object, when supported; otherwise it is copied.
+ */
+#define ONPOSIX_MOVE(x) std::move(x)
+#else
+#define ONPOSIX_MOVE(x) (x)
+#endif
+
+#endif /* MOVE_HPP_ */
@@ -0,0 +1,72 @@
+/*
+ * Numa.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef NUMA_HPP_
+#define NUMA_HPP_
+
+#include <vector>
+
+namespace onposix {
+
+/**
+ * \brief NUMA memory placement.
+ *
+ * It uses the set_mempolicy(), mbind() and get_mempolicy() system calls
+ * directly, so libnuma is not needed.
+ * On kernels without NUMA support every request for node 0 (or for any
+ * node) succeeds without effect, since all memory is local.
+ *
+ * Example of usage (inside the run() method of a thread pinned to the
+ * CPUs of node 1):
+ * \code
+ * Numa::setThreadPolicy(Numa::LOCAL);
+ * Buffer b (1024*1024, 1);
+ * \endcode
+ */
+class Numa {
+public:
+	/**
+	 * \brief Memory policies (same values of the kernel)
+	 */
+	enum Policy {
+		DEFAULT		= 0, ///< Policy of the thread (or of the process)
+		PREFERRED	= 1, ///< Node tried first, falling back to others
+		BIND		= 2, ///< Node used strictly
+		INTERLEAVE	= 3, ///< Pages interleaved across the nodes
+		LOCAL		= 4  ///< Node of the CPU allocating the page
+	};
+
+	static bool isAvailable();
+	static std::vector<int> getNodes();
+	static int getCurrentNode();
+	static void setThreadPolicy(Policy policy, int node = -1);
+	static void bindMemory(void* addr, unsigned long int size,
+	    Policy policy, int node = -1, bool move = false);
+	static int getNodeOfAddress(const void* addr);
+	static void* allocate(unsigned long int size, int node);
+	static void release(void* addr, unsigned long int size);
+
+private:
+	Numa();
+};
+
+} /* onposix */
+
+#endif /* NUMA_HPP_ */
@@ -0,0 +1,255 @@
+/*
+ * Parallel.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef PARALLEL_HPP_
+#define PARALLEL_HPP_
+
+#include "ThreadPool.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Function to compute the grain size used when none is given
+ *
+ * The range is split in about 8 chunks per worker, to balance the load
+ * while keeping the number of tasks low.
+ */
+inline unsigned long int parallelGrain(const ThreadPool& pool,
+    unsigned long int begin, unsigned long int end,
+    unsigned long int grain)
+{
+	if (grain > 0)
+		return grain;
+	unsigned long int g = (end - begin) / (8 * pool.getThreads());
+	return (g > 0) ? g : 1;
+}
+
+/**
+ * \brief Task of parallelFor(): splits its range in halves, submitting the
+ * right halves, until it is not larger than the grain size
+ */
+template<typename F>
+struct ParallelForTask {
+	ThreadPool* pool;
+	unsigned long int begin;
+	unsigned long int end;
+	unsigned long int grain;
+	const F* body;
+
+	void operator()() const {
+		ThreadPool::Handle right[8 * sizeof(unsigned long int)];
+		unsigned int n = 0;
+		unsigned long int e = end;
+		while (e - begin > grain) {
+			unsigned long int mid = begin + (e - begin) / 2;
+			ParallelForTask t = {pool, mid, e, grain, body};
+			right[n++] = pool->submit(t);
+			e = mid;
+		}
+		(*body)(begin, e);
+		while (n > 0)
+			right[--n].wait();
+	}
+};
+
+/**
+ * \brief Task of parallelReduce(): reduces its range in *result
+ */
+template<typename T, typename Map, typename Combine>
+struct ParallelReduceTask {
+	ThreadPool* pool;
+	unsigned long int begin;
+	unsigned long int end;
+	unsigned long int grain;
+	const T* identity;
+	const Map* map;
+	const Combine* combine;
+	T* result;
+
+	void operator()() const {
+		if (end - begin <= grain) {
+			*result = (*map)(begin, end);
+			return;
+		}
+		unsigned long int mid = begin + (end - begin) / 2;
+		T r = *identity;
+		ParallelReduceTask right = {pool, mid, end, grain, identity,
+		    map, combine, &r};
+		ThreadPool::Handle h = pool->submit(right);
+		ParallelReduceTask left = {pool, begin, mid, grain, identity,
+		    map, combine, result};
+		left();
+		h.wait();
+		*result = (*combine)(*result, r);
+	}
+};
+
+/**
+ * \brief Function to run a task on a pool and wait for it
+ *
+ * Ranges of a single chunk, pools with a single worker and calls made by a
+ * worker of the pool run the task on the calling thread (the latter still
+ * share the subtasks with the other workers).
+ */
+template<typename Task>
+inline void parallelRun(ThreadPool& pool, const Task& task)
+{
+	if ((task.end - task.begin <= task.grain) ||
+	    (pool.getThreads() == 1) || pool.isWorker())
+		task();
+	else
+		pool.submit(task).wait();
+}
+
+/**
+ * \brief Function to call a body over a range of indexes split in chunks
+ * run in parallel
+ *
+ * The body is called as body(chunkBegin, chunkEnd) for disjoint chunks
+ * covering [begin, end), each not larger than the grain size. It must be
+ * safe to call it concurrently and it must not throw exceptions.
+ *
+ * Example of usage (checksum of each 64 KB block of a Buffer):
+ * \code
+ * struct BlockChecksum {
+ * 	Buffer* b;
+ * 	uint32_t* crc;
+ * 	void operator()(unsigned long int begin,
+ * 	    unsigned long int end) const {
+ * 		for (unsigned long int i = begin; i < end; ++i)
+ * 			crc[i] = Crc32c::compute(b->getBuffer() + i * 65536,
+ * 			    65536);
+ * 	}
+ * };
+ * BlockChecksum f = {&b, crc};
+ * parallelFor(0, b.getSize() / 65536, 16, f);
+ * \endcode
+ * @param begin First index
+ * @param end Index following the last one
+ * @param grain Maximum size of a chunk; 0 chooses it from the number of
+ * workers
+ * @param body Function object called on each chunk
+ * @param pool Pool running the chunks
+ */
+template<typename F>
+void parallelFor(unsigned long int begin, unsigned long int end,
+    unsigned long int grain, const F& body,
+    ThreadPool& pool = ThreadPool::getDefault())
+{
+	if (begin >= end)
+		return;
+	ParallelForTask<F> t = {&pool, begin, end,
+	    parallelGrain(pool, begin, end, grain), &body};
+	parallelRun(pool, t);
+}
+
+/**
+ * \brief Function to reduce a range of indexes split in chunks run in
+ * parallel
+ *
+ * Each chunk is reduced by map(chunkBegin, chunkEnd); the partial results
+ * are then merged through combine(left, right), which must be associative.
+ * Both must be safe to call concurrently and must not throw exceptions.
+ *
+ * Example of usage (number of lines in a Buffer):
+ * \code
+ * struct CountLines {
+ * 	const char* data;
+ * 	unsigned long int operator()(unsigned long int begin,
+ * 	    unsigned long int end) const {
+ * 		return std::count(data + begin, data + end, '\n');
+ * 	}
+ * };
+ * CountLines c = {b.getBuffer()};
+ * unsigned long int lines = parallelReduce(0, b.getSize(), 0, 0UL, c,
+ *     std::plus<unsigned long int>());
+ * \endcode
+ * @param begin First index
+ * @param end Index following the last one
+ * @param grain Maximum size of a chunk; 0 chooses it from the number of
+ * workers
+ * @param identity Result of an empty range
+ * @param map Function object reducing a chunk
+ * @param combine Function object merging two partial results
+ * @param pool Pool running the chunks
+ * @return The result of the reduction
+ */
+template<typename T, typename Map, typename Combine>
+T parallelReduce(unsigned long int begin, unsigned long int end,
+    unsigned long int grain, const T& identity, const Map& map,
+    const Combine& combine, ThreadPool& pool = ThreadPool::getDefault())
+{
+	T result = identity;
+	if (begin >= end)
+		return result;
+	ParallelReduceTask<T, Map, Combine> t = {&pool, begin, end,
+	    parallelGrain(pool, begin, end, grain), &identity, &map, &combine,
+	    &result};
+	parallelRun(pool, t);
+	return result;
+}
+
+/**
+ * \brief Body of parallelTransform()
+ */
+template<typename In, typename Out, typename F>
+struct ParallelTransformBody {
+	In first;
+	Out result;
+	const F* function;
+
+	void operator()(unsigned long int begin, unsigned long int end) const {
+		In in = first + begin;
+		Out out = result + begin;
+		for (unsigned long int i = begin; i < end; ++i)
+			*out++ = (*function)(*in++);
+	}
+};
+
+/**
+ * \brief Function to apply a function to each element of a range in
+ * parallel, storing the results in another range (like std::transform)
+ *
+ * Example of usage (upper case copy of a Buffer):
+ * \code
+ * Buffer out (in.getSize());
+ * parallelTransform(in.getBuffer(), in.getBuffer() + in.getSize(),
+ *     out.getBuffer(), 0, ::toupper);
+ * \endcode
+ * @param first Random access iterator to the first element
+ * @param last Random access iterator following the last element
+ * @param result Random access iterator to the first result
+ * @param grain Maximum number of elements of a chunk; 0 chooses it from
+ * the number of workers
+ * @param function Function (object) applied to each element
+ * @param pool Pool running the chunks
+ */
+template<typename In, typename Out, typename F>
+void parallelTransform(In first, In last, Out result,
+    unsigned long int grain, const F& function,
+    ThreadPool& pool = ThreadPool::getDefault())
+{
+	ParallelTransformBody<In, Out, F> body = {first, result, &function};
+	parallelFor(0, last - first, grain, body, pool);
+}
+
+} /* onposix */
+
+#endif /* PARALLEL_HPP_ */
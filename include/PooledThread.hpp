@@ -0,0 +1,105 @@
+/*
+ * PooledThread.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef POOLEDTHREAD_HPP_
+#define POOLEDTHREAD_HPP_
+
+#include <vector>
+
+#include "PosixCondition.hpp"
+#include "PosixMutex.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Class for simple thread invocation on reused threads.
+ *
+ * It has the same usage of SimpleThread, but the handler runs on one of
+ * the threads parked by the previous handlers (or by reserve()) instead of
+ * a newly created one: start() just wakes up a parked thread, and
+ * waitForTermination() waits for the handler to return, while the thread
+ * parks again for the next start().
+ * A new thread is created only when no parked thread is available.
+ * At most getMaxIdle() threads stay parked; the others exit.
+ *
+ * The handler must return normally (i.e., it must not call pthread_exit()
+ * or be cancelled), and there is no stop() method.
+ *
+ * Example of usage:
+ * \code
+ * void myfunction (void* arg);
+ *
+ * int main ()
+ * {
+ *	int b;
+ *	PooledThread::reserve(4);
+ * 	PooledThread t (myfunction, (void*) b);
+ * 	t.start();
+ * 	t.waitForTermination();
+ * }
+ * \endcode
+ */
+class PooledThread {
+
+	class Carrier;
+	struct Reserve;
+
+	void (*handler_)(void* p);
+	void* arg_;
+
+	/**
+	 * \brief If start() has been called without waitForTermination()
+	 */
+	bool started_;
+
+	/**
+	 * \brief Set when the handler has returned
+	 */
+	bool done_;
+	PosixMutex lock_;
+	PosixCondition finished_;
+
+	static Reserve* reserve_;
+
+	static void createReserve();
+	static Reserve& getReserve();
+	static Carrier* acquire();
+	static bool park(Carrier* c);
+	static void collect(std::vector<Carrier*>* retired);
+
+	PooledThread(const PooledThread&);
+	PooledThread& operator=(const PooledThread&);
+
+public:
+	PooledThread(void (*handler)(void* p), void* arg);
+	~PooledThread();
+
+	bool start();
+	bool waitForTermination();
+
+	static void reserve(unsigned int threads);
+	static void setMaxIdle(unsigned int threads);
+	static unsigned int getMaxIdle();
+	static unsigned int getIdle();
+};
+
+} /* onposix */
+
+#endif /* POOLEDTHREAD_HPP_ */
@@ -39,6 +39,7 @@
 
 #include "Logger.hpp"
 #include "Buffer.hpp"
+#include "Checksum.hpp"
 #include "AbstractThread.hpp"
 #include "PosixMutex.hpp"
 #include "PosixCondition.hpp"
@@ -303,7 +304,9 @@ class PosixDescriptor {
 		 * this worker
 		 */
 		Worker(shared_queue* q, PosixDescriptor* des):
-		    des_(des), queue_(q)  {}
+		    des_(des), queue_(q)  {
+			setName("onposix-io");
+		}
 
 		~Worker(){
 		}
@@ -365,8 +368,8 @@ protected:
 	 */
 	int fd_;
 
-	int do_read (void* p, size_t size);
-	int do_write (const void* p, size_t size);
+	int do_read (void* p, size_t size, Checksum* c = 0);
+	int do_write (const void* p, size_t size, Checksum* c = 0);
 
 	/**
 	 * \brief Constructor
@@ -497,6 +500,10 @@ public:
 	int write (Buffer* b, size_t size);
 	int write (const void* p, size_t size);
 	int write (const std::string& s);
+	int read (Buffer* b, size_t size, Checksum* c);
+	int read (void* p, size_t size, Checksum* c);
+	int write (Buffer* b, size_t size, Checksum* c);
+	int write (const void* p, size_t size, Checksum* c);
 
 	/**
 	 * \brief Method to close the descriptor.
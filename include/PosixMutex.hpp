@@ -40,7 +40,7 @@ class PosixMutex {
 	friend class PosixCondition;
 
 public:
-	PosixMutex();
+	explicit PosixMutex(bool priorityInheritance = false);
 	~PosixMutex();
 
 	/**
@@ -60,6 +60,9 @@ public:
 	}
 
 	bool tryLock();
+
+	static int initialize(pthread_mutex_t* mutex,
+	    bool priorityInheritance = false);
 };
 
 /**
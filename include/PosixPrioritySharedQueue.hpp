@@ -5,15 +5,385 @@
 #include <map>
 #include <queue>
 #include <assert.h>
+#include <limits>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+#include <errno.h>
+#include <string.h>
 #include "PosixMutex.hpp"
+#include "Move.hpp"
+#include "Time.hpp"
+#include "Assert.hpp"
 
 namespace onposix {
 
+/**
+ * \brief Elements of PosixPrioritySharedQueue, grouped by priority.
+ *
+ * The generic version keeps a FIFO queue per priority in a map, so that
+ * insertion takes a lookup in the map and extraction walks the map up to
+ * the first non-empty queue. It is not thread-safe.
+ */
+template<typename T, typename _Priority,
+	bool integral = std::numeric_limits<_Priority>::is_integer>
+class PriorityLevels {
+
+	std::map< _Priority, std::queue<T> > queues_;
+
+public:
+	/**
+	 * \brief Adds a priority, if not already existing
+	 */
+	void add(const _Priority& prio) {
+		if (queues_.find(prio) == queues_.end())
+			queues_.insert(std::make_pair(prio, std::queue<T>()));
+	}
+
+	/**
+	 * \brief Inserts an element
+	 *
+	 * @return false if the priority has not been added
+	 */
+	bool push(const T& data, const _Priority& prio) {
+		typename std::map<_Priority, std::queue<T> >::iterator it =
+				queues_.find(prio);
+		if (it == queues_.end())
+			return false;
+		it->second.push(data);
+		return true;
+	}
+
+#ifdef ONPOSIX_MOVE_SEMANTICS
+	/**
+	 * \brief Inserts an element constructed in place
+	 *
+	 * @return false if the priority has not been added
+	 */
+	template<typename... Args>
+	bool emplace(const _Priority& prio, Args&&... args) {
+		typename std::map<_Priority, std::queue<T> >::iterator it =
+				queues_.find(prio);
+		if (it == queues_.end())
+			return false;
+		it->second.emplace(std::forward<Args>(args)...);
+		return true;
+	}
+#endif
+
+	/**
+	 * \brief Removes the first of the highest priority elements
+	 *
+	 * There must be at least one element.
+	 */
+	T pop() {
+		typename std::map<_Priority, std::queue<T> >::iterator it =
+				queues_.begin();
+		for (; it != queues_.end(); ++it){
+			if (!(it->second).empty()){
+				T data = ONPOSIX_MOVE((it->second).front());
+				(it->second).pop();
+				return data;
+			}
+		}
+		assert(false);
+		//Just to silent the compiler
+		T data;
+		return data;
+	}
+
+	/**
+	 * \brief Removes all the elements and the priorities
+	 */
+	void clear() {
+		std::map<_Priority, std::queue<T> > empty;
+		std::swap(queues_, empty);
+	}
+};
+
+/**
+ * \brief Elements of PosixPrioritySharedQueue, for integral priorities.
+ *
+ * Each priority between the lowest and the highest added ones has a ring
+ * buffer in a flat array, indexed by the distance from the lowest
+ * priority. A two-level bitmap tells which rings are not empty, so that
+ * both insertion and extraction take constant time (the highest priority
+ * is found by counting trailing zeros). When the added priorities span
+ * more than MAX_LEVELS values, the elements are moved to the map of the
+ * generic version, which is used until clear().
+ */
+template<typename T, typename _Priority>
+class PriorityLevels<T, _Priority, true> {
+
+public:
+	/**
+	 * \brief Maximum distance between the lowest and the highest priority
+	 */
+	static const unsigned long int MAX_LEVELS = 64 * 64;
+
+private:
+	/**
+	 * \brief Growable FIFO ring of the elements of one priority
+	 */
+	struct Ring {
+		std::vector<T> buffer_;
+		size_t head_;
+		size_t count_;
+		bool added_;
+
+		Ring(): head_(0), count_(0), added_(false) {}
+
+		void push(const T& data) {
+			if (count_ == buffer_.size())
+				grow();
+			buffer_[(head_ + count_) & (buffer_.size() - 1)] = data;
+			++count_;
+		}
+
+#ifdef ONPOSIX_MOVE_SEMANTICS
+		template<typename... Args>
+		void emplace(Args&&... args) {
+			if (count_ == buffer_.size())
+				grow();
+			buffer_[(head_ + count_) & (buffer_.size() - 1)] =
+			    T(std::forward<Args>(args)...);
+			++count_;
+		}
+#endif
+
+		T pop() {
+			T data = ONPOSIX_MOVE(buffer_[head_]);
+			// Release the resources of the element
+			buffer_[head_] = T();
+			head_ = (head_ + 1) & (buffer_.size() - 1);
+			--count_;
+			return data;
+		}
+
+		void grow() {
+			std::vector<T> bigger (buffer_.empty() ? 8 :
+			    2 * buffer_.size());
+			for (size_t i = 0; i < count_; ++i)
+				bigger[i] = ONPOSIX_MOVE(buffer_[(head_ + i) &
+				    (buffer_.size() - 1)]);
+			buffer_.swap(bigger);
+			head_ = 0;
+		}
+	};
+
+	std::vector<Ring> levels_;
+
+	/**
+	 * \brief Levels used when the priorities are too far apart
+	 */
+	PriorityLevels<T, _Priority, false> sparse_;
+
+	/**
+	 * \brief If sparse_ is used instead of levels_
+	 */
+	bool isSparse_;
+
+	/**
+	 * \brief Priority of levels_[0]
+	 */
+	_Priority lowest_;
+
+	/**
+	 * \brief Bit i of words_[w] is set if levels_[w * 64 + i] is not empty
+	 */
+	uint64_t words_[MAX_LEVELS / 64];
+
+	/**
+	 * \brief Bit w is set if words_[w] is not zero
+	 */
+	uint64_t summary_;
+
+	/**
+	 * \brief Distance of a priority from the lowest one
+	 */
+	static unsigned long long int distance(const _Priority& from,
+	    const _Priority& to) {
+		// Modular arithmetic, correct for any non-negative distance
+		return (unsigned long long int) to -
+		    (unsigned long long int) from;
+	}
+
+	void mark(size_t i) {
+		words_[i / 64] |= 1ULL << (i % 64);
+		summary_ |= 1ULL << (i / 64);
+	}
+
+	/**
+	 * \brief Ring of an added priority, or NULL
+	 */
+	Ring* find(const _Priority& prio) {
+		if (levels_.empty() || prio < lowest_)
+			return NULL;
+		unsigned long long int i = distance(lowest_, prio);
+		if (i >= levels_.size() || !levels_[(size_t) i].added_)
+			return NULL;
+		return &levels_[(size_t) i];
+	}
+
+	void unmark(size_t i) {
+		words_[i / 64] &= ~(1ULL << (i % 64));
+		if (words_[i / 64] == 0)
+			summary_ &= ~(1ULL << (i / 64));
+	}
+
+	/**
+	 * \brief Moves the priorities and the elements to sparse_, keeping
+	 * their order
+	 */
+	void toSparse() {
+		for (size_t i = 0; i < levels_.size(); ++i) {
+			if (!levels_[i].added_)
+				continue;
+			_Priority prio = (_Priority) (lowest_ + i);
+			sparse_.add(prio);
+			while (levels_[i].count_ > 0) {
+#ifdef ONPOSIX_MOVE_SEMANTICS
+				sparse_.emplace(prio, levels_[i].pop());
+#else
+				sparse_.push(levels_[i].pop(), prio);
+#endif
+			}
+		}
+		std::vector<Ring> empty;
+		levels_.swap(empty);
+		memset(words_, 0, sizeof(words_));
+		summary_ = 0;
+		isSparse_ = true;
+	}
+
+public:
+	PriorityLevels(): isSparse_(false), lowest_(0), summary_(0) {
+		memset(words_, 0, sizeof(words_));
+	}
+
+	/**
+	 * \brief Adds a priority, if not already existing
+	 */
+	void add(const _Priority& prio) {
+		if (isSparse_) {
+			sparse_.add(prio);
+			return;
+		}
+		if (levels_.empty()) {
+			lowest_ = prio;
+			levels_.resize(1);
+		} else if (prio < lowest_) {
+			unsigned long long int shift = distance(prio, lowest_);
+			if (shift + levels_.size() > MAX_LEVELS) {
+				toSparse();
+				sparse_.add(prio);
+				return;
+			}
+			// Shift the rings up, leaving empty rings at the bottom
+			size_t old = levels_.size();
+			levels_.resize(old + (size_t) shift);
+			for (size_t i = old; i > 0; --i)
+				std::swap(levels_[i - 1],
+				    levels_[i - 1 + (size_t) shift]);
+			lowest_ = prio;
+			// Rebuild the bitmap for the new indexes
+			memset(words_, 0, sizeof(words_));
+			summary_ = 0;
+			for (size_t i = 0; i < levels_.size(); ++i)
+				if (levels_[i].count_ > 0)
+					mark(i);
+		} else {
+			unsigned long long int i = distance(lowest_, prio);
+			if (i >= MAX_LEVELS) {
+				toSparse();
+				sparse_.add(prio);
+				return;
+			}
+			if (i >= levels_.size())
+				levels_.resize((size_t) i + 1);
+		}
+		levels_[(size_t) distance(lowest_, prio)].added_ = true;
+	}
+
+	/**
+	 * \brief Inserts an element
+	 *
+	 * @return false if the priority has not been added
+	 */
+	bool push(const T& data, const _Priority& prio) {
+		if (isSparse_)
+			return sparse_.push(data, prio);
+		Ring* r = find(prio);
+		if (r == NULL)
+			return false;
+		r->push(data);
+		mark(r - &levels_[0]);
+		return true;
+	}
+
+#ifdef ONPOSIX_MOVE_SEMANTICS
+	/**
+	 * \brief Inserts an element constructed from the given arguments
+	 *
+	 * @return false if the priority has not been added
+	 */
+	template<typename... Args>
+	bool emplace(const _Priority& prio, Args&&... args) {
+		if (isSparse_)
+			return sparse_.emplace(prio, std::forward<Args>(args)...);
+		Ring* r = find(prio);
+		if (r == NULL)
+			return false;
+		r->emplace(std::forward<Args>(args)...);
+		mark(r - &levels_[0]);
+		return true;
+	}
+#endif
+
+	/**
+	 * \brief Removes the first of the highest priority elements
+	 *
+	 * There must be at least one element.
+	 */
+	T pop() {
+		if (isSparse_)
+			return sparse_.pop();
+		assert(summary_ != 0);
+		size_t w = __builtin_ctzll(summary_);
+		size_t i = w * 64 + __builtin_ctzll(words_[w]);
+		T data = levels_[i].pop();
+		if (levels_[i].count_ == 0)
+			unmark(i);
+		return data;
+	}
+
+	/**
+	 * \brief Removes all the elements and the priorities
+	 */
+	void clear() {
+		std::vector<Ring> empty;
+		levels_.swap(empty);
+		memset(words_, 0, sizeof(words_));
+		summary_ = 0;
+		sparse_.clear();
+		isSparse_ = false;
+	}
+};
+
 /** 
  * \brief Thread-safe FIFO priority queue class.
  *
  * No aging techniques are implemented, so that the low priority elements
- * can starve. The class is noncopyable. \n
+ * can starve. For integral priority types the elements are kept in ring
+ * buffers with a bitmap of the non-empty priorities (see PriorityLevels),
+ * so that push() and pop() take constant time as long as the added
+ * priorities span at most 4096 consecutive values (otherwise a map is
+ * used, as for the other types).
+ * With C++11 the elements are moved out of the queue, and they can be moved
+ * in with push(T&&) or constructed with emplace(), so that move-only types
+ * can be queued too. pop() blocks until an element is available; try_pop() never
+ * blocks and pop_until() blocks until a deadline at most. After close() the
+ * consumers do not wait anymore. The class is noncopyable. \n
  * The template paramaters are:
  * <ul>
  *		<li> T	is the type of the element in the queue
@@ -23,26 +393,43 @@ namespace onposix {
 template<typename T, typename _Priority = int>
 class PosixPrioritySharedQueue {
 
-	std::map< _Priority, std::queue<T> > queues_;
+	PriorityLevels<T, _Priority> queues_;
 	pthread_cond_t empty_;
 	mutable pthread_mutex_t mutex_;
 	size_t globalSize_;
+	bool closed_;
+
+	bool wait(const Time* deadline);
 
 	PosixPrioritySharedQueue(const PosixPrioritySharedQueue&);
 	PosixPrioritySharedQueue& operator=(const PosixPrioritySharedQueue&);
 
 public:
-	PosixPrioritySharedQueue();
+	explicit PosixPrioritySharedQueue(bool priorityInheritance = false);
 	~PosixPrioritySharedQueue();
 
 	void addQueue(const _Priority& prio);
 
 	void push(const T& data, const _Priority& prio);
 
+#ifdef ONPOSIX_MOVE_SEMANTICS
+	void push(T&& data, const _Priority& prio);
+
+	template<typename... Args>
+	void emplace(const _Priority& prio, Args&&... args);
+#endif
+
 	T pop();
 
-	void clear();
+	bool try_pop(T* data);
+
+	bool pop_until(T* data, const Time& deadline);
+
+	void close();
 
+	bool isClosed() const;
+
+	void clear();
 
 	size_t size() const;
 };
@@ -50,19 +437,29 @@ public:
 /**
  * \brief Constructor. Initialize the queue.
  *
+ * @param priorityInheritance If the mutex of the queue uses priority
+ * inheritance (PTHREAD_PRIO_INHERIT)
  * @exception runtime_error if the initialization fails.
  */
 template<typename T, typename _Priority>
-PosixPrioritySharedQueue<T, _Priority>::PosixPrioritySharedQueue():
-	globalSize_(0)
+PosixPrioritySharedQueue<T, _Priority>::PosixPrioritySharedQueue(
+    bool priorityInheritance):
+	globalSize_(0),
+	closed_(false)
 {
-	if (pthread_mutex_init(&mutex_, NULL) != 0)
+	int ret = PosixMutex::initialize(&mutex_, priorityInheritance);
+	if (ret != 0)
 		throw std::runtime_error(std::string("Mutex initialization: ") +
-								 strerror(errno));
-	if (pthread_cond_init(&empty_, NULL) != 0)
+								 strerror(ret));
+	// Timeouts are measured on the monotonic clock, as onposix::Time
+	pthread_condattr_t attr;
+	if ((pthread_condattr_init(&attr) != 0) ||
+	    (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) ||
+	    (pthread_cond_init(&empty_, &attr) != 0))
 		throw std::runtime_error(
 				std::string("Condition variable initialization: ") +
 				strerror(errno));
+	pthread_condattr_destroy(&attr);
 }
 
 /**
@@ -80,14 +477,14 @@ PosixPrioritySharedQueue<T, _Priority>::~PosixPrioritySharedQueue()
  *
  * If the priority already exists does nothing.
  * \param prio	The priority to be added.
+ * @exception runtime_error if the priority is integral and too far from
+ * the other ones.
  */
 template<typename T, typename _Priority>
 void PosixPrioritySharedQueue<T, _Priority>::addQueue(const _Priority &prio)
 {
 	PthreadMutexLocker lock(mutex_);
-	if (queues_.find(prio) == queues_.end())
-		queues_.insert(std::make_pair<_Priority, std::queue<T> >(
-						   prio, std::queue<T>()));
+	queues_.add(prio);
 }
 
 /** 
@@ -101,8 +498,44 @@ void PosixPrioritySharedQueue<T, _Priority>::push(const T& data,
 				const _Priority& prio)
 {
 	pthread_mutex_lock(&mutex_);
-	if (queues_.find(prio) != queues_.end()){
-		queues_[prio].push(data);
+	if (queues_.push(data, prio)){
+		++globalSize_;
+		pthread_mutex_unlock(&mutex_);
+		pthread_cond_signal(&empty_);
+		return;
+	}
+	pthread_mutex_unlock(&mutex_);
+}
+
+#ifdef ONPOSIX_MOVE_SEMANTICS
+/**
+ * \brief Insert an new element in the queue, moving it.
+ *
+ * @param data	The element to be moved in the queue.
+ * @param prio	The priority of the element.
+ */
+template<typename T, typename _Priority>
+void PosixPrioritySharedQueue<T, _Priority>::push(T&& data,
+				const _Priority& prio)
+{
+	emplace(prio, std::move(data));
+}
+
+/**
+ * \brief Insert an new element in the queue, constructing it in place.
+ *
+ * For integral priorities the element is constructed and then moved in
+ * the ring buffer of its priority.
+ * @param prio	The priority of the element.
+ * @param args	The arguments of the constructor of the element.
+ */
+template<typename T, typename _Priority>
+template<typename... Args>
+void PosixPrioritySharedQueue<T, _Priority>::emplace(const _Priority& prio,
+				Args&&... args)
+{
+	pthread_mutex_lock(&mutex_);
+	if (queues_.emplace(prio, std::forward<Args>(args)...)){
 		++globalSize_;
 		pthread_mutex_unlock(&mutex_);
 		pthread_cond_signal(&empty_);
@@ -110,49 +543,139 @@ void PosixPrioritySharedQueue<T, _Priority>::push(const T& data,
 	}
 	pthread_mutex_unlock(&mutex_);
 }
+#endif
+
+/**
+ * \brief Method to wait until the queue is not empty
+ *
+ * It must be called with the mutex held.
+ * @param deadline	Absolute time (CLOCK_MONOTONIC) of the timeout, or NULL
+ * to wait with no timeout.
+ * @return false if the queue is still empty because it has been closed or
+ * the deadline has expired
+ * @exception runtime_error if the wait fails.
+ */
+template<typename T, typename _Priority>
+bool PosixPrioritySharedQueue<T, _Priority>::wait(const Time* deadline)
+{
+	while (!globalSize_) {
+		if (closed_)
+			return false;
+		int ret;
+		if (deadline == NULL)
+			ret = pthread_cond_wait(&empty_, &mutex_);
+		else {
+			timespec ts;
+			ts.tv_sec = deadline->getSeconds();
+			ts.tv_nsec = deadline->getNSeconds();
+			ret = pthread_cond_timedwait(&empty_, &mutex_, &ts);
+		}
+		if (ret == ETIMEDOUT)
+			return globalSize_ != 0;
+		if (ret != 0)
+			throw std::runtime_error(
+					std::string("Condition variable wait: ") +
+					strerror(ret));
+	}
+	return true;
+}
 
 /** 
  * \brief Extract an element from the queue.
  * 
  * If the queue is empty the calling thread is blocked.
  * @return The first of the highest priority element in the queue.
+ * @exception runtime_error if the queue is empty and closed.
  */
 template<typename T, typename _Priority>
 T PosixPrioritySharedQueue<T, _Priority>::pop()
 {
 	PthreadMutexLocker lock(mutex_);
-	while (!globalSize_)
-		pthread_cond_wait(&empty_, &mutex_);
-	typename std::map<_Priority, std::queue<T> >::iterator it = queues_.begin();
-	typename std::map<_Priority, std::queue<T> >::iterator itEnd =
-			queues_.end();
-	for(; it != itEnd; ++it){
-		if (!(it->second).empty()){
-			T data = (it->second).front();
-			(it->second).pop();
-			--globalSize_;
-			return data;
-		}
+	if (!wait(NULL))
+		throw std::runtime_error("Queue closed");
+	--globalSize_;
+	return queues_.pop();
+}
+
+/**
+ * \brief Extract an element from the queue, if not empty.
+ *
+ * @param data	Where the first of the highest priority elements is stored.
+ * @return false if the queue is empty
+ */
+template<typename T, typename _Priority>
+bool PosixPrioritySharedQueue<T, _Priority>::try_pop(T* data)
+{
+	PthreadMutexLocker lock(mutex_);
+	if (!globalSize_)
+		return false;
+	*data = queues_.pop();
+	--globalSize_;
+	return true;
+}
+
+/**
+ * \brief Extract an element from the queue, waiting until a deadline.
+ *
+ * Blocks the calling thread while the queue is empty, until the deadline
+ * or until the queue is closed.
+ * @param data	Where the first of the highest priority elements is stored.
+ * @param deadline	Absolute time of the timeout, on the CLOCK_MONOTONIC
+ * clock (i.e., the default of onposix::Time).
+ * @return false if no element has been extracted
+ * @exception runtime_error if the wait fails.
+ */
+template<typename T, typename _Priority>
+bool PosixPrioritySharedQueue<T, _Priority>::pop_until(T* data,
+				const Time& deadline)
+{
+	PthreadMutexLocker lock(mutex_);
+	if (!wait(&deadline))
+		return false;
+	*data = queues_.pop();
+	--globalSize_;
+	return true;
+}
+
+/**
+ * \brief Closes the queue, waking up all the waiting threads.
+ *
+ * From now on the consumers do not wait for new elements anymore: the
+ * elements left can still be extracted, then pop() throws and the other
+ * methods return false.
+ */
+template<typename T, typename _Priority>
+void PosixPrioritySharedQueue<T, _Priority>::close()
+{
+	{
+		PthreadMutexLocker lock(mutex_);
+		closed_ = true;
 	}
-	assert(false);
-	//Just to silent the compiler
-	T data;
-	return data;
+	pthread_cond_broadcast(&empty_);
+}
+
+/**
+ * \brief Tells whether close() has been called
+ */
+template<typename T, typename _Priority>
+bool PosixPrioritySharedQueue<T, _Priority>::isClosed() const
+{
+	PthreadMutexLocker lock(mutex_);
+	return closed_;
 }
 
 /**
  * \brief Empties the queue. 
  *
  * In order to efficiently accomplish its task,
- * this function exchanges its content with an empty queue using the specialized
- * version of swap() implemented for the STL container std::map.
+ * this function exchanges its content with an empty one using swap(),
+ * so that the priorities are removed as well.
  */
 template<typename T, typename _Priority>
 void PosixPrioritySharedQueue<T, _Priority>::clear()
 {
 	PthreadMutexLocker lock(mutex_);
-	std::map<_Priority, std::queue<T> > empty;
-	std::swap(queues_, empty);
+	queues_.clear();
 	globalSize_ = 0;
 }
 
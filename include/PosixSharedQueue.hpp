@@ -27,6 +27,8 @@
 #include <errno.h>
 #include <string.h>
 #include "PosixMutex.hpp"
+#include "Move.hpp"
+#include "Time.hpp"
 #include "Assert.hpp"
 
 namespace onposix {
@@ -34,7 +36,15 @@ namespace onposix {
 /**
  * \brief Implementation of a thread safe FIFO queue class.
  *
+ * pop() blocks until an element is available; try_pop() never blocks and
+ * pop_until() blocks until a deadline at most. After close() the consumers
+ * do not wait anymore: the elements left can still be extracted, then
+ * pop() throws and the other methods return without any element.
+ *
  * The template parameter is the type of the elements contained in the queue.
+ * With C++11 the elements are moved out of the queue, and they can be moved
+ * in with push(T&&) or constructed in place with emplace(), so that
+ * move-only types (e.g., std::unique_ptr) can be queued too.
  * The class is non copyable and makes use of POSIX threads (pthreads).
  */
 template<typename T>
@@ -43,18 +53,42 @@ class PosixSharedQueue {
 	std::queue<T> queue_;
 	pthread_cond_t empty_;
 	mutable pthread_mutex_t mutex_;
+	bool closed_;
+
+	bool wait(const Time* deadline);
 
 	PosixSharedQueue(const PosixSharedQueue&);
 	PosixSharedQueue& operator=(const PosixSharedQueue&);
 
 public:
-	PosixSharedQueue();
+	explicit PosixSharedQueue(bool priorityInheritance = false);
 	~PosixSharedQueue();
 
 	void push(const T& data);
 
+#ifdef ONPOSIX_MOVE_SEMANTICS
+	void push(T&& data);
+
+	template<typename... Args>
+	void emplace(Args&&... args);
+#endif
+
+	template<typename InputIterator>
+	void pushBatch(InputIterator first, InputIterator last);
+
 	T pop();
 
+	template<typename OutputIterator>
+	size_t popBatch(OutputIterator out, size_t max);
+
+	bool try_pop(T* data);
+
+	bool pop_until(T* data, const Time& deadline);
+
+	void close();
+
+	bool isClosed() const;
+
 	void clear();
 
 	size_t size() const;
@@ -63,17 +97,26 @@ public:
 /**
  * \brief Constructor. Initialize the queue.
  *
+ * @param priorityInheritance If the mutex of the queue uses priority
+ * inheritance (PTHREAD_PRIO_INHERIT)
  * @exception runtime_error if the initialization fails.
  */
 template<typename T>
-PosixSharedQueue<T>::PosixSharedQueue()
+PosixSharedQueue<T>::PosixSharedQueue(bool priorityInheritance):
+	closed_(false)
 {
-	if (pthread_mutex_init(&mutex_, NULL) != 0)
+	int ret = PosixMutex::initialize(&mutex_, priorityInheritance);
+	if (ret != 0)
 		throw std::runtime_error(std::string("Mutex initialization: ") +
-								 strerror(errno));
-	if (pthread_cond_init(&empty_, NULL) != 0)
+								 strerror(ret));
+	// Timeouts are measured on the monotonic clock, as onposix::Time
+	pthread_condattr_t attr;
+	if ((pthread_condattr_init(&attr) != 0) ||
+	    (pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0) ||
+	    (pthread_cond_init(&empty_, &attr) != 0))
 		throw std::runtime_error(std::string("Condition variable initialization: ") +
 								 strerror(errno));
+	pthread_condattr_destroy(&attr);
 }
 
 /**
@@ -86,6 +129,40 @@ PosixSharedQueue<T>::~PosixSharedQueue()
 	VERIFY_ASSERTION(!pthread_cond_destroy(&empty_));
 }
 
+/**
+ * \brief Method to wait until the queue is not empty
+ *
+ * It must be called with the mutex held.
+ * @param deadline	Absolute time (CLOCK_MONOTONIC) of the timeout, or NULL
+ * to wait with no timeout.
+ * @return false if the queue is still empty because it has been closed or
+ * the deadline has expired
+ * @exception runtime_error if the wait fails.
+ */
+template<typename T>
+bool PosixSharedQueue<T>::wait(const Time* deadline)
+{
+	while (queue_.empty()) {
+		if (closed_)
+			return false;
+		int ret;
+		if (deadline == NULL)
+			ret = pthread_cond_wait(&empty_, &mutex_);
+		else {
+			timespec ts;
+			ts.tv_sec = deadline->getSeconds();
+			ts.tv_nsec = deadline->getNSeconds();
+			ret = pthread_cond_timedwait(&empty_, &mutex_, &ts);
+		}
+		if (ret == ETIMEDOUT)
+			return !queue_.empty();
+		if (ret != 0)
+			throw std::runtime_error(std::string("Condition variable wait: ") +
+									 strerror(ret));
+	}
+	return true;
+}
+
 /**
  * \brief Inserts an element in the queue
  *
@@ -101,25 +178,176 @@ void PosixSharedQueue<T>::push(const T &data)
 	pthread_cond_signal(&empty_);
 }
 
+#ifdef ONPOSIX_MOVE_SEMANTICS
+/**
+ * \brief Inserts an element in the queue, moving it
+ *
+ * @param data	The element to be moved in the queue.
+ */
+template<typename T>
+void PosixSharedQueue<T>::push(T&& data)
+{
+	{
+		PthreadMutexLocker lock(mutex_);
+		queue_.push(std::move(data));
+	}
+	pthread_cond_signal(&empty_);
+}
+
+/**
+ * \brief Inserts an element in the queue, constructing it in place
+ *
+ * @param args	The arguments of the constructor of the element.
+ */
+template<typename T>
+template<typename... Args>
+void PosixSharedQueue<T>::emplace(Args&&... args)
+{
+	{
+		PthreadMutexLocker lock(mutex_);
+		queue_.emplace(std::forward<Args>(args)...);
+	}
+	pthread_cond_signal(&empty_);
+}
+#endif
+
+/**
+ * \brief Inserts a range of elements in the queue
+ *
+ * The elements are inserted under a single lock acquisition, and the
+ * waiting threads are woken up once.
+ * @param first	Iterator to the first element to be added (a move iterator
+ * moves the elements in the queue).
+ * @param last	Iterator past the last element to be added.
+ */
+template<typename T>
+template<typename InputIterator>
+void PosixSharedQueue<T>::pushBatch(InputIterator first, InputIterator last)
+{
+	size_t n = 0;
+	{
+		PthreadMutexLocker lock(mutex_);
+		for (; first != last; ++first, ++n)
+			queue_.push(*first);
+	}
+	if (n == 1)
+		pthread_cond_signal(&empty_);
+	else if (n > 1)
+		pthread_cond_broadcast(&empty_);
+}
+
 /**
  * \brief Extracts an element from the queue.
  *
  * Blocks the calling thread if the queue is empty.
  * @return The first element in the queue.
+ * @exception runtime_error if the queue is empty and closed.
  */
 template<typename T>
 T PosixSharedQueue<T>::pop()
 {
 	PthreadMutexLocker lock(mutex_);
-	while (queue_.empty())
-		if (pthread_cond_wait(&empty_, &mutex_) != 0)
-			throw std::runtime_error(std::string("Condition variable wait: ") +
-									 strerror(errno));
-	T data = queue_.front();
+	if (!wait(NULL))
+		throw std::runtime_error("Queue closed");
+	T data = ONPOSIX_MOVE(queue_.front());
 	queue_.pop();
 	return data;
 }
 
+/**
+ * \brief Extracts many elements from the queue.
+ *
+ * Blocks the calling thread only until at least one element is available;
+ * then it extracts the available elements (up to max) under a single lock
+ * acquisition.
+ * @param out	Iterator where the elements are stored, in FIFO order.
+ * @param max	Maximum number of elements to be extracted.
+ * @return The number of elements extracted (0 if the queue is empty and
+ * closed).
+ */
+template<typename T>
+template<typename OutputIterator>
+size_t PosixSharedQueue<T>::popBatch(OutputIterator out, size_t max)
+{
+	if (max == 0)
+		return 0;
+	PthreadMutexLocker lock(mutex_);
+	if (!wait(NULL))
+		return 0;
+	size_t n = 0;
+	while (n < max && !queue_.empty()) {
+		*out = ONPOSIX_MOVE(queue_.front());
+		++out;
+		queue_.pop();
+		++n;
+	}
+	return n;
+}
+
+/**
+ * \brief Extracts an element from the queue, if not empty
+ *
+ * @param data	Where the element is stored.
+ * @return false if the queue is empty
+ */
+template<typename T>
+bool PosixSharedQueue<T>::try_pop(T* data)
+{
+	PthreadMutexLocker lock(mutex_);
+	if (queue_.empty())
+		return false;
+	*data = ONPOSIX_MOVE(queue_.front());
+	queue_.pop();
+	return true;
+}
+
+/**
+ * \brief Extracts an element from the queue, waiting until a deadline
+ *
+ * Blocks the calling thread while the queue is empty, until the deadline
+ * or until the queue is closed.
+ * @param data	Where the element is stored.
+ * @param deadline	Absolute time of the timeout, on the CLOCK_MONOTONIC
+ * clock (i.e., the default of onposix::Time).
+ * @return false if no element has been extracted
+ * @exception runtime_error if the wait fails.
+ */
+template<typename T>
+bool PosixSharedQueue<T>::pop_until(T* data, const Time& deadline)
+{
+	PthreadMutexLocker lock(mutex_);
+	if (!wait(&deadline))
+		return false;
+	*data = ONPOSIX_MOVE(queue_.front());
+	queue_.pop();
+	return true;
+}
+
+/**
+ * \brief Closes the queue, waking up all the waiting threads.
+ *
+ * From now on the consumers do not wait for new elements anymore.
+ */
+template<typename T>
+void PosixSharedQueue<T>::close()
+{
+	{
+		PthreadMutexLocker lock(mutex_);
+		closed_ = true;
+	}
+	pthread_cond_broadcast(&empty_);
+}
+
+/**
+ * \brief Tells whether close() has been called
+ */
+template<typename T>
+bool PosixSharedQueue<T>::isClosed() const
+{
+	PthreadMutexLocker lock(mutex_);
+	return closed_;
+}
+
 /**
  * \brief Empties the queue. 
  *
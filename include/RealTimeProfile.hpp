@@ -0,0 +1,131 @@
+/*
+ * RealTimeProfile.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef REALTIMEPROFILE_HPP_
+#define REALTIMEPROFILE_HPP_
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <vector>
+
+namespace onposix {
+
+/**
+ * \brief Setup of a real-time thread.
+ *
+ * The profile is given to AbstractThread::setRealTimeProfile() and applied
+ * by AbstractThread::start(), so the thread runs with its final settings
+ * since its first instruction:
+ * <ul>
+ * <li> scheduling policy, priority and CPU affinity are set in the
+ *	attributes of the new thread;
+ * <li> memory is locked (mlockall()), so pages are never swapped out and
+ *	new pages are populated when mapped;
+ * <li> the stack is extended and touched up to the given size before
+ *	run(), so it never grows through page faults.
+ * </ul>
+ * Priority inheritance is chosen for each mutex, when it is created (see
+ * PosixMutex and the constructors of the shared queues).
+ *
+ * Example of usage:
+ * \code
+ * RealTimeProfile p;
+ * p.setScheduling(SCHED_FIFO, 80).setStackPrefault(512*1024)
+ * 	.setMemoryLock(true);
+ * MyThread t;
+ * t.setRealTimeProfile(p);
+ * if (!t.start())
+ * 	// Not enough privileges (e.g., CAP_SYS_NICE, CAP_IPC_LOCK)
+ * \endcode
+ */
+class RealTimeProfile {
+
+	int policy_;
+	int priority_;
+	bool scheduling_;
+	std::vector<bool> affinity_;
+	unsigned long int stackPrefault_;
+	bool memoryLock_;
+
+public:
+	RealTimeProfile();
+
+	/**
+	 * \brief Method to set the scheduling policy and priority
+	 *
+	 * @param policy SCHED_FIFO, SCHED_RR or SCHED_OTHER
+	 * @param priority Priority (for SCHED_FIFO and SCHED_RR)
+	 */
+	inline RealTimeProfile& setScheduling(int policy, int priority) {
+		policy_ = policy;
+		priority_ = priority;
+		scheduling_ = true;
+		return *this;
+	}
+
+	/**
+	 * \brief Method to set the CPU affinity
+	 *
+	 * @param v: vector of booleans containing the affinity (true/false);
+	 * an empty vector keeps the affinity of the creating thread
+	 */
+	inline RealTimeProfile& setAffinity(const std::vector<bool>& v) {
+		affinity_ = v;
+		return *this;
+	}
+
+	/**
+	 * \brief Method to set the size of stack touched before run()
+	 *
+	 * The stack of the thread is enlarged if needed.
+	 */
+	inline RealTimeProfile& setStackPrefault(unsigned long int size) {
+		stackPrefault_ = size;
+		return *this;
+	}
+
+	/**
+	 * \brief Method to lock all the memory of the process when the thread
+	 * is started
+	 */
+	inline RealTimeProfile& setMemoryLock(bool lock) {
+		memoryLock_ = lock;
+		return *this;
+	}
+
+	/**
+	 * \brief Method to get the size of stack touched before run()
+	 */
+	inline unsigned long int getStackPrefault() const {
+		return stackPrefault_;
+	}
+
+	bool apply(pthread_attr_t* attr) const;
+
+	static bool lockMemory();
+	static void prefaultStack(unsigned long int size);
+};
+
+} /* onposix */
+
+#endif /* REALTIMEPROFILE_HPP_ */
@@ -0,0 +1,321 @@
+/*
+ * ThreadPool.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <deque>
+#include <vector>
+
+#include "AbstractThread.hpp"
+#include "PosixCondition.hpp"
+#include "PosixMutex.hpp"
+#include "WorkStealingDeque.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Base class of the tasks run by ThreadPool.
+ *
+ * It is allocated by ThreadPool::submit() and freed when both the pool and
+ * all the handles have released it.
+ */
+class ThreadPoolTask {
+
+	/**
+	 * \brief References held by the pool and by the handles
+	 */
+	int references_;
+
+	/**
+	 * \brief Set once execute() has returned
+	 */
+	int done_;
+
+	/**
+	 * \brief Set when a thread blocks waiting for this task
+	 */
+	int waited_;
+
+	friend class ThreadPool;
+
+	ThreadPoolTask(const ThreadPoolTask&);
+	ThreadPoolTask& operator=(const ThreadPoolTask&);
+
+public:
+	ThreadPoolTask(): references_(2), done_(0), waited_(0) {}
+	virtual ~ThreadPoolTask() {}
+
+	/**
+	 * \brief Body of the task
+	 */
+	virtual void execute() = 0;
+
+	/**
+	 * \brief Method to drop a reference, freeing the task on the last one
+	 */
+	inline void release() {
+		if (__atomic_sub_fetch(&references_, 1, __ATOMIC_ACQ_REL) == 0)
+			delete this;
+	}
+};
+
+/**
+ * \brief Task calling a function with an argument
+ */
+class ThreadPoolFunction: public ThreadPoolTask {
+	void (*function_)(void* arg);
+	void* arg_;
+public:
+	ThreadPoolFunction(void (*function)(void* arg), void* arg):
+	    function_(function),
+	    arg_(arg) {}
+
+	void execute() {
+		function_(arg_);
+	}
+};
+
+/**
+ * \brief Task calling a copy of a function object
+ */
+template<typename F>
+class ThreadPoolFunctor: public ThreadPoolTask {
+	F function_;
+public:
+	explicit ThreadPoolFunctor(const F& function): function_(function) {}
+
+	void execute() {
+		function_();
+	}
+};
+
+/**
+ * \brief Pool of worker threads with work stealing.
+ *
+ * Each worker owns a WorkStealingDeque: tasks submitted by a worker are
+ * pushed on its own deque and run in LIFO order, which keeps their data in
+ * cache; idle workers steal the oldest tasks from the other deques. Tasks
+ * submitted by other threads go through a shared injection queue.
+ * Workers that find no work spin for a few rounds and then sleep until a
+ * new task is submitted.
+ *
+ * Tasks must not throw exceptions. A task may submit further tasks and
+ * wait for them: a worker waiting on a handle runs other tasks meanwhile,
+ * so nested waits do not deadlock the pool.
+ * The destructor runs all the tasks still queued before joining the
+ * workers.
+ *
+ * The class is non copyable.
+ *
+ * Example of usage:
+ * \code
+ * void myfunction (void* arg);
+ *
+ * int main ()
+ * {
+ * 	ThreadPool pool (4);
+ * 	ThreadPool::Handle h = pool.submit(myfunction, (void*) 0);
+ * 	h.wait();
+ * }
+ * \endcode
+ */
+class ThreadPool {
+
+	class Worker;
+	friend class Worker;
+
+	/**
+	 * \brief Worker run by the calling thread, if any
+	 */
+	static __thread Worker* current_;
+
+	/**
+	 * \brief Worker threads
+	 */
+	std::vector<Worker*> workers_;
+
+	/**
+	 * \brief Tasks submitted by threads not belonging to the pool
+	 */
+	std::deque<ThreadPoolTask*> injected_;
+
+	/**
+	 * \brief Number of elements of injected_, read without the lock
+	 */
+	unsigned long int injectedCount_;
+
+	/**
+	 * \brief Lock protecting injected_
+	 */
+	PosixMutex injectedLock_;
+
+	/**
+	 * \brief Number of workers sleeping (or about to sleep) on idle_
+	 */
+	int sleepers_;
+
+	/**
+	 * \brief NUMA node of the workers (-1 if none)
+	 */
+	int node_;
+
+	/**
+	 * \brief Set by the destructor to terminate the workers
+	 */
+	bool stopping_;
+
+	/**
+	 * \brief Lock and condition used by the idle workers
+	 */
+	PosixMutex idleLock_;
+	PosixCondition idle_;
+
+	/**
+	 * \brief Lock and condition used by the threads waiting for a task
+	 */
+	PosixMutex finishedLock_;
+	PosixCondition finished_;
+
+	ThreadPool(const ThreadPool&);
+	ThreadPool& operator=(const ThreadPool&);
+
+	void schedule(ThreadPoolTask* task);
+	ThreadPoolTask* findTask(Worker* worker);
+	bool hasWork();
+	bool park();
+	void execute(ThreadPoolTask* task);
+	void wait(ThreadPoolTask* task);
+	void shutdown(unsigned int started);
+
+public:
+
+	/**
+	 * \brief Lightweight reference to a submitted task.
+	 *
+	 * It can be copied and destroyed freely; the task runs anyway.
+	 */
+	class Handle {
+
+		ThreadPool* pool_;
+		ThreadPoolTask* task_;
+
+		friend class ThreadPool;
+
+		Handle(ThreadPool* pool, ThreadPoolTask* task):
+		    pool_(pool),
+		    task_(task) {}
+
+	public:
+		Handle(): pool_(0), task_(0) {}
+
+		Handle(const Handle& h): pool_(h.pool_), task_(h.task_) {
+			if (task_ != 0)
+				__atomic_add_fetch(&task_->references_, 1,
+				    __ATOMIC_RELAXED);
+		}
+
+		Handle& operator=(const Handle& h) {
+			if (h.task_ != 0)
+				__atomic_add_fetch(&h.task_->references_, 1,
+				    __ATOMIC_RELAXED);
+			if (task_ != 0)
+				task_->release();
+			pool_ = h.pool_;
+			task_ = h.task_;
+			return *this;
+		}
+
+		~Handle() {
+			if (task_ != 0)
+				task_->release();
+		}
+
+		/**
+		 * \brief Method to know if the task has been run
+		 *
+		 * An empty handle is always done.
+		 */
+		inline bool isDone() const {
+			return (task_ == 0) ||
+			    __atomic_load_n(&task_->done_, __ATOMIC_ACQUIRE);
+		}
+
+		/**
+		 * \brief Method to block until the task has been run
+		 *
+		 * Called by a worker of the same pool, it runs other tasks
+		 * while waiting.
+		 */
+		inline void wait() {
+			if (!isDone())
+				pool_->wait(task_);
+		}
+	};
+
+	explicit ThreadPool(unsigned int threads = 0, int node = -1);
+	~ThreadPool();
+
+	Handle submit(void (*function)(void* arg), void* arg);
+
+	/**
+	 * \brief Method to submit a function object (e.g., a lambda)
+	 *
+	 * The object is copied and called without arguments on a worker.
+	 * @param function Function object
+	 * @return Handle of the task
+	 */
+	template<typename F>
+	Handle submit(const F& function) {
+		ThreadPoolTask* task = new ThreadPoolFunctor<F>(function);
+		schedule(task);
+		return Handle(this, task);
+	}
+
+	/**
+	 * \brief Method to get the NUMA node of the workers
+	 *
+	 * @return The node given to the constructor, or -1
+	 */
+	inline int getNode() const {
+		return node_;
+	}
+
+	/**
+	 * \brief Method to get the number of workers
+	 */
+	inline unsigned int getThreads() const {
+		return workers_.size();
+	}
+
+	bool isWorker() const;
+
+	static ThreadPool& getDefault();
+
+#if defined(ONPOSIX_LINUX_SPECIFIC) && defined(__GLIBC__) && \
+    ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ > 3)))
+	void setAffinity(unsigned int worker, const std::vector<bool>& v);
+	void setAffinity(const std::vector<bool>& v);
+#endif /* ONPOSIX_LINUX_SPECIFIC && GLIBC */
+};
+
+} /* onposix */
+
+#endif /* THREADPOOL_HPP_ */
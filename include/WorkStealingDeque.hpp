@@ -0,0 +1,263 @@
+/*
+ * WorkStealingDeque.hpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#ifndef WORKSTEALINGDEQUE_HPP_
+#define WORKSTEALINGDEQUE_HPP_
+
+#include <vector>
+
+namespace onposix {
+
+/**
+ * \brief Lock-free Chase-Lev work-stealing deque.
+ *
+ * The owner thread pushes and takes elements at the bottom (LIFO), without
+ * any atomic read-modify-write except when a single element is left; any
+ * other thread can steal elements from the top (FIFO) through a
+ * compare-and-swap.
+ * The array grows when full; the old arrays are kept until the destruction
+ * of the deque, since a thief may still be reading them.
+ *
+ * The template parameter must be a type that can be accessed atomically
+ * (e.g., a pointer). The class is non copyable.
+ *
+ * Example of usage:
+ * \code
+ * WorkStealingDeque<Task*> d;
+ * // Owner thread
+ * d.push(t);
+ * Task* mine;
+ * if (d.take(&mine))
+ * 	mine->run();
+ * // Other threads
+ * Task* stolen;
+ * if (d.steal(&stolen))
+ * 	stolen->run();
+ * \endcode
+ */
+template<typename T>
+class WorkStealingDeque {
+
+	/**
+	 * \brief Circular array of elements
+	 */
+	struct Array {
+		long int size;		///< Number of elements (power of 2)
+		T* data;		///< Elements
+
+		explicit Array(long int s): size(s), data(new T[s]) {}
+		~Array() {
+			delete[] data;
+		}
+
+		inline T get(long int i) const {
+			return __atomic_load_n(&data[i & (size - 1)],
+			    __ATOMIC_RELAXED);
+		}
+
+		inline void put(long int i, T v) {
+			__atomic_store_n(&data[i & (size - 1)], v,
+			    __ATOMIC_RELAXED);
+		}
+	};
+
+	/**
+	 * \brief Current array
+	 */
+	Array* array_;
+
+	/**
+	 * \brief Arrays replaced by grow(), freed by the destructor
+	 */
+	std::vector<Array*> retired_;
+
+	/**
+	 * \brief Padding giving top_ its own cache line, since it is
+	 * written by the thieves.
+	 *
+	 * Padding is used instead of an alignment attribute because new
+	 * does not honour extended alignments before C++17.
+	 */
+	char arrayPad_[64];
+
+	/**
+	 * \brief Index of the next element to be stolen
+	 */
+	long int top_;
+
+	char topPad_[64 - sizeof(long int)];
+
+	/**
+	 * \brief Index of the next free slot (written by the owner only)
+	 */
+	long int bottom_;
+
+	char bottomPad_[64 - sizeof(long int)];
+
+	WorkStealingDeque(const WorkStealingDeque&);
+	WorkStealingDeque& operator=(const WorkStealingDeque&);
+
+	Array* grow(Array* a, long int bottom, long int top);
+
+public:
+	explicit WorkStealingDeque(long int capacity = 256);
+	~WorkStealingDeque();
+
+	void push(T value);
+	bool take(T* value);
+	bool steal(T* value);
+
+	/**
+	 * \brief Method to get the approximate number of elements
+	 *
+	 * It can be called by any thread.
+	 */
+	inline long int size() const {
+		long int b = __atomic_load_n(&bottom_, __ATOMIC_SEQ_CST);
+		long int t = __atomic_load_n(&top_, __ATOMIC_SEQ_CST);
+		return (b > t) ? (b - t) : 0;
+	}
+};
+
+/**
+ * \brief Constructor.
+ *
+ * @param capacity Initial capacity, rounded up to a power of 2
+ */
+template<typename T>
+WorkStealingDeque<T>::WorkStealingDeque(long int capacity):
+    top_(0),
+    bottom_(0)
+{
+	long int size = 2;
+	while (size < capacity)
+		size *= 2;
+	array_ = new Array(size);
+}
+
+/**
+ * \brief Destructor. Frees all the arrays.
+ */
+template<typename T>
+WorkStealingDeque<T>::~WorkStealingDeque()
+{
+	for (unsigned int i = 0; i < retired_.size(); ++i)
+		delete retired_[i];
+	delete array_;
+}
+
+/**
+ * \brief Method to replace a full array with one of double size
+ *
+ * Called by the owner only.
+ */
+template<typename T>
+typename WorkStealingDeque<T>::Array* WorkStealingDeque<T>::grow(Array* a,
+    long int bottom, long int top)
+{
+	Array* bigger = new Array(a->size * 2);
+	for (long int i = top; i < bottom; ++i)
+		bigger->put(i, a->get(i));
+	retired_.push_back(a);
+	__atomic_store_n(&array_, bigger, __ATOMIC_RELEASE);
+	return bigger;
+}
+
+/**
+ * \brief Method to insert an element at the bottom
+ *
+ * It can be called by the owner thread only.
+ * @param value Element to be inserted
+ */
+template<typename T>
+void WorkStealingDeque<T>::push(T value)
+{
+	long int b = __atomic_load_n(&bottom_, __ATOMIC_RELAXED);
+	long int t = __atomic_load_n(&top_, __ATOMIC_ACQUIRE);
+	Array* a = __atomic_load_n(&array_, __ATOMIC_RELAXED);
+	if (b - t > a->size - 1)
+		a = grow(a, b, t);
+	a->put(b, value);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	__atomic_store_n(&bottom_, b + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Method to extract the element at the bottom (i.e., the most
+ * recently pushed)
+ *
+ * It can be called by the owner thread only.
+ * @param value Where the element is stored
+ * @return true if an element has been extracted; false if the deque is
+ * empty or the last element has been stolen meanwhile
+ */
+template<typename T>
+bool WorkStealingDeque<T>::take(T* value)
+{
+	long int b = __atomic_load_n(&bottom_, __ATOMIC_RELAXED) - 1;
+	Array* a = __atomic_load_n(&array_, __ATOMIC_RELAXED);
+	__atomic_store_n(&bottom_, b, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long int t = __atomic_load_n(&top_, __ATOMIC_RELAXED);
+	if (t > b) {
+		// Empty
+		__atomic_store_n(&bottom_, b + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+	*value = a->get(b);
+	if (t < b)
+		return true;
+
+	// Last element: race against the thieves
+	bool won = __atomic_compare_exchange_n(&top_, &t, t + 1, false,
+	    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+	__atomic_store_n(&bottom_, b + 1, __ATOMIC_RELAXED);
+	return won;
+}
+
+/**
+ * \brief Method to extract the element at the top (i.e., the least
+ * recently pushed)
+ *
+ * It can be called by any thread.
+ * @param value Where the element is stored
+ * @return true if an element has been extracted; false if the deque is
+ * empty or another thread has extracted the element meanwhile
+ */
+template<typename T>
+bool WorkStealingDeque<T>::steal(T* value)
+{
+	long int t = __atomic_load_n(&top_, __ATOMIC_ACQUIRE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	long int b = __atomic_load_n(&bottom_, __ATOMIC_ACQUIRE);
+	if (t >= b)
+		return false;
+	Array* a = __atomic_load_n(&array_, __ATOMIC_ACQUIRE);
+	T v = a->get(t);
+	if (!__atomic_compare_exchange_n(&top_, &t, t + 1, false,
+	    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+		return false;
+	*value = v;
+	return true;
+}
+
+} /* onposix */
+
+#endif /* WORKSTEALINGDEQUE_HPP_ */
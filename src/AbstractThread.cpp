@@ -21,13 +21,67 @@
 #include "AbstractThread.hpp"
 #include <unistd.h>
 #include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fstream>
 #include <strings.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <time.h>
 #include "Logger.hpp"
 #include <stdexcept>
 
 
 namespace onposix {
 
+pthread_mutex_t AbstractThread::threadsLock_ = PTHREAD_MUTEX_INITIALIZER;
+AbstractThread* AbstractThread::threads_ = 0;
+
+/**
+ * \brief Function to get the time on the CLOCK_MONOTONIC timeline (ns)
+ */
+static uint64_t monotonicTime()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * \brief Scoped lock of the list of threads, with cancellation disabled
+ *
+ * Some calls made with the lock held are cancellation points (e.g.,
+ * pthread_setname_np() on another thread): a thread cancelled by stop()
+ * there would keep the lock forever.
+ */
+class ThreadsLocker {
+	pthread_mutex_t& lock_;
+	int state_;
+public:
+	explicit ThreadsLocker(pthread_mutex_t& lock): lock_(lock) {
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &state_);
+		pthread_mutex_lock(&lock_);
+	}
+	~ThreadsLocker() {
+		pthread_mutex_unlock(&lock_);
+		pthread_setcancelstate(state_, NULL);
+	}
+};
+
+/**
+ * \brief Function to give a name to a thread
+ *
+ * The kernel keeps only the first 15 characters.
+ */
+static void applyName(pthread_t thread, const std::string& name)
+{
+	char n[16];
+	strncpy(n, name.c_str(), sizeof(n) - 1);
+	n[sizeof(n) - 1] = '\0';
+	pthread_setname_np(thread, n);
+}
+
 /**
  * \brief The static function representing the code executed in the thread context.
  * 
@@ -40,31 +94,123 @@ namespace onposix {
 void *AbstractThread::Execute(void* param)
 {
 	AbstractThread* th = reinterpret_cast<AbstractThread*>(param);
+
+	// The thread has been registered by start(), which releases the lock
+	// only after that
+	{
+		ThreadsLocker lock(threadsLock_);
+		th->tid_ = syscall(SYS_gettid);
+		if (!th->name_.empty())
+			applyName(th->self_, th->name_);
+	}
+
+	// Terminated() is called also when the thread is cancelled by stop()
+	pthread_cleanup_push(AbstractThread::Terminated, param);
 	pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+	th->arena_.reset();
+	Arena::current_ = &th->arena_;
+	RealTimeProfile::prefaultStack(th->profile_.getStackPrefault());
 	th->run();
+	pthread_cleanup_pop(1);
 	return 0;
 }
 
+/**
+ * \brief The static function called when the thread terminates.
+ *
+ * It stores the final statistics and removes the thread from the list of
+ * running threads.
+ * @param param The pointer to the concrete subclass.
+ */
+void AbstractThread::Terminated(void* param)
+{
+	AbstractThread* th = reinterpret_cast<AbstractThread*>(param);
+	Arena::current_ = 0;
+	struct timespec cpu;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+	struct rusage usage;
+	getrusage(RUSAGE_THREAD, &usage);
+
+	ThreadsLocker lock(threadsLock_);
+	th->final_.running = false;
+	th->final_.cpuTime = cpu.tv_sec * 1000000000ULL + cpu.tv_nsec;
+	th->final_.wallTime = monotonicTime() - th->startTime_;
+	th->final_.voluntarySwitches = usage.ru_nvcsw;
+	th->final_.involuntarySwitches = usage.ru_nivcsw;
+	th->unregister();
+}
+
 /**
  * \brief Constructor. Initialize the class attributes.
  */
 AbstractThread::AbstractThread():
-				isStarted_(false)
+				isStarted_(false),
+				tid_(0),
+				self_(),
+				startTime_(0),
+				prev_(0),
+				next_(0),
+				registered_(false)
 {
+	final_.tid = 0;
+	final_.running = false;
+	final_.cpuTime = 0;
+	final_.wallTime = 0;
+	final_.voluntarySwitches = 0;
+	final_.involuntarySwitches = 0;
 }
 
 
 /**
  * \brief Destructor.
  *
- * In case the thread is running, it stops the thread and prints an error
- * message.
+ * In case the thread is running, it stops the thread (waiting for its
+ * termination) and prints an error message. At this point the subclass
+ * has already been destroyed, so subclasses whose run() may still be
+ * executing should call stop() in their own destructor.
  */
 AbstractThread::~AbstractThread() {
 	if (isStarted_){
 		WARNING("Killing a running thread!");
 		stop();
 	}
+	ThreadsLocker lock(threadsLock_);
+	unregister();
+}
+
+/**
+ * \brief Method to add the thread to the list of running threads
+ *
+ * It must be called with threadsLock_ held.
+ */
+void AbstractThread::registerThread()
+{
+	if (registered_)
+		return;
+	prev_ = 0;
+	next_ = threads_;
+	if (threads_ != 0)
+		threads_->prev_ = this;
+	threads_ = this;
+	registered_ = true;
+}
+
+/**
+ * \brief Method to remove the thread from the list of running threads
+ *
+ * It must be called with threadsLock_ held.
+ */
+void AbstractThread::unregister()
+{
+	if (!registered_)
+		return;
+	if (prev_ != 0)
+		prev_->next_ = next_;
+	else
+		threads_ = next_;
+	if (next_ != 0)
+		next_->prev_ = prev_;
+	registered_ = false;
 }
 
 /**
@@ -72,17 +218,38 @@ AbstractThread::~AbstractThread() {
  *
  * If the thread is
  * already started this function does nothing.
+ * The real-time profile, if any, is applied before creating the thread.
  * @return true if the thread is started or it has been previously started;
- * false if an error occurs when starting the thread.
+ * false if an error occurs when starting the thread (e.g., not enough
+ * privileges for the real-time profile).
  */
 bool AbstractThread::start()
 {
 	if (isStarted_)
 		return true;
 
-	if (pthread_create(&handle_, NULL, AbstractThread::Execute,
-					   (void*)this) == 0)
-		isStarted_ = true;
+	pthread_attr_t attr;
+	if (pthread_attr_init(&attr) != 0)
+		return false;
+	if (!profile_.apply(&attr)) {
+		ERROR("Cannot apply the real-time profile: " << strerror(errno));
+		pthread_attr_destroy(&attr);
+		return false;
+	}
+	// The thread is registered here rather than by itself, so that the
+	// registry never refers to an object destroyed before the thread runs
+	{
+		ThreadsLocker lock(threadsLock_);
+		if (pthread_create(&handle_, &attr, AbstractThread::Execute,
+						   (void*)this) == 0) {
+			isStarted_ = true;
+			self_ = handle_;
+			startTime_ = monotonicTime();
+			final_.running = true;
+			registerThread();
+		}
+	}
+	pthread_attr_destroy(&attr);
 
 	return isStarted_;
 }
@@ -90,6 +257,12 @@ bool AbstractThread::start()
 /**
  * \brief Stops the running thread.
  *
+ * The thread is cancelled and, unless this method is called by the thread
+ * itself, it waits for the thread to terminate, because the termination
+ * still uses the object. Therefore the caller blocks until the thread
+ * reaches a cancellation point (e.g., checkTermination() or a blocking
+ * system call): a thread which never does makes this method (and the
+ * destructor) block forever.
  * @return true on success; false if an error occurs or the thread
  * is not running (i.e., it has not been started or it has been already stopped)
  */
@@ -102,11 +275,13 @@ bool AbstractThread::stop()
 
 	DEBUG("Cancelling thread...");
 	isStarted_ = false;
-	if (pthread_cancel(handle_) == 0){
-		DEBUG("Thread succesfully canceled.");
-		return true;
-	}
-	return false;
+	if (pthread_cancel(handle_) != 0)
+		return false;
+	if (!pthread_equal(handle_, pthread_self()) &&
+	    (pthread_join(handle_, NULL) != 0))
+		return false;
+	DEBUG("Thread succesfully canceled.");
+	return true;
 }
 
 /**
@@ -114,10 +289,14 @@ bool AbstractThread::stop()
  *
  * This method blocks the calling thread until the thread associated with
  * the AbstractThread object has finished execution
- * @return true on success, false if an error occurs.
+ * @return true on success, false if an error occurs or the thread is not
+ * running (i.e., it has not been started or it has been already stopped or
+ * waited for).
  */
 bool AbstractThread::waitForTermination()
 {
+	if (!isStarted_)
+		return false;
 	if (pthread_join(handle_, NULL) == 0){
 		DEBUG("Thread succesfully joined.");
 		isStarted_ = false;
@@ -260,6 +439,117 @@ bool AbstractThread::getSchedParam(int* policy, int* priority)
 }
 
 
+/**
+ * \brief Set the name of the thread
+ *
+ * The name is shown by tools like top and ps (only the first 15
+ * characters) and is reported by getStats(). It can be set before or
+ * after start().
+ * @param name Name of the thread
+ */
+void AbstractThread::setName(const std::string& name)
+{
+	ThreadsLocker lock(threadsLock_);
+	name_ = name;
+	if (registered_)
+		applyName(self_, name_);
+}
+
+/**
+ * \brief Method to fill the statistics of the thread
+ *
+ * It must be called with threadsLock_ held. The context switches of a
+ * running thread are read afterwards by readSwitches(), without the lock.
+ */
+void AbstractThread::fillStats(ThreadStats* s) const
+{
+	*s = final_;
+	s->name = name_;
+	s->tid = tid_;
+	if (!final_.running)
+		return;
+
+	clockid_t clock;
+	struct timespec t;
+	if ((pthread_getcpuclockid(self_, &clock) == 0) &&
+	    (clock_gettime(clock, &t) == 0))
+		s->cpuTime = t.tv_sec * 1000000000ULL + t.tv_nsec;
+	s->wallTime = monotonicTime() - startTime_;
+}
+
+/**
+ * \brief Function to read the context switches of a running thread
+ *
+ * The values are left unchanged if the thread has terminated meanwhile.
+ */
+static void readSwitches(ThreadStats* s)
+{
+	if (!s->running || s->tid == 0)
+		return;
+	char fileName[64];
+	snprintf(fileName, sizeof(fileName), "/proc/self/task/%d/status",
+	    (int) s->tid);
+	std::ifstream in (fileName);
+	std::string line;
+	while (std::getline(in, line)) {
+		unsigned long int n;
+		if (sscanf(line.c_str(), "voluntary_ctxt_switches: %lu",
+		    &n) == 1)
+			s->voluntarySwitches = n;
+		else if (sscanf(line.c_str(),
+		    "nonvoluntary_ctxt_switches: %lu", &n) == 1)
+			s->involuntarySwitches = n;
+	}
+}
+
+/**
+ * \brief Method to get the statistics of the thread
+ *
+ * Example of usage:
+ * \code
+ * ThreadStats s;
+ * if (t.getStats(&s))
+ * 	std::cout << s.name << ": " << s.cpuTime / 1000000 << " ms CPU, "
+ * 	    << s.involuntarySwitches << " preemptions" << std::endl;
+ * \endcode
+ * @param s Where the statistics are stored
+ * @return false if the thread has not run yet
+ */
+bool AbstractThread::getStats(ThreadStats* s) const
+{
+	bool ret;
+	{
+		ThreadsLocker lock(threadsLock_);
+		ret = (tid_ != 0);
+		if (ret)
+			fillStats(s);
+	}
+	if (ret)
+		readSwitches(s);
+	return ret;
+}
+
+/**
+ * \brief Method to get the statistics of all the running threads
+ *
+ * The list includes all threads derived from AbstractThread, such as the
+ * workers of PosixDescriptor and ThreadPool and the threads of the Logger.
+ * @param threads Where the statistics are stored (one element per thread)
+ */
+void AbstractThread::getThreads(std::vector<ThreadStats>* threads)
+{
+	threads->clear();
+	{
+		ThreadsLocker lock(threadsLock_);
+		for (AbstractThread* t = threads_; t != 0; t = t->next_) {
+			threads->push_back(ThreadStats());
+			t->fillStats(&threads->back());
+		}
+	}
+	for (unsigned int i = 0; i < threads->size(); ++i)
+		readSwitches(&(*threads)[i]);
+}
+
 #if defined(ONPOSIX_LINUX_SPECIFIC) && defined(__GLIBC__) && \
     ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ > 3)))
 /**
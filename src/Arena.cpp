@@ -0,0 +1,161 @@
+/*
+ * Arena.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstdlib>
+
+#include "Arena.hpp"
+
+namespace onposix {
+
+__thread Arena* Arena::current_ = 0;
+
+/**
+ * \brief Constructor. No memory is allocated until the first request.
+ *
+ * @param blockSize Size of the blocks taken from the heap
+ */
+Arena::Arena(unsigned long int blockSize):
+    blockSize_(blockSize),
+    block_(0),
+    top_(0),
+    end_(0),
+    large_(0),
+    sequence_(0),
+    used_(0),
+    largeUsed_(0)
+{
+}
+
+/**
+ * \brief Destructor. It frees all the memory.
+ */
+Arena::~Arena()
+{
+	reset();
+	for (unsigned int i = 0; i < blocks_.size(); ++i)
+		free(blocks_[i]);
+}
+
+/**
+ * \brief Method to move to the next block, allocating it if needed
+ *
+ * @exception std::bad_alloc if the memory is exhausted
+ */
+void Arena::nextBlock()
+{
+	if (block_ == blocks_.size()) {
+		char* b = reinterpret_cast<char*>(malloc(blockSize_));
+		if (b == 0)
+			throw std::bad_alloc();
+		blocks_.push_back(b);
+	}
+	top_ = blocks_[block_++];
+	end_ = top_ + blockSize_;
+}
+
+/**
+ * \brief Method to allocate a large request from the heap
+ *
+ * The header linking the allocations lies just before the returned
+ * memory.
+ * @exception std::bad_alloc if the memory is exhausted
+ */
+void* Arena::allocateLarge(unsigned long int size, unsigned long int align)
+{
+	if (align < 16)
+		align = 16;
+	unsigned long int header = (sizeof(Large) + align - 1) & ~(align - 1);
+	void* raw;
+	if (posix_memalign(&raw, align, header + size) != 0)
+		throw std::bad_alloc();
+	char* p = reinterpret_cast<char*>(raw) + header;
+	Large* l = reinterpret_cast<Large*>(p) - 1;
+	l->raw = raw;
+	l->size = size;
+	l->sequence = sequence_++;
+	l->prev = 0;
+	l->next = large_;
+	if (large_ != 0)
+		large_->prev = l;
+	large_ = l;
+	largeUsed_ += size;
+	return p;
+}
+
+/**
+ * \brief Method to release memory before rewinding
+ *
+ * Large requests go back to the heap at once; the memory of the last
+ * request of a block is reused by the next one. Otherwise, the memory is
+ * released only by rewind() or reset().
+ * @param p Memory returned by allocate()
+ * @param size Size given to allocate()
+ */
+void Arena::deallocate(void* p, unsigned long int size)
+{
+	if (size > (blockSize_ / 4)) {
+		Large* l = reinterpret_cast<Large*>(p) - 1;
+		if (l->prev != 0)
+			l->prev->next = l->next;
+		else
+			large_ = l->next;
+		if (l->next != 0)
+			l->next->prev = l->prev;
+		largeUsed_ -= l->size;
+		free(l->raw);
+	} else if (reinterpret_cast<char*>(p) + size == top_) {
+		top_ = reinterpret_cast<char*>(p);
+		used_ -= size;
+	}
+}
+
+/**
+ * \brief Method to release the memory allocated after a mark
+ *
+ * @param mark Value returned by getMark()
+ */
+void Arena::rewind(const Mark& mark)
+{
+	while ((large_ != 0) && (large_->sequence >= mark.sequence)) {
+		Large* l = large_;
+		large_ = l->next;
+		largeUsed_ -= l->size;
+		free(l->raw);
+	}
+	if (large_ != 0)
+		large_->prev = 0;
+	block_ = mark.block;
+	top_ = mark.top;
+	end_ = (block_ > 0) ? blocks_[block_ - 1] + blockSize_ : 0;
+	used_ = mark.used;
+}
+
+/**
+ * \brief Method to release all the memory allocated
+ *
+ * The blocks are kept for the next requests.
+ */
+void Arena::reset()
+{
+	Mark m = {0, 0, 0, 0};
+	rewind(m);
+}
+
+} /* onposix */
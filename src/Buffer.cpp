@@ -22,16 +22,20 @@
 #include <cstring>
 
 #include "Buffer.hpp"
+#include "ByteSearch.hpp"
+#include "Numa.hpp"
 
 namespace onposix {
 
+const unsigned long int Buffer::npos;
+
 /**
  * \brief Constructor. It checks size and allocates memory.
  *
  * @param size size of the buffer
  * @exception invalid_argument in case of wrong size
  */
-Buffer::Buffer(unsigned long int size): size_(size)
+Buffer::Buffer(unsigned long int size): size_(size), owner_(true), node_(-1)
 {
 	if (size == 0)
 		throw std::invalid_argument("Buffer with size 0");
@@ -39,14 +43,69 @@ Buffer::Buffer(unsigned long int size): size_(size)
 		data_ = new char[size_];
 }
 
+/**
+ * \brief Constructor. It allocates memory on a NUMA node.
+ *
+ * The memory is mapped directly and bound to the node (see
+ * Numa::allocate()), so its pages are allocated there when first touched,
+ * whatever thread touches them.
+ * @param size size of the buffer
+ * @param node NUMA node; -1 allocates as the other constructor
+ * @exception invalid_argument in case of wrong size
+ * @exception runtime_error if the memory cannot be bound to the node
+ */
+Buffer::Buffer(unsigned long int size, int node):
+    size_(size), owner_(true), node_(node)
+{
+	if (size == 0)
+		throw std::invalid_argument("Buffer with size 0");
+	else if (node_ < 0)
+		data_ = new char[size_];
+	else
+		data_ = reinterpret_cast<char*> (Numa::allocate(size_, node_));
+}
+
+/**
+ * \brief Constructor for derived classes. The buffer is empty until
+ * wrap() is called.
+ */
+Buffer::Buffer():
+    size_(0), data_(0), owner_(false), node_(-1)
+{
+}
+
+/**
+ * \brief Method for derived classes to wrap existing memory.
+ *
+ * It must be called only on a buffer built by the default constructor.
+ * The memory is not deallocated by the destructor: it is up to the
+ * derived class to release it.
+ * @param data pointer to the memory
+ * @param size size of the memory
+ * @exception invalid_argument in case of wrong size or NULL pointer
+ */
+void Buffer::wrap(char* data, unsigned long int size)
+{
+	if (size == 0)
+		throw std::invalid_argument("Buffer with size 0");
+	else if (data == 0)
+		throw std::invalid_argument("Buffer on NULL pointer");
+	size_ = size;
+	data_ = data;
+}
+
 /**
  * Destructor.
  * It deallocates memory.
  */
 Buffer::~Buffer()
 {
-	if (size_ != 0)
-		delete[] data_;
+	if (owner_ && size_ != 0) {
+		if (node_ >= 0)
+			Numa::release(data_, size_);
+		else
+			delete[] data_;
+	}
 }
 
 /**
@@ -146,6 +205,109 @@ bool Buffer::compare(const char* s, unsigned long int size)
 	return !memcmp(data_, s, size);
 }
 
+/**
+ * \brief Method to find the first occurrence of a byte
+ *
+ * The search is done through the vectorized kernels of ByteSearch.
+ * @param c byte to be found
+ * @param from position where the search starts
+ * @return position of the first occurrence; Buffer::npos if not found
+ * @see ByteSearch::findByte()
+ */
+unsigned long int Buffer::find(char c, unsigned long int from)
+{
+	if (from >= size_)
+		return npos;
+	unsigned long int ret = ByteSearch::findByte(data_+from, size_-from, c);
+	return (ret == size_-from) ? npos : from + ret;
+}
+
+/**
+ * \brief Method to find the first occurrence of a sequence of bytes
+ *
+ * The search is done through the vectorized kernels of ByteSearch.
+ * @param s pointer to the sequence to be found
+ * @param size size of the sequence
+ * @param from position where the search starts
+ * @return position of the first occurrence; Buffer::npos if not found
+ * @exception invalid_argument in case the sequence points to NULL
+ * @see ByteSearch::findSubstring()
+ */
+unsigned long int Buffer::find(const char* s, unsigned long int size,
+    unsigned long int from)
+{
+	if (s == 0)
+		throw std::invalid_argument("Attempt to search a NULL pointer");
+	if (from > size_ || size > size_ - from)
+		return npos;
+	unsigned long int ret = ByteSearch::findSubstring(data_+from,
+	    size_-from, s, size);
+	return (ret == size_-from) ? npos : from + ret;
+}
+
+/**
+ * \brief Method to find the first occurrence of any byte of a set
+ *
+ * This is useful for delimiter-based protocols (e.g., "\r\n").
+ * @param set pointer to the bytes to be found
+ * @param setSize number of bytes in the set
+ * @param from position where the search starts
+ * @return position of the first byte belonging to the set; Buffer::npos
+ * if not found
+ * @exception invalid_argument in case the set points to NULL
+ * @see ByteSearch::findAnyOf()
+ */
+unsigned long int Buffer::findAnyOf(const char* set,
+    unsigned long int setSize, unsigned long int from)
+{
+	if (set == 0)
+		throw std::invalid_argument("Attempt to search a NULL pointer");
+	if (from >= size_)
+		return npos;
+	unsigned long int ret = ByteSearch::findAnyOf(data_+from, size_-from,
+	    set, setSize);
+	return (ret == size_-from) ? npos : from + ret;
+}
+
+/**
+ * \brief Method to find the first byte that differs from another buffer
+ *
+ * @param b the buffer against whose content it must be compared
+ * @param size number of bytes to be compared
+ * @return position of the first different byte; Buffer::npos if the
+ * contents match
+ * @exception out_of_range in case the given size is greater than the size
+ * of one of the two buffers
+ * @see ByteSearch::mismatch()
+ */
+unsigned long int Buffer::mismatch(Buffer* b, unsigned long int size)
+{
+	if (size > size_ || size > b->getSize())
+		throw std::out_of_range("Operation on buffer out of boundary");
+	unsigned long int ret = ByteSearch::mismatch(data_, b->getBuffer(),
+	    size);
+	return (ret == size) ? npos : ret;
+}
+
+/**
+ * \brief Method to find the first byte that differs from a memory area
+ *
+ * @param s pointer to the memory address against whose content it must be
+ * compared
+ * @param size number of bytes to be compared
+ * @return position of the first different byte; Buffer::npos if the
+ * contents match
+ * @exception out_of_range in case the given size is greater than the buffer
+ * @see ByteSearch::mismatch()
+ */
+unsigned long int Buffer::mismatch(const char* s, unsigned long int size)
+{
+	if (size > size_)
+		throw std::out_of_range("Operation on buffer out of boundary");
+	unsigned long int ret = ByteSearch::mismatch(data_, s, size);
+	return (ret == size) ? npos : ret;
+}
+
 
 
 } /* onposix */
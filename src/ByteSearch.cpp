@@ -0,0 +1,529 @@
+/*
+ * ByteSearch.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstring>
+
+#include "ByteSearch.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ONPOSIX_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace onposix {
+
+/**
+ * \brief Table of kernels for a specific implementation
+ */
+struct kernels {
+	unsigned long int (*findByte) (const char*, unsigned long int, char);
+	unsigned long int (*findAnyOf) (const char*, unsigned long int,
+	    const char*, unsigned long int);
+	unsigned long int (*findSubstring) (const char*, unsigned long int,
+	    const char*, unsigned long int);
+	unsigned long int (*mismatch) (const char*, const char*,
+	    unsigned long int);
+	ByteSearch::Implementation impl;
+};
+
+
+// ======================================================================
+//   Scalar kernels
+// ======================================================================
+
+static unsigned long int scalarFindByte(const char* data,
+    unsigned long int size, char c)
+{
+	for (unsigned long int i = 0; i < size; ++i)
+		if (data[i] == c)
+			return i;
+	return size;
+}
+
+static unsigned long int scalarFindAnyOf(const char* data,
+    unsigned long int size, const char* set, unsigned long int setSize)
+{
+	bool table[256];
+	std::memset(table, 0, sizeof(table));
+	for (unsigned long int i = 0; i < setSize; ++i)
+		table[static_cast<unsigned char>(set[i])] = true;
+	for (unsigned long int i = 0; i < size; ++i)
+		if (table[static_cast<unsigned char>(data[i])])
+			return i;
+	return size;
+}
+
+static unsigned long int scalarFindSubstring(const char* data,
+    unsigned long int size, const char* needle,
+    unsigned long int needleSize)
+{
+	if (needleSize > size)
+		return size;
+	for (unsigned long int i = 0; i <= size - needleSize; ++i) {
+		unsigned long int j = 0;
+		while (j < needleSize && data[i+j] == needle[j])
+			++j;
+		if (j == needleSize)
+			return i;
+	}
+	return size;
+}
+
+static unsigned long int scalarMismatch(const char* a, const char* b,
+    unsigned long int size)
+{
+	for (unsigned long int i = 0; i < size; ++i)
+		if (a[i] != b[i])
+			return i;
+	return size;
+}
+
+static const kernels scalarKernels = {
+	scalarFindByte,
+	scalarFindAnyOf,
+	scalarFindSubstring,
+	scalarMismatch,
+	ByteSearch::SCALAR
+};
+
+
+#ifdef ONPOSIX_X86_SIMD
+
+/*
+ * Vector kernels are used for sets of at most this number of bytes;
+ * larger sets are handled by the scalar lookup table.
+ */
+#define MAX_SIMD_SET_SIZE 16
+
+// ======================================================================
+//   SSE2 kernels
+// ======================================================================
+
+__attribute__((target("sse2")))
+static unsigned long int sse2FindByte(const char* data,
+    unsigned long int size, char c)
+{
+	const __m128i v = _mm_set1_epi8(c);
+	unsigned long int i = 0;
+	// Unrolled loop: one branch every 64 bytes
+	for (; i + 64 <= size; i += 64) {
+		const __m128i* p = reinterpret_cast<const __m128i*>(data+i);
+		__m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128(p), v);
+		__m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128(p+1), v);
+		__m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128(p+2), v);
+		__m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128(p+3), v);
+		if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(e0, e1),
+		    _mm_or_si128(e2, e3))))
+			break;
+	}
+	for (; i + 16 <= size; i += 16) {
+		__m128i d = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i*>(data+i));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(d, v));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + scalarFindByte(data+i, size-i, c);
+}
+
+__attribute__((target("sse2")))
+static unsigned long int sse2FindAnyOf(const char* data,
+    unsigned long int size, const char* set, unsigned long int setSize)
+{
+	if (setSize > MAX_SIMD_SET_SIZE)
+		return scalarFindAnyOf(data, size, set, setSize);
+	if (setSize == 0)
+		return size;
+	__m128i v[MAX_SIMD_SET_SIZE];
+	for (unsigned long int j = 0; j < setSize; ++j)
+		v[j] = _mm_set1_epi8(set[j]);
+	unsigned long int i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i d = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i*>(data+i));
+		__m128i eq = _mm_cmpeq_epi8(d, v[0]);
+		for (unsigned long int j = 1; j < setSize; ++j)
+			eq = _mm_or_si128(eq, _mm_cmpeq_epi8(d, v[j]));
+		unsigned int mask = _mm_movemask_epi8(eq);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + scalarFindAnyOf(data+i, size-i, set, setSize);
+}
+
+/*
+ * Candidate positions are those where both the first and the last byte of
+ * the needle match; only those are verified with memcmp().
+ */
+__attribute__((target("sse2")))
+static unsigned long int sse2FindSubstring(const char* data,
+    unsigned long int size, const char* needle,
+    unsigned long int needleSize)
+{
+	if (needleSize > size)
+		return size;
+	if (needleSize < 2)
+		return (needleSize == 0) ? 0 : sse2FindByte(data, size, *needle);
+	const __m128i first = _mm_set1_epi8(needle[0]);
+	const __m128i last = _mm_set1_epi8(needle[needleSize-1]);
+	unsigned long int i = 0;
+	for (; i + needleSize - 1 + 16 <= size; i += 16) {
+		__m128i bf = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i*>(data+i));
+		__m128i bl = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i*>(data+i+needleSize-1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(
+		    _mm_cmpeq_epi8(bf, first), _mm_cmpeq_epi8(bl, last)));
+		while (mask) {
+			unsigned int bit = __builtin_ctz(mask);
+			if (!std::memcmp(data+i+bit+1, needle+1, needleSize-2))
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	unsigned long int ret = scalarFindSubstring(data+i, size-i, needle,
+	    needleSize);
+	return (ret == size-i) ? size : i + ret;
+}
+
+__attribute__((target("sse2")))
+static unsigned long int sse2Mismatch(const char* a, const char* b,
+    unsigned long int size)
+{
+	unsigned long int i = 0;
+	// Unrolled loop: one branch every 64 bytes
+	for (; i + 64 <= size; i += 64) {
+		const __m128i* pa = reinterpret_cast<const __m128i*>(a+i);
+		const __m128i* pb = reinterpret_cast<const __m128i*>(b+i);
+		__m128i e = _mm_and_si128(
+		    _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_loadu_si128(pa), _mm_loadu_si128(pb)),
+			_mm_cmpeq_epi8(_mm_loadu_si128(pa+1),
+			    _mm_loadu_si128(pb+1))),
+		    _mm_and_si128(
+			_mm_cmpeq_epi8(_mm_loadu_si128(pa+2),
+			    _mm_loadu_si128(pb+2)),
+			_mm_cmpeq_epi8(_mm_loadu_si128(pa+3),
+			    _mm_loadu_si128(pb+3))));
+		if (_mm_movemask_epi8(e) != 0xFFFF)
+			break;
+	}
+	for (; i + 16 <= size; i += 16) {
+		__m128i va = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i*>(a+i));
+		__m128i vb = _mm_loadu_si128(
+		    reinterpret_cast<const __m128i*>(b+i));
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+		if (mask != 0xFFFF)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + scalarMismatch(a+i, b+i, size-i);
+}
+
+static const kernels sse2Kernels = {
+	sse2FindByte,
+	sse2FindAnyOf,
+	sse2FindSubstring,
+	sse2Mismatch,
+	ByteSearch::SSE2
+};
+
+
+// ======================================================================
+//   AVX2 kernels
+// ======================================================================
+
+__attribute__((target("avx2")))
+static unsigned long int avx2FindByte(const char* data,
+    unsigned long int size, char c)
+{
+	const __m256i v = _mm256_set1_epi8(c);
+	unsigned long int i = 0;
+	// Unrolled loop: one branch every 128 bytes
+	for (; i + 128 <= size; i += 128) {
+		const __m256i* p = reinterpret_cast<const __m256i*>(data+i);
+		__m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(p), v);
+		__m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(p+1), v);
+		__m256i e2 = _mm256_cmpeq_epi8(_mm256_loadu_si256(p+2), v);
+		__m256i e3 = _mm256_cmpeq_epi8(_mm256_loadu_si256(p+3), v);
+		if (_mm256_movemask_epi8(_mm256_or_si256(
+		    _mm256_or_si256(e0, e1), _mm256_or_si256(e2, e3))))
+			break;
+	}
+	for (; i + 32 <= size; i += 32) {
+		__m256i d = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i*>(data+i));
+		unsigned int mask = _mm256_movemask_epi8(
+		    _mm256_cmpeq_epi8(d, v));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + sse2FindByte(data+i, size-i, c);
+}
+
+__attribute__((target("avx2")))
+static unsigned long int avx2FindAnyOf(const char* data,
+    unsigned long int size, const char* set, unsigned long int setSize)
+{
+	if (setSize > MAX_SIMD_SET_SIZE)
+		return scalarFindAnyOf(data, size, set, setSize);
+	if (setSize == 0)
+		return size;
+	__m256i v[MAX_SIMD_SET_SIZE];
+	for (unsigned long int j = 0; j < setSize; ++j)
+		v[j] = _mm256_set1_epi8(set[j]);
+	unsigned long int i = 0;
+	for (; i + 32 <= size; i += 32) {
+		__m256i d = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i*>(data+i));
+		__m256i eq = _mm256_cmpeq_epi8(d, v[0]);
+		for (unsigned long int j = 1; j < setSize; ++j)
+			eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(d, v[j]));
+		unsigned int mask = _mm256_movemask_epi8(eq);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	return i + sse2FindAnyOf(data+i, size-i, set, setSize);
+}
+
+__attribute__((target("avx2")))
+static unsigned long int avx2FindSubstring(const char* data,
+    unsigned long int size, const char* needle,
+    unsigned long int needleSize)
+{
+	if (needleSize > size)
+		return size;
+	if (needleSize < 2)
+		return (needleSize == 0) ? 0 : avx2FindByte(data, size, *needle);
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[needleSize-1]);
+	unsigned long int i = 0;
+	for (; i + needleSize - 1 + 32 <= size; i += 32) {
+		__m256i bf = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i*>(data+i));
+		__m256i bl = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i*>(data+i+needleSize-1));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(
+		    _mm256_cmpeq_epi8(bf, first),
+		    _mm256_cmpeq_epi8(bl, last)));
+		while (mask) {
+			unsigned int bit = __builtin_ctz(mask);
+			if (!std::memcmp(data+i+bit+1, needle+1, needleSize-2))
+				return i + bit;
+			mask &= mask - 1;
+		}
+	}
+	unsigned long int ret = sse2FindSubstring(data+i, size-i, needle,
+	    needleSize);
+	return (ret == size-i) ? size : i + ret;
+}
+
+__attribute__((target("avx2")))
+static unsigned long int avx2Mismatch(const char* a, const char* b,
+    unsigned long int size)
+{
+	unsigned long int i = 0;
+	// Unrolled loop: one branch every 128 bytes
+	for (; i + 128 <= size; i += 128) {
+		const __m256i* pa = reinterpret_cast<const __m256i*>(a+i);
+		const __m256i* pb = reinterpret_cast<const __m256i*>(b+i);
+		__m256i e = _mm256_and_si256(
+		    _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256(pa),
+			    _mm256_loadu_si256(pb)),
+			_mm256_cmpeq_epi8(_mm256_loadu_si256(pa+1),
+			    _mm256_loadu_si256(pb+1))),
+		    _mm256_and_si256(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256(pa+2),
+			    _mm256_loadu_si256(pb+2)),
+			_mm256_cmpeq_epi8(_mm256_loadu_si256(pa+3),
+			    _mm256_loadu_si256(pb+3))));
+		if (static_cast<unsigned int>(_mm256_movemask_epi8(e)) !=
+		    0xFFFFFFFFU)
+			break;
+	}
+	for (; i + 32 <= size; i += 32) {
+		__m256i va = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i*>(a+i));
+		__m256i vb = _mm256_loadu_si256(
+		    reinterpret_cast<const __m256i*>(b+i));
+		unsigned int mask = _mm256_movemask_epi8(
+		    _mm256_cmpeq_epi8(va, vb));
+		if (mask != 0xFFFFFFFFU)
+			return i + __builtin_ctz(~mask);
+	}
+	return i + sse2Mismatch(a+i, b+i, size-i);
+}
+
+static const kernels avx2Kernels = {
+	avx2FindByte,
+	avx2FindAnyOf,
+	avx2FindSubstring,
+	avx2Mismatch,
+	ByteSearch::AVX2
+};
+
+#endif /* ONPOSIX_X86_SIMD */
+
+
+// ======================================================================
+//   Runtime dispatch
+// ======================================================================
+
+/**
+ * \brief Kernels currently in use.
+ *
+ * Set the first time a kernel is invoked (or by setImplementation()).
+ * Accesses are atomic because the kernels can be invoked concurrently
+ * from different threads.
+ */
+static const kernels* current = 0;
+
+static const kernels* getKernels(ByteSearch::Implementation impl)
+{
+#ifdef ONPOSIX_X86_SIMD
+	if (impl == ByteSearch::AVX2)
+		return &avx2Kernels;
+	else if (impl == ByteSearch::SSE2)
+		return &sse2Kernels;
+#else
+	(void) impl;
+#endif
+	return &scalarKernels;
+}
+
+static inline const kernels* getCurrentKernels()
+{
+	const kernels* k = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+	if (k == 0) {
+		k = getKernels(ByteSearch::getBestImplementation());
+		__atomic_store_n(&current, k, __ATOMIC_RELEASE);
+	}
+	return k;
+}
+
+/**
+ * \brief Method to get the best implementation supported by the CPU
+ *
+ * @return The fastest implementation that can run on this CPU
+ */
+ByteSearch::Implementation ByteSearch::getBestImplementation()
+{
+#ifdef ONPOSIX_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return AVX2;
+	if (__builtin_cpu_supports("sse2"))
+		return SSE2;
+#endif
+	return SCALAR;
+}
+
+/**
+ * \brief Method to get the implementation currently in use
+ *
+ * @return The implementation used by the kernels
+ */
+ByteSearch::Implementation ByteSearch::getImplementation()
+{
+	return getCurrentKernels()->impl;
+}
+
+/**
+ * \brief Method to force a specific implementation
+ *
+ * This method is mainly useful for testing and benchmarking.
+ * @param impl Implementation to be used from now on
+ * @return true in case of success; false if the implementation is not
+ * supported by this CPU (in that case the current one is kept)
+ */
+bool ByteSearch::setImplementation(Implementation impl)
+{
+	if (impl > getBestImplementation())
+		return false;
+	__atomic_store_n(&current, getKernels(impl), __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * \brief Method to find the first occurrence of a byte
+ *
+ * @param data Pointer to the memory area to be searched
+ * @param size Size of the memory area
+ * @param c Byte to be found
+ * @return position of the first occurrence; size if not found
+ */
+unsigned long int ByteSearch::findByte(const char* data,
+    unsigned long int size, char c)
+{
+	return getCurrentKernels()->findByte(data, size, c);
+}
+
+/**
+ * \brief Method to find the first occurrence of any byte of a set
+ *
+ * Sets of up to 16 bytes are handled by the vector kernels;
+ * larger sets fall back to a scalar lookup table.
+ * @param data Pointer to the memory area to be searched
+ * @param size Size of the memory area
+ * @param set Pointer to the bytes to be found
+ * @param setSize Number of bytes in the set
+ * @return position of the first byte belonging to the set; size if not
+ * found
+ */
+unsigned long int ByteSearch::findAnyOf(const char* data,
+    unsigned long int size, const char* set, unsigned long int setSize)
+{
+	return getCurrentKernels()->findAnyOf(data, size, set, setSize);
+}
+
+/**
+ * \brief Method to find the first occurrence of a sequence of bytes
+ *
+ * @param data Pointer to the memory area to be searched
+ * @param size Size of the memory area
+ * @param needle Pointer to the sequence to be found
+ * @param needleSize Size of the sequence
+ * @return position of the first occurrence; size if not found
+ */
+unsigned long int ByteSearch::findSubstring(const char* data,
+    unsigned long int size, const char* needle,
+    unsigned long int needleSize)
+{
+	return getCurrentKernels()->findSubstring(data, size, needle,
+	    needleSize);
+}
+
+/**
+ * \brief Method to find the first position where two memory areas differ
+ *
+ * @param a Pointer to the first memory area
+ * @param b Pointer to the second memory area
+ * @param size Number of bytes to be compared
+ * @return position of the first different byte; size if the two areas
+ * are equal
+ */
+unsigned long int ByteSearch::mismatch(const char* a, const char* b,
+    unsigned long int size)
+{
+	return getCurrentKernels()->mismatch(a, b, size);
+}
+
+} /* onposix */
@@ -0,0 +1,444 @@
+/*
+ * Checksum.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstring>
+#include <stdexcept>
+#include <pthread.h>
+
+#include "Checksum.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ONPOSIX_X86_CRC
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#define ONPOSIX_ARM_CRC
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+namespace onposix {
+
+/**
+ * \brief Method to add a range of a Buffer to the checksum
+ *
+ * @param b Buffer containing the data
+ * @param offset Position of the first byte of the range
+ * @param size Number of bytes of the range
+ * @exception out_of_range in case the range exceeds the buffer
+ */
+void Checksum::update(Buffer* b, unsigned long int offset,
+    unsigned long int size)
+{
+	if (offset > b->getSize() || size > b->getSize() - offset)
+		throw std::out_of_range("Operation on buffer out of boundary");
+	update(b->getBuffer() + offset, size);
+}
+
+
+// ======================================================================
+//   CRC-32C
+// ======================================================================
+
+/// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78
+
+/**
+ * \brief Tables for the slicing-by-8 implementation.
+ *
+ * Filled only once, by initCrcTables().
+ */
+static uint32_t crcTables[8][256];
+static pthread_once_t crcTablesOnce = PTHREAD_ONCE_INIT;
+
+static void initCrcTables()
+{
+	for (unsigned int i = 0; i < 256; ++i) {
+		uint32_t c = i;
+		for (int k = 0; k < 8; ++k)
+			c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : (c >> 1);
+		crcTables[0][i] = c;
+	}
+	for (unsigned int i = 0; i < 256; ++i)
+		for (int t = 1; t < 8; ++t)
+			crcTables[t][i] = (crcTables[t-1][i] >> 8) ^
+			    crcTables[0][crcTables[t-1][i] & 0xFF];
+}
+
+static inline uint32_t readLe32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) |
+	    (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint32_t tableCrc(uint32_t crc, const unsigned char* p,
+    unsigned long int size)
+{
+	pthread_once(&crcTablesOnce, initCrcTables);
+	while (size >= 8) {
+		uint32_t lo = crc ^ readLe32(p);
+		uint32_t hi = readLe32(p+4);
+		crc = crcTables[7][lo & 0xFF] ^
+		    crcTables[6][(lo >> 8) & 0xFF] ^
+		    crcTables[5][(lo >> 16) & 0xFF] ^
+		    crcTables[4][lo >> 24] ^
+		    crcTables[3][hi & 0xFF] ^
+		    crcTables[2][(hi >> 8) & 0xFF] ^
+		    crcTables[1][(hi >> 16) & 0xFF] ^
+		    crcTables[0][hi >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while (size--)
+		crc = (crc >> 8) ^ crcTables[0][(crc ^ *p++) & 0xFF];
+	return crc;
+}
+
+#if defined(ONPOSIX_X86_CRC)
+
+__attribute__((target("sse4.2")))
+static uint32_t hardwareCrc(uint32_t crc, const unsigned char* p,
+    unsigned long int size)
+{
+	while (size > 0 && (reinterpret_cast<unsigned long int>(p) & 7)) {
+		crc = _mm_crc32_u8(crc, *p++);
+		--size;
+	}
+#if defined(__x86_64__)
+	uint64_t c = crc;
+	while (size >= 8) {
+		uint64_t v;
+		std::memcpy(&v, p, 8);
+		c = _mm_crc32_u64(c, v);
+		p += 8;
+		size -= 8;
+	}
+	crc = static_cast<uint32_t>(c);
+#endif
+	while (size >= 4) {
+		uint32_t v;
+		std::memcpy(&v, p, 4);
+		crc = _mm_crc32_u32(crc, v);
+		p += 4;
+		size -= 4;
+	}
+	while (size--)
+		crc = _mm_crc32_u8(crc, *p++);
+	return crc;
+}
+
+static bool hardwareCrcSupported()
+{
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse4.2");
+}
+
+#elif defined(ONPOSIX_ARM_CRC)
+
+__attribute__((target("+crc")))
+static uint32_t hardwareCrc(uint32_t crc, const unsigned char* p,
+    unsigned long int size)
+{
+	while (size > 0 && (reinterpret_cast<unsigned long int>(p) & 7)) {
+		crc = __crc32cb(crc, *p++);
+		--size;
+	}
+	while (size >= 8) {
+		uint64_t v;
+		std::memcpy(&v, p, 8);
+		crc = __crc32cd(crc, v);
+		p += 8;
+		size -= 8;
+	}
+	while (size--)
+		crc = __crc32cb(crc, *p++);
+	return crc;
+}
+
+static bool hardwareCrcSupported()
+{
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+
+#else
+
+static uint32_t hardwareCrc(uint32_t crc, const unsigned char* p,
+    unsigned long int size)
+{
+	return tableCrc(crc, p, size);
+}
+
+static bool hardwareCrcSupported()
+{
+	return false;
+}
+
+#endif
+
+typedef uint32_t (*crcFunction) (uint32_t, const unsigned char*,
+    unsigned long int);
+
+/**
+ * \brief Implementation currently in use (selected at first use).
+ */
+static crcFunction currentCrc = 0;
+
+static inline crcFunction getCrcFunction()
+{
+	crcFunction f = __atomic_load_n(&currentCrc, __ATOMIC_ACQUIRE);
+	if (f == 0) {
+		f = hardwareCrcSupported() ? &hardwareCrc : &tableCrc;
+		__atomic_store_n(&currentCrc, f, __ATOMIC_RELEASE);
+	}
+	return f;
+}
+
+/**
+ * \brief Method to add data to the CRC
+ *
+ * @param data Pointer to the data
+ * @param size Number of bytes
+ */
+void Crc32c::update(const void* data, unsigned long int size)
+{
+	state_ = getCrcFunction()(state_,
+	    reinterpret_cast<const unsigned char*>(data), size);
+}
+
+/**
+ * \brief Method to compute the CRC of a memory area in one shot
+ *
+ * @param data Pointer to the data
+ * @param size Number of bytes
+ * @return Value of the CRC
+ */
+uint32_t Crc32c::compute(const void* data, unsigned long int size)
+{
+	return ~getCrcFunction()(0xFFFFFFFF,
+	    reinterpret_cast<const unsigned char*>(data), size);
+}
+
+/**
+ * \brief Method to get the best implementation supported by the CPU
+ *
+ * @return HARDWARE if the CPU has crc32c instructions; TABLE otherwise
+ */
+Crc32c::Implementation Crc32c::getBestImplementation()
+{
+	return hardwareCrcSupported() ? HARDWARE : TABLE;
+}
+
+/**
+ * \brief Method to get the implementation currently in use
+ *
+ * @return The implementation used to compute CRCs
+ */
+Crc32c::Implementation Crc32c::getImplementation()
+{
+	return (getCrcFunction() == &tableCrc) ? TABLE : HARDWARE;
+}
+
+/**
+ * \brief Method to force a specific implementation
+ *
+ * This method is mainly useful for testing and benchmarking.
+ * @param impl Implementation to be used from now on
+ * @return true in case of success; false if the implementation is not
+ * supported by this CPU
+ */
+bool Crc32c::setImplementation(Implementation impl)
+{
+	if (impl > getBestImplementation())
+		return false;
+	__atomic_store_n(&currentCrc,
+	    (impl == HARDWARE) ? &hardwareCrc : &tableCrc, __ATOMIC_RELEASE);
+	return true;
+}
+
+
+// ======================================================================
+//   XXH64
+// ======================================================================
+
+static const uint64_t PRIME64_1 = 11400714785074694791ULL;
+static const uint64_t PRIME64_2 = 14029467366897019727ULL;
+static const uint64_t PRIME64_3 = 1609587929392839161ULL;
+static const uint64_t PRIME64_4 = 9650029242287828579ULL;
+static const uint64_t PRIME64_5 = 2870177450012600261ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t readLe64(const unsigned char* p)
+{
+	return readLe32(p) | (static_cast<uint64_t>(readLe32(p+4)) << 32);
+}
+
+static inline uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = rotl64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static inline uint64_t xxhMergeRound(uint64_t acc, uint64_t val)
+{
+	acc ^= xxhRound(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+/**
+ * \brief Constructor.
+ *
+ * @param seed Seed of the hash
+ */
+XxHash64::XxHash64(uint64_t seed): seed_(seed)
+{
+	reset();
+}
+
+/**
+ * \brief Method to restart the computation from scratch
+ *
+ * The seed given to the constructor is kept.
+ */
+void XxHash64::reset()
+{
+	v1_ = seed_ + PRIME64_1 + PRIME64_2;
+	v2_ = seed_ + PRIME64_2;
+	v3_ = seed_;
+	v4_ = seed_ - PRIME64_1;
+	totalLength_ = 0;
+	pendingSize_ = 0;
+}
+
+/**
+ * \brief Method to add data to the hash
+ *
+ * Data is consumed in stripes of 32 bytes; the remainder is kept until
+ * the next call.
+ * @param data Pointer to the data
+ * @param size Number of bytes
+ */
+void XxHash64::update(const void* data, unsigned long int size)
+{
+	const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+	const unsigned char* const end = p + size;
+	totalLength_ += size;
+
+	if (pendingSize_ + size < 32) {
+		std::memcpy(pending_ + pendingSize_, p, size);
+		pendingSize_ += size;
+		return;
+	}
+
+	if (pendingSize_ > 0) {
+		unsigned int fill = 32 - pendingSize_;
+		std::memcpy(pending_ + pendingSize_, p, fill);
+		v1_ = xxhRound(v1_, readLe64(pending_));
+		v2_ = xxhRound(v2_, readLe64(pending_+8));
+		v3_ = xxhRound(v3_, readLe64(pending_+16));
+		v4_ = xxhRound(v4_, readLe64(pending_+24));
+		p += fill;
+		pendingSize_ = 0;
+	}
+
+	// Local copies let the compiler keep the accumulators in registers
+	uint64_t v1 = v1_, v2 = v2_, v3 = v3_, v4 = v4_;
+	while (p + 32 <= end) {
+		v1 = xxhRound(v1, readLe64(p));
+		v2 = xxhRound(v2, readLe64(p+8));
+		v3 = xxhRound(v3, readLe64(p+16));
+		v4 = xxhRound(v4, readLe64(p+24));
+		p += 32;
+	}
+	v1_ = v1; v2_ = v2; v3_ = v3; v4_ = v4;
+
+	if (p < end) {
+		pendingSize_ = end - p;
+		std::memcpy(pending_, p, pendingSize_);
+	}
+}
+
+/**
+ * \brief Method to get the hash of the data added so far
+ *
+ * @return Value of the hash
+ */
+uint64_t XxHash64::getValue() const
+{
+	uint64_t h;
+	if (totalLength_ >= 32) {
+		h = rotl64(v1_, 1) + rotl64(v2_, 7) + rotl64(v3_, 12) +
+		    rotl64(v4_, 18);
+		h = xxhMergeRound(h, v1_);
+		h = xxhMergeRound(h, v2_);
+		h = xxhMergeRound(h, v3_);
+		h = xxhMergeRound(h, v4_);
+	} else {
+		h = seed_ + PRIME64_5;
+	}
+	h += totalLength_;
+
+	const unsigned char* p = pending_;
+	const unsigned char* const end = pending_ + pendingSize_;
+	while (p + 8 <= end) {
+		h ^= xxhRound(0, readLe64(p));
+		h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= static_cast<uint64_t>(readLe32(p)) * PRIME64_1;
+		h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * PRIME64_5;
+		h = rotl64(h, 11) * PRIME64_1;
+		++p;
+	}
+
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+/**
+ * \brief Method to compute the hash of a memory area in one shot
+ *
+ * @param data Pointer to the data
+ * @param size Number of bytes
+ * @param seed Seed of the hash
+ * @return Value of the hash
+ */
+uint64_t XxHash64::compute(const void* data, unsigned long int size,
+    uint64_t seed)
+{
+	XxHash64 h(seed);
+	h.update(data, size);
+	return h.getValue();
+}
+
+} /* onposix */
@@ -0,0 +1,341 @@
+/*
+ * CpuTopology.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "CpuTopology.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Function to read the first line of a sysfs file
+ *
+ * @return The line, or an empty string if the file cannot be read
+ */
+static std::string readLine(const std::string& fileName)
+{
+	std::ifstream in (fileName.c_str());
+	std::string line;
+	std::getline(in, line);
+	return line;
+}
+
+/**
+ * \brief Function to read an integer from a sysfs file
+ *
+ * @param def Value returned if the file cannot be read
+ */
+static int readInt(const std::string& fileName, int def)
+{
+	std::string line = readLine(fileName);
+	if (line.empty())
+		return def;
+	return atoi(line.c_str());
+}
+
+/**
+ * \brief Function to build the name of an entry of a sysfs directory
+ */
+static std::string entry(const std::string& dir, const char* prefix, int n,
+    const char* file)
+{
+	char tmp[64];
+	snprintf(tmp, sizeof(tmp), "/%s%d/%s", prefix, n, file);
+	return dir + tmp;
+}
+
+/**
+ * \brief Function to renumber keys from 0, in order of first appearance
+ */
+static int renumber(std::map<int, int>* numbers, int key)
+{
+	std::map<int, int>::iterator i = numbers->find(key);
+	if (i != numbers->end())
+		return i->second;
+	int n = numbers->size();
+	(*numbers)[key] = n;
+	return n;
+}
+
+/**
+ * \brief Function to compare CPUs by core and then by SMT sibling
+ */
+static bool byCore(const CpuTopology::Cpu& a, const CpuTopology::Cpu& b)
+{
+	if (a.core != b.core)
+		return a.core < b.core;
+	return a.thread < b.thread;
+}
+
+/**
+ * \brief Function to compare CPUs by SMT sibling and then by core
+ */
+static bool byThread(const CpuTopology::Cpu& a, const CpuTopology::Cpu& b)
+{
+	if (a.thread != b.thread)
+		return a.thread < b.thread;
+	return a.core < b.core;
+}
+
+/**
+ * \brief Constructor. Reads the topology.
+ *
+ * @param root Directory containing the cpu and node directories of sysfs
+ * (a different directory can be given for testing)
+ */
+CpuTopology::CpuTopology(const std::string& root):
+    cores_(0),
+    llcs_(0),
+    packages_(0),
+    maskSize_(0)
+{
+	std::string cpuDir = root + "/cpu";
+	std::vector<int> online = parseCpuList(readLine(cpuDir + "/online"));
+	if (online.empty()) {
+		long int n = sysconf(_SC_NPROCESSORS_ONLN);
+		for (long int i = 0; i < ((n > 0) ? n : 1); ++i)
+			online.push_back(i);
+	}
+
+	std::map<int, int> nodeOf;
+	std::string nodeDir = root + "/node";
+	std::vector<int> nodes = parseCpuList(readLine(nodeDir + "/online"));
+	for (unsigned int i = 0; i < nodes.size(); ++i) {
+		std::vector<int> list = parseCpuList(readLine(entry(nodeDir,
+		    "node", nodes[i], "cpulist")));
+		for (unsigned int j = 0; j < list.size(); ++j)
+			nodeOf[list[j]] = nodes[i];
+	}
+
+	std::map<int, int> coreNumbers, llcNumbers, packageNumbers;
+	for (unsigned int i = 0; i < online.size(); ++i) {
+		Cpu c;
+		c.id = online[i];
+
+		std::vector<int> siblings = parseCpuList(readLine(entry(cpuDir,
+		    "cpu", c.id, "topology/thread_siblings_list")));
+		std::vector<int>::iterator s = std::find(siblings.begin(),
+		    siblings.end(), c.id);
+		c.thread = (s != siblings.end()) ? (s - siblings.begin()) : 0;
+		c.core = renumber(&coreNumbers,
+		    siblings.empty() ? c.id : siblings[0]);
+
+		int package = readInt(entry(cpuDir, "cpu", c.id,
+		    "topology/physical_package_id"), 0);
+		c.package = renumber(&packageNumbers, package);
+
+		// The LLC is the highest level data or unified cache; without
+		// cache information, each package is an LLC group (negative
+		// keys, to not collide with CPU numbers)
+		int llcKey = -1 - package;
+		int llcLevel = 0;
+		for (int k = 0; ; ++k) {
+			std::string cache = entry(cpuDir, "cpu", c.id, "cache");
+			int level = readInt(entry(cache, "index", k, "level"), -1);
+			if (level < 0)
+				break;
+			if (readLine(entry(cache, "index", k, "type")) ==
+			    "Instruction" || level < llcLevel)
+				continue;
+			std::vector<int> shared = parseCpuList(readLine(
+			    entry(cache, "index", k, "shared_cpu_list")));
+			if (!shared.empty()) {
+				llcLevel = level;
+				llcKey = shared[0];
+			}
+		}
+		c.llc = renumber(&llcNumbers, llcKey);
+
+		std::map<int, int>::iterator n = nodeOf.find(c.id);
+		c.node = (n != nodeOf.end()) ? n->second : 0;
+		if (std::find(nodes_.begin(), nodes_.end(), c.node) ==
+		    nodes_.end())
+			nodes_.push_back(c.node);
+
+		cpus_.push_back(c);
+		if (static_cast<unsigned int>(c.id) + 1 > maskSize_)
+			maskSize_ = c.id + 1;
+	}
+	std::sort(nodes_.begin(), nodes_.end());
+	cores_ = coreNumbers.size();
+	llcs_ = llcNumbers.size();
+	packages_ = packageNumbers.size();
+}
+
+/**
+ * \brief Function to parse a list of CPUs in the sysfs format
+ * (e.g., "0-3,8,10-11")
+ *
+ * @return The CPU numbers, in the order of the list
+ */
+std::vector<int> CpuTopology::parseCpuList(const std::string& list)
+{
+	std::vector<int> cpus;
+	const char* p = list.c_str();
+	while (*p != '\0') {
+		char* end;
+		long int first = strtol(p, &end, 10);
+		if (end == p)
+			break;
+		long int last = first;
+		p = end;
+		if (*p == '-') {
+			last = strtol(p + 1, &end, 10);
+			if (end == p + 1)
+				break;
+			p = end;
+		}
+		for (long int i = first; i <= last; ++i)
+			cpus.push_back(i);
+		if (*p != ',')
+			break;
+		++p;
+	}
+	return cpus;
+}
+
+/**
+ * \brief Method to get the mask of the CPUs having a given value of a
+ * field
+ */
+std::vector<bool> CpuTopology::getMask(int Cpu::* field, int value) const
+{
+	std::vector<bool> mask (maskSize_, false);
+	for (unsigned int i = 0; i < cpus_.size(); ++i)
+		if (cpus_[i].*field == value)
+			mask[cpus_[i].id] = true;
+	return mask;
+}
+
+/**
+ * \brief Method to get the mask of a single CPU
+ */
+std::vector<bool> CpuTopology::getCpuMask(int cpu) const
+{
+	return getMask(&Cpu::id, cpu);
+}
+
+/**
+ * \brief Method to get the mask of the SMT siblings of a physical core
+ *
+ * @param core Index of the core (from 0 to getCores() - 1)
+ */
+std::vector<bool> CpuTopology::getCoreMask(int core) const
+{
+	return getMask(&Cpu::core, core);
+}
+
+/**
+ * \brief Method to get the mask of the CPUs sharing a last level cache
+ *
+ * @param llc Index of the LLC group (from 0 to getLlcs() - 1)
+ */
+std::vector<bool> CpuTopology::getLlcMask(int llc) const
+{
+	return getMask(&Cpu::llc, llc);
+}
+
+/**
+ * \brief Method to get the mask of the CPUs of a NUMA node
+ *
+ * @param node Number of the node
+ */
+std::vector<bool> CpuTopology::getNodeMask(int node) const
+{
+	return getMask(&Cpu::node, node);
+}
+
+/**
+ * \brief Placement with one thread per physical core
+ *
+ * Each thread may run on all SMT siblings of its core; with more threads
+ * than cores, the cores are reused in the same order.
+ * @param threads Number of threads
+ * @return One mask per thread
+ */
+std::vector<std::vector<bool> > CpuTopology::onePerCore(unsigned int threads)
+    const
+{
+	std::vector<std::vector<bool> > masks;
+	for (unsigned int i = 0; i < threads; ++i)
+		masks.push_back(getCoreMask(i % cores_));
+	return masks;
+}
+
+/**
+ * \brief Placement of the threads on CPUs as close as possible
+ *
+ * Each thread is pinned to a single CPU; the SMT siblings of a core are
+ * filled before moving to the next core.
+ * @param threads Number of threads
+ * @param node NUMA node to be used; -1 means all nodes
+ * @return One mask per thread
+ * @exception std::runtime_error if the node has no online CPU
+ */
+std::vector<std::vector<bool> > CpuTopology::compact(unsigned int threads,
+    int node) const
+{
+	std::vector<Cpu> list;
+	for (unsigned int i = 0; i < cpus_.size(); ++i)
+		if ((node < 0) || (cpus_[i].node == node))
+			list.push_back(cpus_[i]);
+	if (list.empty())
+		throw std::runtime_error("CpuTopology: no CPU on node");
+	std::stable_sort(list.begin(), list.end(), byCore);
+
+	std::vector<std::vector<bool> > masks;
+	for (unsigned int i = 0; i < threads; ++i)
+		masks.push_back(getCpuMask(list[i % list.size()].id));
+	return masks;
+}
+
+/**
+ * \brief Placement of the threads across the last level caches
+ *
+ * Each thread is pinned to a single CPU. Consecutive threads go to
+ * different LLC groups; inside a group, distinct cores are used before
+ * their SMT siblings.
+ * @param threads Number of threads
+ * @return One mask per thread
+ */
+std::vector<std::vector<bool> > CpuTopology::spread(unsigned int threads)
+    const
+{
+	std::vector<std::vector<Cpu> > groups (llcs_);
+	for (unsigned int i = 0; i < cpus_.size(); ++i)
+		groups[cpus_[i].llc].push_back(cpus_[i]);
+	for (unsigned int i = 0; i < groups.size(); ++i)
+		std::stable_sort(groups[i].begin(), groups[i].end(), byThread);
+
+	std::vector<std::vector<bool> > masks;
+	for (unsigned int i = 0; i < threads; ++i) {
+		const std::vector<Cpu>& g = groups[i % llcs_];
+		masks.push_back(getCpuMask(g[(i / llcs_) % g.size()].id));
+	}
+	return masks;
+}
+
+} /* onposix */
@@ -19,64 +19,238 @@
  */
 
 
+#include <cstring>
+#include <errno.h>
+#include <stdexcept>
+#include <vector>
+
 #include "DescriptorsMonitor.hpp"
 #include "AbstractDescriptorReader.hpp"
 #include "Logger.hpp"
 
+#ifdef ONPOSIX_LINUX_SPECIFIC
+#include <sys/epoll.h>
+#endif
+
 namespace onposix {
 
 /**
  * \brief Constructor.
- * It just initializes the set of descriptors.
+ * It just initializes the set of descriptors (i.e., the epoll instance).
+ * @exception runtime_error if the epoll instance cannot be created
  */
+#ifdef ONPOSIX_LINUX_SPECIFIC
+DescriptorsMonitor::DescriptorsMonitor(): alwaysReady_(0)
+{
+	epoll_ = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_ < 0) {
+		ERROR("epoll_create1()");
+		throw std::runtime_error("Descriptors monitor error");
+	}
+}
+#else
 DescriptorsMonitor::DescriptorsMonitor(): highestDescriptor_(0)
 {
 	FD_ZERO(&descriptorSet_);
+	FD_ZERO(&writeSet_);
 }
+#endif
 
 /**
  * \brief Destructor.
  *
- * It just deletes the data structure containing the association between
- * readers and monitored descriptors.
  * Note: it does not deletes the descriptors and the readers, because
  * they are just pointers to classes allocated somewhere else.
  */
 DescriptorsMonitor::~DescriptorsMonitor()
 {
-	for (std::vector<monitoredDescriptor*>::iterator i = descriptors_.begin();
-	    i != descriptors_.end(); ++i)
-			delete(*i);
+#ifdef ONPOSIX_LINUX_SPECIFIC
+	close(epoll_);
+#endif
 }
 
+#ifdef ONPOSIX_LINUX_SPECIFIC
 /**
- * \brief Method to start monitoring a descriptor.
+ * \brief Method to update the events monitored by epoll for a descriptor.
+ *
+ * Descriptors that epoll does not support (i.e., regular files) are
+ * marked as always ready, which is how select() reports them.
+ * @param fd descriptor number
+ * @param m readers of the descriptor
+ * @param op EPOLL_CTL_ADD, EPOLL_CTL_MOD or EPOLL_CTL_DEL
+ * @return true in case of success; false if epoll_ctl() fails
+ */
+bool DescriptorsMonitor::update(int fd, monitoredDescriptor& m, int op)
+{
+	if (m.alwaysReady_) {
+		if (op == EPOLL_CTL_DEL)
+			--alwaysReady_;
+		return true;
+	}
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	if (m.reader_ != 0)
+		ev.events |= EPOLLIN;
+	if (m.writer_ != 0)
+		ev.events |= EPOLLOUT;
+	ev.data.fd = fd;
+	if (epoll_ctl(epoll_, op, fd, &ev) == 0)
+		return true;
+	if (op == EPOLL_CTL_ADD && errno == EPERM) {
+		m.alwaysReady_ = true;
+		++alwaysReady_;
+		return true;
+	}
+	// A closed descriptor has already been removed by the kernel
+	if (op == EPOLL_CTL_DEL)
+		return true;
+	ERROR("epoll_ctl()");
+	return false;
+}
+#endif
+
+/**
+ * \brief Method to add a descriptor to a set of monitored descriptors.
  *
- * It is called by each class AbstractDescriptorReader that wants to be notified
- * about a specific descriptor.
  * @param reader class that wants to be notified
  * @param descriptor descriptor
- * @return true in case of success; false if the descriptor is already monitored
+ * @param write if the descriptor is monitored for write operations
+ * @return true in case of success; false if the descriptor is already
+ * monitored or it cannot be monitored
  */
-bool DescriptorsMonitor::startMonitoringDescriptor(AbstractDescriptorReader& reader,
-		PosixDescriptor& descriptor)
+bool DescriptorsMonitor::startMonitoring(AbstractDescriptorReader& reader,
+		PosixDescriptor& descriptor, bool write)
 {
-	if (FD_ISSET(descriptor.getDescriptorNumber(), &descriptorSet_)){
+	int fd = descriptor.getDescriptorNumber();
+#ifndef ONPOSIX_LINUX_SPECIFIC
+	if (fd < 0 || fd >= FD_SETSIZE) {
+		ERROR("Descriptor " << fd << " beyond FD_SETSIZE");
+		return false;
+	}
+#endif
+	std::map<int, monitoredDescriptor>::iterator i = descriptors_.find(fd);
+	bool added = (i == descriptors_.end());
+	if (added) {
+		monitoredDescriptor m;
+		memset(&m, 0, sizeof(m));
+		i = descriptors_.insert(std::make_pair(fd, m)).first;
+	}
+	monitoredDescriptor& m = i->second;
+	if ((write ? m.writer_ : m.reader_) != 0) {
 		ERROR("Descriptor already monitored by some reader");
 		return false;
 	}
-	monitoredDescriptor* n = new monitoredDescriptor;
-	n->descriptor_ = &descriptor;
-	n->reader_ = &reader;
-	descriptors_.push_back(n);
+	if (write) {
+		m.writer_ = &reader;
+		m.writeDescriptor_ = &descriptor;
+	} else {
+		m.reader_ = &reader;
+		m.descriptor_ = &descriptor;
+	}
 
-	FD_SET(descriptor.getDescriptorNumber(), &descriptorSet_);
+#ifdef ONPOSIX_LINUX_SPECIFIC
+	if (!update(fd, m, added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD)) {
+		if (write)
+			m.writer_ = 0;
+		else
+			m.reader_ = 0;
+		if (added)
+			descriptors_.erase(i);
+		return false;
+	}
+#else
+	FD_SET(fd, write ? &writeSet_ : &descriptorSet_);
+	if (highestDescriptor_ < fd)
+		highestDescriptor_ = fd;
+#endif
+	return true;
+}
 
-	if (highestDescriptor_ < descriptor.getDescriptorNumber())
-		highestDescriptor_ = descriptor.getDescriptorNumber();
+/**
+ * \brief Method to remove a descriptor from a set of monitored
+ * descriptors.
+ *
+ * @param descriptor descriptor
+ * @param write if the descriptor is monitored for write operations
+ * @return true in case of success; false if the descriptor was not
+ * monitored
+ */
+bool DescriptorsMonitor::stopMonitoring(PosixDescriptor& descriptor,
+		bool write)
+{
+	int fd = descriptor.getDescriptorNumber();
+	std::map<int, monitoredDescriptor>::iterator i = descriptors_.find(fd);
+	if (i == descriptors_.end() ||
+	    (write ? i->second.writer_ : i->second.reader_) == 0) {
+		ERROR("Descriptor was not monitored");
+		return false;
+	}
+	monitoredDescriptor& m = i->second;
+	if (write) {
+		m.writer_ = 0;
+		m.writeDescriptor_ = 0;
+	} else {
+		m.reader_ = 0;
+		m.descriptor_ = 0;
+	}
+
+#ifdef ONPOSIX_LINUX_SPECIFIC
+	if (m.reader_ == 0 && m.writer_ == 0) {
+		update(fd, m, EPOLL_CTL_DEL);
+		descriptors_.erase(i);
+	} else {
+		update(fd, m, EPOLL_CTL_MOD);
+	}
+#else
+	FD_CLR(fd, write ? &writeSet_ : &descriptorSet_);
+	if (m.reader_ == 0 && m.writer_ == 0)
+		descriptors_.erase(i);
+#endif
 	return true;
 }
 
+/**
+ * \brief Method to notify the readers of a descriptor.
+ *
+ * The descriptor is looked up again before each notification, because
+ * the previous notifications may have stopped monitoring it.
+ * @param fd descriptor number
+ * @param readable if the descriptor is ready for read operations
+ * @param writable if the descriptor is ready for write operations
+ */
+void DescriptorsMonitor::notify(int fd, bool readable, bool writable)
+{
+	std::map<int, monitoredDescriptor>::iterator i;
+	if (readable) {
+		i = descriptors_.find(fd);
+		if (i != descriptors_.end() && i->second.reader_ != 0) {
+			DEBUG("Notifying class...");
+			i->second.reader_->dataAvailable(*(i->second.descriptor_));
+		}
+	}
+	if (writable) {
+		i = descriptors_.find(fd);
+		if (i != descriptors_.end() && i->second.writer_ != 0)
+			i->second.writer_->writeAvailable(
+			    *(i->second.writeDescriptor_));
+	}
+}
+
+/**
+ * \brief Method to start monitoring a descriptor.
+ *
+ * It is called by each class AbstractDescriptorReader that wants to be notified
+ * about a specific descriptor.
+ * @param reader class that wants to be notified
+ * @param descriptor descriptor
+ * @return true in case of success; false if the descriptor is already monitored
+ */
+bool DescriptorsMonitor::startMonitoringDescriptor(AbstractDescriptorReader& reader,
+		PosixDescriptor& descriptor)
+{
+	return startMonitoring(reader, descriptor, false);
+}
+
 /**
  * \brief Method to stop monitoring a descriptor.
  *
@@ -89,70 +263,114 @@ bool DescriptorsMonitor::startMonitoringDescriptor(AbstractDescriptorReader& rea
  */
 bool DescriptorsMonitor::stopMonitoringDescriptor(PosixDescriptor& descriptor)
 {
-	if (!FD_ISSET(descriptor.getDescriptorNumber(), &descriptorSet_)){
-		ERROR("Descriptor was not monitored");
-		return false;
-	}
+	return stopMonitoring(descriptor, false);
+}
 
-	for (std::vector<monitoredDescriptor*>::iterator i = descriptors_.begin();
-	    i != descriptors_.end(); ++i)
-		if ((*i)->descriptor_->getDescriptorNumber() ==
-		    descriptor.getDescriptorNumber()) {
-			delete(*i);
-			descriptors_.erase(i);
-			break;
-		}
-	FD_CLR(descriptor.getDescriptorNumber(), &descriptorSet_);
-	return true;
+/**
+ * \brief Method to start monitoring a descriptor for write operations.
+ *
+ * The reader is notified through
+ * AbstractDescriptorReader::writeAvailable().
+ * @param reader class that wants to be notified
+ * @param descriptor descriptor
+ * @return true in case of success; false if the descriptor is already
+ * monitored for write operations
+ */
+bool DescriptorsMonitor::startMonitoringWritable(
+		AbstractDescriptorReader& reader, PosixDescriptor& descriptor)
+{
+	return startMonitoring(reader, descriptor, true);
+}
+
+/**
+ * \brief Method to stop monitoring a descriptor for write operations.
+ *
+ * @param descriptor whose notifications must be stopped
+ * @return true in case of success; false if the descriptor was not
+ * monitored for write operations
+ */
+bool DescriptorsMonitor::stopMonitoringWritable(PosixDescriptor& descriptor)
+{
+	return stopMonitoring(descriptor, true);
 }
 
 /**
  * \brief Method to wait until some descriptor becomes ready for read
- * operations.
+ * (or write) operations.
  *
  * It suspends the execution of the program until a descriptor becomes
  * ready.
- * @return true in case of success; false if selects() returns error
+ * @return true in case of success; false if epoll_wait() (or select())
+ * returns error
  */
 bool DescriptorsMonitor::wait()
 {
+#ifdef ONPOSIX_LINUX_SPECIFIC
+	struct epoll_event events[64];
+
+	// Descriptors that are always ready must not block the wait
+	int ret = epoll_wait(epoll_, events, 64, alwaysReady_ ? 0 : -1);
+	DEBUG("Epoll returned!");
+	if (ret == -1){
+		ERROR_RATE(10, 10, "epoll_wait()");
+		return false;
+	}
+
+	// The always-ready descriptors are collected before any notification,
+	// because AbstractDescriptorReader::dataAvailable() can start or
+	// stop monitoring further descriptors.
+	std::vector<int> ready;
+	if (alwaysReady_)
+		for (std::map<int, monitoredDescriptor>::iterator i =
+		    descriptors_.begin(); i != descriptors_.end(); ++i)
+			if (i->second.alwaysReady_)
+				ready.push_back(i->first);
+
+	for (int i = 0; i < ret; ++i) {
+		bool error = (events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+		notify(events[i].data.fd,
+		    error || (events[i].events & EPOLLIN),
+		    error || (events[i].events & EPOLLOUT));
+	}
+	for (std::vector<int>::iterator i = ready.begin(); i != ready.end(); ++i)
+		notify(*i, true, true);
+	return true;
+#else
 	// Additional variable needed because select() will change the set
 	fd_set fd = descriptorSet_;
+	fd_set wfd = writeSet_;
 
 	// We need this additional variable, because this method calls
 	// AbstractDescriptorReader::dataAvailable() which in turn can call
 	// DescriptorsMonitor::startMonitoringDescriptor() to start
 	// monitoring a further descriptor. This adds new descriptors to
 	// descriptors_ within the execution of this method, messing up things.
-	std::vector<monitoredDescriptor*> checkedDescriptors = descriptors_;
+	std::vector<int> checkedDescriptors;
+	for (std::map<int, monitoredDescriptor>::iterator i =
+	    descriptors_.begin(); i != descriptors_.end(); ++i)
+		checkedDescriptors.push_back(i->first);
 	int ret = select(highestDescriptor_+1,
 			&fd,
-			NULL,
+			&wfd,
 			NULL,
 			NULL);
 	DEBUG("Select returned!");
 	if (ret == -1){
 		// Error in select()
-		ERROR("select()");
+		ERROR_RATE(10, 10, "select()");
 		return false;
 	} else if (!ret) {
 		// Timeout
 		DEBUG("Timeout()");
 		return false;
 	} else {
-		// At least one descriptor is ready for read operations
-		for (std::vector<monitoredDescriptor*>::iterator i = 
-		    checkedDescriptors.begin();
-		    i != checkedDescriptors.end(); ++i) {
-			if (FD_ISSET((*i)->descriptor_->getDescriptorNumber(),
-			    &fd)) {
-				// Notify the class
-				DEBUG("Notifying class...");
-				((*i)->reader_)->dataAvailable(*((*i)->descriptor_));
-			}
-		}
+		// At least one descriptor is ready
+		for (std::vector<int>::iterator i = checkedDescriptors.begin();
+		    i != checkedDescriptors.end(); ++i)
+			notify(*i, FD_ISSET(*i, &fd), FD_ISSET(*i, &wfd));
 		return true;
 	}
+#endif
 }
 
 } /* onposix */
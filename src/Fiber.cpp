@@ -0,0 +1,246 @@
+/*
+ * Fiber.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <errno.h>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "Fiber.hpp"
+#include "Logger.hpp"
+
+namespace onposix {
+
+__thread FiberScheduler* FiberScheduler::current_ = 0;
+
+/**
+ * \brief Constructor
+ *
+ * @param dm Monitor used to wait for the descriptors
+ * @param stackSize Size of the stack of each fiber (rounded to pages)
+ */
+FiberScheduler::FiberScheduler(DescriptorsMonitor& dm,
+    unsigned long int stackSize):
+    AbstractDescriptorReader(dm),
+    monitor_(&dm),
+    pageSize_(sysconf(_SC_PAGESIZE)),
+    running_(0),
+    fibers_(0)
+{
+	stackSize_ = (stackSize + pageSize_ - 1) / pageSize_ * pageSize_;
+}
+
+/**
+ * \brief Destructor. It frees the stacks, including the ones of the fibers
+ * not terminated.
+ */
+FiberScheduler::~FiberScheduler()
+{
+	for (std::map<PosixDescriptor*, Fiber*>::iterator i = parked_.begin();
+	    i != parked_.end(); ++i)
+		stopMonitorDescriptor(*(i->first));
+	for (std::map<PosixDescriptor*, Fiber*>::iterator i = writers_.begin();
+	    i != writers_.end(); ++i)
+		stopMonitorWritable(*(i->first));
+	for (unsigned int i = 0; i < all_.size(); ++i) {
+		munmap(all_[i]->stack_, stackSize_ + pageSize_);
+		delete all_[i];
+	}
+}
+
+/**
+ * \brief Entry point of the fibers
+ *
+ * When it returns, run() is resumed through uc_link.
+ */
+void FiberScheduler::Trampoline()
+{
+	Fiber* f = current_->running_;
+	try {
+		f->function_(f->arg_);
+	} catch (std::exception& e) {
+		ERROR("Fiber terminated by exception: " << e.what());
+	} catch (...) {
+		ERROR("Fiber terminated by unknown exception");
+	}
+	f->finished_ = true;
+}
+
+/**
+ * \brief Method to create a fiber
+ *
+ * The fiber runs once run() is called (or, if called by a fiber, once
+ * the caller suspends).
+ * @param function Function run by the fiber
+ * @param arg Argument of the function
+ * @exception runtime_error if the stack cannot be allocated
+ */
+void FiberScheduler::spawn(void (*function)(void*), void* arg)
+{
+	Fiber* f;
+	if (!free_.empty()) {
+		f = free_.back();
+		free_.pop_back();
+	} else {
+		void* s = mmap(0, stackSize_ + pageSize_, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (s == MAP_FAILED)
+			throw std::runtime_error(std::string("Fiber stack: ") +
+			    strerror(errno));
+		// Guard page: an overflow faults instead of corrupting memory
+		mprotect(s, pageSize_, PROT_NONE);
+		f = new Fiber;
+		f->stack_ = reinterpret_cast<char*>(s);
+		all_.push_back(f);
+	}
+	getcontext(&f->context_);
+	f->context_.uc_stack.ss_sp = f->stack_ + pageSize_;
+	f->context_.uc_stack.ss_size = stackSize_;
+	f->context_.uc_link = &context_;
+	makecontext(&f->context_, FiberScheduler::Trampoline, 0);
+	f->function_ = function;
+	f->arg_ = arg;
+	f->finished_ = false;
+	ready_.push_back(f);
+	++fibers_;
+}
+
+/**
+ * \brief Method to run the fibers until all of them have terminated
+ *
+ * When no fiber is ready, it waits on the DescriptorsMonitor.
+ */
+void FiberScheduler::run()
+{
+	current_ = this;
+	while (fibers_ > 0) {
+		while (!ready_.empty()) {
+			Fiber* f = ready_.front();
+			ready_.pop_front();
+			running_ = f;
+			swapcontext(&context_, &f->context_);
+			running_ = 0;
+			if (f->finished_) {
+				free_.push_back(f);
+				--fibers_;
+			}
+		}
+		if (!parked_.empty() || !writers_.empty())
+			monitor_->wait();
+	}
+	current_ = 0;
+}
+
+/**
+ * \brief Method to switch from the running fiber back to run()
+ */
+void FiberScheduler::suspend()
+{
+	swapcontext(&running_->context_, &context_);
+}
+
+/**
+ * \brief Method called by the monitor when a descriptor is readable
+ *
+ * It resumes the fiber parked on the descriptor.
+ */
+void FiberScheduler::dataAvailable(PosixDescriptor& descriptor)
+{
+	std::map<PosixDescriptor*, Fiber*>::iterator i =
+	    parked_.find(&descriptor);
+	if (i == parked_.end())
+		return;
+	stopMonitorDescriptor(descriptor);
+	ready_.push_back(i->second);
+	parked_.erase(i);
+}
+
+/**
+ * \brief Method called by the monitor when a descriptor is writable
+ *
+ * It resumes the fiber parked on the descriptor.
+ */
+void FiberScheduler::writeAvailable(PosixDescriptor& descriptor)
+{
+	std::map<PosixDescriptor*, Fiber*>::iterator i =
+	    writers_.find(&descriptor);
+	if (i == writers_.end())
+		return;
+	stopMonitorWritable(descriptor);
+	ready_.push_back(i->second);
+	writers_.erase(i);
+}
+
+/**
+ * \brief Method to let the other ready fibers run
+ *
+ * It does nothing if the caller is not a fiber.
+ */
+void FiberScheduler::yield()
+{
+	if (!isFiber())
+		return;
+	current_->ready_.push_back(current_->running_);
+	current_->suspend();
+}
+
+/**
+ * \brief Method to suspend the calling fiber until a descriptor is
+ * readable
+ *
+ * It does nothing if the caller is not a fiber.
+ * @param descriptor Descriptor
+ * @exception runtime_error if the descriptor is already monitored or it
+ * cannot be monitored
+ */
+void FiberScheduler::waitReadable(PosixDescriptor& descriptor)
+{
+	if (!isFiber())
+		return;
+	FiberScheduler* s = current_;
+	if (!s->monitorDescriptor(descriptor))
+		throw std::runtime_error("Descriptor cannot be monitored");
+	s->parked_[&descriptor] = s->running_;
+	s->suspend();
+}
+
+/**
+ * \brief Method to suspend the calling fiber until a descriptor is
+ * writable
+ *
+ * It does nothing if the caller is not a fiber.
+ * @param descriptor Descriptor
+ * @exception runtime_error if the descriptor is already monitored for
+ * write operations or it cannot be monitored
+ */
+void FiberScheduler::waitWritable(PosixDescriptor& descriptor)
+{
+	if (!isFiber())
+		return;
+	FiberScheduler* s = current_;
+	if (!s->monitorWritable(descriptor))
+		throw std::runtime_error("Descriptor cannot be monitored");
+	s->writers_[&descriptor] = s->running_;
+	s->suspend();
+}
+
+} /* onposix */
@@ -0,0 +1,271 @@
+/*
+ * LogBinary.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "LogBinary.hpp"
+#include "LogClock.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Magic number at the beginning of binary log files
+ */
+static const char MAGIC[8] = {'O', 'N', 'P', 'X', 'L', 'O', 'G', '1'};
+
+/**
+ * \brief Current version of the format
+ */
+static const uint32_t VERSION = 2;
+
+/**
+ * \brief Function to round a size up to a multiple of 8 bytes
+ */
+static inline unsigned long int pad(unsigned long int size)
+{
+	return (size + 7) & ~7UL;
+}
+
+/**
+ * \brief Constructor. It creates the file and writes its header.
+ *
+ * The header also records the wall-clock time, to correlate it with the
+ * timestamps of the messages.
+ * @param name Name of the file
+ * @param initialTime Start of the program (as returned by LogClock::now()),
+ * used to print relative times
+ * @param preallocate Space allocated immediately for the file
+ * @exception runtime_error if the file cannot be created
+ */
+LogBinaryWriter::LogBinaryWriter(const std::string& name,
+    uint64_t initialTime, unsigned long int preallocate):
+    file_(name, false, preallocate),
+    nextSite_(0)
+{
+	LogBinaryHeader h;
+	memcpy(h.magic, MAGIC, sizeof(h.magic));
+	h.version = VERSION;
+	h.reserved = 0;
+	h.initialTime = initialTime;
+	h.wallTime = LogClock::getWallClock(&h.monotonic);
+	file_.write(&h, sizeof(h));
+}
+
+/**
+ * \brief Method to write the definition of a new call site
+ *
+ * @return Identifier of the call site
+ */
+uint32_t LogBinaryWriter::writeSite(const char* file, int line, int level,
+    const char* format)
+{
+	unsigned long int fileLength = strlen(file) + 1;
+	unsigned long int formatLength = strlen(format) + 1;
+	unsigned long int size = pad(sizeof(LogBinarySite) + fileLength +
+	    formatLength);
+	char* p = file_.reserve(size);
+	LogBinarySite* s = reinterpret_cast<LogBinarySite*>(p);
+	s->record.size = size;
+	s->record.type = LOG_BINARY_SITE;
+	s->id = nextSite_++;
+	s->line = line;
+	s->level = level;
+	s->fileLength = fileLength;
+	s->formatLength = formatLength;
+	s->reserved = 0;
+	p += sizeof(LogBinarySite);
+	memcpy(p, file, fileLength);
+	memcpy(p + fileLength, format, formatLength);
+	memset(p + fileLength + formatLength, 0,
+	    size - sizeof(LogBinarySite) - fileLength - formatLength);
+	return s->id;
+}
+
+/**
+ * \brief Method to reserve a message record
+ *
+ * @return Pointer where the arguments must be written
+ */
+char* LogBinaryWriter::reserveMessage(uint64_t timestamp, uint32_t thread,
+    uint32_t site, unsigned long int size)
+{
+	unsigned long int total = pad(sizeof(LogBinaryMessage) + size);
+	char* p = file_.reserve(total);
+	LogBinaryMessage* m = reinterpret_cast<LogBinaryMessage*>(p);
+	m->record.size = total;
+	m->record.type = LOG_BINARY_MESSAGE;
+	m->timestamp = timestamp;
+	m->site = site;
+	m->thread = thread;
+	p += sizeof(LogBinaryMessage);
+	memset(p + size, 0, total - sizeof(LogBinaryMessage) - size);
+	return p;
+}
+
+/**
+ * \brief Method to write a message logged through DEBUGF() & co.
+ *
+ * @param timestamp Time of the message, as returned by LogClock::now()
+ * @param thread Id of the thread that logged the message
+ * @param site Static descriptor of the call site
+ * @param args Arguments encoded through logArgsEncode()
+ * @param size Size of the arguments
+ * @exception runtime_error if the file cannot be extended
+ */
+void LogBinaryWriter::writeMessage(uint64_t timestamp, uint32_t thread,
+    const LogSite* site, const char* args, unsigned long int size)
+{
+	uint32_t id;
+	std::map<const LogSite*, uint32_t>::iterator i = sites_.find(site);
+	if (i != sites_.end()) {
+		id = i->second;
+	} else {
+		id = writeSite(site->file, site->line, site->level,
+		    site->format);
+		sites_[site] = id;
+	}
+	memcpy(reserveMessage(timestamp, thread, id, size), args, size);
+}
+
+/**
+ * \brief Method to write a message already formatted as text
+ *
+ * @param timestamp Time of the message, as returned by LogClock::now()
+ * @param thread Id of the thread that logged the message
+ * @param file Source file of the message
+ * @param line Source line of the message
+ * @param text Text of the message
+ * @param length Length of the text
+ * @exception runtime_error if the file cannot be extended
+ */
+void LogBinaryWriter::writeText(uint64_t timestamp, uint32_t thread,
+    const char* file, int line, const char* text, unsigned long int length)
+{
+	uint32_t id;
+	std::pair<std::string, int> key (file, line);
+	std::map<std::pair<std::string, int>, uint32_t>::iterator i =
+	    textSites_.find(key);
+	if (i != textSites_.end()) {
+		id = i->second;
+	} else {
+		id = writeSite(file, line, 0, "%s");
+		textSites_[key] = id;
+	}
+
+	// Same encoding of logArgEncode(const char*)
+	uint32_t l = length;
+	char* p = reserveMessage(timestamp, thread, id, 1 + sizeof(l) +
+	    length + 1);
+	*p = LOG_ARG_STRING;
+	memcpy(p + 1, &l, sizeof(l));
+	memcpy(p + 1 + sizeof(l), text, length);
+	p[1 + sizeof(l) + length] = '\0';
+}
+
+/**
+ * \brief Definition of a call site read from a binary log file
+ */
+struct DecodedSite {
+	std::string file;
+	int line;
+	std::string format;
+};
+
+/**
+ * \brief Function to convert a binary log file to text
+ *
+ * Each message is printed in the same format used for text log files,
+ * preceded by the correlation between relative and wall-clock time.
+ * @param name Name of the binary log file
+ * @param out Stream where the messages are printed
+ * @return true in case of success; false if the file cannot be read or it
+ * is not a binary log file
+ */
+bool decodeLogFile(const std::string& name, std::ostream& out)
+{
+	std::ifstream in (name.c_str(), std::ios::binary);
+	if (!in)
+		return false;
+	std::vector<char> data ((std::istreambuf_iterator<char>(in)),
+	    std::istreambuf_iterator<char>());
+	if (data.size() < sizeof(LogBinaryHeader))
+		return false;
+	const LogBinaryHeader* h =
+	    reinterpret_cast<const LogBinaryHeader*>(&data[0]);
+	if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0 ||
+	    h->version != VERSION)
+		return false;
+	uint64_t initialTime = h->initialTime;
+	std::string text;
+	formatLogTime(&text, h->monotonic, initialTime);
+	text.append(":[CLOCK]\t");
+	formatWallClock(&text, h->wallTime);
+	out << text << "\n";
+
+	std::map<uint32_t, DecodedSite> sites;
+	std::string message;
+	unsigned long int pos = sizeof(LogBinaryHeader);
+	while (pos + sizeof(LogBinaryRecord) <= data.size()) {
+		const LogBinaryRecord* r =
+		    reinterpret_cast<const LogBinaryRecord*>(&data[pos]);
+		if (r->size < sizeof(LogBinaryRecord) ||
+		    r->size > data.size() - pos)
+			break;
+		if (r->type == LOG_BINARY_SITE &&
+		    r->size >= sizeof(LogBinarySite)) {
+			const LogBinarySite* s =
+			    reinterpret_cast<const LogBinarySite*>(r);
+			if (s->fileLength + s->formatLength >
+			    r->size - sizeof(LogBinarySite))
+				break;
+			const char* p = reinterpret_cast<const char*>(s + 1);
+			DecodedSite& d = sites[s->id];
+			d.file.assign(p, s->fileLength - 1);
+			d.line = s->line;
+			d.format.assign(p + s->fileLength,
+			    s->formatLength - 1);
+		} else if (r->type == LOG_BINARY_MESSAGE &&
+		    r->size >= sizeof(LogBinaryMessage)) {
+			const LogBinaryMessage* m =
+			    reinterpret_cast<const LogBinaryMessage*>(r);
+			std::map<uint32_t, DecodedSite>::const_iterator s =
+			    sites.find(m->site);
+			if (s != sites.end()) {
+				message.clear();
+				formatLogMessage(&message,
+				    s->second.format.c_str(),
+				    reinterpret_cast<const char*>(m + 1),
+				    r->size - sizeof(LogBinaryMessage));
+				text.clear();
+				formatLogTime(&text, m->timestamp, initialTime);
+				out << text << ":" << message << "\t\t[" <<
+				    s->second.file << ":" << s->second.line <<
+				    "]\n";
+			}
+		}
+		pos += r->size;
+	}
+	return true;
+}
+
+} /* onposix */
@@ -0,0 +1,207 @@
+/*
+ * LogClock.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstdio>
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+#include "LogClock.hpp"
+
+namespace onposix {
+
+// Definition (and initialization) of static attributes
+LogClock::Source LogClock::source_ = LogClock::MONOTONIC;
+uint64_t LogClock::tscStart_ = 0;
+uint64_t LogClock::tscBase_ = 0;
+uint64_t LogClock::tscMult_ = 0;
+
+/**
+ * \brief Duration of the calibration of the TSC (ns)
+ */
+static const uint64_t CALIBRATION_NS = 10000000;
+
+static pthread_once_t calibrationOnce_ = PTHREAD_ONCE_INIT;
+
+/**
+ * \brief Function to read CLOCK_MONOTONIC in ns
+ */
+static inline uint64_t monotonic()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+/**
+ * \brief Function to know if the TSC is invariant
+ */
+static bool hasInvariantTsc()
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) == 0 ||
+	    eax < 0x80000007)
+		return false;
+	__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+	return (edx & (1 << 8)) != 0;
+}
+
+/**
+ * \brief Function to read at the same time the TSC and CLOCK_MONOTONIC
+ *
+ * @param ns Monotonic time (ns)
+ * @return TSC value read in the middle of clock_gettime()
+ */
+static uint64_t sample(uint64_t* ns)
+{
+	uint64_t before = __builtin_ia32_rdtsc();
+	*ns = monotonic();
+	uint64_t after = __builtin_ia32_rdtsc();
+	return before + (after - before)/2;
+}
+#endif
+
+/**
+ * \brief Method to compute the conversion from TSC ticks to ns
+ *
+ * It compares the TSC and CLOCK_MONOTONIC over a short interval.
+ */
+void LogClock::calibrate()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	uint64_t ns1, ns2;
+	uint64_t tsc1 = sample(&ns1);
+	struct timespec t = {0, static_cast<long>(CALIBRATION_NS)};
+	nanosleep(&t, 0);
+	uint64_t tsc2 = sample(&ns2);
+	if (tsc2 <= tsc1)
+		return;
+	tscMult_ = ((ns2 - ns1) << 32) / (tsc2 - tsc1);
+	tscStart_ = tsc2;
+	tscBase_ = ns2;
+#endif
+}
+
+/**
+ * \brief Method to get the most efficient source supported by the
+ * platform
+ *
+ * @return TSC if the TSC is invariant; MONOTONIC otherwise
+ */
+LogClock::Source LogClock::getBestSource()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	if (hasInvariantTsc())
+		return TSC;
+#endif
+	return MONOTONIC;
+}
+
+/**
+ * \brief Method to get the current source
+ *
+ * @return Current source (MONOTONIC by default)
+ */
+LogClock::Source LogClock::getSource()
+{
+	return __atomic_load_n(&source_, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * \brief Method to select the source
+ *
+ * The first time TSC is selected, the calibration blocks the caller for
+ * about 10 ms.
+ * @param source New source
+ * @return true in case of success; false if the source is not supported
+ */
+bool LogClock::setSource(Source source)
+{
+	if (source == TSC) {
+		if (getBestSource() != TSC)
+			return false;
+		pthread_once(&calibrationOnce_, calibrate);
+		if (tscMult_ == 0)
+			return false;
+	}
+	__atomic_store_n(&source_, source, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * \brief Method to read the wall clock and the current time at the same
+ * instant
+ *
+ * It is used to correlate timestamps and wall-clock time.
+ * @param monotonic Current time, as returned by now()
+ * @return Wall-clock time (ns since the Epoch)
+ */
+uint64_t LogClock::getWallClock(uint64_t* monotonic)
+{
+	uint64_t before = now();
+	struct timespec t;
+	clock_gettime(CLOCK_REALTIME, &t);
+	uint64_t after = now();
+	*monotonic = before + (after - before)/2;
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+/**
+ * \brief Function to append the time elapsed from the initial time, in
+ * seconds with nanosecond resolution (e.g., "12.000345678")
+ *
+ * Timestamps preceding the initial time are printed as 0.
+ * @param out String where the time is appended
+ * @param timestamp Time, as returned by LogClock::now()
+ * @param initialTime Reference time, as returned by LogClock::now()
+ */
+void formatLogTime(std::string* out, uint64_t timestamp, uint64_t initialTime)
+{
+	uint64_t elapsed = (timestamp > initialTime) ?
+	    (timestamp - initialTime) : 0;
+	char tmp[32];
+	out->append(tmp, snprintf(tmp, sizeof(tmp), "%llu.%09llu",
+	    static_cast<unsigned long long>(elapsed / 1000000000ULL),
+	    static_cast<unsigned long long>(elapsed % 1000000000ULL)));
+}
+
+/**
+ * \brief Function to append a wall-clock time in local time (e.g.,
+ * "2012-06-01 10:20:30.000345678 +0200")
+ *
+ * @param out String where the time is appended
+ * @param wallTime Nanoseconds since the Epoch
+ */
+void formatWallClock(std::string* out, uint64_t wallTime)
+{
+	time_t secs = wallTime / 1000000000ULL;
+	struct tm t;
+	localtime_r(&secs, &t);
+	char date[32], zone[8], tmp[64];
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &t);
+	strftime(zone, sizeof(zone), "%z", &t);
+	out->append(tmp, snprintf(tmp, sizeof(tmp), "%s.%09llu %s", date,
+	    static_cast<unsigned long long>(wallTime % 1000000000ULL), zone));
+}
+
+} /* onposix */
@@ -0,0 +1,220 @@
+/*
+ * LogFile.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cerrno>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "LogFile.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Constructor. It opens (or creates) the file.
+ *
+ * @param name Name of the file
+ * @param append If true, data is appended to the current content of the
+ * file; otherwise, the file is truncated
+ * @param preallocate Space allocated immediately for the data (0 to
+ * allocate the space of each window when it is mapped)
+ * @param windowSize Length of the windows mapped in memory
+ * @exception runtime_error if the file cannot be opened or allocated
+ */
+LogFile::LogFile(const std::string& name, bool append,
+    unsigned long int preallocate, unsigned long int windowSize):
+    name_(name),
+    window_(0),
+    windowOffset_(0),
+    windowLength_(0),
+    next_(0),
+    nextOffset_(0),
+    nextLength_(0),
+    retired_(0),
+    retiredLength_(0),
+    windowSize_(windowSize),
+    length_(0),
+    allocated_(0)
+{
+	fd_ = open(name.c_str(), O_RDWR|O_CREAT|(append ? 0 : O_TRUNC),
+	    S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH);
+	if (fd_ < 0)
+		throw std::runtime_error ("Open log file error");
+	struct stat st;
+	if (append && fstat(fd_, &st) == 0) {
+		length_ = st.st_size;
+		allocated_ = st.st_size;
+	}
+	try {
+		if (preallocate > allocated_)
+			allocate(preallocate);
+	} catch (std::runtime_error& e) {
+		::close(fd_);
+		throw;
+	}
+}
+
+/**
+ * \brief Destructor. It unmaps the window and truncates the file to the
+ * written length.
+ */
+LogFile::~LogFile()
+{
+	if (window_ != 0)
+		munmap(window_, windowLength_);
+	if (next_ != 0)
+		munmap(next_, nextLength_);
+	if (retired_ != 0)
+		munmap(retired_, retiredLength_);
+	if (ftruncate(fd_, length_) < 0) {
+		// Nothing to do: the tail of the file is just zero-filled
+	}
+	::close(fd_);
+}
+
+/**
+ * \brief Method to extend the file
+ *
+ * Blocks are allocated through fallocate(), if supported by the file
+ * system; otherwise the file is just extended (i.e., sparse).
+ * @param size New size of the file
+ * @exception runtime_error if the file cannot be extended
+ */
+void LogFile::allocate(unsigned long int size)
+{
+#ifdef __linux__
+	if (fallocate(fd_, 0, allocated_, size - allocated_) == 0) {
+		allocated_ = size;
+		return;
+	}
+	if (errno != EOPNOTSUPP && errno != ENOSYS)
+		throw std::runtime_error ("Allocate log file error");
+#endif
+	if (ftruncate(fd_, size) < 0)
+		throw std::runtime_error ("Extend log file error");
+	allocated_ = size;
+}
+
+/**
+ * \brief Method to map a window of the file
+ *
+ * The file is extended as needed. Pages of the window are populated in
+ * advance, where supported.
+ * @param offset Offset of the window (page-aligned)
+ * @param length Length of the window
+ * @return Address of the window
+ * @exception runtime_error if the file cannot be extended or mapped
+ */
+char* LogFile::map(unsigned long int offset, unsigned long int length)
+{
+	if (offset + length > allocated_)
+		allocate(offset + length);
+	int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+	flags |= MAP_POPULATE;
+#endif
+	void* p = mmap(0, length, PROT_READ|PROT_WRITE, flags, fd_, offset);
+	if (p == MAP_FAILED)
+		throw std::runtime_error ("Map log file error");
+	return reinterpret_cast<char*>(p);
+}
+
+/**
+ * \brief Method to map the window containing the next size bytes
+ *
+ * The window mapped by prepare() is used, if it contains them; then, the
+ * current window is left to prepare() to unmap.
+ * @param size Amount of data that must fit in the window
+ * @exception runtime_error if the file cannot be extended or mapped
+ */
+void LogFile::remap(unsigned long int size)
+{
+	if (retired_ != 0) {
+		munmap(retired_, retiredLength_);
+		retired_ = 0;
+	}
+	if (next_ != 0) {
+		char* p = next_;
+		next_ = 0;
+		if (nextOffset_ <= length_ &&
+		    length_ + size <= nextOffset_ + nextLength_) {
+			retired_ = window_;
+			retiredLength_ = windowLength_;
+			window_ = p;
+			windowOffset_ = nextOffset_;
+			windowLength_ = nextLength_;
+			return;
+		}
+		munmap(p, nextLength_);
+	}
+	if (window_ != 0) {
+		munmap(window_, windowLength_);
+		window_ = 0;
+	}
+
+	unsigned long int page = sysconf(_SC_PAGESIZE);
+	unsigned long int offset = length_ & ~(page - 1);
+	unsigned long int length = (length_ - offset + size + page - 1) &
+	    ~(page - 1);
+	if (length < windowSize_)
+		length = windowSize_;
+	window_ = map(offset, length);
+	windowOffset_ = offset;
+	windowLength_ = length;
+}
+
+/**
+ * \brief Method to map the next window ahead of time
+ *
+ * It unmaps the previous window, if any. Then, it does nothing until the
+ * current window is half full, or if the next window has already been
+ * mapped. The next window starts at the page of the current length, so
+ * that it contains also a record crossing the end of the current window,
+ * and ends a window past the current one. Its pages not yet written are
+ * written once (with zeros, as the content of the file), because the
+ * pages of a shared mapping are populated read-only and the first write
+ * on each page would fault anyway.
+ * It must not run concurrently with the writes.
+ * @exception runtime_error if the file cannot be extended or mapped
+ */
+void LogFile::prepare()
+{
+	if (retired_ != 0) {
+		munmap(retired_, retiredLength_);
+		retired_ = 0;
+	}
+	if (window_ == 0 || next_ != 0 ||
+	    length_ - windowOffset_ < windowLength_ / 2)
+		return;
+	unsigned long int page = sysconf(_SC_PAGESIZE);
+	unsigned long int offset = length_ & ~(page - 1);
+	unsigned long int length = windowOffset_ + windowLength_ +
+	    windowSize_ - offset;
+	next_ = map(offset, length);
+	nextOffset_ = offset;
+	nextLength_ = length;
+	for (unsigned long int p = length_ - offset; p < length;
+	    p = (p + page) & ~(page - 1))
+		next_[p] = 0;
+}
+
+} /* onposix */
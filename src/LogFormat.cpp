@@ -0,0 +1,266 @@
+/*
+ * LogFormat.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstdio>
+#include <vector>
+
+#include "LogFormat.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Maximum length of a conversion specification
+ */
+static const unsigned int MAX_SPEC = 32;
+
+/**
+ * \brief Function to append a snprintf() result to a string
+ */
+template <typename T>
+static void appendFormatted(std::string* out, const char* spec, T value)
+{
+	char tmp[128];
+	int n = snprintf(tmp, sizeof(tmp), spec, value);
+	if (n < 0)
+		return;
+	if (static_cast<unsigned int>(n) < sizeof(tmp)) {
+		out->append(tmp, n);
+	} else {
+		std::vector<char> big (n + 1);
+		snprintf(&big[0], big.size(), spec, value);
+		out->append(&big[0], n);
+	}
+}
+
+/**
+ * \brief Function to check that a complete argument is available
+ *
+ * Zero bytes (e.g., padding of binary records) are not arguments.
+ */
+static bool isArgAvailable(const char* args, const char* end)
+{
+	if (args >= end || *args == 0)
+		return false;
+	unsigned long int left = end - args - 1;
+	if (*args != LOG_ARG_STRING)
+		return left >= sizeof(uint64_t);
+	uint32_t length;
+	if (left < sizeof(length))
+		return false;
+	memcpy(&length, args + 1, sizeof(length));
+	return left - sizeof(length) > length;
+}
+
+/**
+ * \brief Function to take an integer argument given for a '*' width or
+ * precision
+ *
+ * @return false if the next argument is not a complete integer
+ */
+static bool takeIntArg(const char** args, const char* end, int* value)
+{
+	if (!isArgAvailable(*args, end) ||
+	    (**args != LOG_ARG_INT && **args != LOG_ARG_UINT))
+		return false;
+	int64_t v;
+	memcpy(&v, *args + 1, sizeof(v));
+	*args += 1 + sizeof(v);
+	*value = static_cast<int>(v);
+	return true;
+}
+
+/**
+ * \brief Function to get the size (in bits) of an integer argument from
+ * the length modifier of its conversion
+ *
+ * @param f Pointer to the length modifier (if any); moved past it
+ */
+static unsigned int parseLength(const char** f)
+{
+	const char* p = *f;
+	unsigned int bits = sizeof(int) * 8;
+	if (p[0] == 'h' && p[1] == 'h') {
+		bits = 8;
+		p += 2;
+	} else if (p[0] == 'h') {
+		bits = sizeof(short) * 8;
+		++p;
+	} else if (p[0] == 'l' && p[1] == 'l') {
+		bits = sizeof(long long) * 8;
+		p += 2;
+	} else if (p[0] == 'l') {
+		bits = sizeof(long) * 8;
+		++p;
+	} else if (p[0] == 'L' || p[0] == 'q' || p[0] == 'j') {
+		bits = 64;
+		++p;
+	} else if (p[0] == 'z' || p[0] == 't') {
+		bits = sizeof(size_t) * 8;
+		++p;
+	}
+	*f = p;
+	return bits;
+}
+
+/**
+ * \brief Function to format a message from its format and its encoded
+ * arguments.
+ *
+ * Integers are encoded as 64-bit values, so they are converted back to
+ * the size given by the length modifier of the format (e.g., int for
+ * "%x", long for "%lx") as printf() does. Widths and precisions given as
+ * '*' take their value from the arguments. Conversions without a matching
+ * (complete) argument are printed verbatim.
+ * @param out String where the message is appended
+ * @param format printf-like format
+ * @param args Arguments encoded through logArgsEncode()
+ * @param size Size of the encoded arguments
+ */
+void formatLogMessage(std::string* out, const char* format,
+    const char* args, unsigned long int size)
+{
+	const char* end = args + size;
+	const char* f = format;
+	while (*f != '\0') {
+		const char* percent = strchr(f, '%');
+		if (percent == 0) {
+			out->append(f);
+			break;
+		}
+		out->append(f, percent - f);
+		f = percent + 1;
+		if (*f == '%') {
+			out->push_back('%');
+			++f;
+			continue;
+		}
+
+		// Copy flags, width and precision; '*' takes an argument
+		char spec[MAX_SPEC + 32];
+		unsigned int n = 0;
+		bool missing = false;
+		int star;
+		spec[n++] = '%';
+		while (*f != '\0' && strchr("-+ #0", *f) != 0 && n < MAX_SPEC)
+			spec[n++] = *f++;
+		if (*f == '*') {
+			++f;
+			if (takeIntArg(&args, end, &star))
+				n += snprintf(spec + n, 16, "%d", star);
+			else
+				missing = true;
+		}
+		while (*f >= '0' && *f <= '9' && n < MAX_SPEC)
+			spec[n++] = *f++;
+		if (*f == '.') {
+			++f;
+			if (*f == '*') {
+				++f;
+				// A negative precision is as if omitted
+				if (!takeIntArg(&args, end, &star))
+					missing = true;
+				else if (star >= 0)
+					n += snprintf(spec + n, 16, ".%d", star);
+			} else {
+				spec[n++] = '.';
+				while (*f >= '0' && *f <= '9' && n < MAX_SPEC)
+					spec[n++] = *f++;
+			}
+		}
+		unsigned int bits = parseLength(&f);
+		char conversion = *f;
+		if (conversion == '\0' || missing ||
+		    !isArgAvailable(args, end)) {
+			out->append(percent, f - percent);
+			args = end;
+			continue;
+		}
+		++f;
+
+		char tag = *args++;
+		if (tag == LOG_ARG_STRING) {
+			uint32_t length;
+			memcpy(&length, args, sizeof(length));
+			const char* s = args + sizeof(length);
+			args = s + length + 1;
+			if (n == 1)
+				out->append(s, length);
+			else {
+				spec[n++] = 's';
+				spec[n] = '\0';
+				appendFormatted(out, spec, s);
+			}
+			continue;
+		}
+
+		uint64_t raw;
+		memcpy(&raw, args, sizeof(raw));
+		args += sizeof(raw);
+		if (strchr("diouxXc", conversion) != 0) {
+			long long int v;
+			if (tag == LOG_ARG_DOUBLE) {
+				double d;
+				memcpy(&d, &raw, sizeof(d));
+				v = static_cast<long long int>(d);
+			} else {
+				v = static_cast<long long int>(raw);
+			}
+			// Convert to the size of the modifier, as printf() does
+			if (bits < 64) {
+				uint64_t mask = (1ULL << bits) - 1;
+				uint64_t sign = 1ULL << (bits - 1);
+				uint64_t u = static_cast<uint64_t>(v) & mask;
+				if (strchr("di", conversion) != 0 && (u & sign))
+					u |= ~mask;
+				v = static_cast<long long int>(u);
+			}
+			if (conversion == 'c') {
+				spec[n++] = 'c';
+				spec[n] = '\0';
+				appendFormatted(out, spec, static_cast<int>(v));
+			} else {
+				spec[n++] = 'l';
+				spec[n++] = 'l';
+				spec[n++] = conversion;
+				spec[n] = '\0';
+				appendFormatted(out, spec, v);
+			}
+		} else if (strchr("fFeEgGaA", conversion) != 0) {
+			double d;
+			if (tag == LOG_ARG_DOUBLE)
+				memcpy(&d, &raw, sizeof(d));
+			else if (tag == LOG_ARG_INT)
+				d = static_cast<int64_t>(raw);
+			else
+				d = raw;
+			spec[n++] = conversion;
+			spec[n] = '\0';
+			appendFormatted(out, spec, d);
+		} else {
+			// %p, or %s given a non-string argument
+			spec[n++] = 'p';
+			spec[n] = '\0';
+			appendFormatted(out, spec,
+			    reinterpret_cast<void*>(static_cast<uintptr_t>(raw)));
+		}
+	}
+}
+
+} /* onposix */
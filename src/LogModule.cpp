@@ -0,0 +1,372 @@
+/*
+ * LogModule.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "LogModule.hpp"
+#include "AbstractThread.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Levels set by name
+ */
+typedef std::map<std::string, int> LevelMap;
+
+/**
+ * \brief Lock protecting the registry; it is statically initialized,
+ * since modules are registered during the dynamic initialization of
+ * arbitrary source files
+ */
+static pthread_mutex_t registryLock_ = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * \brief List of registered modules
+ */
+static LogModule* modules_ = 0;
+
+/**
+ * \brief Levels set by name (allocated at the first use)
+ */
+static LevelMap* levels_ = 0;
+
+/**
+ * \brief Level set for "*" (-1 if none)
+ */
+static int defaultLevel_ = -1;
+
+/**
+ * \brief Configuration file reloaded on signal (allocated at the first
+ * use)
+ */
+static std::string* reloadFile_ = 0;
+
+/**
+ * \brief Pipe used by the signal handler to wake up the reloader thread
+ */
+static int reloadPipe_[2] = {-1, -1};
+
+/**
+ * \brief Function to get the name of a file without the directories
+ */
+static const char* getBaseName(const char* name)
+{
+	const char* slash = strrchr(name, '/');
+	return (slash != 0) ? (slash + 1) : name;
+}
+
+/**
+ * \brief Function to parse a level, either numeric or symbolic (e.g.,
+ * "WARNINGS", "LOG_ALL", "debug")
+ *
+ * @return The level; -1 if not valid
+ */
+static int parseLevel(const std::string& s)
+{
+	static const char* names[][3] = {
+		{"NOLOG", "NONE", "OFF"},
+		{"ERRORS", "ERROR", "ERR"},
+		{"WARNINGS", "WARNING", "WARN"},
+		{"ALL", "DEBUG", "ON"}
+	};
+	std::string u;
+	for (unsigned int i = 0; i < s.size(); ++i)
+		u.push_back(toupper(static_cast<unsigned char>(s[i])));
+	if (u.compare(0, 4, "LOG_") == 0)
+		u.erase(0, 4);
+	for (int level = 0; level < 4; ++level)
+		for (int j = 0; j < 3; ++j)
+			if (u == names[level][j])
+				return level;
+	if (u.size() == 1 && u[0] >= '0' && u[0] <= '3')
+		return u[0] - '0';
+	return -1;
+}
+
+/**
+ * \brief Function to compute the level of a module.
+ *
+ * It must be called with registryLock_ held.
+ */
+static int findLevel(const char* name, int initialLevel)
+{
+	if (levels_ != 0) {
+		LevelMap::const_iterator i = levels_->find(name);
+		if (i == levels_->end())
+			i = levels_->find(getBaseName(name));
+		if (i != levels_->end())
+			return i->second;
+	}
+	return (defaultLevel_ >= 0) ? defaultLevel_ : initialLevel;
+}
+
+/**
+ * \brief Constructor. It registers the module and sets its level.
+ *
+ * @param module Module of the calling source file
+ */
+LogModuleRegistrar::LogModuleRegistrar(LogModule* module):
+    module_(module)
+{
+	pthread_mutex_lock(&registryLock_);
+	module->next = modules_;
+	modules_ = module;
+	module->update();
+	pthread_mutex_unlock(&registryLock_);
+}
+
+/**
+ * \brief Destructor. It unregisters the module (e.g., when a shared
+ * library is unloaded).
+ */
+LogModuleRegistrar::~LogModuleRegistrar()
+{
+	pthread_mutex_lock(&registryLock_);
+	for (LogModule** m = &modules_; *m != 0; m = &(*m)->next)
+		if (*m == module_) {
+			*m = module_->next;
+			break;
+		}
+	pthread_mutex_unlock(&registryLock_);
+}
+
+/**
+ * \brief Method to update the level of the module.
+ *
+ * It must be called with registryLock_ held.
+ */
+void LogModule::update()
+{
+	__atomic_store_n(&level, findLevel(name, initialLevel),
+	    __ATOMIC_RELAXED);
+}
+
+/**
+ * \brief Method to update the level of all modules.
+ *
+ * It must be called with registryLock_ held.
+ */
+void LogModule::updateAll()
+{
+	for (LogModule* m = modules_; m != 0; m = m->next)
+		m->update();
+}
+
+/**
+ * \brief Method to set the level of one or more modules
+ *
+ * @param name Name of the module(s): source file (with or without the
+ * directories), tag set through LOG_MODULE, or "*" for all modules without
+ * a level of their own
+ * @param level New level (LOG_NOLOG, LOG_ERRORS, LOG_WARNINGS or LOG_ALL)
+ */
+void LogModule::setLevel(const std::string& name, int level)
+{
+	pthread_mutex_lock(&registryLock_);
+	if (name == "*") {
+		defaultLevel_ = level;
+	} else {
+		if (levels_ == 0)
+			levels_ = new LevelMap;
+		(*levels_)[name] = level;
+	}
+	updateAll();
+	pthread_mutex_unlock(&registryLock_);
+}
+
+/**
+ * \brief Method to get the current level of a module
+ *
+ * @param name Name of the module (source file, with or without the
+ * directories, or tag)
+ * @return The level; -1 if no module matches the name
+ */
+int LogModule::getLevel(const std::string& name)
+{
+	int level = -1;
+	pthread_mutex_lock(&registryLock_);
+	for (LogModule* m = modules_; m != 0; m = m->next)
+		if (name == m->name || name == getBaseName(m->name)) {
+			level = __atomic_load_n(&m->level, __ATOMIC_RELAXED);
+			break;
+		}
+	pthread_mutex_unlock(&registryLock_);
+	return level;
+}
+
+/**
+ * \brief Method to restore the initial level of all modules
+ */
+void LogModule::resetLevels()
+{
+	pthread_mutex_lock(&registryLock_);
+	if (levels_ != 0)
+		levels_->clear();
+	defaultLevel_ = -1;
+	updateAll();
+	pthread_mutex_unlock(&registryLock_);
+}
+
+/**
+ * \brief Method to set the levels of the modules from a file.
+ *
+ * Each line contains the name of a module (as in setLevel()) followed by
+ * its level, either numeric or symbolic (NOLOG, ERRORS, WARNINGS, ALL).
+ * Empty lines, comments (starting with #) and invalid lines are ignored.
+ * The levels set so far are replaced by the content of the file:
+ * \code
+ * # module			level
+ * *				WARNINGS
+ * PosixDescriptor.cpp		ALL
+ * net				ERRORS
+ * \endcode
+ * @param fileName Name of the file
+ * @return true in case of success; false if the file cannot be read
+ */
+bool LogModule::loadConfig(const std::string& fileName)
+{
+	std::ifstream in (fileName.c_str());
+	if (!in)
+		return false;
+	LevelMap* levels = new LevelMap;
+	int defaultLevel = -1;
+	std::string line;
+	while (std::getline(in, line)) {
+		std::istringstream iss (line);
+		std::string name, value;
+		if (!(iss >> name >> value) || name[0] == '#')
+			continue;
+		int level = parseLevel(value);
+		if (level < 0)
+			continue;
+		if (name == "*")
+			defaultLevel = level;
+		else
+			(*levels)[name] = level;
+	}
+
+	pthread_mutex_lock(&registryLock_);
+	std::swap(levels, levels_);
+	defaultLevel_ = defaultLevel;
+	updateAll();
+	pthread_mutex_unlock(&registryLock_);
+	delete levels;
+	return true;
+}
+
+/**
+ * \brief Thread reloading the configuration file when woken up by the
+ * signal handler
+ */
+class LogConfigReloader: public AbstractThread {
+public:
+	LogConfigReloader() {
+		setName("onposix-logcfg");
+	}
+
+protected:
+	void run() {
+		char c;
+		for (;;) {
+			ssize_t n = read(reloadPipe_[0], &c, 1);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0)
+				return;
+			pthread_mutex_lock(&registryLock_);
+			std::string name = *reloadFile_;
+			pthread_mutex_unlock(&registryLock_);
+			LogModule::loadConfig(name);
+		}
+	}
+};
+
+/**
+ * \brief Signal handler: it only wakes up the reloader thread, since the
+ * file cannot be read within the handler
+ */
+static void reloadHandler(int)
+{
+	int e = errno;
+	char c = 0;
+	if (write(reloadPipe_[1], &c, 1) < 0) {
+		// Nothing to do: a reload is already pending
+	}
+	errno = e;
+}
+
+/**
+ * \brief Method to load a configuration file, and to reload it whenever
+ * the process receives a signal.
+ *
+ * The file is reloaded by a background thread (see loadConfig()).
+ * @param fileName Name of the file
+ * @param signal Signal triggering the reload (SIGHUP by default)
+ * @return true if the file has been loaded; false if it cannot be read
+ * (it will be loaded at the next signal)
+ * @exception runtime_error if the thread or the signal handler cannot be
+ * set up
+ */
+bool LogModule::reloadOnSignal(const std::string& fileName, int signal)
+{
+	static LogConfigReloader* reloader = 0;
+
+	pthread_mutex_lock(&registryLock_);
+	if (reloadFile_ == 0)
+		reloadFile_ = new std::string;
+	*reloadFile_ = fileName;
+	if (reloader == 0) {
+		if (pipe(reloadPipe_) < 0) {
+			pthread_mutex_unlock(&registryLock_);
+			throw std::runtime_error ("Log reload pipe error");
+		}
+		fcntl(reloadPipe_[1], F_SETFL, O_NONBLOCK);
+		reloader = new LogConfigReloader;
+		if (!reloader->start()) {
+			delete reloader;
+			reloader = 0;
+			close(reloadPipe_[0]);
+			close(reloadPipe_[1]);
+			pthread_mutex_unlock(&registryLock_);
+			throw std::runtime_error ("Log reload thread error");
+		}
+	}
+	pthread_mutex_unlock(&registryLock_);
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = reloadHandler;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(signal, &sa, 0) < 0)
+		throw std::runtime_error ("Log reload signal error");
+	return loadConfig(fileName);
+}
+
+} /* onposix */
@@ -0,0 +1,120 @@
+/*
+ * LogRing.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include "LogRing.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Smallest size of a ring
+ */
+static const unsigned long int MIN_RING_SIZE = 4096;
+
+/**
+ * \brief Constructor.
+ *
+ * @param size Size of the ring in bytes; it is rounded up to a power of 2
+ */
+LogRing::LogRing(unsigned long int size):
+    reserved_(0),
+    cachedTail_(0),
+    dropped_(0),
+    orphaned_(false),
+    busy_(false),
+    head_(0),
+    tail_(0)
+{
+	size_ = MIN_RING_SIZE;
+	while (size_ < size)
+		size_ <<= 1;
+	data_ = new char[size_];
+}
+
+/**
+ * \brief Destructor.
+ */
+LogRing::~LogRing()
+{
+	delete[] data_;
+}
+
+/**
+ * \brief Method to reserve space for a record (producer side)
+ *
+ * The record becomes visible to the consumer only after commit().
+ * @param size Size of the record; it must not exceed getMaxRecordSize()
+ * @return Pointer to the space of the record; 0 if the ring is full
+ */
+char* LogRing::reserve(unsigned long int size)
+{
+	unsigned long int frame = (size + sizeof(Frame) + 7) & ~7UL;
+	unsigned long int pos = head_ & (size_ - 1);
+	unsigned long int room = size_ - pos;
+	unsigned long int needed = (frame > room) ? (frame + room) : frame;
+
+	if (size_ - (head_ - cachedTail_) < needed) {
+		cachedTail_ = __atomic_load_n(&tail_, __ATOMIC_ACQUIRE);
+		if (size_ - (head_ - cachedTail_) < needed)
+			return 0;
+	}
+
+	if (frame > room) {
+		// Skip the end of the ring
+		Frame* pad = reinterpret_cast<Frame*>(data_ + pos);
+		pad->size = room;
+		pad->padding = 1;
+		pos = 0;
+	}
+	Frame* f = reinterpret_cast<Frame*>(data_ + pos);
+	f->size = frame;
+	f->padding = 0;
+	reserved_ = needed;
+	return reinterpret_cast<char*>(f + 1);
+}
+
+/**
+ * \brief Method to read the next record (consumer side)
+ *
+ * The space of the record is not freed until release() is called, so
+ * the returned pointer stays valid until then.
+ * @param pos Position of the record; it is moved to the next record
+ * @param data Pointer to the record
+ * @param size Space of the record (i.e., its size rounded up)
+ * @return true if a record has been read; false if there are no more
+ * records
+ */
+bool LogRing::read(unsigned long int* pos, const char** data,
+    unsigned long int* size) const
+{
+	unsigned long int head = __atomic_load_n(&head_, __ATOMIC_ACQUIRE);
+	while (*pos != head) {
+		const Frame* f = reinterpret_cast<const Frame*>
+		    (data_ + (*pos & (size_ - 1)));
+		*pos += f->size;
+		if (f->padding == 0) {
+			*data = reinterpret_cast<const char*>(f + 1);
+			*size = f->size - sizeof(Frame);
+			return true;
+		}
+	}
+	return false;
+}
+
+} /* onposix */
@@ -18,14 +18,149 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
  */
 
+#include <algorithm>
+#include <cstdarg>
 #include <iostream>
 #include <new>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <sched.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 
 #include "Logger.hpp"
+#include "LogBinary.hpp"
+#include "LogClock.hpp"
+#include "LogFile.hpp"
+#include "LogRing.hpp"
+#include "AbstractThread.hpp"
 
 namespace onposix {
 
+/**
+ * \brief Header of a message stored in a LogRing.
+ *
+ * The text of the message (or the encoded arguments, in case of messages
+ * logged through DEBUGF() & co.) follows the header.
+ */
+struct LogRecord {
+	uint64_t timestamp;	///< Time (ns), as returned by LogClock::now()
+	const char* file;	///< Source file (__FILE__)
+	int line;		///< Source line (__LINE__)
+	unsigned int sinks;	///< Mask of Logger::Sink
+	unsigned int length;	///< Length of the text or of the arguments
+	uint32_t thread;	///< Id of the thread
+	const LogSite* site;	///< Call site of DEBUGF() & co.; 0 for text
+};
+
+/**
+ * \brief Time slept by the writer thread when all rings are empty (ns)
+ */
+static const long int WRITER_IDLE_NS = 1000000;
+
+/**
+ * \brief Ring of the calling thread (asynchronous mode)
+ */
+static __thread LogRing* threadRing_ = 0;
+
+__thread bool Logger::isWriter_ = false;
+
+/**
+ * \brief Id of the calling thread (0 if not yet known)
+ */
+static __thread uint32_t threadId_ = 0;
+
+static inline uint32_t getThreadId()
+{
+	if (threadId_ == 0)
+		threadId_ = syscall(SYS_gettid);
+	return threadId_;
+}
+
+/**
+ * \brief Function to append a formatted message to a string
+ *
+ * @param out String where the message is appended
+ * @param timestamp Time of the message, as returned by LogClock::now()
+ * @param initialTime Reference of the relative times
+ */
+static void formatRecord(std::string* out, uint64_t timestamp,
+    uint64_t initialTime, const char* message, unsigned long int length,
+    const char* file, int line)
+{
+	char tmp[32];
+	formatLogTime(out, timestamp, initialTime);
+	out->push_back(':');
+	out->append(message, length);
+	out->append("\t\t[");
+	out->append(file);
+	out->append(tmp, snprintf(tmp, sizeof(tmp), ":%d]\n", line));
+}
+
+/**
+ * \brief Key used to be notified about the termination of a thread owning
+ * a ring
+ */
+static pthread_key_t ringKey_;
+static pthread_once_t ringKeyOnce_ = PTHREAD_ONCE_INIT;
+
+static void releaseRing(void* ring)
+{
+	reinterpret_cast<LogRing*>(ring)->setOrphaned();
+}
+
+static void createRingKey()
+{
+	if (pthread_key_create(&ringKey_, releaseRing) != 0)
+		throw std::runtime_error ("Logger key error");
+}
+
+static void flushAtExit()
+{
+	Logger::getInstance().stopAsync();
+	Logger::getInstance().closeFile();
+}
+
+static pthread_once_t exitOnce_ = PTHREAD_ONCE_INIT;
+
+static void registerExitHandler()
+{
+	atexit(flushAtExit);
+}
+
+/**
+ * \brief Thread draining the rings in asynchronous mode
+ */
+class LogWriter: public AbstractThread {
+	Logger& logger_;
+	bool stop_;
+
+public:
+	explicit LogWriter(Logger& logger): logger_(logger), stop_(false) {
+		setName("onposix-log");
+	}
+
+	void requestStop() {
+		__atomic_store_n(&stop_, true, __ATOMIC_RELEASE);
+	}
+
+protected:
+	void run() {
+		Logger::isWriter_ = true;
+		struct timespec idle = {0, WRITER_IDLE_NS};
+		while (!__atomic_load_n(&stop_, __ATOMIC_ACQUIRE)) {
+			bool busy = logger_.drain();
+			logger_.mapAhead();
+			if (!busy)
+				nanosleep(&idle, 0);
+		}
+	}
+};
+
 // Definition (and initialization) of static attributes
 Logger* Logger::m_ = 0;
 
@@ -61,48 +196,260 @@ inline void Logger::unlock(){}
  * configure() method.
  */
 Logger::Logger():
+		fileBase_(""),
 		logFile_(""),
+		format_(TEXT),
+		text_(0),
+		binary_(0),
+		maxFileSize_(0),
+		maxFileAge_(0),
+		maxFiles_(0),
+		segment_(0),
+		segmentStart_(0),
+		segmentHeader_(0),
 		latestMsgPrintedOnFile_(false),
-		latestMsgPrintedOnConsole_(false)
+		latestMsgPrintedOnConsole_(false),
+		async_(false),
+		policy_(BLOCK),
+		ringSize_(0),
+		writer_(0),
+		reportedDropped_(0),
+		orphanDropped_(0)
 {
-	gettimeofday(&initialTime_, NULL);
+	initialTime_ = LogClock::now();
 }
 
 /**
  * \brief Method to configure the logger. 
  *
  * This method is called by the LOG_FILE() macro.
+ * Binary files can be converted to text through the logdecode tool.
+ * The file is closed at exit.
  * @param outputFile Name of the file used for logging
+ * @param format Format of the file (TEXT or BINARY)
+ * @exception runtime_error if the file cannot be created
  */
-void Logger::setFile (const std::string& outputFile)
+void Logger::setFile (const std::string& outputFile, FileFormat format)
 {
 		Logger::lock();
 		latestMsgPrintedOnFile_ = false;
 		latestMsgPrintedOnConsole_ = false;
 
-		// Compute a new file name, if needed
-		if (outputFile != logFile_){
-
-			if (logFile_ != "")
-				out_.close();
-			std::ostringstream oss;
-			time_t currTime;
-			time(&currTime);
-			struct tm *currTm = localtime(&currTime);
-			oss << outputFile << "_" <<
-					currTm->tm_mday << "_" <<
-					currTm->tm_mon << "_" <<
-					(1900 + currTm->tm_year) << "_" <<
-					currTm->tm_hour << "-" <<
-					currTm->tm_min << "-" <<
-					currTm->tm_sec << ".log";
-			logFile_ = oss.str().c_str();
+		releaseFile();
+		if (outputFile != fileBase_)
+			segments_.clear();
+		fileBase_ = outputFile;
+		format_ = format;
+		segment_ = 0;
+		try {
+			openFile();
+		} catch (std::runtime_error& e) {
+			Logger::unlock();
+			throw;
 		}
 
-		// Open a new stream:
-		out_.open(logFile_.c_str(), std::ios::app);
-
 		Logger::unlock();
+		pthread_once(&exitOnce_, registerExitHandler);
+}
+
+/**
+ * \brief Method to configure the rotation of the log files.
+ *
+ * When the current file would exceed the maximum size, or it is older than
+ * the maximum age, a new file is created (with the same name followed by
+ * a sequence number) and the oldest files created since the latest
+ * setFile() are deleted, keeping at most maxFiles files.
+ * The space of each new file (i.e., maxSize) is preallocated, so that
+ * writes do not wait for the file system to allocate blocks.
+ * The preallocation applies to the files created after the call.
+ * @param maxSize Maximum size of a file in bytes (0 for no limit)
+ * @param maxAge Maximum age of a file in seconds (0 for no limit)
+ * @param maxFiles Number of files kept (0 to keep all files)
+ */
+void Logger::setRotation(unsigned long int maxSize, unsigned int maxAge,
+    unsigned int maxFiles)
+{
+	Logger::lock();
+	maxFileSize_ = maxSize;
+	maxFileAge_ = maxAge * 1000000000ULL;
+	maxFiles_ = maxFiles;
+	Logger::unlock();
+}
+
+/**
+ * \brief Method to stop logging on file.
+ *
+ * The file is truncated to the length of the data.
+ */
+void Logger::closeFile()
+{
+	Logger::lock();
+	releaseFile();
+	Logger::unlock();
+}
+
+/**
+ * \brief Method to create a new file.
+ *
+ * It must be called with the lock held.
+ * @exception runtime_error if the file cannot be created
+ */
+void Logger::openFile()
+{
+	std::ostringstream oss;
+	time_t currTime;
+	time(&currTime);
+	struct tm *currTm = localtime(&currTime);
+	oss << fileBase_ << "_" <<
+			currTm->tm_mday << "_" <<
+			currTm->tm_mon << "_" <<
+			(1900 + currTm->tm_year) << "_" <<
+			currTm->tm_hour << "-" <<
+			currTm->tm_min << "-" <<
+			currTm->tm_sec;
+	if (segment_ > 0)
+		oss << "." << segment_;
+	oss << ((format_ == BINARY) ? ".bin" : ".log");
+	logFile_ = oss.str();
+
+	try {
+		if (format_ == BINARY) {
+			binary_ = new LogBinaryWriter(logFile_, initialTime_,
+			    maxFileSize_);
+		} else {
+			text_ = new LogFile(logFile_, true, maxFileSize_);
+
+			// Correlate relative times and wall-clock time
+			uint64_t monotonic;
+			uint64_t wallTime = LogClock::getWallClock(&monotonic);
+			std::string clock;
+			formatLogTime(&clock, monotonic, initialTime_);
+			clock.append(":[CLOCK]\t");
+			formatWallClock(&clock, wallTime);
+			clock.push_back('\n');
+			text_->write(clock.data(), clock.size());
+		}
+	} catch (std::runtime_error& e) {
+		releaseFile();
+		throw;
+	}
+	segmentStart_ = LogClock::now();
+	segmentHeader_ = (binary_ != 0) ? binary_->getLength() :
+	    text_->getLength();
+
+	// Retention
+	if (segments_.empty() || segments_.back() != logFile_)
+		segments_.push_back(logFile_);
+	while (maxFiles_ != 0 && segments_.size() > maxFiles_) {
+		unlink(segments_.front().c_str());
+		segments_.pop_front();
+	}
+}
+
+/**
+ * \brief Method to close the current file.
+ *
+ * It must be called with the lock held.
+ */
+void Logger::releaseFile()
+{
+	delete text_;
+	text_ = 0;
+	delete binary_;
+	binary_ = 0;
+	logFile_ = "";
+}
+
+/**
+ * \brief Method to prepare the file for writing a message, rotating it
+ * if needed.
+ *
+ * It must be called with the lock held. A file is never rotated before
+ * its first message.
+ * @param timestamp Time of the message
+ * @param size Size of the message in the file
+ * @return false if logging on file is disabled
+ */
+bool Logger::prepareFile(uint64_t timestamp, unsigned long int size)
+{
+	if (text_ == 0 && binary_ == 0)
+		return false;
+	unsigned long int length = (binary_ != 0) ? binary_->getLength() :
+	    text_->getLength();
+	if (length == segmentHeader_)
+		return true;
+	if ((maxFileSize_ != 0 && length + size > maxFileSize_) ||
+	    (maxFileAge_ != 0 && timestamp >= segmentStart_ + maxFileAge_)) {
+		std::string previous = logFile_;
+		releaseFile();
+		++segment_;
+		try {
+			openFile();
+		} catch (std::runtime_error& e) {
+			std::cerr << "Error rotating " << previous << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * \brief Method to write a formatted message on the text file.
+ *
+ * It must be called with the lock held. In case of error, logging on file
+ * is disabled.
+ */
+void Logger::writeTextFile(uint64_t timestamp, const std::string& record)
+{
+	if (!prepareFile(timestamp, record.size()))
+		return;
+	try {
+		text_->write(record.data(), record.size());
+		latestMsgPrintedOnFile_ = true;
+	} catch (std::runtime_error& e) {
+		std::cerr << "Error writing " << logFile_ << std::endl;
+		releaseFile();
+	}
+}
+
+/**
+ * \brief Method to write a text message on the binary file.
+ *
+ * It must be called with the lock held. In case of error, logging on file
+ * is disabled.
+ */
+void Logger::writeBinaryText(uint64_t timestamp, uint32_t thread,
+    const char* file, int line, const char* text, unsigned long int length)
+{
+	if (!prepareFile(timestamp, sizeof(LogBinaryMessage) + length))
+		return;
+	try {
+		binary_->writeText(timestamp, thread, file, line, text, length);
+		latestMsgPrintedOnFile_ = true;
+	} catch (std::runtime_error& e) {
+		std::cerr << "Error writing " << logFile_ << std::endl;
+		releaseFile();
+	}
+}
+
+/**
+ * \brief Method to write a message of DEBUGF() & co. on the binary file.
+ *
+ * It must be called with the lock held. In case of error, logging on file
+ * is disabled.
+ */
+void Logger::writeBinaryMessage(uint64_t timestamp, uint32_t thread,
+    const LogSite* site, const char* args, unsigned long int size)
+{
+	if (!prepareFile(timestamp, sizeof(LogBinaryMessage) + size))
+		return;
+	try {
+		binary_->writeMessage(timestamp, thread, site, args, size);
+		latestMsgPrintedOnFile_ = true;
+	} catch (std::runtime_error& e) {
+		std::cerr << "Error writing " << logFile_ << std::endl;
+		releaseFile();
+	}
 }
 
 
@@ -116,8 +463,7 @@ void Logger::setFile (const std::string& outputFile)
 Logger::~Logger()
 {
 	Logger::lock();
-	if (logFile_ != "")
-		out_.close();
+	releaseFile();
 	delete m_;
 	Logger::unlock();
 
@@ -155,16 +501,14 @@ void Logger::printOnConsole(const std::string& file,
 			const int line,
 			const std::string& message)
 {
-
-	struct timeval currentTime;
-	gettimeofday(&currentTime, NULL);
+	std::string record;
+	formatRecord(&record, LogClock::now(), initialTime_, message.data(),
+	    message.size(), file.c_str(), line);
 
 	Logger::lock();
-	
-	std::cout <<
-	    (currentTime.tv_sec - initialTime_.tv_sec) <<
-	    ":" << message << "\t\t[" << file << ":" << line << "]" <<
-		std::endl;
+
+	std::cout.write(record.data(), record.size());
+	std::cout.flush();
 
 	latestMsgPrintedOnConsole_ = true;
 
@@ -187,23 +531,535 @@ void Logger::printOnFile(const std::string& file,
 			const int line,
 			const std::string& message)
 {
-
-	struct timeval currentTime;
-	gettimeofday(&currentTime, NULL);
+	uint64_t now = LogClock::now();
 
 	Logger::lock();
 	
 	latestMsgPrintedOnFile_ = false;
 	
-	if (logFile_ != "") {
-		out_ <<
-		    (currentTime.tv_sec - initialTime_.tv_sec) <<
-		    ":" << message << "\t\t[" << file << ":" << line << "]" <<
-			std::endl;
-		latestMsgPrintedOnFile_ = true;
+	if (binary_ != 0) {
+		writeBinaryText(now, getThreadId(), file.c_str(), line,
+		    message.data(), message.size());
+	} else if (text_ != 0) {
+		std::string record;
+		formatRecord(&record, now, initialTime_, message.data(),
+		    message.size(), file.c_str(), line);
+		writeTextFile(now, record);
 	}
 
 	Logger::unlock();
 }
 
+/**
+ * @brief Method used to print messages.
+ *
+ * This method is called by the DEBUG(), WARNING() and ERROR() macros.
+ * In asynchronous mode the message is only copied in the ring of the
+ * calling thread; otherwise it is printed immediately.
+ * @param sinks Mask of destinations (SINK_CONSOLE and/or SINK_FILE)
+ * @param file Source file where the method has been called (set equal to
+ *	      __FILE__ by the macros; it must be a string literal)
+ * @param line Number of line in the source code where the method has been
+ * called (automatically set equal to __LINE__ by the macros)
+ * @param message Message to be logged
+ */
+void Logger::print(unsigned int sinks, const char* file, int line,
+    const std::string& message)
+{
+	if (isAsync() && !isWriter_ && enqueue(sinks, file, line, message))
+		return;
+	if (sinks & SINK_CONSOLE)
+		printOnConsole(file, line, message);
+	if (sinks & SINK_FILE)
+		printOnFile(file, line, message);
+}
+
+/**
+ * \brief Method used to log a message through its call site descriptor,
+ * formatting it at once.
+ *
+ * This method is called by the DEBUGF(), WARNINGF() and ERRORF() macros
+ * when variadic templates are not available (i.e., before C++11).
+ * @param site Static descriptor of the call site
+ * @param ... Arguments of the format
+ */
+void Logger::logNow(const LogSite* site, ...)
+{
+	char buffer[256];
+	va_list args;
+	va_start(args, site);
+	int n = vsnprintf(buffer, sizeof(buffer), site->format, args);
+	va_end(args);
+	if (n < 0)
+		return;
+	if ((unsigned int) n < sizeof(buffer)) {
+		print(site->sinks, site->file, site->line,
+		    std::string(buffer, n));
+		return;
+	}
+	std::vector<char> large (n + 1);
+	va_start(args, site);
+	vsnprintf(&large[0], large.size(), site->format, args);
+	va_end(args);
+	print(site->sinks, site->file, site->line, std::string(&large[0], n));
+}
+
+/**
+ * \brief Method used to report the messages suppressed by a call site.
+ *
+ * This method is called by the rate-limited and sampled macros (e.g.,
+ * ERROR_RATE()).
+ * @param sinks Mask of destinations (SINK_CONSOLE and/or SINK_FILE)
+ * @param file Source file of the call site
+ * @param line Source line of the call site
+ * @param prefix Prefix of the level of the call site (e.g., "[ERROR]\t")
+ * @param count Number of messages suppressed since the latest report
+ */
+void Logger::reportSuppressed(unsigned int sinks, const char* file, int line,
+    const char* prefix, unsigned long int count)
+{
+	std::ostringstream oss;
+	oss << prefix << count << " messages suppressed";
+	print(sinks, file, line, oss.str());
+}
+
+/**
+ * \brief Method to start writing a record in the ring of the calling thread
+ *
+ * The ring is marked as busy before checking the mode, so stopAsync()
+ * waits for the record before the final drain.
+ * @return Ring of the calling thread; 0 if the asynchronous mode has been
+ * stopped in the meantime
+ */
+LogRing* Logger::enterRing()
+{
+	LogRing* r = (threadRing_ != 0) ? threadRing_ : registerThread();
+	r->enter();
+	if (!__atomic_load_n(&async_, __ATOMIC_SEQ_CST)) {
+		r->leave();
+		return 0;
+	}
+	return r;
+}
+
+/**
+ * \brief Method to reserve a record in the ring of the calling thread
+ *
+ * The ring must have been obtained through enterRing().
+ * @param size Size of the payload of the record
+ * @return Pointer to the record; 0 if the message has been dropped
+ */
+LogRecord* Logger::reserveRecord(unsigned long int size)
+{
+	uint64_t now = LogClock::now();
+	LogRing* r = threadRing_;
+	char* p;
+	while ((p = r->reserve(sizeof(LogRecord) + size)) == 0) {
+		if (policy_ == DROP) {
+			r->drop();
+			return 0;
+		}
+		sched_yield();
+	}
+	LogRecord* rec = reinterpret_cast<LogRecord*>(p);
+	rec->timestamp = now;
+	rec->length = size;
+	rec->thread = getThreadId();
+	return rec;
+}
+
+/**
+ * \brief Method to publish the record obtained through reserveRecord()
+ */
+void Logger::commitRecord()
+{
+	threadRing_->commit();
+	threadRing_->leave();
+}
+
+/**
+ * \brief Method to append a message to the ring of the calling thread
+ *
+ * @return false if the message must be printed synchronously
+ */
+bool Logger::enqueue(unsigned int sinks, const char* file, int line,
+    const std::string& message)
+{
+	LogRing* r = enterRing();
+	if (r == 0)
+		return false;
+	unsigned long int length = message.size();
+	if (sizeof(LogRecord) + length > r->getMaxRecordSize())
+		length = r->getMaxRecordSize() - sizeof(LogRecord);
+
+	LogRecord* rec = reserveRecord(length);
+	if (rec == 0) {
+		r->leave();
+		return true;
+	}
+	rec->file = file;
+	rec->line = line;
+	rec->sinks = sinks;
+	rec->site = 0;
+	memcpy(rec + 1, message.data(), length);
+	commitRecord();
+	return true;
+}
+
+/**
+ * \brief Method to reserve the record of a message logged through
+ * DEBUGF() & co.
+ *
+ * @param site Static descriptor of the call site
+ * @param size Size of the encoded arguments
+ * @param args Pointer where the arguments must be encoded; 0 if the
+ * message has been dropped
+ * @return false if the message must be printed synchronously
+ */
+bool Logger::reserveSite(const LogSite* site, unsigned long int size,
+    char** args)
+{
+	LogRing* r = enterRing();
+	if (r == 0)
+		return false;
+	if (sizeof(LogRecord) + size > r->getMaxRecordSize()) {
+		r->leave();
+		return false;
+	}
+	LogRecord* rec = reserveRecord(size);
+	if (rec != 0) {
+		rec->file = site->file;
+		rec->line = site->line;
+		rec->sinks = site->sinks;
+		rec->site = site;
+		*args = reinterpret_cast<char*>(rec + 1);
+	} else {
+		r->leave();
+		*args = 0;
+	}
+	return true;
+}
+
+/**
+ * \brief Method to print synchronously a message logged through DEBUGF()
+ * & co.
+ */
+void Logger::printSite(const LogSite* site, const char* args,
+    unsigned long int size)
+{
+	unsigned int sinks = site->sinks;
+	if (sinks & SINK_FILE) {
+		Logger::lock();
+		if (binary_ != 0) {
+			writeBinaryMessage(LogClock::now(), getThreadId(), site,
+			    args, size);
+			sinks &= ~SINK_FILE;
+		}
+		Logger::unlock();
+	}
+	if (sinks == 0)
+		return;
+
+	std::string message;
+	formatLogMessage(&message, site->format, args, size);
+	if (sinks & SINK_CONSOLE)
+		printOnConsole(site->file, site->line, message);
+	if (sinks & SINK_FILE)
+		printOnFile(site->file, site->line, message);
+}
+
+/**
+ * \brief Method to create the ring of the calling thread
+ */
+LogRing* Logger::registerThread()
+{
+	LogRing* r = new LogRing(ringSize_);
+	pthread_setspecific(ringKey_, r);
+	ringsLock_.lock();
+	rings_.push_back(r);
+	ringsLock_.unlock();
+	threadRing_ = r;
+	return r;
+}
+
+/**
+ * \brief Method to count the messages dropped so far
+ */
+unsigned long int Logger::countDropped()
+{
+	MutexLocker l(ringsLock_);
+	unsigned long int n = orphanDropped_;
+	for (unsigned int i = 0; i < rings_.size(); ++i)
+		n += rings_[i]->getDropped();
+	return n;
+}
+
+/**
+ * \brief Function to get the text of a record
+ *
+ * @param r Record
+ * @param buffer String used to format messages of DEBUGF() & co.
+ * @param length Length of the text
+ * @return Pointer to the text
+ */
+static const char* getRecordText(const LogRecord* r, std::string* buffer,
+    unsigned long int* length)
+{
+	const char* payload = reinterpret_cast<const char*>(r + 1);
+	if (r->site == 0) {
+		*length = r->length;
+		return payload;
+	}
+	buffer->clear();
+	formatLogMessage(buffer, r->site->format, payload, r->length);
+	*length = buffer->size();
+	return buffer->data();
+}
+
+/**
+ * \brief Entry used to sort the records of different rings by time
+ */
+struct PendingRecord {
+	const LogRecord* record;
+
+	bool operator<(const PendingRecord& other) const {
+		return record->timestamp < other.record->timestamp;
+	}
+};
+
+/**
+ * \brief Method to print the records currently stored in the rings.
+ *
+ * Records are printed in order of time, with a single write (and flush)
+ * on console.
+ * @return true if something has been printed; false otherwise
+ */
+bool Logger::drain()
+{
+	MutexLocker d(drainLock_);
+
+	std::vector<LogRing*> rings;
+	ringsLock_.lock();
+	rings = rings_;
+	ringsLock_.unlock();
+
+	std::vector<PendingRecord> pending;
+	std::vector<unsigned long int> positions (rings.size());
+	for (unsigned int i = 0; i < rings.size(); ++i) {
+		positions[i] = rings[i]->getReadPosition();
+		const char* data;
+		unsigned long int size;
+		while (rings[i]->read(&positions[i], &data, &size)) {
+			PendingRecord p;
+			p.record = reinterpret_cast<const LogRecord*>(data);
+			pending.push_back(p);
+		}
+	}
+	unsigned long int dropped = countDropped();
+	if (pending.empty() && dropped == reportedDropped_)
+		return false;
+
+	std::stable_sort(pending.begin(), pending.end());
+	std::string console, file, message;
+	const char* text;
+	unsigned long int length;
+	for (unsigned int i = 0; i < pending.size(); ++i) {
+		const LogRecord* r = pending[i].record;
+		if (r->sinks & SINK_CONSOLE) {
+			text = getRecordText(r, &message, &length);
+			formatRecord(&console, r->timestamp, initialTime_,
+			    text, length, r->file, r->line);
+		}
+	}
+	std::string notice;
+	if (dropped != reportedDropped_) {
+		std::ostringstream oss;
+		oss << "[WARNING]\t" << (dropped - reportedDropped_) <<
+		    " log messages dropped";
+		notice = oss.str();
+		reportedDropped_ = dropped;
+	}
+
+	Logger::lock();
+	if (binary_ != 0) {
+		for (unsigned int i = 0; i < pending.size() && binary_; ++i) {
+			const LogRecord* r = pending[i].record;
+			if ((r->sinks & SINK_FILE) == 0)
+				continue;
+			const char* payload =
+			    reinterpret_cast<const char*>(r + 1);
+			if (r->site != 0)
+				writeBinaryMessage(r->timestamp, r->thread,
+				    r->site, payload, r->length);
+			else
+				writeBinaryText(r->timestamp, r->thread,
+				    r->file, r->line, payload, r->length);
+		}
+		if (!notice.empty() && binary_ != 0)
+			writeBinaryText(LogClock::now(), getThreadId(),
+			    __FILE__, __LINE__, notice.data(), notice.size());
+	} else if (text_ != 0) {
+		// Writes are just copies in the mapped file: no need to batch
+		for (unsigned int i = 0; i < pending.size() && text_; ++i) {
+			const LogRecord* r = pending[i].record;
+			if ((r->sinks & SINK_FILE) == 0)
+				continue;
+			text = getRecordText(r, &message, &length);
+			file.clear();
+			formatRecord(&file, r->timestamp, initialTime_, text,
+			    length, r->file, r->line);
+			writeTextFile(r->timestamp, file);
+		}
+		if (!notice.empty() && text_ != 0) {
+			uint64_t now = LogClock::now();
+			file.clear();
+			formatRecord(&file, now, initialTime_, notice.data(),
+			    notice.size(), __FILE__, __LINE__);
+			writeTextFile(now, file);
+		}
+	} else if (!notice.empty()) {
+		formatRecord(&console, LogClock::now(), initialTime_,
+		    notice.data(), notice.size(), __FILE__, __LINE__);
+	}
+	if (!console.empty()) {
+		std::cout.write(console.data(), console.size());
+		std::cout.flush();
+		latestMsgPrintedOnConsole_ = true;
+	}
+	Logger::unlock();
+
+	for (unsigned int i = 0; i < rings.size(); ++i)
+		rings[i]->release(positions[i]);
+
+	// Delete the rings of terminated threads
+	ringsLock_.lock();
+	for (unsigned int i = 0; i < rings_.size(); ) {
+		if (rings_[i]->isOrphaned() && rings_[i]->isEmpty()) {
+			orphanDropped_ += rings_[i]->getDropped();
+			delete rings_[i];
+			rings_.erase(rings_.begin() + i);
+		} else {
+			++i;
+		}
+	}
+	ringsLock_.unlock();
+	return true;
+}
+
+/**
+ * \brief Method to map the next window of the file ahead of time.
+ *
+ * Called by the writer thread between two batches, so that the write
+ * crossing the window does not have to map it (see LogFile::prepare()).
+ * In case of error, logging on file is disabled.
+ */
+void Logger::mapAhead()
+{
+	Logger::lock();
+	try {
+		if (binary_ != 0)
+			binary_->prepare();
+		else if (text_ != 0)
+			text_->prepare();
+	} catch (std::runtime_error& e) {
+		std::cerr << "Error writing " << logFile_ << std::endl;
+		releaseFile();
+	}
+	Logger::unlock();
+}
+
+/**
+ * \brief Method to switch to asynchronous mode.
+ *
+ * It starts the writer thread. Messages are then printed in batches by
+ * that thread, out of the critical path of the calling threads. Between
+ * batches, the writer thread also maps the next window of the file; in
+ * synchronous mode, the message crossing a window maps it while holding
+ * the lock of the Logger.
+ * Pending messages are flushed at exit.
+ * @param policy What to do when the ring of a thread is full (DROP or
+ * BLOCK)
+ * @param ringSize Size (in bytes) of the ring allocated for each thread
+ * @exception runtime_error if the writer thread cannot be started
+ */
+void Logger::startAsync(OverflowPolicy policy, unsigned long int ringSize)
+{
+	pthread_once(&ringKeyOnce_, createRingKey);
+	pthread_once(&exitOnce_, registerExitHandler);
+
+	Logger::lock();
+	if (writer_ == 0) {
+		policy_ = policy;
+		ringSize_ = ringSize;
+		writer_ = new LogWriter(*this);
+		if (!writer_->start()) {
+			delete writer_;
+			writer_ = 0;
+			Logger::unlock();
+			throw std::runtime_error ("Logger thread error");
+		}
+		__atomic_store_n(&async_, true, __ATOMIC_RELEASE);
+	}
+	Logger::unlock();
+}
+
+/**
+ * \brief Method to go back to synchronous mode.
+ *
+ * It waits for the messages being written by other threads, stops the
+ * writer thread and prints all pending messages.
+ */
+void Logger::stopAsync()
+{
+	Logger::lock();
+	LogWriter* w = writer_;
+	writer_ = 0;
+	__atomic_store_n(&async_, false, __ATOMIC_SEQ_CST);
+	Logger::unlock();
+
+	// Threads that saw the asynchronous mode before the switch may still
+	// be writing a record. The writer keeps running meanwhile, because
+	// with the BLOCK policy they may be waiting for room in their ring.
+	for (;;) {
+		bool busy = false;
+		ringsLock_.lock();
+		for (unsigned int i = 0; i < rings_.size() && !busy; ++i)
+			busy = rings_[i]->isBusy();
+		ringsLock_.unlock();
+		if (!busy)
+			break;
+		sched_yield();
+	}
+
+	if (w != 0) {
+		w->requestStop();
+		w->waitForTermination();
+		delete w;
+	}
+	drain();
+}
+
+/**
+ * \brief Method to print all pending messages.
+ *
+ * In asynchronous mode, it returns once all messages logged before the
+ * call have been written.
+ */
+void Logger::flush()
+{
+	if (isAsync())
+		drain();
+}
+
+/**
+ * \brief Method to get the number of messages dropped because of the
+ * DROP policy
+ *
+ * @return Number of messages dropped since the program started
+ */
+unsigned long int Logger::getDroppedMessages()
+{
+	return countDropped();
+}
+
 } /* onposix */
@@ -0,0 +1,191 @@
+/*
+ * MappedRegion.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <stdexcept>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "MappedRegion.hpp"
+#include "Logger.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Distance between an offset and the page boundary preceding it
+ */
+static inline unsigned long int pageDelta(unsigned long int offset)
+{
+	return offset % static_cast<unsigned long int>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * \brief Method to get the length of a file
+ *
+ * Unlike FileDescriptor::getLength(), it works also for files larger
+ * than 2 GB.
+ * @param fd descriptor of the file
+ * @return length of the file
+ * @exception runtime_error if fstat() returns an error
+ */
+unsigned long int MappedRegion::getFileLength(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		ERROR("fstat() on descriptor " << fd);
+		throw std::runtime_error ("Map file error");
+	}
+	return st.st_size;
+}
+
+/**
+ * \brief Method to map a range of a file and wrap it
+ *
+ * The range must be inside the file: accessing a mapping beyond the
+ * end of the file raises SIGBUS.
+ * @param fd descriptor of the file
+ * @param offset offset of the range (not necessarily page-aligned)
+ * @param length length of the range
+ * @exception invalid_argument if the length is 0
+ * @exception runtime_error if mmap() returns an error
+ */
+void MappedRegion::map(int fd, unsigned long int offset,
+    unsigned long int length)
+{
+	if (length == 0)
+		throw std::invalid_argument("Mapping with size 0");
+	unsigned long int delta = pageDelta(offset);
+	int prot = (mode_ == READ_WRITE) ? (PROT_READ | PROT_WRITE) : PROT_READ;
+	void* p = mmap(0, length + delta, prot, MAP_SHARED, fd,
+	    offset - delta);
+	if (p == MAP_FAILED) {
+		ERROR("mmap() on descriptor " << fd);
+		throw std::runtime_error ("Map file error");
+	}
+	base_ = reinterpret_cast<char*>(p);
+	mappedLength_ = length + delta;
+	wrap(base_ + delta, length);
+}
+
+/**
+ * \brief Constructor to map a whole file.
+ *
+ * The descriptor must have been opened with O_RDONLY or O_RDWR (the latter
+ * is needed for READ_WRITE). The descriptor can be closed once the region
+ * has been created.
+ * @param fd descriptor of the file
+ * @param mode access mode (READ_ONLY or READ_WRITE)
+ * @exception invalid_argument if the file is empty
+ * @exception runtime_error if the file cannot be mapped
+ */
+MappedRegion::MappedRegion(FileDescriptor& fd, Mode mode):
+    base_(0),
+    mappedLength_(0),
+    offset_(0),
+    mode_(mode)
+{
+	int n = fd.getDescriptorNumber();
+	map(n, 0, getFileLength(n));
+}
+
+/**
+ * \brief Constructor to map a range of a file.
+ *
+ * The offset does not need to be page-aligned.
+ * @param fd descriptor of the file
+ * @param offset offset of the first byte of the range
+ * @param length length of the range
+ * @param mode access mode (READ_ONLY or READ_WRITE)
+ * @exception invalid_argument if the length is 0
+ * @exception runtime_error if the range exceeds the file or the file
+ * cannot be mapped
+ */
+MappedRegion::MappedRegion(FileDescriptor& fd, unsigned long int offset,
+    unsigned long int length, Mode mode):
+    base_(0),
+    mappedLength_(0),
+    offset_(offset),
+    mode_(mode)
+{
+	int n = fd.getDescriptorNumber();
+	unsigned long int fileLength = getFileLength(n);
+	if (offset > fileLength || length > fileLength - offset) {
+		ERROR("Range " << offset << "+" << length <<
+		    " beyond the end of the file (" << fileLength << ")");
+		throw std::runtime_error ("Map file error");
+	}
+	map(n, offset, length);
+}
+
+/**
+ * \brief Destructor. It unmaps the region.
+ *
+ * Changes to a READ_WRITE region are carried to the file by the kernel;
+ * call sync() to be sure they have reached the disk.
+ */
+MappedRegion::~MappedRegion()
+{
+	if (munmap(base_, mappedLength_) < 0)
+		ERROR("munmap()");
+}
+
+/**
+ * \brief Method to give the kernel a hint about the access pattern
+ *
+ * @param advice expected access pattern for the whole region
+ * @return true in case of success; false otherwise
+ */
+bool MappedRegion::advise(Advice advice)
+{
+	return (madvise(base_, mappedLength_, advice) == 0);
+}
+
+/**
+ * \brief Method to give the kernel a hint about the access pattern of a
+ * part of the region
+ *
+ * @param advice expected access pattern
+ * @param offset offset of the part, relative to the beginning of the region
+ * @param length length of the part
+ * @return true in case of success; false otherwise
+ * @exception out_of_range in case the part exceeds the region
+ */
+bool MappedRegion::advise(Advice advice, unsigned long int offset,
+    unsigned long int length)
+{
+	if (offset > getSize() || length > getSize() - offset)
+		throw std::out_of_range("Operation on buffer out of boundary");
+	char* start = getBuffer() + offset;
+	unsigned long int delta = pageDelta(offset_ + offset);
+	return (madvise(start - delta, length + delta, advice) == 0);
+}
+
+/**
+ * \brief Method to flush changes to the file
+ *
+ * @param wait true to wait until the changes have been written (MS_SYNC);
+ * false to just schedule the write (MS_ASYNC)
+ * @return true in case of success; false otherwise
+ */
+bool MappedRegion::sync(bool wait)
+{
+	return (msync(base_, mappedLength_, wait ? MS_SYNC : MS_ASYNC) == 0);
+}
+
+} /* onposix */
@@ -0,0 +1,234 @@
+/*
+ * Numa.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <errno.h>
+#include <fstream>
+#include <stdexcept>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "CpuTopology.hpp"
+#include "Numa.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Maximum number of nodes in the masks passed to the kernel
+ */
+static const int MAX_NODES = 1024;
+
+static const unsigned int BITS_PER_LONG = 8 * sizeof(unsigned long int);
+
+/**
+ * \brief Flags of mbind() and get_mempolicy() (see linux/mempolicy.h)
+ */
+static const unsigned int MPOL_MF_MOVE_ = 1 << 1;
+static const unsigned int MPOL_F_NODE_ = 1 << 0;
+static const unsigned int MPOL_F_ADDR_ = 1 << 1;
+
+/**
+ * \brief Function to build the node mask of a policy
+ *
+ * A node lower than 0 means all nodes, except for PREFERRED, where an
+ * empty mask means local allocation.
+ */
+static void buildMask(Numa::Policy policy, int node,
+    unsigned long int* mask)
+{
+	memset(mask, 0, MAX_NODES / 8);
+	if (node >= MAX_NODES)
+		throw std::runtime_error("NUMA node out of range");
+	if (node >= 0) {
+		mask[node / BITS_PER_LONG] |= 1UL << (node % BITS_PER_LONG);
+	} else if (policy != Numa::PREFERRED) {
+		std::vector<int> nodes = Numa::getNodes();
+		for (unsigned int i = 0; i < nodes.size(); ++i)
+			if (nodes[i] < MAX_NODES)
+				mask[nodes[i] / BITS_PER_LONG] |=
+				    1UL << (nodes[i] % BITS_PER_LONG);
+	}
+}
+
+/**
+ * \brief Function to handle the failure of a system call
+ *
+ * Without NUMA support in the kernel, the requests that do not name a node
+ * other than 0 are satisfied anyway.
+ * @exception std::runtime_error in the other cases
+ */
+static void checkError(const char* call, int node)
+{
+	if (errno == ENOSYS && node <= 0)
+		return;
+	throw std::runtime_error(std::string(call) + ": " + strerror(errno));
+}
+
+/**
+ * \brief Method to know if the kernel supports NUMA policies
+ */
+bool Numa::isAvailable()
+{
+	int mode;
+	return syscall(SYS_get_mempolicy, &mode, 0, 0, 0, 0) == 0;
+}
+
+/**
+ * \brief Method to get the online nodes
+ *
+ * @return The node numbers; only node 0 if the information is not
+ * available
+ */
+std::vector<int> Numa::getNodes()
+{
+	std::ifstream in ("/sys/devices/system/node/online");
+	std::string line;
+	std::getline(in, line);
+	std::vector<int> nodes = CpuTopology::parseCpuList(line);
+	if (nodes.empty())
+		nodes.push_back(0);
+	return nodes;
+}
+
+/**
+ * \brief Method to get the node of the CPU running the calling thread
+ *
+ * @return The node, or 0 if it cannot be known
+ */
+int Numa::getCurrentNode()
+{
+	unsigned int cpu, node;
+	if (syscall(SYS_getcpu, &cpu, &node, 0) != 0)
+		return 0;
+	return node;
+}
+
+/**
+ * \brief Method to set the memory policy of the calling thread
+ *
+ * The policy applies to the pages first touched afterwards by the thread,
+ * including heap memory (e.g., new).
+ * @param policy Memory policy
+ * @param node Node for PREFERRED and BIND; -1 means all nodes for BIND
+ * and INTERLEAVE and local allocation for PREFERRED. It is ignored by
+ * DEFAULT and LOCAL.
+ * @exception std::runtime_error in case of error
+ */
+void Numa::setThreadPolicy(Policy policy, int node)
+{
+	long int ret;
+	if (policy == DEFAULT || policy == LOCAL) {
+		ret = syscall(SYS_set_mempolicy, policy, 0, 0);
+		node = -1;
+	} else {
+		unsigned long int mask[MAX_NODES / BITS_PER_LONG];
+		buildMask(policy, node, mask);
+		ret = syscall(SYS_set_mempolicy, policy, mask, MAX_NODES + 1);
+	}
+	if (ret != 0)
+		checkError("set_mempolicy", node);
+}
+
+/**
+ * \brief Method to set the memory policy of a range of memory
+ *
+ * @param addr Start of the range (aligned to the page size)
+ * @param size Size of the range
+ * @param policy Memory policy
+ * @param node Node, as for setThreadPolicy()
+ * @param move If the pages already allocated must be moved to comply
+ * with the policy
+ * @exception std::runtime_error in case of error
+ */
+void Numa::bindMemory(void* addr, unsigned long int size, Policy policy,
+    int node, bool move)
+{
+	long int ret;
+	unsigned int flags = move ? MPOL_MF_MOVE_ : 0;
+	if (policy == DEFAULT || policy == LOCAL) {
+		ret = syscall(SYS_mbind, addr, size, policy, 0, 0, flags);
+		node = -1;
+	} else {
+		unsigned long int mask[MAX_NODES / BITS_PER_LONG];
+		buildMask(policy, node, mask);
+		ret = syscall(SYS_mbind, addr, size, policy, mask,
+		    MAX_NODES + 1, flags);
+	}
+	if (ret != 0)
+		checkError("mbind", node);
+}
+
+/**
+ * \brief Method to know the node of a page
+ *
+ * @param addr Address inside the page, which must have been touched
+ * @return The node, or -1 if it cannot be known
+ */
+int Numa::getNodeOfAddress(const void* addr)
+{
+	int node = -1;
+	if (syscall(SYS_get_mempolicy, &node, 0, 0, addr,
+	    MPOL_F_NODE_ | MPOL_F_ADDR_) != 0)
+		return -1;
+	return node;
+}
+
+/**
+ * \brief Method to allocate memory on a node
+ *
+ * The memory is mapped directly (i.e., not from the heap) and bound to the
+ * node, so its pages are allocated there when first touched.
+ * @param size Size of the memory
+ * @param node Node; -1 means the policy of the thread touching the pages
+ * @return Address of the memory, aligned to the page size
+ * @exception std::runtime_error in case of error
+ */
+void* Numa::allocate(unsigned long int size, int node)
+{
+	void* p = mmap(0, size, PROT_READ | PROT_WRITE,
+	    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED)
+		throw std::runtime_error(std::string("mmap: ") +
+		    strerror(errno));
+	if (node >= 0) {
+		try {
+			bindMemory(p, size, BIND, node);
+		} catch (std::runtime_error&) {
+			munmap(p, size);
+			throw;
+		}
+	}
+	return p;
+}
+
+/**
+ * \brief Method to free memory obtained through allocate()
+ *
+ * @param addr Address returned by allocate()
+ * @param size Size given to allocate()
+ */
+void Numa::release(void* addr, unsigned long int size)
+{
+	munmap(addr, size);
+}
+
+} /* onposix */
@@ -0,0 +1,339 @@
+/*
+ * PooledThread.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <vector>
+
+#include "AbstractThread.hpp"
+#include "Logger.hpp"
+#include "PooledThread.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Thread running the handlers of PooledThread
+ *
+ * Between two handlers it waits on its condition for the next one.
+ */
+class PooledThread::Carrier: public AbstractThread {
+	PosixMutex lock_;
+	PosixCondition assigned_;
+	PooledThread* task_;
+	bool exit_;
+
+	void run();
+
+public:
+	Carrier(): task_(0), exit_(false) {
+		setName("onposix-spare");
+	}
+
+	/**
+	 * \brief Method to give a handler to the thread
+	 */
+	void assign(PooledThread* t) {
+		lock_.lock();
+		task_ = t;
+		assigned_.signal();
+		lock_.unlock();
+	}
+
+	/**
+	 * \brief Method to make the parked thread exit
+	 */
+	void retire() {
+		lock_.lock();
+		exit_ = true;
+		assigned_.signal();
+		lock_.unlock();
+	}
+};
+
+/**
+ * \brief Threads shared by all the PooledThread objects
+ *
+ * It is created on the first use and never destroyed.
+ */
+struct PooledThread::Reserve {
+	PosixMutex lock_;
+
+	/**
+	 * \brief Threads parked, waiting for a handler
+	 */
+	std::vector<Carrier*> idle_;
+
+	/**
+	 * \brief Threads exited, to be joined and freed
+	 */
+	std::vector<Carrier*> retired_;
+	unsigned int maxIdle_;
+
+	Reserve(): maxIdle_(16) {}
+};
+
+PooledThread::Reserve* PooledThread::reserve_ = 0;
+
+static pthread_once_t reserveOnce = PTHREAD_ONCE_INIT;
+
+void PooledThread::createReserve()
+{
+	reserve_ = new Reserve;
+}
+
+/**
+ * \brief Method to get the threads shared by all the PooledThread objects
+ */
+PooledThread::Reserve& PooledThread::getReserve()
+{
+	pthread_once(&reserveOnce, createReserve);
+	return *reserve_;
+}
+
+/**
+ * \brief Method to join and free the threads retired so far
+ *
+ * It must be called without holding the lock of the reserve.
+ */
+void PooledThread::collect(std::vector<Carrier*>* retired)
+{
+	for (unsigned int i = 0; i < retired->size(); ++i) {
+		(*retired)[i]->waitForTermination();
+		delete (*retired)[i];
+	}
+	retired->clear();
+}
+
+void PooledThread::Carrier::run()
+{
+	for (;;) {
+		lock_.lock();
+		while (task_ == 0 && !exit_)
+			assigned_.wait(&lock_);
+		PooledThread* t = task_;
+		task_ = 0;
+		lock_.unlock();
+		if (t == 0)
+			return;
+
+		t->handler_(t->arg_);
+		// The next handler must not inherit the memory of this one
+		getArena().reset();
+
+		// Park before notifying, so that a start() following
+		// waitForTermination() finds this thread available
+		bool parked = PooledThread::park(this);
+		t->lock_.lock();
+		t->done_ = true;
+		t->finished_.signalAll();
+		t->lock_.unlock();
+		if (!parked)
+			return;
+	}
+}
+
+/**
+ * \brief Method to take a parked thread, or to create a new one
+ *
+ * @return The thread, or 0 if it cannot be created
+ */
+PooledThread::Carrier* PooledThread::acquire()
+{
+	Reserve& r = getReserve();
+	std::vector<Carrier*> retired;
+	Carrier* c = 0;
+	r.lock_.lock();
+	retired.swap(r.retired_);
+	if (!r.idle_.empty()) {
+		c = r.idle_.back();
+		r.idle_.pop_back();
+	}
+	r.lock_.unlock();
+	collect(&retired);
+
+	if (c == 0) {
+		c = new Carrier;
+		if (!c->start()) {
+			ERROR("Cannot create a pooled thread");
+			delete c;
+			return 0;
+		}
+	}
+	return c;
+}
+
+/**
+ * \brief Method to park a thread which has run its handler
+ *
+ * @return false if too many threads are parked, so the thread must exit
+ */
+bool PooledThread::park(Carrier* c)
+{
+	Reserve& r = getReserve();
+	bool parked = true;
+	r.lock_.lock();
+	if (r.idle_.size() < r.maxIdle_)
+		r.idle_.push_back(c);
+	else {
+		r.retired_.push_back(c);
+		parked = false;
+	}
+	r.lock_.unlock();
+	return parked;
+}
+
+/**
+ * \brief Constructor
+ *
+ * @param handler Function run by start()
+ * @param arg Argument of the function
+ */
+PooledThread::PooledThread(void (*handler)(void* p), void* arg):
+    handler_(handler),
+    arg_(arg),
+    started_(false),
+    done_(false)
+{
+}
+
+/**
+ * \brief Destructor
+ *
+ * In case the handler is running, it waits for its termination.
+ */
+PooledThread::~PooledThread()
+{
+	if (started_) {
+		WARNING("Waiting for a running pooled thread");
+		waitForTermination();
+	}
+}
+
+/**
+ * \brief Method to run the handler on a parked thread
+ *
+ * If the handler is already running this method does nothing.
+ * @return true if the handler is running or it has been previously
+ * started; false if no thread can be created.
+ */
+bool PooledThread::start()
+{
+	if (started_)
+		return true;
+	done_ = false;
+	Carrier* c = acquire();
+	if (c == 0)
+		return false;
+	started_ = true;
+	c->assign(this);
+	return true;
+}
+
+/**
+ * \brief Method to wait until the handler has returned
+ *
+ * @return true on success; false if the handler has not been started
+ */
+bool PooledThread::waitForTermination()
+{
+	if (!started_)
+		return false;
+	lock_.lock();
+	while (!done_)
+		finished_.wait(&lock_);
+	lock_.unlock();
+	started_ = false;
+	return true;
+}
+
+/**
+ * \brief Method to create threads in advance
+ *
+ * The maximum number of parked threads is raised if needed.
+ * @param threads Number of threads that must be parked
+ */
+void PooledThread::reserve(unsigned int threads)
+{
+	Reserve& r = getReserve();
+	r.lock_.lock();
+	if (r.maxIdle_ < threads)
+		r.maxIdle_ = threads;
+	unsigned int missing = (r.idle_.size() < threads) ?
+	    threads - r.idle_.size() : 0;
+	r.lock_.unlock();
+
+	for (unsigned int i = 0; i < missing; ++i) {
+		Carrier* c = new Carrier;
+		if (!c->start()) {
+			ERROR("Cannot create a pooled thread");
+			delete c;
+			return;
+		}
+		if (!park(c)) {
+			c->retire();
+			return;
+		}
+	}
+}
+
+/**
+ * \brief Method to set the maximum number of parked threads
+ *
+ * Parked threads in excess exit.
+ */
+void PooledThread::setMaxIdle(unsigned int threads)
+{
+	Reserve& r = getReserve();
+	std::vector<Carrier*> retired;
+	r.lock_.lock();
+	r.maxIdle_ = threads;
+	while (r.idle_.size() > threads) {
+		retired.push_back(r.idle_.back());
+		r.idle_.pop_back();
+	}
+	r.lock_.unlock();
+	for (unsigned int i = 0; i < retired.size(); ++i)
+		retired[i]->retire();
+	collect(&retired);
+}
+
+/**
+ * \brief Method to get the maximum number of parked threads
+ */
+unsigned int PooledThread::getMaxIdle()
+{
+	Reserve& r = getReserve();
+	r.lock_.lock();
+	unsigned int n = r.maxIdle_;
+	r.lock_.unlock();
+	return n;
+}
+
+/**
+ * \brief Method to get the number of parked threads
+ */
+unsigned int PooledThread::getIdle()
+{
+	Reserve& r = getReserve();
+	r.lock_.lock();
+	unsigned int n = r.idle_.size();
+	r.lock_.unlock();
+	return n;
+}
+
+} /* onposix */
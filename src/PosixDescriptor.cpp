@@ -18,10 +18,22 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
  */
 
+#include <errno.h>
+
+#include "Fiber.hpp"
 #include "PosixDescriptor.hpp"
 
 namespace onposix {
 
+/**
+ * \brief Maximum number of bytes transferred by a single syscall when a
+ * checksum is computed.
+ *
+ * It keeps the transferred data in cache until the checksum has been
+ * updated.
+ */
+#define CHECKSUM_CHUNK (128 * 1024)
+
 /**
  * \brief Function to start an asynchronous operation
  *
@@ -97,15 +109,15 @@ void PosixDescriptor::Worker::run()
 {
 	DEBUG("Worker running");
 	for (;;) {
-		DEBUG("===================");
-		DEBUG("New cycle");
+		DEBUGF("===================");
+		DEBUGF("New cycle");
 		bool close;
 		job* j = queue_->pop(&close);
 		if (j != 0){
 			int n;
-			DEBUG("Found one item in queue");
-			DEBUG("Need to read " << j->size_ << " bytes");
-			DEBUG("File descriptor = " << des_->getDescriptorNumber());
+			DEBUGF("Found one item in queue");
+			DEBUGF("Need to read %zu bytes", j->size_);
+			DEBUGF("File descriptor = %d", des_->getDescriptorNumber());
 
 			if (j->job_type_ == job::READ_BUFFER)
 				n = des_->do_read(j->buff_buffer_->getBuffer(), j->size_);
@@ -119,9 +131,9 @@ void PosixDescriptor::Worker::run()
 				ERROR("Handler called without operation!");
 				throw std::runtime_error ("Async error");
 			}
-			DEBUG("Read " << n << " bytes");
+			DEBUGF("Read %d bytes", n);
 
-			DEBUG("Calling handler");
+			DEBUGF("Calling handler");
 			if ((j->job_type_ == job::READ_BUFFER) || (j->job_type_ == job::WRITE_BUFFER))
 				j->buff_handler_(j->buff_buffer_, n);
 			else
@@ -130,7 +142,7 @@ void PosixDescriptor::Worker::run()
 		} else {
 			queue_->signal_empty();
 			if (!close) {
-				DEBUG("No data in queue");
+				DEBUGF("No data in queue");
 				queue_->wait_not_empty();
 			} else {
 				DEBUG("Exiting!!");
@@ -150,22 +162,34 @@ void PosixDescriptor::Worker::run()
  * number of bytes have been read.
  * @param buffer Pointer to the buffer where read bytes must be stored
  * @param size Number of bytes to be read
+ * @param c Checksum updated with the read bytes (0 for none)
  * @exception runtime_error if the ::read() returns an error
  * @return The number of actually read bytes or -1 in case of error
  */
-int PosixDescriptor::do_read (void* buffer, size_t size)
+int PosixDescriptor::do_read (void* buffer, size_t size, Checksum* c)
 {
 	size_t remaining = size;
 	while (remaining > 0) {
-		ssize_t ret = ::read (fd_, ((char*)buffer)+(size-remaining),
-		    remaining);
+		char* p = ((char*)buffer)+(size-remaining);
+		size_t chunk = remaining;
+		if (c != 0 && chunk > CHECKSUM_CHUNK)
+			chunk = CHECKSUM_CHUNK;
+		ssize_t ret = ::read (fd_, p, chunk);
 		if (ret == 0)
 			// End of file reached
 			break;
 		else if (ret < 0) {
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+			    FiberScheduler::isFiber()) {
+				// Park the fiber until data is available
+				FiberScheduler::waitReadable(*this);
+				continue;
+			}
 			throw std::runtime_error ("Read error");
 			return -1;
 		}
+		if (c != 0)
+			c->update(p, ret);
 		remaining -= ret;
 	}
 	return (size-remaining);
@@ -184,7 +208,7 @@ int PosixDescriptor::do_read (void* buffer, size_t size)
 int PosixDescriptor::read (Buffer* b, size_t size)
 {
 	if (b->getSize() == 0 || size > b->getSize()) {
-		ERROR("Buffer size not enough!");
+		ERROR_RATE(10, 10, "Buffer size not enough!");
 		return -1;
 	}
 	int ret = do_read(b->getBuffer(), size);
@@ -218,22 +242,34 @@ int PosixDescriptor::read (void* p, size_t size)
  * given number of bytes have been written.
  * @param buffer Pointer to the buffer containing bytes to be written
  * @param size Number of bytes to be written
+ * @param c Checksum updated with the written bytes (0 for none)
  * @exception runtime_error if the ::write() returns 0 or an error
  * @return The number of actually written bytes or -1 in case of error
  */
-int PosixDescriptor::do_write (const void* buffer, size_t size)
+int PosixDescriptor::do_write (const void* buffer, size_t size, Checksum* c)
 {
 	size_t remaining = size;
 	while (remaining > 0) {
-		ssize_t ret = ::write (fd_,
-		    ((char*)buffer)+(size-remaining), remaining);
+		const char* p = ((const char*)buffer)+(size-remaining);
+		size_t chunk = remaining;
+		if (c != 0 && chunk > CHECKSUM_CHUNK)
+			chunk = CHECKSUM_CHUNK;
+		ssize_t ret = ::write (fd_, p, chunk);
 		if (ret == 0)
 			// Cannot write more
 			break;
 		else if (ret < 0) {
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) &&
+			    FiberScheduler::isFiber()) {
+				// Park the fiber until there is room
+				FiberScheduler::waitWritable(*this);
+				continue;
+			}
 			throw std::runtime_error ("Write error");
 			return -1;
 		}
+		if (c != 0)
+			c->update(p, ret);
 		remaining -= ret;
 	}
 	return (size-remaining);
@@ -251,7 +287,7 @@ int PosixDescriptor::do_write (const void* buffer, size_t size)
 int PosixDescriptor::write (Buffer* b, size_t size)
 {
 	if (b->getSize() == 0 || size > b->getSize()) {
-		ERROR("Buffer size not enough!");
+		ERROR_RATE(10, 10, "Buffer size not enough!");
 		return -1;
 	}
 	return do_write(reinterpret_cast<const void*> (b->getBuffer()),
@@ -284,4 +320,73 @@ int PosixDescriptor::write (const std::string& s)
 	return do_write(reinterpret_cast<const void*> (s.c_str()), s.size());
 }
 
+/**
+ * \brief Method to read from the descriptor and update a checksum.
+ *
+ * The checksum is updated right after each chunk of data has been read,
+ * while the data is still in cache.
+ * Note: this method may block current thread if data is not available.
+ * @param b Pointer to the buffer to be filled
+ * @param size Number of bytes that must be read
+ * @param c Checksum to be updated with the read bytes
+ * @return -1 in case of error; the number of bytes read otherwise
+ */
+int PosixDescriptor::read (Buffer* b, size_t size, Checksum* c)
+{
+	if (b->getSize() == 0 || size > b->getSize()) {
+		ERROR_RATE(10, 10, "Buffer size not enough!");
+		return -1;
+	}
+	return do_read(b->getBuffer(), size, c);
+}
+
+/**
+ * \brief Method to read from the descriptor and update a checksum.
+ *
+ * Note: this method may block current thread if data is not available.
+ * @param p Pointer to the memory space to be filled
+ * @param size Number of bytes that must be read
+ * @param c Checksum to be updated with the read bytes
+ * @return -1 in case of error; the number of bytes read otherwise
+ */
+int PosixDescriptor::read (void* p, size_t size, Checksum* c)
+{
+	return do_read(p, size, c);
+}
+
+/**
+ * \brief Method to write data in a buffer and update a checksum.
+ *
+ * The checksum is updated right after each chunk of data has been
+ * written, while the data is still in cache.
+ * Note: this method may block current thread if data cannot be written.
+ * @param b Pointer to the buffer containing data
+ * @param size Number of bytes that must be written
+ * @param c Checksum to be updated with the written bytes
+ * @return -1 in case of error; the number of bytes written otherwise
+ */
+int PosixDescriptor::write (Buffer* b, size_t size, Checksum* c)
+{
+	if (b->getSize() == 0 || size > b->getSize()) {
+		ERROR_RATE(10, 10, "Buffer size not enough!");
+		return -1;
+	}
+	return do_write(reinterpret_cast<const void*> (b->getBuffer()),
+	    size, c);
+}
+
+/**
+ * \brief Method to write to the descriptor and update a checksum.
+ *
+ * Note: this method may block current thread if data cannot be written.
+ * @param p Pointer to the memory space containing data
+ * @param size Number of bytes that must be written
+ * @param c Checksum to be updated with the written bytes
+ * @return -1 in case of error; the number of bytes written otherwise
+ */
+int PosixDescriptor::write (const void* p, size_t size, Checksum* c)
+{
+	return do_write(p, size, c);
+}
+
 } /* onposix */
@@ -29,12 +29,38 @@ namespace onposix {
 /**
  * \brief Constructor. Initialize the mutex.
  *
+ * @param priorityInheritance If the mutex uses priority inheritance
+ * (PTHREAD_PRIO_INHERIT)
  * @exception runtime_error if the mutex initialization fails.
  */
-PosixMutex::PosixMutex()
+PosixMutex::PosixMutex(bool priorityInheritance)
 {
-	if (pthread_mutex_init(&mutex_, NULL) != 0)
-		throw std::runtime_error(std::string("Error: ") + strerror(errno));
+	int ret = initialize(&mutex_, priorityInheritance);
+	if (ret != 0)
+		throw std::runtime_error(std::string("Error: ") + strerror(ret));
+}
+
+/**
+ * \brief Function to initialize a pthread mutex
+ *
+ * @param mutex Mutex to be initialized
+ * @param priorityInheritance If the mutex uses priority inheritance
+ * (PTHREAD_PRIO_INHERIT)
+ * @return 0 in case of success; the error number otherwise
+ */
+int PosixMutex::initialize(pthread_mutex_t* mutex, bool priorityInheritance)
+{
+	if (!priorityInheritance)
+		return pthread_mutex_init(mutex, NULL);
+
+	pthread_mutexattr_t attr;
+	int ret = pthread_mutexattr_init(&attr);
+	if (ret == 0)
+		ret = pthread_mutexattr_setprotocol(&attr, PTHREAD_PRIO_INHERIT);
+	if (ret == 0)
+		ret = pthread_mutex_init(mutex, &attr);
+	pthread_mutexattr_destroy(&attr);
+	return ret;
 }
 
 /**
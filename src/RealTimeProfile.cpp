@@ -0,0 +1,136 @@
+/*
+ * RealTimeProfile.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <alloca.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "AbstractThread.hpp"
+#include "RealTimeProfile.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Stack left free above the prefaulted area, for run() itself
+ */
+static const unsigned long int STACK_MARGIN = 64 * 1024;
+
+/**
+ * \brief Constructor. The profile changes nothing.
+ */
+RealTimeProfile::RealTimeProfile():
+    policy_(SCHED_OTHER),
+    priority_(0),
+    scheduling_(false),
+    stackPrefault_(0),
+    memoryLock_(false)
+{
+}
+
+/**
+ * \brief Method to apply the profile before creating a thread
+ *
+ * It locks the memory if requested, and fills the attributes of the new
+ * thread.
+ * @param attr Attributes of the thread, already initialized
+ * @return false in case of error (errno is set)
+ */
+bool RealTimeProfile::apply(pthread_attr_t* attr) const
+{
+	if (memoryLock_ && !lockMemory())
+		return false;
+
+	int ret;
+	if (scheduling_) {
+		struct sched_param p;
+		p.sched_priority = priority_;
+		if (((ret = pthread_attr_setinheritsched(attr,
+		    PTHREAD_EXPLICIT_SCHED)) != 0) ||
+		    ((ret = pthread_attr_setschedpolicy(attr, policy_)) != 0) ||
+		    ((ret = pthread_attr_setschedparam(attr, &p)) != 0)) {
+			errno = ret;
+			return false;
+		}
+	}
+
+#if defined(ONPOSIX_LINUX_SPECIFIC) && defined(__GLIBC__) && \
+    ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ > 3)))
+	if (!affinity_.empty()) {
+		cpu_set_t s;
+		CPU_ZERO(&s);
+		for (unsigned int i = 0; (i < affinity_.size()) &&
+		    (i < CPU_SETSIZE); ++i)
+			if (affinity_[i])
+				CPU_SET(i, &s);
+		if ((ret = pthread_attr_setaffinity_np(attr, sizeof(s),
+		    &s)) != 0) {
+			errno = ret;
+			return false;
+		}
+	}
+#endif /* ONPOSIX_LINUX_SPECIFIC && GLIBC */
+
+	if (stackPrefault_ > 0) {
+		size_t size;
+		pthread_attr_getstacksize(attr, &size);
+		if (size < stackPrefault_ + STACK_MARGIN) {
+			long int page = sysconf(_SC_PAGESIZE);
+			size = (stackPrefault_ + STACK_MARGIN + page - 1) /
+			    page * page;
+			if ((ret = pthread_attr_setstacksize(attr, size)) != 0) {
+				errno = ret;
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * \brief Method to lock the current and future memory of the process
+ *
+ * @return false in case of error (e.g., not enough privileges)
+ */
+bool RealTimeProfile::lockMemory()
+{
+	return mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+}
+
+/**
+ * \brief Method to touch a given amount of the stack of the calling thread
+ *
+ * The pages stay mapped after the function returns, so later function
+ * calls do not fault on them.
+ * @param size Bytes of stack to touch
+ */
+void __attribute__((noinline)) RealTimeProfile::prefaultStack(
+    unsigned long int size)
+{
+	if (size == 0)
+		return;
+	volatile char* p = reinterpret_cast<volatile char*>(alloca(size));
+	long int page = sysconf(_SC_PAGESIZE);
+	for (unsigned long int i = 0; i < size; i += page)
+		p[i] = 0;
+	p[size - 1] = 0;
+}
+
+} /* onposix */
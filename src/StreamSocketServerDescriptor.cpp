@@ -34,7 +34,7 @@ StreamSocketServerDescriptor::StreamSocketServerDescriptor(const StreamSocketSer
 {
 	fd_ = accept(socket.getDescriptorNumber(), NULL, 0);
 	if (fd_ < 0) {
-		ERROR("accept()");
+		ERROR_RATE(10, 10, "accept()");
 		throw std::runtime_error("Accept error");
 	}
 }
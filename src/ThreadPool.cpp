@@ -0,0 +1,417 @@
+/*
+ * ThreadPool.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+#include <cstdio>
+#include <sched.h>
+#include <stdexcept>
+#include <unistd.h>
+
+#include "CpuTopology.hpp"
+#include "Numa.hpp"
+#include "ThreadPool.hpp"
+
+namespace onposix {
+
+/**
+ * \brief Rounds of search for work before an idle worker sleeps
+ */
+static const int SPIN_ROUNDS = 16;
+
+/**
+ * \brief Worker thread of a ThreadPool
+ */
+class ThreadPool::Worker: public AbstractThread {
+public:
+	/**
+	 * \brief Pool the worker belongs to
+	 */
+	ThreadPool* pool_;
+
+	/**
+	 * \brief Index in ThreadPool::workers_
+	 */
+	unsigned int index_;
+
+	/**
+	 * \brief State of the generator choosing the victims of steals
+	 */
+	unsigned int seed_;
+
+	/**
+	 * \brief Tasks submitted by this worker
+	 */
+	WorkStealingDeque<ThreadPoolTask*> deque_;
+
+	Worker(ThreadPool* pool, unsigned int index):
+	    pool_(pool),
+	    index_(index),
+	    seed_(index * 2654435761U + 1) {
+		char name[32];
+		snprintf(name, sizeof(name), "onposix-pool%u", index);
+		setName(name);
+	}
+
+	/**
+	 * \brief Method to get a pseudo-random number (xorshift)
+	 */
+	inline unsigned int random() {
+		seed_ ^= seed_ << 13;
+		seed_ ^= seed_ >> 17;
+		seed_ ^= seed_ << 5;
+		return seed_;
+	}
+
+protected:
+	void run();
+};
+
+__thread ThreadPool::Worker* ThreadPool::current_ = 0;
+
+/**
+ * \brief Main loop of the workers
+ *
+ * Each worker runs tasks until the pool is destroyed and no task is left.
+ */
+void ThreadPool::Worker::run()
+{
+	current_ = this;
+	if (pool_->node_ >= 0) {
+		try {
+			Numa::setThreadPolicy(Numa::PREFERRED, pool_->node_);
+		} catch (std::runtime_error&) {
+			// The node has been checked by the constructor: the
+			// kernel has no NUMA support, so all memory is local
+		}
+	}
+	int idle = 0;
+	for (;;) {
+		ThreadPoolTask* task = pool_->findTask(this);
+		if (task != 0) {
+			pool_->execute(task);
+			idle = 0;
+		} else if (idle < SPIN_ROUNDS) {
+			++idle;
+			sched_yield();
+		} else {
+			idle = 0;
+			if (!pool_->park())
+				break;
+		}
+	}
+	current_ = 0;
+}
+
+/**
+ * \brief Constructor. Starts the workers.
+ *
+ * When a NUMA node is given, the workers are pinned to its CPUs and
+ * allocate memory preferably from it.
+ * @param threads Number of workers; 0 means one per online CPU (of the
+ * node, if given)
+ * @param node NUMA node of the workers; -1 means no placement
+ * @exception std::runtime_error if the node does not exist or a worker
+ * cannot be started (or pinned to the node)
+ */
+ThreadPool::ThreadPool(unsigned int threads, int node):
+    injectedCount_(0),
+    sleepers_(0),
+    node_(node),
+    stopping_(false)
+{
+	std::vector<bool> nodeMask;
+	if (node_ >= 0) {
+		CpuTopology topology;
+		nodeMask = topology.getNodeMask(node_);
+		unsigned int cpus = 0;
+		for (unsigned int i = 0; i < nodeMask.size(); ++i)
+			if (nodeMask[i])
+				++cpus;
+		if (cpus == 0)
+			throw std::runtime_error("Thread pool: no CPU on node");
+		if (threads == 0)
+			threads = cpus;
+	}
+	if (threads == 0) {
+		long int cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = (cpus > 0) ? cpus : 1;
+	}
+
+	// All deques must exist before any worker starts stealing
+	for (unsigned int i = 0; i < threads; ++i)
+		workers_.push_back(new Worker(this, i));
+
+	// The workers are pinned when created, before running any task
+	if (node_ >= 0) {
+		RealTimeProfile profile;
+		profile.setAffinity(nodeMask);
+		for (unsigned int i = 0; i < threads; ++i)
+			workers_[i]->setRealTimeProfile(profile);
+	}
+	for (unsigned int i = 0; i < threads; ++i) {
+		if (!workers_[i]->start()) {
+			shutdown(i);
+			throw std::runtime_error("Thread pool: can't start worker");
+		}
+	}
+}
+
+/**
+ * \brief Destructor.
+ *
+ * It runs all the tasks still queued and then joins the workers.
+ */
+ThreadPool::~ThreadPool()
+{
+	shutdown(workers_.size());
+}
+
+/**
+ * \brief Method to stop and join the workers, and to free them
+ *
+ * @param started Number of workers that have been started
+ */
+void ThreadPool::shutdown(unsigned int started)
+{
+	{
+		MutexLocker l(idleLock_);
+		stopping_ = true;
+		idle_.signalAll();
+	}
+	for (unsigned int i = 0; i < started; ++i)
+		workers_[i]->waitForTermination();
+	for (unsigned int i = 0; i < workers_.size(); ++i)
+		delete workers_[i];
+	workers_.clear();
+}
+
+/**
+ * \brief Method to submit a function call
+ *
+ * @param function Function run by a worker
+ * @param arg Argument passed to the function
+ * @return Handle of the task
+ */
+ThreadPool::Handle ThreadPool::submit(void (*function)(void* arg), void* arg)
+{
+	ThreadPoolTask* task = new ThreadPoolFunction(function, arg);
+	schedule(task);
+	return Handle(this, task);
+}
+
+/**
+ * \brief Pool returned by getDefault()
+ */
+static ThreadPool* defaultPool = 0;
+
+static pthread_once_t defaultPoolOnce = PTHREAD_ONCE_INIT;
+
+static void createDefaultPool()
+{
+	defaultPool = new ThreadPool();
+}
+
+/**
+ * \brief Method to get the pool shared by the whole process
+ *
+ * The pool has one worker per online CPU; it is created on the first call
+ * and never destroyed, so it can be used until the process exits.
+ * @return The default pool
+ */
+ThreadPool& ThreadPool::getDefault()
+{
+	pthread_once(&defaultPoolOnce, createDefaultPool);
+	return *defaultPool;
+}
+
+/**
+ * \brief Method to know if the calling thread is a worker of this pool
+ */
+bool ThreadPool::isWorker() const
+{
+	return (current_ != 0) && (current_->pool_ == this);
+}
+
+/**
+ * \brief Method to queue a task and wake up an idle worker
+ *
+ * Tasks submitted by a worker go on its own deque; the others on the
+ * injection queue.
+ */
+void ThreadPool::schedule(ThreadPoolTask* task)
+{
+	Worker* w = current_;
+	if ((w != 0) && (w->pool_ == this)) {
+		w->deque_.push(task);
+	} else {
+		MutexLocker l(injectedLock_);
+		injected_.push_back(task);
+		__atomic_store_n(&injectedCount_, injected_.size(),
+		    __ATOMIC_RELAXED);
+	}
+
+	// Pairs with the increment of sleepers_ in park(): either the worker
+	// going to sleep sees the task, or we see the worker
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&sleepers_, __ATOMIC_RELAXED) > 0) {
+		MutexLocker l(idleLock_);
+		idle_.signal();
+	}
+}
+
+/**
+ * \brief Method to get the next task for a worker
+ *
+ * Tries the own deque, then the injection queue, then steals from the
+ * other workers starting from a random one.
+ * @return The task, or 0 if no task has been found
+ */
+ThreadPoolTask* ThreadPool::findTask(Worker* worker)
+{
+	ThreadPoolTask* task;
+	if (worker->deque_.take(&task))
+		return task;
+
+	if (__atomic_load_n(&injectedCount_, __ATOMIC_RELAXED) > 0) {
+		MutexLocker l(injectedLock_);
+		if (!injected_.empty()) {
+			task = injected_.front();
+			injected_.pop_front();
+			__atomic_store_n(&injectedCount_, injected_.size(),
+			    __ATOMIC_RELAXED);
+			return task;
+		}
+	}
+
+	unsigned int n = workers_.size();
+	unsigned int first = worker->random() % n;
+	for (unsigned int i = 0; i < n; ++i) {
+		Worker* victim = workers_[(first + i) % n];
+		if ((victim != worker) && victim->deque_.steal(&task))
+			return task;
+	}
+	return 0;
+}
+
+/**
+ * \brief Method to know if any task is queued
+ */
+bool ThreadPool::hasWork()
+{
+	if (__atomic_load_n(&injectedCount_, __ATOMIC_SEQ_CST) > 0)
+		return true;
+	for (unsigned int i = 0; i < workers_.size(); ++i)
+		if (workers_[i]->deque_.size() > 0)
+			return true;
+	return false;
+}
+
+/**
+ * \brief Method to put an idle worker to sleep until a task is submitted
+ *
+ * @return false if the worker must terminate
+ */
+bool ThreadPool::park()
+{
+	MutexLocker l(idleLock_);
+	__atomic_add_fetch(&sleepers_, 1, __ATOMIC_SEQ_CST);
+	if (!stopping_ && !hasWork())
+		idle_.wait(&idleLock_);
+	__atomic_sub_fetch(&sleepers_, 1, __ATOMIC_RELAXED);
+	return !stopping_ || hasWork();
+}
+
+/**
+ * \brief Method to run a task and notify the threads waiting for it
+ */
+void ThreadPool::execute(ThreadPoolTask* task)
+{
+	task->execute();
+	__atomic_store_n(&task->done_, 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&task->waited_, __ATOMIC_SEQ_CST)) {
+		MutexLocker l(finishedLock_);
+		finished_.signalAll();
+	}
+	task->release();
+}
+
+/**
+ * \brief Method to block until a task has been run
+ *
+ * A worker of the pool runs other tasks meanwhile; any other thread
+ * sleeps.
+ */
+void ThreadPool::wait(ThreadPoolTask* task)
+{
+	Worker* w = current_;
+	if ((w != 0) && (w->pool_ == this)) {
+		while (!__atomic_load_n(&task->done_, __ATOMIC_ACQUIRE)) {
+			ThreadPoolTask* other = findTask(w);
+			if (other != 0)
+				execute(other);
+			else
+				sched_yield();
+		}
+		return;
+	}
+
+	MutexLocker l(finishedLock_);
+	__atomic_store_n(&task->waited_, 1, __ATOMIC_SEQ_CST);
+	while (!__atomic_load_n(&task->done_, __ATOMIC_SEQ_CST))
+		finished_.wait(&finishedLock_);
+}
+
+#if defined(ONPOSIX_LINUX_SPECIFIC) && defined(__GLIBC__) && \
+    ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ > 3)))
+/**
+ * \brief Set CPU affinity of a worker
+ *
+ * Example of usage (one worker per CPU):
+ * \code
+ * for (unsigned int i = 0; i < pool.getThreads(); ++i) {
+ * 	std::vector<bool> v (pool.getThreads(), false);
+ * 	v[i] = true;
+ * 	pool.setAffinity(i, v);
+ * }
+ * \endcode
+ * @param worker Index of the worker
+ * @param v: vector of booleans containing the affinity (true/false)
+ * @exception std::runtime_error in case affinity cannot be set
+ */
+void ThreadPool::setAffinity(unsigned int worker, const std::vector<bool>& v)
+{
+	if (worker >= workers_.size())
+		throw std::runtime_error ("Set affinity error: no such worker");
+	workers_[worker]->setAffinity(v);
+}
+
+/**
+ * \brief Set CPU affinity of all the workers
+ *
+ * @param v: vector of booleans containing the affinity (true/false)
+ * @exception std::runtime_error in case affinity cannot be set
+ */
+void ThreadPool::setAffinity(const std::vector<bool>& v)
+{
+	for (unsigned int i = 0; i < workers_.size(); ++i)
+		workers_[i]->setAffinity(v);
+}
+#endif /* ONPOSIX_LINUX_SPECIFIC && GLIBC */
+
+} /* onposix */
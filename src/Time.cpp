@@ -54,7 +54,13 @@ Time::Time(clockid_t clockType): clockType_(clockType)
 void Time::add(time_t sec, long nsec)
 {
 	time_.tv_nsec += nsec;
-	time_.tv_sec += sec;
+	time_.tv_sec += sec + time_.tv_nsec / 1000000000L;
+	time_.tv_nsec %= 1000000000L;
+	// Keep the nanoseconds in [0, 1s), as required by POSIX timeouts
+	if (time_.tv_nsec < 0) {
+		time_.tv_nsec += 1000000000L;
+		--time_.tv_sec;
+	}
 }
 
 /**
@@ -123,6 +123,20 @@
  * ./test
  * \endcode
  *
+ * Micro-benchmarks are available inside the bench directory. To build them,
+ * type
+ *
+ * \code
+ * make bench
+ * \endcode
+ *
+ * The tools directory contains logdecode, which converts binary log files
+ * to text. To build it, type
+ *
+ * \code
+ * make tools
+ * \endcode
+ *
  * <br>
  * <br>
  * <h1>Examples of usage</h1>
@@ -183,6 +197,11 @@
  * }
  * \endcode
  *
+ * \ref onposix::PooledThread has the same interface, but runs the handler
+ * on a parked thread reused across calls, so short bursty handlers do not
+ * pay for thread creation. PooledThread::reserve() creates threads in
+ * advance.
+ *
  * For more complex cases, or if you need a better exchange of arguments
  * (e.g., return values), create your own class by inheriting from 
  * \ref onposix::AbstractThread and specifying a run() method.
@@ -211,6 +230,102 @@
  * }
  * \endcode
  *
+ * Threads can be named (the name is visible in top and ps) and report
+ * their CPU time, voluntary and involuntary context switches and wall
+ * runtime. The statistics of all running library threads (including the
+ * workers of descriptors, pools and logger) can be listed at once:
+ *
+ * \code
+ * t.setName("decoder");
+ * std::vector<ThreadStats> threads;
+ * AbstractThread::getThreads(&threads);
+ * for (unsigned int i = 0; i < threads.size(); ++i)
+ *	std::cout << threads[i].name << ": " << threads[i].cpuTime << " ns, "
+ *	    << threads[i].involuntarySwitches << " preemptions" << std::endl;
+ * \endcode
+ *
+ * Latency-critical threads can be given a \ref onposix::RealTimeProfile,
+ * applied by start() before the thread runs: scheduling policy and
+ * affinity, locked memory and a prefaulted stack. Priority inheritance is
+ * chosen per mutex instead, through PosixMutex(true) or the constructors
+ * of the shared queues. The cyclictest benchmark measures the wake-up
+ * jitter with and without a profile:
+ *
+ * \code
+ * RealTimeProfile p;
+ * p.setScheduling(SCHED_FIFO, 80).setStackPrefault(512*1024)
+ *	.setMemoryLock(true);
+ * t.setRealTimeProfile(p);
+ * t.start();
+ * \endcode
+ *
+ * Each thread owns a \ref onposix::Arena, a bump allocator for short-lived
+ * objects: allocations are served without locks from per-thread blocks and
+ * released all at once when a reset point goes out of scope. Large
+ * requests fall back to the heap. ArenaAllocator plugs the arena into STL
+ * containers:
+ *
+ * \code
+ * void run() {
+ *	for (;;) {
+ *		Arena::Scope s (getArena());
+ *		std::vector<int, ArenaAllocator<int> > v;
+ *		// ...
+ *	}
+ * }
+ * \endcode
+ *
+ * Short tasks can be run by a \ref onposix::ThreadPool. Each worker has its
+ * own deque of tasks: tasks submitted by a worker are run by the same
+ * worker, while idle workers steal tasks from the others. submit() accepts
+ * a function with its argument or a function object, and returns a handle
+ * to wait for the task:
+ *
+ * \code
+ * ThreadPool pool (4);
+ * ThreadPool::Handle h = pool.submit(myfunction, (void*) &b);
+ * h.wait();
+ * \endcode
+ *
+ * Scans of large buffers can be split across the workers of the default
+ * pool (one worker per CPU, created on first use) through
+ * \ref onposix::parallelFor, \ref onposix::parallelReduce and
+ * \ref onposix::parallelTransform. The range is split in chunks not larger
+ * than the given grain size (0 chooses it from the number of workers):
+ *
+ * \code
+ * // Calls f(begin, end) on chunks of at most 16 blocks
+ * parallelFor(0, blocks, 16, f);
+ * // Upper case copy of a Buffer
+ * parallelTransform(in.getBuffer(), in.getBuffer() + in.getSize(),
+ *     out.getBuffer(), 0, ::toupper);
+ * \endcode
+ *
+ * \ref onposix::CpuTopology reads from sysfs which CPUs are SMT siblings,
+ * share the last level cache or belong to the same NUMA node, and builds
+ * the affinity masks of common placements (onePerCore(), compact() on a
+ * node, spread() across LLCs) for threads, processes and pools:
+ *
+ * \code
+ * CpuTopology topology;
+ * std::vector<std::vector<bool> > masks =
+ *	topology.onePerCore(pool.getThreads());
+ * for (unsigned int i = 0; i < masks.size(); ++i)
+ *	pool.setAffinity(i, masks[i]);
+ * \endcode
+ *
+ * On NUMA machines, \ref onposix::Numa sets the memory policy of the
+ * calling thread (e.g., node-local allocation) through the kernel system
+ * calls, without libnuma. Buffers and thread pools accept a target node:
+ * the memory of the buffer is bound to the node, and the workers of the
+ * pool are pinned to its CPUs and allocate memory from it:
+ *
+ * \code
+ * Numa::setThreadPolicy(Numa::LOCAL);
+ * Buffer b (64*1024*1024, 1);
+ * ThreadPool pool (0, 1);
+ * \endcode
+ *
  * <h2>Mutual exclusion</h2>
  *
  * \code
@@ -254,6 +369,15 @@
  * fd.close();
  * \endcode
  *
+ * Checksums (\ref onposix::Crc32c and \ref onposix::XxHash64) can be
+ * computed while data is read or written, without a separate pass:
+ *
+ * \code
+ * Crc32c crc;
+ * fd.write (&b, b.getSize(), &crc);
+ * uint64_t value = crc.getValue();
+ * \endcode
+ *
  * <h2>Socket descriptors</h2>
  *
  * The library offers mechanisms for both connection-oriented (e.g., TCP) and
@@ -308,6 +432,19 @@
  * \endcode
  *
  *
+ * <h2>Memory-mapped files</h2>
+ *
+ * \ref onposix::MappedRegion maps a file (or a range of it) in memory.
+ * Since it is a \ref onposix::Buffer, it can be used wherever a buffer is
+ * expected, without copying the file content:
+ *
+ * \code
+ * FileDescriptor fd ("/tmp/myindex", O_RDONLY);
+ * MappedRegion m (fd);
+ * m.advise(MappedRegion::SEQUENTIAL);
+ * unsigned long int pos = m.find('\n');
+ * \endcode
+ *
  * <h2>FIFOs (AKA "named pipes")</h2>
  *
  * \code
@@ -347,6 +484,86 @@
  * DEBUG("this is an error");
  * \endcode
  *
+ * By default, messages are printed by the calling thread. In asynchronous
+ * mode, each thread appends its messages to a private lock-free ring, and a
+ * background thread writes them in batches. When a ring is full, the
+ * message is either dropped (Logger::DROP) or the caller waits
+ * (Logger::BLOCK):
+ * \code
+ * Logger::getInstance().startAsync(Logger::DROP);
+ * DEBUG("hello " << "world");
+ * Logger::getInstance().flush();
+ * \endcode
+ *
+ * The DEBUGF(), WARNINGF() and ERRORF() macros take a printf-like format,
+ * checked at compile time. Only the values of the arguments are copied at
+ * the call site, and the message is formatted when it is printed (i.e., by
+ * the background thread in asynchronous mode):
+ * \code
+ * DEBUGF("read %d bytes from %s", n, name.c_str());
+ * \endcode
+ *
+ * For high-rate tracing, the file can be written in a compact binary format
+ * (through a memory-mapped window), without formatting the messages at
+ * all. Binary files are converted to text by tools/logdecode:
+ * \code
+ * Logger::getInstance().setFile("/tmp/myproject", Logger::BINARY);
+ * \endcode
+ *
+ * Messages are timestamped with nanosecond resolution, relative to the
+ * start of the program; each file begins with a [CLOCK] line relating this
+ * time to the wall clock. Timestamps are read from CLOCK_MONOTONIC by
+ * default; \ref onposix::LogClock can switch to the calibrated TSC or to
+ * the coarse clock, which are cheaper (see bench/timestamps):
+ * \code
+ * LogClock::setSource(LogClock::getBestSource());
+ * \endcode
+ *
+ * Log files are written through a memory-mapped window, so writing a
+ * message is just a copy in memory. They can be rotated by size and/or age,
+ * keeping only the most recent files; the space of each new file is
+ * preallocated, so that writes do not stall while the file grows:
+ * \code
+ * // Files of at most 64 MB, rotated at least hourly; keep the latest 10
+ * Logger::getInstance().setRotation(64*1024*1024, 3600, 10);
+ * LOG_FILE("/tmp/myproject");
+ * \endcode
+ *
+ * Call sites that may log at high rate (e.g., on errors caused by a peer)
+ * can be limited through the *_RATE() (token bucket) and *_SAMPLE() (one
+ * message every N) variants of all macros. The state is kept per call
+ * site, and the number of suppressed messages is reported periodically:
+ * \code
+ * ERROR_RATE(10, 5, "read() failed on " << fd);	// 10/s, bursts of 5
+ * DEBUGF_SAMPLE(1000, "received packet %u", seq);
+ * \endcode
+ *
+ * The compile-time levels are an upper bound: each source file (or group
+ * of files sharing the tag defined by LOG_MODULE) also has a level that can
+ * be changed at runtime, checked through a single atomic load (see
+ * \ref onposix::LogModule). Levels are set by name, or loaded from a file
+ * that can be reloaded on a signal:
+ * \code
+ * LogModule::setLevel("*", LOG_WARNINGS);
+ * LogModule::setLevel("PosixDescriptor.cpp", LOG_ALL);
+ * LogModule::reloadOnSignal("/etc/myproject/log.conf", SIGHUP);
+ * \endcode
+ *
+ * <h2>Searching buffers</h2>
+ *
+ * Search and compare operations on \ref onposix::Buffer use SSE2/AVX2
+ * kernels (see \ref onposix::ByteSearch) selected at runtime according to
+ * the CPU:
+ *
+ * \code
+ * Buffer b (100);
+ * fd.read (&b, b.getSize());
+ * unsigned long int eol = b.findAnyOf("\r\n", 2);
+ * if (eol != Buffer::npos) {
+ *	//...
+ * }
+ * \endcode
+ *
  * <h2>Timing</h2>
  *
  * \code
@@ -372,6 +589,26 @@
  * }; 
  * \endcode
  *
+ * Many sessions can share one thread as fibers of a
+ * \ref onposix::FiberScheduler. A fiber reading a non-blocking descriptor
+ * with no data is parked until the monitor reports it as readable, so
+ * session code keeps the blocking style:
+ *
+ * \code
+ * void session(void* arg)
+ * {
+ *	PosixDescriptor* d = reinterpret_cast<PosixDescriptor*>(arg);
+ *	while (d->read(request, sizeof(request)) > 0)
+ *		// ...
+ * }
+ *
+ * DescriptorsMonitor dm;
+ * FiberScheduler s (dm);
+ * s.spawn(session, &d1);
+ * s.spawn(session, &d2);
+ * s.run();
+ * \endcode
+ *
  * <h2>Assertions</h2>
  *
  * Assertions provided by this library work also when code is compiled with the
@@ -387,7 +624,9 @@
  * <h2>Much more...</h2>
  *
  * The library also offer Observer designer pattern on descriptors (i.e., \ref onposix::DescriptorsMonitor), buffers (i.e., \ref onposix::Buffer)
- * and shared queues (i.e., \ref onposix::PosixSharedQueue and \ref onposix::PosixPrioritySharedQueue).
+ * and shared queues (i.e., \ref onposix::PosixSharedQueue and \ref onposix::PosixPrioritySharedQueue,
+ * the bounded lock-free \ref onposix::BoundedSharedQueue and the
+ * earliest-deadline-first \ref onposix::DeadlineSharedQueue).
  *
  * <br>
  * <br>
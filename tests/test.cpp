@@ -20,11 +20,20 @@
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
 #include <vector>
 #include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 
 /// Log level for console messages:
@@ -33,21 +42,41 @@
 /// Log level for file:
 #define LOG_LEVEL_FILE		LOG_ALL
 #include "Logger.hpp"
+#include "LogBinary.hpp"
+#include "LogClock.hpp"
 
 
 #include "Buffer.hpp"
+#include "BoundedSharedQueue.hpp"
+#include "DeadlineSharedQueue.hpp"
+#include "ByteSearch.hpp"
+#include "Checksum.hpp"
 #include "AbstractDescriptorReader.hpp"
 #include "DescriptorsMonitor.hpp"
 #include "FileDescriptor.hpp"
+#include "MappedRegion.hpp"
 #include "FifoDescriptor.hpp"
+#include "Fiber.hpp"
 #include "StreamSocketServerDescriptor.hpp"
 #include "StreamSocketServer.hpp"
 #include "StreamSocketClientDescriptor.hpp"
 #include "AbstractThread.hpp"
+#include "Arena.hpp"
+#include "PosixMutex.hpp"
+#include "PosixSharedQueue.hpp"
+#include "PosixPrioritySharedQueue.hpp"
+#include "RealTimeProfile.hpp"
 #include "Time.hpp"
 #include "SimpleThread.hpp"
+#include "PooledThread.hpp"
+#include "CpuTopology.hpp"
+#include "Numa.hpp"
+#include "Parallel.hpp"
+#include "ThreadPool.hpp"
+#include "WorkStealingDeque.hpp"
 #include "Process.hpp"
 #include "Pipe.hpp"
+#include <sys/mman.h>
 
 
 // Uncomment to enable Linux-specific methods:
@@ -198,6 +227,158 @@ TEST (BufferTest, Comparison)
 }
 
 
+TEST (BufferTest, Find)
+{
+	Buffer b (100);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		b[i] = 'a';
+	b[70] = '\n';
+	b[90] = '\r';
+	for (int impl = ByteSearch::SCALAR;
+	    impl <= ByteSearch::getBestImplementation(); ++impl) {
+		ASSERT_TRUE(ByteSearch::setImplementation(
+		    static_cast<ByteSearch::Implementation>(impl)));
+		ASSERT_EQ(b.find('\n'), 70UL)
+			<< "ERROR: byte not found (implementation " << impl << ")";
+		ASSERT_EQ(b.find('\n', 71), Buffer::npos)
+			<< "ERROR: byte found after its position";
+		ASSERT_EQ(b.findAnyOf("\r\n", 2, 71), 90UL)
+			<< "ERROR: set not found (implementation " << impl << ")";
+		ASSERT_EQ(b.findAnyOf("xyz", 3), Buffer::npos)
+			<< "ERROR: set found when not present";
+	}
+	ByteSearch::setImplementation(ByteSearch::getBestImplementation());
+}
+
+TEST (BufferTest, FindSubstring)
+{
+	Buffer b (200);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		b[i] = 'A' + (i % 7);
+	const char* s = "HTTP/1.0";
+	b.fill(s, 8);
+	std::memcpy(b.getBuffer() + 192, s, 8);
+	for (int impl = ByteSearch::SCALAR;
+	    impl <= ByteSearch::getBestImplementation(); ++impl) {
+		ASSERT_TRUE(ByteSearch::setImplementation(
+		    static_cast<ByteSearch::Implementation>(impl)));
+		ASSERT_EQ(b.find(s, 8), 0UL)
+			<< "ERROR: sequence not found (implementation " << impl << ")";
+		ASSERT_EQ(b.find(s, 8, 1), 192UL)
+			<< "ERROR: sequence at the end not found";
+		ASSERT_EQ(b.find(s, 8, 193), Buffer::npos)
+			<< "ERROR: sequence found after its position";
+		ASSERT_EQ(b.find("ABCDEFGA", 8, 1), 14UL)
+			<< "ERROR: sequence in the middle not found";
+	}
+	ByteSearch::setImplementation(ByteSearch::getBestImplementation());
+}
+
+TEST (BufferTest, Mismatch)
+{
+	Buffer b1 (100);
+	Buffer b2 (100);
+	for (unsigned int i = 0; i < b1.getSize(); ++i)
+		b1[i] = b2[i] = i;
+	for (int impl = ByteSearch::SCALAR;
+	    impl <= ByteSearch::getBestImplementation(); ++impl) {
+		ASSERT_TRUE(ByteSearch::setImplementation(
+		    static_cast<ByteSearch::Implementation>(impl)));
+		b2[99] = b1[99];
+		ASSERT_EQ(b1.mismatch(&b2, 100), Buffer::npos)
+			<< "ERROR: equal buffers reported as different";
+		b2[99] = 0;
+		ASSERT_EQ(b1.mismatch(&b2, 100), 99UL)
+			<< "ERROR: wrong mismatch position (implementation " << impl << ")";
+		ASSERT_EQ(b1.mismatch(b2.getBuffer(), 99), Buffer::npos)
+			<< "ERROR: mismatch outside the compared area";
+	}
+	ByteSearch::setImplementation(ByteSearch::getBestImplementation());
+}
+
+
+// ======================================================================
+//   CHECKSUMS
+// ======================================================================
+
+TEST (ChecksumTest, Crc32c)
+{
+	Buffer b (100);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		b[i] = i;
+	b.fill("123456789", 9);
+	for (int impl = Crc32c::TABLE;
+	    impl <= Crc32c::getBestImplementation(); ++impl) {
+		ASSERT_TRUE(Crc32c::setImplementation(
+		    static_cast<Crc32c::Implementation>(impl)));
+		ASSERT_EQ(Crc32c::compute("123456789", 9), 0xE3069283U)
+			<< "ERROR: wrong CRC (implementation " << impl << ")";
+		Crc32c c;
+		c.update(&b, 0, 4);
+		c.update(&b, 4, 5);
+		ASSERT_EQ(c.getValue(), 0xE3069283U)
+			<< "ERROR: wrong incremental CRC";
+		c.reset();
+		c.update(&b, 3, 97);
+		ASSERT_EQ(c.getValue(), Crc32c::compute(b.getBuffer() + 3, 97))
+			<< "ERROR: incremental and one-shot CRC differ";
+	}
+	Crc32c::setImplementation(Crc32c::getBestImplementation());
+}
+
+TEST (ChecksumTest, XxHash64)
+{
+	ASSERT_EQ(XxHash64::compute("", 0), 0xEF46DB3751D8E999ULL)
+		<< "ERROR: wrong hash of empty input";
+	ASSERT_EQ(XxHash64::compute("abc", 3), 0x44BC2CF5AD770999ULL)
+		<< "ERROR: wrong hash of short input";
+	Buffer b (100);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		b[i] = i;
+	ASSERT_EQ(XxHash64::compute(b.getBuffer(), 100), 0x6AC1E58032166597ULL)
+		<< "ERROR: wrong hash of long input";
+	XxHash64 h;
+	h.update(&b, 0, 7);
+	h.update(&b, 7, 30);
+	h.update(&b, 37, 63);
+	ASSERT_EQ(h.getValue(), 0x6AC1E58032166597ULL)
+		<< "ERROR: wrong incremental hash";
+	bool catched = false;
+	try {
+		h.update(&b, 50, 51);
+	} catch (std::out_of_range&) {
+		catched = true;
+	}
+	ASSERT_TRUE(catched)
+		<< "ERROR: exception not thrown for range out of boundary";
+}
+
+TEST (ChecksumTest, FusedReadWrite)
+{
+	Buffer b (300000);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		b[i] = i * 7;
+	Crc32c written;
+	FileDescriptor fd1("/tmp/test-checksum-1", O_WRONLY|O_CREAT|O_TRUNC,
+	    S_IRWXU);
+	ASSERT_EQ(fd1.write(&b, b.getSize(), &written), 300000)
+		<< "ERROR: write with checksum";
+	fd1.close();
+	ASSERT_EQ(written.getValue(), Crc32c::compute(b.getBuffer(),
+	    b.getSize()))
+		<< "ERROR: wrong checksum of written data";
+
+	Buffer r (300000);
+	XxHash64 read;
+	FileDescriptor fd2("/tmp/test-checksum-1", O_RDONLY);
+	ASSERT_EQ(fd2.read(&r, r.getSize(), &read), 300000)
+		<< "ERROR: read with checksum";
+	ASSERT_EQ(read.getValue(), XxHash64::compute(b.getBuffer(),
+	    b.getSize()))
+		<< "ERROR: wrong checksum of read data";
+}
+
+
 // ======================================================================
 //   FIFOs
 // ======================================================================
@@ -341,6 +522,100 @@ TEST (FileDescriptorTest, ReadOnly)
 
 
 
+TEST (MappedRegionTest, ReadOnly)
+{
+	bool catched = false;
+	try {
+		FileDescriptor fd1("/tmp/test-mmap-1", O_WRONLY|O_CREAT|O_TRUNC,
+		    S_IRWXU);
+		const char* s1 = "ABCDEFGHILMNOPQRSTUVZ";
+		fd1.write(s1, 21);
+		fd1.close();
+
+		FileDescriptor fd2("/tmp/test-mmap-1", O_RDONLY);
+		MappedRegion m(fd2);
+		ASSERT_EQ(m.getSize(), 21UL)
+			<< "ERROR: wrong size of mapped file";
+		ASSERT_TRUE(m.compare(s1, 21))
+			<< "ERROR: content of mapped file wrong";
+		ASSERT_EQ(m.find('M'), 10UL)
+			<< "ERROR: search on mapped file";
+		ASSERT_TRUE(m.advise(MappedRegion::SEQUENTIAL))
+			<< "ERROR: madvise() failed";
+		Buffer b(21);
+		b.fill(&m, 21);
+		ASSERT_TRUE(b.compare(&m, 21))
+			<< "ERROR: fill from mapped file";
+	} catch (...) {
+		catched = true;
+	}
+	ASSERT_FALSE(catched)
+		<< "ERROR: exception thrown when mapping a file";
+}
+
+TEST (MappedRegionTest, ReadWriteRange)
+{
+	bool catched = false;
+	try {
+		FileDescriptor fd1("/tmp/test-mmap-2", O_RDWR|O_CREAT|O_TRUNC,
+		    S_IRWXU);
+		Buffer b(8192);
+		for (unsigned int i = 0; i < b.getSize(); ++i)
+			b[i] = 'a';
+		fd1.write(&b, b.getSize());
+
+		MappedRegion m(fd1, 5000, 10, MappedRegion::READ_WRITE);
+		ASSERT_EQ(m.getOffset(), 5000UL)
+			<< "ERROR: wrong offset of mapped region";
+		ASSERT_TRUE(m.advise(MappedRegion::WILLNEED, 2, 5))
+			<< "ERROR: madvise() on part of the region failed";
+		m.fill("0123456789", 10);
+		ASSERT_TRUE(m.sync())
+			<< "ERROR: msync() failed";
+
+		fd1.lseek(4999);
+		fd1.read(&b, 12);
+		ASSERT_TRUE(b.compare("a0123456789a", 12))
+			<< "ERROR: changes not carried to the file";
+	} catch (...) {
+		catched = true;
+	}
+	ASSERT_FALSE(catched)
+		<< "ERROR: exception thrown when mapping a range of a file";
+}
+
+TEST (MappedRegionTest, EmptyFile)
+{
+	bool catched = false;
+	try {
+		FileDescriptor fd1("/tmp/test-mmap-3", O_RDWR|O_CREAT|O_TRUNC,
+		    S_IRWXU);
+		MappedRegion m(fd1);
+	} catch (...) {
+		catched = true;
+	}
+	ASSERT_TRUE(catched)
+		<< "ERROR: exception not thrown when mapping an empty file";
+}
+
+TEST (MappedRegionTest, BeyondEnd)
+{
+	FileDescriptor fd1("/tmp/test-mmap-4", O_RDWR|O_CREAT|O_TRUNC,
+	    S_IRWXU);
+	Buffer b(8192);
+	fd1.write(&b, b.getSize());
+
+	ASSERT_THROW(MappedRegion(fd1, 8000, 500), std::runtime_error)
+		<< "ERROR: range beyond the end of the file accepted";
+	ASSERT_THROW(MappedRegion(fd1, 10000, 1), std::runtime_error)
+		<< "ERROR: offset beyond the end of the file accepted";
+	MappedRegion m(fd1, 8000, 192);
+	ASSERT_EQ(m.getSize(), 192UL)
+		<< "ERROR: range ending at the end of the file refused";
+}
+
+
+
 // ======================================================================
 //   PROCESSES
 // ======================================================================
@@ -466,6 +741,245 @@ TEST (ThreadTest, SchedParam)
 		<< "ERROR: can't stop the thread!";
 }
 
+class StatsThread: public AbstractThread {
+public:
+	bool busyDone_;
+	bool stop_;
+
+	StatsThread(): busyDone_(false), stop_(false) {}
+
+	void run() {
+		// 50 ms of CPU, then sleep until stopped
+		struct timespec t;
+		do
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+		while (t.tv_sec == 0 && t.tv_nsec < 50000000);
+		usleep(1000);
+		__atomic_store_n(&busyDone_, true, __ATOMIC_RELEASE);
+		while (!__atomic_load_n(&stop_, __ATOMIC_ACQUIRE))
+			usleep(1000);
+	}
+};
+
+static bool find_thread (pid_t tid, ThreadStats* s)
+{
+	std::vector<ThreadStats> threads;
+	AbstractThread::getThreads(&threads);
+	for (unsigned int i = 0; i < threads.size(); ++i) {
+		if (threads[i].tid == tid) {
+			*s = threads[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+TEST (ThreadTest, Stats)
+{
+	StatsThread t;
+	t.setName("stats-test");
+	ThreadStats s;
+	ASSERT_FALSE(t.getStats(&s))
+	    << "ERROR: statistics of a thread not started";
+	ASSERT_TRUE(t.start());
+	while (!__atomic_load_n(&t.busyDone_, __ATOMIC_ACQUIRE))
+		usleep(1000);
+
+	ASSERT_TRUE(t.getStats(&s));
+	ASSERT_TRUE(s.running);
+	ASSERT_EQ(s.name, "stats-test");
+	ASSERT_GE(s.cpuTime, 50000000ULL)
+	    << "ERROR: CPU time not measured";
+	ASSERT_GE(s.wallTime, s.cpuTime);
+	ASSERT_GE(s.voluntarySwitches, 1UL)
+	    << "ERROR: voluntary context switches not counted";
+	char comm[64];
+	snprintf(comm, sizeof(comm), "/proc/self/task/%d/comm", (int) s.tid);
+	std::ifstream in (comm);
+	std::string name;
+	std::getline(in, name);
+	ASSERT_EQ(name, "stats-test")
+	    << "ERROR: name not set in the kernel";
+
+	ThreadStats r;
+	ASSERT_TRUE(find_thread(s.tid, &r))
+	    << "ERROR: running thread not in the registry";
+	ASSERT_EQ(r.name, "stats-test");
+	{
+		// Workers are registered when started
+		ThreadPool pool (2);
+		unsigned int workers = 0;
+		for (int retry = 0; retry < 1000 && workers < 2; ++retry) {
+			usleep(1000);
+			std::vector<ThreadStats> threads;
+			AbstractThread::getThreads(&threads);
+			workers = 0;
+			for (unsigned int i = 0; i < threads.size(); ++i)
+				if (threads[i].name.find("onposix-pool") == 0)
+					++workers;
+		}
+		ASSERT_EQ(workers, 2U)
+		    << "ERROR: pool workers not in the registry";
+	}
+
+	__atomic_store_n(&t.stop_, true, __ATOMIC_RELEASE);
+	t.waitForTermination();
+	ASSERT_TRUE(t.getStats(&s));
+	ASSERT_FALSE(s.running);
+	ASSERT_GE(s.cpuTime, 50000000ULL);
+	ASSERT_FALSE(find_thread(s.tid, &r))
+	    << "ERROR: terminated thread still in the registry";
+}
+
+/**
+ * \brief Thread stopped by its own destructor, while run() is still available
+ */
+class GuardedThread: public MyThread {
+public:
+	~GuardedThread() {
+		stop();
+	}
+};
+
+TEST (ThreadTest, DestroyRunning)
+{
+	std::vector<ThreadStats> before;
+	AbstractThread::getThreads(&before);
+
+	// Destroyed while running: the destructor waits for the cancellation
+	ThreadStats s;
+	{
+		MyThread t;
+		ASSERT_TRUE(t.start());
+		while (!t.getStats(&s))
+			usleep(1000);
+	}
+	ThreadStats r;
+	ASSERT_FALSE(find_thread(s.tid, &r))
+	    << "ERROR: destroyed thread still in the registry";
+
+	// Destroyed before running
+	for (int i = 0; i < 10; ++i) {
+		GuardedThread* t = new GuardedThread;
+		ASSERT_TRUE(t->start());
+		delete t;
+	}
+	std::vector<ThreadStats> after;
+	AbstractThread::getThreads(&after);
+	ASSERT_EQ(after.size(), before.size())
+	    << "ERROR: destroyed threads still in the registry";
+}
+
+class ListingThread: public AbstractThread {
+public:
+	~ListingThread() {
+		stop();
+	}
+
+	void run() {
+		std::vector<ThreadStats> v;
+		ThreadStats s;
+		for (;;) {
+			AbstractThread::getThreads(&v);
+			getStats(&s);
+			setName("listing");
+		}
+	}
+};
+
+TEST (ThreadTest, StopWhileListing)
+{
+	// Cancelled anywhere in the loop, the thread must not keep the lock
+	// of the registry (the next threads would block forever)
+	for (int i = 0; i < 20; ++i) {
+		ListingThread t;
+		ASSERT_TRUE(t.start());
+		usleep(1000 + 100 * i);
+		ASSERT_TRUE(t.stop());
+	}
+	std::vector<ThreadStats> v;
+	AbstractThread::getThreads(&v);
+}
+
+class RealTimeThread: public AbstractThread {
+public:
+	int policy_;
+	int priority_;
+	int cpu_;
+	int allowed_;
+	bool mutex_;
+	bool queue_;
+
+	RealTimeThread(): policy_(-1), priority_(-1), cpu_(-1), allowed_(-1),
+	    mutex_(false), queue_(false) {}
+
+	void run() {
+		struct sched_param p;
+		pthread_getschedparam(pthread_self(), &policy_, &p);
+		priority_ = p.sched_priority;
+		cpu_ = sched_getcpu();
+		cpu_set_t s;
+		if (pthread_getaffinity_np(pthread_self(), sizeof(s), &s) == 0)
+			allowed_ = CPU_COUNT(&s);
+		pthread_mutex_t m;
+		if (PosixMutex::initialize(&m, true) == 0) {
+			mutex_ = (pthread_mutex_lock(&m) == 0);
+			pthread_mutex_unlock(&m);
+			pthread_mutex_destroy(&m);
+		}
+		PosixMutex pi (true);
+		pi.lock();
+		pi.unlock();
+		PosixSharedQueue<int> q (true);
+		q.push(1);
+		queue_ = (q.pop() == 1);
+	}
+};
+
+TEST (ThreadTest, RealTime)
+{
+	RealTimeThread t;
+	RealTimeProfile p;
+	// Pin to the last CPU available, so that the affinity differs from
+	// the default one whenever there are more CPUs
+	cpu_set_t available;
+	ASSERT_EQ(sched_getaffinity(0, sizeof(available), &available), 0);
+	int last = 0;
+	for (int i = 0; i < CPU_SETSIZE; ++i)
+		if (CPU_ISSET(i, &available))
+			last = i;
+	std::vector<bool> cpus (last + 1, false);
+	cpus[last] = true;
+	p.setScheduling(SCHED_FIFO, 10).setAffinity(cpus)
+	    .setStackPrefault(1024 * 1024).setMemoryLock(true);
+	t.setRealTimeProfile(p);
+	ASSERT_TRUE(t.start())
+	    << "ERROR: can't start the thread (this test needs to be run as root)";
+	t.waitForTermination();
+	munlockall();
+
+	ASSERT_EQ(t.policy_, SCHED_FIFO)
+	    << "ERROR: scheduling policy not set before run()";
+	ASSERT_EQ(t.priority_, 10)
+	    << "ERROR: scheduling priority not set before run()";
+	ASSERT_EQ(t.cpu_, last)
+	    << "ERROR: affinity not set before run()";
+	ASSERT_EQ(t.allowed_, 1)
+	    << "ERROR: affinity not set before run()";
+	ASSERT_TRUE(t.mutex_)
+	    << "ERROR: priority inheritance mutex not usable";
+	ASSERT_TRUE(t.queue_)
+	    << "ERROR: priority inheritance queue not usable";
+
+	// The stack grows to fit a prefault larger than its default size
+	RealTimeThread big;
+	big.setRealTimeProfile(RealTimeProfile().setStackPrefault(
+	    16 * 1024 * 1024));
+	ASSERT_TRUE(big.start());
+	big.waitForTermination();
+	ASSERT_EQ(big.policy_, SCHED_OTHER);
+}
+
 int value = 0;
 
 void change_value (void* arg)
@@ -492,6 +1006,505 @@ TEST (ThreadTest, SimpleThread)
 }
 
 
+void record_tid (void* arg)
+{
+	*reinterpret_cast<pid_t*>(arg) = syscall(SYS_gettid);
+}
+
+void allocate_in_arena (void* arg)
+{
+	*reinterpret_cast<unsigned long int*>(arg) =
+	    Arena::getCurrent()->getUsed();
+	Arena::getCurrent()->allocate(100);
+}
+
+static bool pooled_release = false;
+
+void record_tid_and_wait (void* arg)
+{
+	record_tid(arg);
+	while (!__atomic_load_n(&pooled_release, __ATOMIC_ACQUIRE))
+		usleep(1000);
+}
+
+TEST (ThreadTest, PooledThread)
+{
+	int v = 0;
+	PooledThread t (change_value, (void*) &v);
+	ASSERT_FALSE(t.waitForTermination())
+	    << "ERROR: wait on a thread not started";
+	ASSERT_TRUE(t.start());
+	ASSERT_TRUE(t.waitForTermination());
+	ASSERT_EQ(v, 1)
+	    << "ERROR: value of variable not incremented";
+	ASSERT_TRUE(t.start());
+	ASSERT_TRUE(t.waitForTermination());
+	ASSERT_EQ(v, 2)
+	    << "ERROR: value of variable not incremented (2nd time)";
+
+	// The same parked thread runs the next handlers
+	PooledThread::setMaxIdle(1);
+	pid_t tid1 = 0, tid2 = 0;
+	PooledThread a (record_tid, &tid1);
+	PooledThread b (record_tid, &tid2);
+	a.start();
+	a.waitForTermination();
+	b.start();
+	b.waitForTermination();
+	ASSERT_NE(tid1, 0);
+	ASSERT_EQ(tid1, tid2)
+	    << "ERROR: thread not reused";
+	ASSERT_NE(tid1, (pid_t) syscall(SYS_gettid));
+
+	// Memory left in the arena by a handler is released for the next one
+	unsigned long int used1 = 1, used2 = 1;
+	PooledThread c (allocate_in_arena, &used1);
+	PooledThread d (allocate_in_arena, &used2);
+	c.start();
+	c.waitForTermination();
+	d.start();
+	d.waitForTermination();
+	ASSERT_EQ(used1, 0UL);
+	ASSERT_EQ(used2, 0UL)
+	    << "ERROR: arena not reset between handlers";
+
+	// Concurrent handlers get their own threads
+	PooledThread::reserve(8);
+	ASSERT_GE(PooledThread::getIdle(), 8U);
+	ASSERT_GE(PooledThread::getMaxIdle(), 8U);
+	pid_t tids[8];
+	std::vector<PooledThread*> many;
+	for (int i = 0; i < 8; ++i) {
+		many.push_back(new PooledThread(record_tid_and_wait, &tids[i]));
+		ASSERT_TRUE(many.back()->start());
+	}
+	__atomic_store_n(&pooled_release, true, __ATOMIC_RELEASE);
+	for (int i = 0; i < 8; ++i) {
+		ASSERT_TRUE(many[i]->waitForTermination());
+		delete many[i];
+	}
+	std::sort(tids, tids + 8);
+	ASSERT_TRUE(std::unique(tids, tids + 8) == tids + 8)
+	    << "ERROR: concurrent handlers on the same thread";
+
+	PooledThread::setMaxIdle(0);
+	ASSERT_EQ(PooledThread::getIdle(), 0U);
+	PooledThread::setMaxIdle(16);
+}
+
+TEST (ArenaTest, Allocate)
+{
+	Arena a (4096);
+	ASSERT_EQ(a.getReserved(), 0UL)
+	    << "ERROR: memory reserved before the first request";
+
+	char* p = reinterpret_cast<char*>(a.allocate(10, 1));
+	char* q = reinterpret_cast<char*>(a.allocate(8, 64));
+	ASSERT_EQ(reinterpret_cast<unsigned long int>(q) % 64, 0UL)
+	    << "ERROR: alignment not respected";
+	ASSERT_GE(q, p + 10);
+	ASSERT_EQ(a.getUsed(), 18UL);
+
+	// Reset point: memory after the mark is released and reused
+	Arena::Mark m = a.getMark();
+	char* r = reinterpret_cast<char*>(a.allocate(100));
+	for (int i = 0; i < 100; ++i)
+		a.allocate(100);
+	ASSERT_GT(a.getReserved(), 4096UL)
+	    << "ERROR: new block not allocated";
+	a.rewind(m);
+	ASSERT_EQ(a.getUsed(), 18UL);
+	ASSERT_EQ(reinterpret_cast<char*>(a.allocate(100)), r)
+	    << "ERROR: memory not reused after rewind";
+	unsigned long int reserved = a.getReserved();
+
+	// Large blocks come from the heap
+	{
+		Arena::Scope s (a);
+		void* l = a.allocate(4096);
+		memset(l, 0, 4096);
+		ASSERT_EQ(a.getUsed(), 18UL + 100 + 4096);
+		a.deallocate(l, 4096);
+		ASSERT_EQ(a.getUsed(), 18UL + 100);
+		a.allocate(2048, 256);
+	}
+	ASSERT_EQ(a.getUsed(), 18UL + 100);
+	ASSERT_EQ(a.getReserved(), reserved)
+	    << "ERROR: large blocks taken from the arena";
+
+	// Releasing the last request
+	void* t = a.allocate(32);
+	a.deallocate(t, 32);
+	ASSERT_EQ(a.allocate(32), t);
+
+	a.reset();
+	ASSERT_EQ(a.getUsed(), 0UL);
+	ASSERT_EQ(a.getReserved(), reserved)
+	    << "ERROR: blocks not kept after reset";
+}
+
+class ArenaThread: public AbstractThread {
+public:
+	bool current_;
+	bool arena_;
+	long int sum_;
+
+	ArenaThread(): current_(false), arena_(false), sum_(0) {}
+
+	void run() {
+		current_ = (Arena::getCurrent() == &getArena());
+		Arena::Scope s (getArena());
+		std::vector<int, ArenaAllocator<int> > v;
+		std::map<int, int, std::less<int>,
+		    ArenaAllocator<std::pair<const int, int> > > m;
+		for (int i = 0; i < 1000; ++i) {
+			v.push_back(i);
+			m[i] = i;
+		}
+		arena_ = (v.get_allocator().getArena() == &getArena()) &&
+		    (getArena().getUsed() > 0);
+		for (int i = 0; i < 1000; ++i)
+			sum_ += v[i] + m[i];
+	}
+};
+
+TEST (ArenaTest, Thread)
+{
+	ASSERT_TRUE(Arena::getCurrent() == 0)
+	    << "ERROR: arena outside AbstractThread";
+	ArenaAllocator<int> heap;
+	int* h = heap.allocate(4);
+	heap.deallocate(h, 4);
+
+	ArenaThread t;
+	ASSERT_TRUE(t.start());
+	t.waitForTermination();
+	ASSERT_TRUE(t.current_)
+	    << "ERROR: arena of the thread not current";
+	ASSERT_TRUE(t.arena_)
+	    << "ERROR: containers not using the arena";
+	ASSERT_EQ(t.sum_, 999000);
+	ASSERT_EQ(t.getArena().getUsed(), 0UL)
+	    << "ERROR: memory not released by the scope";
+	ASSERT_GT(t.getArena().getReserved(), 0UL);
+}
+
+TEST (ThreadPoolTest, Deque)
+{
+	WorkStealingDeque<long int> d (4);
+	for (long int i = 0; i < 100; ++i)
+		d.push(i);
+	ASSERT_EQ(d.size(), 100)
+	    << "ERROR: elements lost while growing";
+	long int v;
+	ASSERT_TRUE(d.steal(&v));
+	ASSERT_EQ(v, 0)
+	    << "ERROR: steal() does not extract the oldest element";
+	ASSERT_TRUE(d.take(&v));
+	ASSERT_EQ(v, 99)
+	    << "ERROR: take() does not extract the newest element";
+	long int n = 0;
+	while (d.take(&v))
+		++n;
+	ASSERT_EQ(n, 98);
+	ASSERT_FALSE(d.steal(&v));
+}
+
+static void increment_value (void* arg)
+{
+	__atomic_add_fetch((int*) arg, 1, __ATOMIC_RELAXED);
+}
+
+TEST (ThreadPoolTest, Submit)
+{
+	int counter = 0;
+	{
+		ThreadPool pool (4);
+		ASSERT_EQ(pool.getThreads(), 4U);
+		ASSERT_FALSE(pool.isWorker());
+		std::vector<ThreadPool::Handle> h;
+		for (int i = 0; i < 1000; ++i)
+			h.push_back(pool.submit(increment_value, &counter));
+		for (unsigned int i = 0; i < h.size(); ++i) {
+			h[i].wait();
+			ASSERT_TRUE(h[i].isDone());
+		}
+		ASSERT_EQ(counter, 1000)
+		    << "ERROR: tasks not run before wait() returned";
+
+		// Tasks whose handles are dropped are run by the destructor
+		for (int i = 0; i < 1000; ++i)
+			pool.submit(increment_value, &counter);
+	}
+	ASSERT_EQ(counter, 2000)
+	    << "ERROR: queued tasks not run before destruction";
+}
+
+/*
+ * Recursive fork-join: each task waits for its subtasks, so workers must
+ * run other tasks while waiting.
+ */
+struct SumTask {
+	ThreadPool* pool;
+	const int* data;
+	int size;
+	long int* result;
+
+	void operator()() const {
+		if (size <= 16) {
+			long int s = 0;
+			for (int i = 0; i < size; ++i)
+				s += data[i];
+			*result = s;
+			return;
+		}
+		long int left, right;
+		SumTask l = {pool, data, size / 2, &left};
+		SumTask r = {pool, data + size / 2, size - size / 2, &right};
+		ThreadPool::Handle h = pool->submit(l);
+		r();
+		h.wait();
+		*result = left + right;
+	}
+};
+
+TEST (ThreadPoolTest, Nested)
+{
+	std::vector<int> data (100000);
+	for (unsigned int i = 0; i < data.size(); ++i)
+		data[i] = i;
+	ThreadPool pool (3);
+	long int result = 0;
+	SumTask t = {&pool, &data[0], (int) data.size(), &result};
+	pool.submit(t).wait();
+	ASSERT_EQ(result, 99999L * 100000L / 2)
+	    << "ERROR: wrong result of nested tasks";
+}
+
+struct MarkChunk {
+	std::vector<int>* marks;
+	unsigned long int grain;
+	int* oversized;
+
+	void operator()(unsigned long int begin, unsigned long int end) const {
+		if (end - begin > grain)
+			__atomic_add_fetch(oversized, 1, __ATOMIC_RELAXED);
+		for (unsigned long int i = begin; i < end; ++i)
+			(*marks)[i]++;
+	}
+};
+
+struct CountByte {
+	const char* data;
+	char c;
+
+	unsigned long int operator()(unsigned long int begin,
+	    unsigned long int end) const {
+		unsigned long int n = 0;
+		for (unsigned long int i = begin; i < end; ++i)
+			if (data[i] == c)
+				++n;
+		return n;
+	}
+};
+
+struct AddCounts {
+	unsigned long int operator()(unsigned long int a,
+	    unsigned long int b) const {
+		return a + b;
+	}
+};
+
+static char next_char (char c)
+{
+	return c + 1;
+}
+
+TEST (ThreadPoolTest, Parallel)
+{
+	ThreadPool pool (4);
+
+	std::vector<int> marks (100003, 0);
+	int oversized = 0;
+	MarkChunk m = {&marks, 1000, &oversized};
+	parallelFor(0, marks.size(), 1000, m, pool);
+	ASSERT_EQ(oversized, 0)
+	    << "ERROR: chunk larger than the grain size";
+	for (unsigned int i = 0; i < marks.size(); ++i)
+		ASSERT_EQ(marks[i], 1)
+		    << "ERROR: index " << i << " not visited once";
+
+	Buffer b (1 << 20);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		b.getBuffer()[i] = (i % 7 == 0) ? '\n' : 'a';
+	CountByte c = {b.getBuffer(), '\n'};
+	ASSERT_EQ(parallelReduce(0, b.getSize(), 4096, 0UL, c, AddCounts(),
+	    pool), (b.getSize() + 6) / 7)
+	    << "ERROR: wrong result of parallelReduce()";
+	ASSERT_EQ(parallelReduce(5, 5, 0, 42UL, c, AddCounts(), pool), 42UL)
+	    << "ERROR: empty range does not return the identity";
+
+	Buffer out (b.getSize());
+	parallelTransform(b.getBuffer(), b.getBuffer() + b.getSize(),
+	    out.getBuffer(), 0, next_char);
+	for (unsigned int i = 0; i < b.getSize(); ++i)
+		ASSERT_EQ(out.getBuffer()[i], b.getBuffer()[i] + 1)
+		    << "ERROR: wrong result of parallelTransform()";
+}
+
+#if defined(ONPOSIX_LINUX_SPECIFIC) && defined(__GLIBC__) && \
+    ((__GLIBC__ > 2) || ((__GLIBC__ == 2) && (__GLIBC_MINOR__ > 3)))
+static void get_cpu (void* arg)
+{
+	*((int*) arg) = sched_getcpu();
+}
+
+TEST (ThreadPoolTest, Affinity)
+{
+	ThreadPool pool (2);
+	std::vector<bool> v (1, true);
+	pool.setAffinity(v);
+	int cpu = -1;
+	pool.submit(get_cpu, &cpu).wait();
+	ASSERT_EQ(cpu, 0)
+	    << "ERROR: worker not run on the selected CPU";
+	ASSERT_THROW(pool.setAffinity(2, v), std::runtime_error);
+}
+#endif /* ONPOSIX_LINUX_SPECIFIC && GLIBC */
+
+static void write_sysfs (const std::string& root, const std::string& file,
+    const char* value)
+{
+	mkdir(root.c_str(), 0755);
+	for (std::string::size_type i = 1;
+	    (i = file.find('/', i)) != std::string::npos; ++i)
+		mkdir((root + file.substr(0, i)).c_str(), 0755);
+	std::ofstream out ((root + file).c_str());
+	out << value << "\n";
+}
+
+TEST (CpuTopologyTest, Placement)
+{
+	std::vector<int> l = CpuTopology::parseCpuList("0-2,5\n");
+	ASSERT_EQ(l.size(), 4U);
+	ASSERT_EQ(l[2], 2);
+	ASSERT_EQ(l[3], 5);
+
+	// 2 packages (and nodes) with 2 cores of 2 SMT siblings each:
+	// cores {0,4}, {1,5} on package 0 and {2,6}, {3,7} on package 1
+	std::string root = "/tmp/onposix-topology";
+	int ret = system(("rm -rf " + root).c_str());
+	(void) ret;
+	write_sysfs(root, "/cpu/online", "0-7");
+	write_sysfs(root, "/node/online", "0-1");
+	write_sysfs(root, "/node/node0/cpulist", "0-1,4-5");
+	write_sysfs(root, "/node/node1/cpulist", "2-3,6-7");
+	for (int i = 0; i < 8; ++i) {
+		char cpu[64], siblings[16], llc[16], package[4];
+		snprintf(cpu, sizeof(cpu), "/cpu/cpu%d/", i);
+		snprintf(siblings, sizeof(siblings), "%d,%d", i % 4, i % 4 + 4);
+		snprintf(llc, sizeof(llc), "%d-%d,%d-%d", i % 4 / 2 * 2,
+		    i % 4 / 2 * 2 + 1, i % 4 / 2 * 2 + 4, i % 4 / 2 * 2 + 5);
+		snprintf(package, sizeof(package), "%d", i % 4 / 2);
+		std::string c = cpu;
+		write_sysfs(root, c + "topology/thread_siblings_list", siblings);
+		write_sysfs(root, c + "topology/physical_package_id", package);
+		write_sysfs(root, c + "cache/index0/level", "1");
+		write_sysfs(root, c + "cache/index0/type", "Data");
+		write_sysfs(root, c + "cache/index0/shared_cpu_list", siblings);
+		write_sysfs(root, c + "cache/index1/level", "3");
+		write_sysfs(root, c + "cache/index1/type", "Unified");
+		write_sysfs(root, c + "cache/index1/shared_cpu_list", llc);
+	}
+
+	CpuTopology t (root);
+	ASSERT_EQ(t.getCpus().size(), 8U);
+	ASSERT_EQ(t.getCores(), 4U);
+	ASSERT_EQ(t.getLlcs(), 2U);
+	ASSERT_EQ(t.getPackages(), 2U);
+	ASSERT_EQ(t.getNodes().size(), 2U);
+	ASSERT_EQ(t.getCpus()[5].core, 1);
+	ASSERT_EQ(t.getCpus()[5].thread, 1);
+	ASSERT_EQ(t.getCpus()[6].node, 1);
+
+	std::vector<std::vector<bool> > m = t.onePerCore(5);
+	ASSERT_EQ(m.size(), 5U);
+	ASSERT_TRUE(m[1][1] && m[1][5] && !m[1][0])
+	    << "ERROR: core mask does not contain the SMT siblings";
+	ASSERT_TRUE(m[4] == m[0]);
+
+	m = t.compact(3, 1);
+	ASSERT_TRUE(m[0][2] && m[1][6] && m[2][3])
+	    << "ERROR: compact placement does not fill the siblings first";
+	ASSERT_THROW(t.compact(1, 2), std::runtime_error);
+
+	m = t.spread(4);
+	ASSERT_TRUE(m[0][0] && m[1][2] && m[2][1] && m[3][3])
+	    << "ERROR: spread placement does not alternate the LLCs";
+	ASSERT_EQ(std::count(m[3].begin(), m[3].end(), true), 1);
+	ret = system(("rm -rf " + root).c_str());
+
+	CpuTopology local;
+	ASSERT_GE(local.getCpus().size(), 1U);
+	ASSERT_GE(local.getCores(), 1U);
+	ASSERT_TRUE(local.getNodeMask(local.getNodes()[0])[
+	    local.getCpus()[0].id]);
+}
+
+static void get_node_of_new_page (void* arg)
+{
+	std::vector<char> v (1024*1024, 1);
+	*((int*) arg) = Numa::getNodeOfAddress(&v[512*1024]);
+}
+
+static void get_affinity (void* arg)
+{
+	cpu_set_t s;
+	CPU_ZERO(&s);
+	pthread_getaffinity_np(pthread_self(), sizeof(s), &s);
+	std::vector<bool>* v = (std::vector<bool>*) arg;
+	for (unsigned int i = 0; i < v->size(); ++i)
+		(*v)[i] = CPU_ISSET(i, &s);
+}
+
+TEST (NumaTest, Placement)
+{
+	std::vector<int> nodes = Numa::getNodes();
+	ASSERT_FALSE(nodes.empty());
+	int node = nodes.back();
+
+	Buffer b (1024*1024, node);
+	ASSERT_EQ(b.getNode(), node);
+	b.getBuffer()[0] = 1;
+	b.getBuffer()[b.getSize() - 1] = 1;
+	if (Numa::isAvailable()) {
+		ASSERT_EQ(Numa::getNodeOfAddress(b.getBuffer()), node)
+		    << "ERROR: buffer not allocated on the node";
+		ASSERT_THROW(Buffer(4096, 1000), std::runtime_error);
+	}
+
+	Numa::setThreadPolicy(Numa::LOCAL);
+	Numa::setThreadPolicy(Numa::PREFERRED, node);
+	Numa::setThreadPolicy(Numa::DEFAULT);
+
+	ThreadPool pool (0, node);
+	ASSERT_EQ(pool.getNode(), node);
+	ASSERT_GE(pool.getThreads(), 1U);
+	int n = -2;
+	pool.submit(get_node_of_new_page, &n).wait();
+	if (Numa::isAvailable()) {
+		ASSERT_EQ(n, node)
+		    << "ERROR: worker memory not allocated on the node";
+	}
+	std::vector<bool> mask = CpuTopology().getNodeMask(node);
+	std::vector<bool> affinity (mask.size());
+	pool.submit(get_affinity, &affinity).wait();
+	ASSERT_TRUE(affinity == mask)
+	    << "ERROR: worker not pinned to the node";
+	ASSERT_THROW(ThreadPool(1, 1000), std::runtime_error);
+}
+
+
 
 // ======================================================================
 //   SOCKETS
@@ -561,6 +1574,76 @@ TEST (ThreadSockTest, MainTest)
 	t.waitForTermination();
 }
 
+class PipeReader: public AbstractDescriptorReader {
+ public:
+	int notified_;
+	explicit PipeReader(DescriptorsMonitor& dm):
+	    AbstractDescriptorReader(dm), notified_(-1){}
+	virtual void dataAvailable(PosixDescriptor& descriptor) {
+		notified_ = descriptor.getDescriptorNumber();
+	}
+};
+
+TEST (DescriptorsMonitorTest, HighDescriptor)
+{
+	// Move the next descriptors beyond FD_SETSIZE
+	struct rlimit old;
+	ASSERT_EQ(getrlimit(RLIMIT_NOFILE, &old), 0);
+	struct rlimit l = old;
+	if (l.rlim_cur < FD_SETSIZE + 16) {
+		l.rlim_cur = FD_SETSIZE + 16;
+		if (l.rlim_max != RLIM_INFINITY && l.rlim_cur > l.rlim_max)
+			return;
+		ASSERT_EQ(setrlimit(RLIMIT_NOFILE, &l), 0);
+	}
+	std::vector<int> fillers;
+	int fd;
+	while ((fd = open("/dev/null", O_RDONLY)) >= 0 && fd < FD_SETSIZE)
+		fillers.push_back(fd);
+	if (fd >= 0)
+		fillers.push_back(fd);
+
+	{
+		Pipe p;
+		ASSERT_GE(p.getReadDescriptor()->getDescriptorNumber(),
+		    FD_SETSIZE);
+		DescriptorsMonitor dm;
+		PipeReader r(dm);
+#ifndef ONPOSIX_LINUX_SPECIFIC
+		// select() cannot monitor descriptors beyond FD_SETSIZE
+		ASSERT_FALSE(r.monitorDescriptor(*p.getReadDescriptor()));
+#else
+		ASSERT_TRUE(r.monitorDescriptor(*p.getReadDescriptor()));
+		ASSERT_FALSE(r.monitorDescriptor(*p.getReadDescriptor()));
+		char c = 'x';
+		p.getWriteDescriptor()->write(&c, 1);
+		ASSERT_TRUE(dm.wait());
+		ASSERT_EQ(r.notified_,
+		    p.getReadDescriptor()->getDescriptorNumber());
+		ASSERT_TRUE(r.stopMonitorDescriptor(*p.getReadDescriptor()));
+		ASSERT_FALSE(r.stopMonitorDescriptor(*p.getReadDescriptor()));
+#endif
+	}
+
+	for (std::vector<int>::iterator i = fillers.begin();
+	    i != fillers.end(); ++i)
+		close(*i);
+	setrlimit(RLIMIT_NOFILE, &old);
+}
+
+TEST (DescriptorsMonitorTest, RegularFile)
+{
+	FileDescriptor f("/tmp/test-monitor-file", O_RDWR|O_CREAT|O_TRUNC,
+	    S_IRUSR|S_IWUSR);
+	DescriptorsMonitor dm;
+	PipeReader r(dm);
+	ASSERT_TRUE(r.monitorDescriptor(f));
+	ASSERT_TRUE(dm.wait());
+	ASSERT_EQ(r.notified_, f.getDescriptorNumber());
+	ASSERT_TRUE(r.stopMonitorDescriptor(f));
+	unlink("/tmp/test-monitor-file");
+}
+
 
 bool read_socket_handler_called = false;
 
@@ -620,6 +1703,963 @@ TEST (ThreadSockAsyncTest, AsyncRead)
 
 
 
+// ======================================================================
+//   QUEUES
+// ======================================================================
+
+template <typename Queue>
+class QueueProducer: public AbstractThread {
+	Queue* queue_;
+	int first_;
+	int count_;
+public:
+	QueueProducer(Queue* q, int first, int count): queue_(q),
+	    first_(first), count_(count) {}
+
+	void run() {
+		for (int i = first_; i < first_ + count_; ++i)
+			queue_->push(i);
+	}
+};
+
+template <typename Queue>
+class QueueConsumer: public AbstractThread {
+	Queue* queue_;
+	int count_;
+public:
+	std::vector<int> values_;
+
+	QueueConsumer(Queue* q, int count): queue_(q), count_(count) {}
+
+	void run() {
+		for (int i = 0; i < count_; ++i)
+			values_.push_back(queue_->pop());
+	}
+};
+
+/**
+ * \brief Element whose assignment throws when the source is negative
+ */
+struct ThrowingValue {
+	int value_;
+	ThrowingValue(int v = 0): value_(v) {}
+	ThrowingValue(const ThrowingValue& other): value_(other.value_) {}
+	ThrowingValue& operator=(const ThrowingValue& other) {
+		if (other.value_ < 0)
+			throw std::runtime_error("assignment");
+		value_ = other.value_;
+		return *this;
+	}
+};
+
+TEST (QueueTest, Bounded)
+{
+	BoundedSharedQueue<int> q (5);
+	ASSERT_EQ(q.capacity(), 8UL)
+	    << "ERROR: capacity not rounded to a power of 2";
+	int v;
+	ASSERT_FALSE(q.try_pop(&v));
+	for (int i = 0; i < 8; ++i)
+		ASSERT_TRUE(q.try_push(i));
+	ASSERT_FALSE(q.try_push(8))
+	    << "ERROR: push on a full queue";
+	ASSERT_EQ(q.size(), 8U);
+	for (int i = 0; i < 8; ++i) {
+		ASSERT_TRUE(q.try_pop(&v));
+		ASSERT_EQ(v, i) << "ERROR: FIFO order not respected";
+	}
+	ASSERT_FALSE(q.try_pop(&v));
+
+	// Blocking operations with 4 producers and 4 consumers on a small
+	// queue: every element is received exactly once
+	static const int PER_THREAD = 20000;
+	typedef QueueProducer<BoundedSharedQueue<int> > Producer;
+	typedef QueueConsumer<BoundedSharedQueue<int> > Consumer;
+	std::vector<Producer*> producers;
+	std::vector<Consumer*> consumers;
+	for (int i = 0; i < 4; ++i) {
+		consumers.push_back(new Consumer(&q, PER_THREAD));
+		consumers.back()->start();
+	}
+	for (int i = 0; i < 4; ++i) {
+		producers.push_back(new Producer(&q, i * PER_THREAD,
+		    PER_THREAD));
+		producers.back()->start();
+	}
+	std::vector<int> received;
+	for (int i = 0; i < 4; ++i) {
+		producers[i]->waitForTermination();
+		consumers[i]->waitForTermination();
+		// Elements of each producer are received in order
+		int last[4] = {-1, -1, -1, -1};
+		for (unsigned int j = 0; j < consumers[i]->values_.size(); ++j) {
+			int x = consumers[i]->values_[j];
+			ASSERT_GT(x, last[x / PER_THREAD]);
+			last[x / PER_THREAD] = x;
+		}
+		received.insert(received.end(),
+		    consumers[i]->values_.begin(), consumers[i]->values_.end());
+		delete producers[i];
+		delete consumers[i];
+	}
+	std::sort(received.begin(), received.end());
+	ASSERT_EQ(received.size(), 4U * PER_THREAD);
+	for (int i = 0; i < 4 * PER_THREAD; ++i)
+		ASSERT_EQ(received[i], i) << "ERROR: element lost or duplicated";
+	ASSERT_EQ(q.size(), 0U);
+	// A throwing assignment does not stall the queue
+	BoundedSharedQueue<ThrowingValue> t (2);
+	ASSERT_TRUE(t.try_push(ThrowingValue(1)));
+	ASSERT_THROW(t.try_push(ThrowingValue(-1)), std::runtime_error);
+	ThrowingValue out;
+	ASSERT_TRUE(t.try_pop(&out));
+	ASSERT_EQ(out.value_, 1);
+	ASSERT_FALSE(t.try_pop(&out))
+	    << "ERROR: element of a failed push received";
+	for (int i = 0; i < 10; ++i) {
+		t.push(ThrowingValue(i));
+		ASSERT_EQ(t.pop().value_, i);
+	}
+}
+
+class BatchConsumer: public AbstractThread {
+	PosixSharedQueue<int>* queue_;
+	int count_;
+public:
+	std::vector<int> values_;
+	int calls_;
+
+	BatchConsumer(PosixSharedQueue<int>* q, int count): queue_(q),
+	    count_(count), calls_(0) {}
+
+	void run() {
+		while ((int) values_.size() < count_) {
+			queue_->popBatch(std::back_inserter(values_), 100);
+			++calls_;
+		}
+	}
+};
+
+TEST (QueueTest, Batch)
+{
+	PosixSharedQueue<int> q;
+	std::vector<int> in;
+	for (int i = 0; i < 250; ++i)
+		in.push_back(i);
+	q.pushBatch(in.begin(), in.end());
+	ASSERT_EQ(q.size(), 250U);
+
+	int out[100];
+	ASSERT_EQ(q.popBatch(out, 0), 0U);
+	ASSERT_EQ(q.popBatch(out, 100), 100U);
+	ASSERT_EQ(out[0], 0);
+	ASSERT_EQ(out[99], 99);
+	ASSERT_EQ(q.popBatch(out, 100), 100U);
+	ASSERT_EQ(q.popBatch(out, 100), 50U)
+	    << "ERROR: popBatch did not return the available elements";
+	ASSERT_EQ(out[49], 249);
+	ASSERT_EQ(q.size(), 0U);
+
+	// A waiting consumer is woken by a batch
+	BatchConsumer c (&q, 500);
+	c.start();
+	usleep(10000);
+	for (int i = 0; i < 5; ++i) {
+		std::vector<int> batch;
+		for (int j = 0; j < 100; ++j)
+			batch.push_back(i * 100 + j);
+		q.pushBatch(batch.begin(), batch.end());
+	}
+	q.pushBatch(in.begin(), in.begin());
+	c.waitForTermination();
+	ASSERT_EQ(c.values_.size(), 500U);
+	for (int i = 0; i < 500; ++i)
+		ASSERT_EQ(c.values_[i], i);
+	// Batches are pushed atomically, so each call gets a whole one
+	ASSERT_EQ(c.calls_, 5)
+	    << "ERROR: elements not moved in batches";
+}
+
+template <typename Queue>
+class TimedConsumer: public AbstractThread {
+	Queue* queue_;
+public:
+	bool popped_;
+
+	TimedConsumer(Queue* q): queue_(q), popped_(true) {}
+
+	void run() {
+		int data;
+		Time deadline;
+		deadline.add(60, 0);
+		popped_ = queue_->pop_until(&data, deadline);
+	}
+};
+
+TEST (QueueTest, Timed)
+{
+	PosixSharedQueue<int> q;
+	int data = 0;
+	ASSERT_FALSE(q.try_pop(&data));
+	q.push(3);
+	ASSERT_TRUE(q.try_pop(&data));
+	ASSERT_EQ(data, 3);
+
+	// The deadline expires
+	Time start;
+	Time deadline = start;
+	deadline.add(0, 50000000);
+	ASSERT_FALSE(q.pop_until(&data, deadline));
+	Time end;
+	ASSERT_FALSE(end < deadline) << "ERROR: woken up before the deadline";
+	q.push(4);
+	ASSERT_TRUE(q.pop_until(&data, deadline));
+	ASSERT_EQ(data, 4);
+
+	// close() wakes up the waiting consumer
+	TimedConsumer<PosixSharedQueue<int> > c (&q);
+	c.start();
+	usleep(50000);
+	q.push(5);
+	q.close();
+	c.waitForTermination();
+	ASSERT_TRUE(q.isClosed());
+	ASSERT_EQ(q.size(), 0U) << "ERROR: element not popped before close()";
+	c.start();
+	c.waitForTermination();
+	ASSERT_FALSE(c.popped_);
+	ASSERT_THROW(q.pop(), std::runtime_error);
+
+	PosixPrioritySharedQueue<int> p;
+	p.addQueue(0);
+	p.addQueue(1);
+	ASSERT_FALSE(p.try_pop(&data));
+	ASSERT_FALSE(p.pop_until(&data, deadline));
+	p.push(6, 1);
+	p.push(7, 0);
+	ASSERT_TRUE(p.try_pop(&data));
+	ASSERT_EQ(data, 7);
+	TimedConsumer<PosixPrioritySharedQueue<int> > pc (&p);
+	pc.start();
+	usleep(50000);
+	p.close();
+	pc.waitForTermination();
+	ASSERT_TRUE(pc.popped_) << "ERROR: element left not popped";
+	pc.start();
+	pc.waitForTermination();
+	ASSERT_FALSE(pc.popped_);
+	ASSERT_THROW(p.pop(), std::runtime_error);
+}
+
+TEST (QueueTest, Priority)
+{
+	// Integral priorities: ring buffers with a bitmap
+	PosixPrioritySharedQueue<int> q;
+	q.addQueue(10);
+	q.addQueue(70);
+	for (int i = 0; i < 20; ++i)
+		q.push(i, 70);
+	q.push(100, 10);
+	q.push(200, 5);
+	ASSERT_EQ(q.size(), 21U) << "ERROR: element of unknown priority added";
+	// Priority lower than all the others, while elements are queued
+	q.addQueue(-3);
+	q.push(300, -3);
+	ASSERT_EQ(q.pop(), 300);
+	ASSERT_EQ(q.pop(), 100);
+	for (int i = 0; i < 20; ++i)
+		ASSERT_EQ(q.pop(), i);
+	// Priorities too far apart: the queued elements move to a map
+	q.push(1, 70);
+	q.push(2, 10);
+	q.push(3, 70);
+	q.addQueue(10000);
+	q.push(4, 10000);
+	q.addQueue(-20000);
+	q.push(5, -20000);
+	ASSERT_EQ(q.size(), 5U);
+	ASSERT_EQ(q.pop(), 5);
+	ASSERT_EQ(q.pop(), 2);
+	ASSERT_EQ(q.pop(), 1);
+	ASSERT_EQ(q.pop(), 3);
+	ASSERT_EQ(q.pop(), 4);
+	q.clear();
+	q.push(1, 10);
+	ASSERT_EQ(q.size(), 0U) << "ERROR: priority not removed by clear()";
+
+	// Other priorities: map of queues
+	PosixPrioritySharedQueue<int, std::string> m;
+	m.addQueue("b");
+	m.addQueue("a");
+	m.push(1, "b");
+	m.push(2, "a");
+	m.push(3, "c");
+	ASSERT_EQ(m.size(), 2U);
+	ASSERT_EQ(m.pop(), 2);
+	ASSERT_EQ(m.pop(), 1);
+}
+
+TEST (QueueTest, Deadline)
+{
+	DeadlineSharedQueue<int> q;
+	Time base;
+	int order[] = {5, 2, 9, 2, 7, 0, 3, 8, 1, 6};
+	for (int i = 0; i < 10; ++i) {
+		Time d = base;
+		d.add(order[i], 0);
+		q.push(i, d);
+	}
+	Time next;
+	ASSERT_TRUE(q.nextDeadline(&next));
+	Time expected = base;
+	expected.add(0, 0);
+	ASSERT_TRUE(next == expected);
+	ASSERT_EQ(q.pop(), 5);
+	ASSERT_EQ(q.pop(), 8);
+	// Equal deadlines in FIFO order
+	ASSERT_EQ(q.pop(), 1);
+	ASSERT_EQ(q.pop(), 3);
+
+	// Everything due within 6 seconds from the base time
+	Time now = base;
+	now.add(6, 0);
+	std::vector<int> due;
+	ASSERT_EQ(q.popDue(std::back_inserter(due), now), 3U);
+	ASSERT_EQ(due[0], 6);
+	ASSERT_EQ(due[1], 0);
+	ASSERT_EQ(due[2], 9);
+	ASSERT_EQ(q.popDue(std::back_inserter(due)), 0U)
+	    << "ERROR: element extracted before its deadline";
+	ASSERT_EQ(q.size(), 3U);
+	q.clear();
+	int data;
+	ASSERT_FALSE(q.try_pop(&data));
+
+	// Heap order with many elements
+	srand(1);
+	for (int i = 0; i < 1000; ++i) {
+		int offset = rand() % 1000000;
+		Time d = base;
+		d.add(0, offset);
+		q.push(offset, d);
+	}
+	int last = 0;
+	for (int i = 0; i < 1000; ++i) {
+		int cur = q.pop();
+		ASSERT_LE(last, cur) << "ERROR: elements not in deadline order";
+		last = cur;
+	}
+
+	// Aging: a low priority element waiting since long comes first
+	q.setAging(0, 1000000);
+	q.pushPriority(1, 5);
+	q.pushPriority(2, 0);
+	usleep(20000);
+	q.pushPriority(3, 0);
+	ASSERT_EQ(q.pop(), 2);
+	ASSERT_EQ(q.pop(), 1);
+	ASSERT_EQ(q.pop(), 3);
+
+	q.close();
+	ASSERT_FALSE(q.pop_until(&data, base));
+	ASSERT_THROW(q.pop(), std::runtime_error);
+}
+
+#ifdef ONPOSIX_MOVE_SEMANTICS
+/**
+ * \brief Element counting its copies
+ */
+struct Counted {
+	static int copies_;
+	int value_;
+
+	Counted(int value = 0): value_(value) {}
+	Counted(const Counted& other): value_(other.value_) { ++copies_; }
+	Counted(Counted&& other): value_(other.value_) {}
+	Counted& operator=(const Counted& other) {
+		value_ = other.value_;
+		++copies_;
+		return *this;
+	}
+	Counted& operator=(Counted&& other) {
+		value_ = other.value_;
+		return *this;
+	}
+};
+
+int Counted::copies_ = 0;
+
+TEST (QueueTest, Move)
+{
+	// Move-only elements
+	PosixSharedQueue<std::unique_ptr<int> > q;
+	q.push(std::unique_ptr<int>(new int(1)));
+	q.emplace(new int(2));
+	std::unique_ptr<int> p (new int(3));
+	q.push(std::move(p));
+	ASSERT_EQ(*q.pop(), 1);
+	ASSERT_TRUE(q.try_pop(&p));
+	ASSERT_EQ(*p, 2);
+	Time deadline;
+	ASSERT_TRUE(q.pop_until(&p, deadline));
+	ASSERT_EQ(*p, 3);
+
+	PosixPrioritySharedQueue<std::unique_ptr<int> > pq;
+	pq.addQueue(1);
+	pq.addQueue(2);
+	pq.emplace(2, new int(4));
+	pq.push(std::unique_ptr<int>(new int(5)), 1);
+	pq.addQueue(0);
+	pq.addQueue(100000);
+	pq.emplace(100000, new int(7));
+	ASSERT_EQ(*pq.pop(), 5);
+	ASSERT_EQ(*pq.pop(), 4);
+	ASSERT_EQ(*pq.pop(), 7);
+
+	PosixPrioritySharedQueue<std::unique_ptr<int>, std::string> sq;
+	sq.addQueue("a");
+	sq.emplace("a", new int(6));
+	ASSERT_EQ(*sq.pop(), 6);
+
+	// No copies from push to pop
+	Counted::copies_ = 0;
+	PosixSharedQueue<Counted> c;
+	c.emplace(7);
+	c.push(Counted(8));
+	ASSERT_EQ(c.pop().value_, 7);
+	ASSERT_EQ(c.pop().value_, 8);
+	PosixPrioritySharedQueue<Counted> cp;
+	cp.addQueue(0);
+	for (int i = 0; i < 20; ++i)
+		cp.emplace(0, i);
+	for (int i = 0; i < 20; ++i)
+		ASSERT_EQ(cp.pop().value_, i);
+	ASSERT_EQ(Counted::copies_, 0) << "ERROR: elements copied";
+}
+#endif
+
+// ======================================================================
+//   FIBERS
+// ======================================================================
+
+struct FiberSession {
+	Pipe* in;
+	Pipe* out;
+	int received;
+};
+
+void fiber_echo (void* arg)
+{
+	// Blocking-style code: read() parks the fiber until data arrives
+	FiberSession* s = reinterpret_cast<FiberSession*>(arg);
+	int v;
+	while (s->in->getReadDescriptor()->read(&v, sizeof(v)) == sizeof(v)) {
+		s->received++;
+		if (v < 0)
+			break;
+		++v;
+		s->out->getWriteDescriptor()->write(&v, sizeof(v));
+	}
+}
+
+void fiber_yield (void* arg)
+{
+	for (int i = 0; i < 10; ++i) {
+		(*reinterpret_cast<int*>(arg))++;
+		FiberScheduler::yield();
+	}
+}
+
+TEST (FiberTest, PingPong)
+{
+	static const int SESSIONS = 100;
+	DescriptorsMonitor dm;
+	FiberScheduler s (dm, 16 * 1024);
+	Pipe pipes[2 * SESSIONS];
+	FiberSession sessions[SESSIONS];
+	for (int i = 0; i < SESSIONS; ++i) {
+		fcntl(pipes[2 * i].getReadDescriptor()->getDescriptorNumber(),
+		    F_SETFL, O_NONBLOCK);
+		sessions[i].in = &pipes[2 * i];
+		sessions[i].out = &pipes[2 * i + 1];
+		sessions[i].received = 0;
+		s.spawn(fiber_echo, &sessions[i]);
+	}
+	int yields = 0;
+	s.spawn(fiber_yield, &yields);
+	ASSERT_EQ(s.getFibers(), (unsigned int) SESSIONS + 1);
+
+	// Data written before run(): each session gets two values and a
+	// terminator, the second one after its first fiber has parked
+	for (int i = 0; i < SESSIONS; ++i) {
+		int v = i;
+		sessions[i].in->getWriteDescriptor()->write(&v, sizeof(v));
+	}
+	class Feeder {
+	public:
+		static void run(void* arg) {
+			FiberSession* s = reinterpret_cast<FiberSession*>(arg);
+			FiberScheduler::yield();
+			int v[2] = {1000, -1};
+			for (int i = 0; i < 2; ++i) {
+				s->in->getWriteDescriptor()->write(&v[i],
+				    sizeof(v[i]));
+				FiberScheduler::yield();
+			}
+		}
+	};
+	for (int i = 0; i < SESSIONS; ++i)
+		s.spawn(Feeder::run, &sessions[i]);
+	s.run();
+
+	ASSERT_EQ(s.getFibers(), 0U);
+	ASSERT_EQ(yields, 10);
+	for (int i = 0; i < SESSIONS; ++i) {
+		ASSERT_EQ(sessions[i].received, 3)
+		    << "ERROR: fiber not resumed on data";
+		int v[2];
+		ASSERT_EQ(sessions[i].out->getReadDescriptor()->read(v,
+		    sizeof(v)), (int) sizeof(v));
+		ASSERT_EQ(v[0], i + 1);
+		ASSERT_EQ(v[1], 1001);
+	}
+
+	// Stacks are reused by the next fibers
+	unsigned int stacks = s.getStacks();
+	ASSERT_EQ(stacks, 2U * SESSIONS + 1);
+	for (int i = 0; i < 50; ++i)
+		s.spawn(fiber_yield, &yields);
+	s.run();
+	ASSERT_EQ(s.getStacks(), stacks)
+	    << "ERROR: stacks not reused";
+	ASSERT_EQ(yields, 510);
+	ASSERT_FALSE(FiberScheduler::isFiber());
+}
+
+static const int FIBER_WRITE_SIZE = 256 * 1024;
+
+void fiber_write (void* arg)
+{
+	Pipe* p = reinterpret_cast<Pipe*>(arg);
+	std::vector<char> data (FIBER_WRITE_SIZE, 'w');
+	p->getWriteDescriptor()->write(&data[0], data.size());
+}
+
+class PipeDrainer: public AbstractThread {
+public:
+	Pipe* pipe_;
+	int read_;
+
+	void run() {
+		usleep(200000);
+		std::vector<char> data (FIBER_WRITE_SIZE);
+		read_ = pipe_->getReadDescriptor()->read(&data[0],
+		    data.size());
+	}
+};
+
+TEST (FiberTest, WriteParked)
+{
+	DescriptorsMonitor dm;
+	FiberScheduler s (dm, 16 * 1024);
+	Pipe p;
+	fcntl(p.getWriteDescriptor()->getDescriptorNumber(), F_SETFL,
+	    O_NONBLOCK);
+	PipeDrainer d;
+	d.pipe_ = &p;
+	d.read_ = 0;
+	s.spawn(fiber_write, &p);
+	ASSERT_TRUE(d.start());
+
+	// The writer fills the pipe, then waits for the drainer in select()
+	struct timespec start, end;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+	s.run();
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+	d.waitForTermination();
+	ASSERT_EQ(d.read_, FIBER_WRITE_SIZE);
+	ASSERT_LT((end.tv_sec - start.tv_sec) * 1000000000L +
+	    (end.tv_nsec - start.tv_nsec), 50000000L)
+	    << "ERROR: writer fiber busy-waiting on a full pipe";
+}
+
+// ======================================================================
+//   LOGGER
+// ======================================================================
+
+static int countLogLines(const std::string& marker)
+{
+	std::ifstream in (Logger::getInstance().getFileName().c_str());
+	std::string line;
+	int n = 0;
+	while (std::getline(in, line))
+		if (line.find(marker) != std::string::npos)
+			++n;
+	return n;
+}
+
+static const int LOG_THREAD_MESSAGES = 2000;
+
+void log_messages (void* arg)
+{
+	for (int i = 0; i < LOG_THREAD_MESSAGES; ++i)
+		DEBUG((const char*) arg << " message " << i);
+}
+
+TEST (LoggerTest, Async)
+{
+	LOG_FILE("/tmp/onposix-test-log");
+	Logger::getInstance().startAsync(Logger::BLOCK);
+	ASSERT_TRUE(Logger::getInstance().isAsync());
+	SimpleThread t1 (log_messages, (void*) "async-block");
+	SimpleThread t2 (log_messages, (void*) "async-block");
+	t1.start();
+	t2.start();
+	log_messages((void*) "async-block");
+	t1.waitForTermination();
+	t2.waitForTermination();
+	Logger::getInstance().flush();
+	ASSERT_EQ(countLogLines("async-block message"),
+	    3 * LOG_THREAD_MESSAGES);
+	Logger::getInstance().stopAsync();
+	ASSERT_FALSE(Logger::getInstance().isAsync());
+	DEBUG("async-block message after stop");
+	ASSERT_EQ(countLogLines("async-block message"),
+	    3 * LOG_THREAD_MESSAGES + 1);
+}
+
+TEST (LoggerTest, AsyncStop)
+{
+	LOG_FILE("/tmp/onposix-test-log");
+	Logger::getInstance().startAsync(Logger::BLOCK, 4096);
+	SimpleThread t1 (log_messages, (void*) "async-stop");
+	SimpleThread t2 (log_messages, (void*) "async-stop");
+	t1.start();
+	t2.start();
+	usleep(1000);
+	// Messages logged across the switch must not be lost
+	Logger::getInstance().stopAsync();
+	t1.waitForTermination();
+	t2.waitForTermination();
+	ASSERT_EQ(countLogLines("async-stop message"),
+	    2 * LOG_THREAD_MESSAGES);
+}
+
+TEST (LoggerTest, AsyncDrop)
+{
+	LOG_FILE("/tmp/onposix-test-log");
+	unsigned long int before = Logger::getInstance().getDroppedMessages();
+	Logger::getInstance().startAsync(Logger::DROP, 4096);
+	SimpleThread t (log_messages, (void*) "async-drop");
+	t.start();
+	t.waitForTermination();
+	Logger::getInstance().stopAsync();
+	unsigned long int dropped =
+	    Logger::getInstance().getDroppedMessages() - before;
+	ASSERT_EQ(countLogLines("async-drop message") + dropped,
+	    (unsigned long int) LOG_THREAD_MESSAGES);
+}
+
+template <typename... Args>
+static std::string formatArgs(const char* format, const Args&... args)
+{
+	std::vector<char> data (logArgsSize(args...) + 1);
+	logArgsEncode(&data[0], args...);
+	std::string out;
+	formatLogMessage(&out, format, &data[0], data.size() - 1);
+	return out;
+}
+
+TEST (LoggerTest, Format)
+{
+	ASSERT_EQ(formatArgs("no args, 100%%"), "no args, 100%");
+	ASSERT_EQ(formatArgs("%d %ld %u %zu", -1, -2L, 3U, (size_t) 4),
+	    "-1 -2 3 4");
+	ASSERT_EQ(formatArgs("[%5d|%-3x|%05.1f]", 42, 255U, 3.14159),
+	    "[   42|ff |003.1]");
+	ASSERT_EQ(formatArgs("%s=%c %.2s", "name", 'x', "abcdef"),
+	    "name=x ab");
+	ASSERT_EQ(formatArgs("%s and %s", "one"), "one and %s");
+	const char* null = 0;
+	ASSERT_EQ(formatArgs("[%s]", null), "[]");
+	char buf[] = "mutable";
+	ASSERT_EQ(formatArgs("%s %g", buf, 1e10), "mutable 1e+10");
+	// Integers are converted to the size of the length modifier
+	ASSERT_EQ(formatArgs("%x %lx %hhx %hx", -1, -1L, 0x1ff, 0x12345),
+	    "ffffffff ffffffffffffffff ff 2345");
+	ASSERT_EQ(formatArgs("%u %hhd %lld", -1, 200, -3LL),
+	    "4294967295 -56 -3");
+	// Width and precision given as arguments
+	ASSERT_EQ(formatArgs("[%*d|%-*d|%.*f|%.*s]", 4, 7, 3, 8, 2, 3.14159,
+	    3, "abcdef"), "[   7|8  |3.14|abc]");
+	ASSERT_EQ(formatArgs("[%.*f]", -1, 0.5), "[0.500000]");
+	ASSERT_EQ(formatArgs("[%*d]", 4), "[%*d]");
+}
+
+void log_formatted (void* arg)
+{
+	for (int i = 0; i < LOG_THREAD_MESSAGES; ++i)
+		DEBUGF("%s formatted %d of %u (%.1f%%)", (const char*) arg, i,
+		    (unsigned int) LOG_THREAD_MESSAGES,
+		    100.0 * i / LOG_THREAD_MESSAGES);
+}
+
+TEST (LoggerTest, Deferred)
+{
+	LOG_FILE("/tmp/onposix-test-log");
+	log_formatted((void*) "sync");
+	ASSERT_EQ(countLogLines("sync formatted"), LOG_THREAD_MESSAGES);
+	// Arguments larger than the stack buffer
+	std::string large (400, 'x');
+	DEBUGF("sync large %s", large.c_str());
+	ASSERT_EQ(countLogLines("sync large " + large), 1);
+	// Formatted at the call site, as without variadic templates
+	static const LogSite site = {__FILE__, __LINE__, LOG_ALL,
+	    Logger::SINK_FILE, "[DEBUG]\tsync now %d %s"};
+	Logger::getInstance().logNow(&site, 7, "small");
+	Logger::getInstance().logNow(&site, 8, large.c_str());
+	ASSERT_EQ(countLogLines("sync now 7 small"), 1);
+	ASSERT_EQ(countLogLines("sync now 8 " + large), 1);
+
+	Logger::getInstance().startAsync(Logger::BLOCK);
+	SimpleThread t (log_formatted, (void*) "deferred");
+	t.start();
+	t.waitForTermination();
+	Logger::getInstance().flush();
+	ASSERT_EQ(countLogLines("deferred formatted"), LOG_THREAD_MESSAGES);
+	ASSERT_EQ(countLogLines("[DEBUG]\tdeferred formatted 1000 of 2000 "
+	    "(50.0%)"), 1);
+	Logger::getInstance().stopAsync();
+}
+
+TEST (LoggerTest, Binary)
+{
+	Logger::getInstance().setFile("/tmp/onposix-test-log",
+	    Logger::BINARY);
+	std::string name = Logger::getInstance().getFileName();
+	DEBUG("binary text " << 1);
+	DEBUGF("binary value %d %s %.2f", 42, "x", 0.5);
+	Logger::getInstance().startAsync(Logger::BLOCK);
+	log_formatted((void*) "binary");
+	DEBUG("binary async text " << 2);
+	Logger::getInstance().stopAsync();
+
+	std::ostringstream out;
+	ASSERT_TRUE(decodeLogFile(name, out));
+	std::istringstream in (out.str());
+	std::string line;
+	int formatted = 0, found = 0, clock = 0;
+	while (std::getline(in, line)) {
+		if (line.find(":[CLOCK]\t") != std::string::npos)
+			++clock;
+		if (line.find(":[DEBUG]\tbinary formatted ") !=
+		    std::string::npos)
+			++formatted;
+		if (line.find(":[DEBUG]\tbinary text 1\t\t[") !=
+		    std::string::npos ||
+		    line.find(":[DEBUG]\tbinary value 42 x 0.50\t\t[") !=
+		    std::string::npos ||
+		    line.find(":[DEBUG]\tbinary async text 2\t\t[") !=
+		    std::string::npos)
+			++found;
+	}
+	ASSERT_EQ(formatted, LOG_THREAD_MESSAGES);
+	ASSERT_EQ(found, 3);
+	ASSERT_EQ(clock, 1);
+	ASSERT_FALSE(decodeLogFile("/tmp/onposix-test-missing.bin", out));
+
+	LOG_FILE("/tmp/onposix-test-log");
+	unlink(name.c_str());
+}
+
+TEST (LoggerTest, WindowAhead)
+{
+	const char* name = "/tmp/onposix-test-logfile";
+	unsigned long int window = 2 * sysconf(_SC_PAGESIZE);
+	std::string expected;
+	{
+		LogFile f (name, false, 0, window);
+		// Records cross the windows; some are larger than a window
+		for (int i = 0; i < 200; ++i) {
+			std::string record (((i % 50) == 49) ? window + 100 :
+			    100 + i, 'a' + (i % 26));
+			f.write(record.data(), record.size());
+			expected += record;
+			if (i % 3 != 0)
+				f.prepare();
+		}
+		ASSERT_EQ(f.getLength(), expected.size());
+	}
+	FileDescriptor fd (name, O_RDONLY);
+	ASSERT_EQ((unsigned long int) fd.getLength(), expected.size())
+		<< "ERROR: log file not truncated to the written length";
+	MappedRegion m (fd);
+	ASSERT_TRUE(m.compare(expected.data(), expected.size()))
+		<< "ERROR: wrong content written through the windows";
+	unlink(name);
+}
+
+TEST (LoggerTest, Clock)
+{
+	LogClock::Source sources[] = {LogClock::MONOTONIC,
+	    LogClock::MONOTONIC_COARSE, LogClock::TSC};
+	for (unsigned int i = 0; i < 3; ++i) {
+		if (!LogClock::setSource(sources[i])) {
+			ASSERT_EQ(sources[i], LogClock::TSC);
+			continue;
+		}
+		ASSERT_EQ(LogClock::getSource(), sources[i]);
+		uint64_t previous = LogClock::now();
+		for (int j = 0; j < 1000; ++j) {
+			uint64_t t = LogClock::now();
+			ASSERT_GE(t, previous);
+			previous = t;
+		}
+		struct timespec m;
+		clock_gettime(CLOCK_MONOTONIC, &m);
+		int64_t diff = (m.tv_sec * 1000000000LL + m.tv_nsec) -
+		    (int64_t) LogClock::now();
+		ASSERT_LT(diff < 0 ? -diff : diff, 10000000LL);
+	}
+	ASSERT_TRUE(LogClock::setSource(LogClock::MONOTONIC));
+
+	std::string text;
+	formatLogTime(&text, 12000345678ULL, 0);
+	formatLogTime(&text, 1, 2);
+	ASSERT_EQ(text, "12.0003456780.000000000");
+
+	// One correlation with the wall clock per file
+	LOG_FILE("/tmp/onposix-test-clock");
+	DEBUG("clock message");
+	ASSERT_EQ(countLogLines(":[CLOCK]\t"), 1);
+	ASSERT_EQ(countLogLines(":[DEBUG]\tclock message"), 1);
+	unlink(Logger::getInstance().getFileName().c_str());
+	LOG_FILE("/tmp/onposix-test-log");
+}
+
+TEST (LoggerTest, Rotation)
+{
+	Logger::FileFormat formats[] = {Logger::TEXT, Logger::BINARY};
+	for (unsigned int f = 0; f < 2; ++f) {
+		Logger::getInstance().setRotation(64*1024, 0, 3);
+		Logger::getInstance().setFile("/tmp/onposix-test-rotate",
+		    formats[f]);
+		std::vector<std::string> names;
+		names.push_back(Logger::getInstance().getFileName());
+		for (int i = 0; i < 5000; ++i) {
+			DEBUGF("rotation message %d", i);
+			if (Logger::getInstance().getFileName() != names.back())
+				names.push_back(
+				    Logger::getInstance().getFileName());
+		}
+		Logger::getInstance().closeFile();
+		ASSERT_GE(names.size(), 4U);
+		for (unsigned int i = 0; i < names.size(); ++i) {
+			struct stat st;
+			if (i < names.size() - 3) {
+				ASSERT_NE(stat(names[i].c_str(), &st), 0);
+				continue;
+			}
+			ASSERT_EQ(stat(names[i].c_str(), &st), 0);
+			ASSERT_LE(st.st_size, 64*1024);
+			if (formats[f] == Logger::BINARY) {
+				std::ostringstream out;
+				ASSERT_TRUE(decodeLogFile(names[i], out));
+			}
+			unlink(names[i].c_str());
+		}
+	}
+
+	// Rotation by age
+	Logger::getInstance().setRotation(0, 1, 0);
+	LOG_FILE("/tmp/onposix-test-rotate");
+	std::string first = Logger::getInstance().getFileName();
+	DEBUG("rotation by age");
+	sleep(1);
+	DEBUG("rotation by age");
+	ASSERT_NE(Logger::getInstance().getFileName(), first);
+	ASSERT_EQ(countLogLines("rotation by age"), 1);
+	unlink(first.c_str());
+	unlink(Logger::getInstance().getFileName().c_str());
+
+	Logger::getInstance().setRotation(0);
+	LOG_FILE("/tmp/onposix-test-log");
+}
+
+TEST (LoggerTest, Limit)
+{
+	LOG_FILE("/tmp/onposix-test-limit");
+	for (int i = 0; i < 1000; ++i)
+		DEBUGF_SAMPLE(10, "sampled message %d", i);
+	ASSERT_EQ(countLogLines("sampled message"), 100);
+	ASSERT_EQ(countLogLines("sampled message 990"), 1);
+	ASSERT_EQ(countLogLines("[DEBUG]\t9 messages suppressed"), 1);
+
+	// 100 messages per second, bursts of 10, for 50 ms
+	int calls = 0;
+	uint64_t start = LogClock::now();
+	uint64_t elapsed;
+	do {
+		DEBUG_RATE(100, 10, "rated message " << calls);
+		++calls;
+		elapsed = LogClock::now() - start;
+	} while (elapsed < 50000000ULL);
+	int printed = countLogLines("rated message");
+	ASSERT_GE(printed, 10);
+	ASSERT_LE(printed, 11 + (int) (elapsed / 10000000ULL));
+	ASSERT_LT(printed, calls);
+	ASSERT_EQ(countLogLines("messages suppressed"), 2);
+
+	unlink(Logger::getInstance().getFileName().c_str());
+	LOG_FILE("/tmp/onposix-test-log");
+}
+
+TEST (LoggerTest, Modules)
+{
+	LOG_FILE("/tmp/onposix-test-modules");
+	ASSERT_EQ(LogModule::getLevel("test.cpp"), LOG_ALL);
+	ASSERT_EQ(LogModule::getLevel("PosixDescriptor.cpp"), LOG_ALL);
+	ASSERT_EQ(LogModule::getLevel("missing.cpp"), -1);
+
+	LogModule::setLevel("test.cpp", LOG_WARNINGS);
+	LogModule::setLevel("*", LOG_NOLOG);
+	ASSERT_EQ(LogModule::getLevel("test.cpp"), LOG_WARNINGS);
+	ASSERT_EQ(LogModule::getLevel("PosixDescriptor.cpp"), LOG_NOLOG);
+	DEBUG("module message");
+	DEBUGF("module message %d", 1);
+	DEBUGF_SAMPLE(1, "module message %d", 2);
+	WARNING("module message");
+	ASSERT_EQ(countLogLines("module message"), 1);
+	LogModule::resetLevels();
+	ASSERT_EQ(LogModule::getLevel("test.cpp"), LOG_ALL);
+	DEBUG("module message");
+	ASSERT_EQ(countLogLines("module message"), 2);
+	unlink(Logger::getInstance().getFileName().c_str());
+	LOG_FILE("/tmp/onposix-test-log");
+
+	// Configuration file, reloaded on signal
+	const char* config = "/tmp/onposix-test-log.conf";
+	{
+		std::ofstream f (config);
+		f << "# module level\n*\terrors\ntest.cpp DEBUG\nbad x\n";
+	}
+	ASSERT_TRUE(LogModule::reloadOnSignal(config, SIGUSR1));
+	ASSERT_EQ(LogModule::getLevel("test.cpp"), LOG_ALL);
+	ASSERT_EQ(LogModule::getLevel("DescriptorsMonitor.cpp"), LOG_ERRORS);
+	{
+		std::ofstream f (config);
+		f << "test.cpp 0\n";
+	}
+	raise(SIGUSR1);
+	for (int i = 0; i < 100 && LogModule::getLevel("test.cpp") != 0; ++i)
+		usleep(10000);
+	ASSERT_EQ(LogModule::getLevel("test.cpp"), LOG_NOLOG);
+	ASSERT_EQ(LogModule::getLevel("DescriptorsMonitor.cpp"), LOG_ALL);
+	LogModule::resetLevels();
+	unlink(config);
+}
+
+
 // ======================================================================
 //   TIME 
 // ======================================================================
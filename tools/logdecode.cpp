@@ -0,0 +1,47 @@
+/*
+ * logdecode.cpp
+ *
+ * Copyright (C) 2012 Evidence Srl - www.evidence.eu.com
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ */
+
+/*
+ * Tool to convert binary log files (see Logger::setFile()) to text.
+ *
+ * Usage: logdecode file.bin [file.bin ...]
+ */
+
+#include <iostream>
+
+#include "LogBinary.hpp"
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " file.bin [file.bin ...]"
+		    << std::endl;
+		return 1;
+	}
+	int ret = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (!onposix::decodeLogFile(argv[i], std::cout)) {
+			std::cerr << argv[i] << ": not a binary log file" <<
+			    std::endl;
+			ret = 1;
+		}
+	}
+	return ret;
+}